@@ -0,0 +1,139 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "dwarfs/block_range.h"
+#include "dwarfs/types.h"
+
+namespace dwarfs {
+
+class filesystem_v2;
+class logger;
+class os_access;
+
+struct async_read_request {
+  uint32_t inode{0}; // as returned by filesystem_v2::open()
+  file_off_t offset{0};
+  size_t size{0};
+  // Destination for the data; if null, the completion holds references
+  // to the cached blocks instead (zero-copy).
+  void* buffer{nullptr};
+  uint64_t user_data{0};
+};
+
+struct async_read_completion {
+  uint64_t user_data{0};
+  // Number of bytes read or negative error code, like filesystem_v2::read()
+  int64_t result{0};
+  // Only for zero-copy requests; keeps the underlying blocks alive for as
+  // long as the completion (or a copy of the ranges) exists.
+  std::vector<block_range> ranges;
+};
+
+struct async_reader_options {
+  // Number of threads assembling the results of completed requests and
+  // running callbacks; they never wait for blocks to be decompressed
+  size_t num_threads{2};
+  // Called whenever the completion queue goes from empty to non-empty;
+  // may be called from any thread, so it should do little more than wake
+  // up the thread that harvests completions
+  std::function<void()> notify{};
+};
+
+/**
+ * Asynchronous reads from a filesystem image
+ *
+ * Requests are handed to the block cache as soon as they are submitted,
+ * so any number of reads can be in flight, and each request completes as
+ * soon as its last block is available, regardless of the order in which
+ * requests were submitted. Completions are either pushed to a queue that
+ * can be harvested using `poll()` or `wait()`, or passed to a per-request
+ * callback. Callbacks are run on one of the reader's threads and must not
+ * block.
+ *
+ * The filesystem must outlive the reader. Destroying the reader waits for
+ * all outstanding requests to complete.
+ */
+class async_reader {
+ public:
+  using callback_type = std::function<void(async_read_completion&&)>;
+
+  async_reader(logger& lgr, os_access const& os, filesystem_v2 const& fs,
+               async_reader_options const& opts = {});
+
+  void submit(async_read_request const& req) { impl_->submit(req, nullptr); }
+
+  void submit(async_read_request const& req, callback_type cb) {
+    impl_->submit(req, std::move(cb));
+  }
+
+  /**
+   * Move up to `max` queued completions to `out` without blocking
+   *
+   * \returns the number of completions moved
+   */
+  size_t poll(std::vector<async_read_completion>& out,
+              size_t max = std::numeric_limits<size_t>::max()) {
+    return impl_->wait(out, 0, max, std::chrono::milliseconds::zero());
+  }
+
+  /**
+   * Like `poll()`, but block until at least `min` completions are queued
+   * or until the timeout expires
+   */
+  size_t
+  wait(std::vector<async_read_completion>& out, size_t min = 1,
+       size_t max = std::numeric_limits<size_t>::max(),
+       std::optional<std::chrono::milliseconds> timeout = std::nullopt) {
+    return impl_->wait(out, min, max, timeout);
+  }
+
+  /**
+   * Number of submitted requests whose completion hasn't been harvested
+   */
+  size_t in_flight() const { return impl_->in_flight(); }
+
+  class impl {
+   public:
+    virtual ~impl() = default;
+
+    virtual void submit(async_read_request const& req, callback_type cb) = 0;
+    virtual size_t wait(std::vector<async_read_completion>& out, size_t min,
+                        size_t max,
+                        std::optional<std::chrono::milliseconds> timeout) = 0;
+    virtual size_t in_flight() const = 0;
+  };
+
+ private:
+  std::unique_ptr<impl> impl_;
+};
+
+} // namespace dwarfs
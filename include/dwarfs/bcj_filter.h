@@ -0,0 +1,65 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <optional>
+#include <span>
+#include <string_view>
+
+namespace dwarfs {
+
+/**
+ * Architectures supported by the branch/call/jump (BCJ) filters
+ *
+ * The values are stored in the image and must never change.
+ */
+enum class bcj_architecture : uint8_t {
+  X86 = 1,
+  ARM = 2,
+  ARMTHUMB = 3,
+  ARM64 = 4,
+  POWERPC = 5,
+  SPARC = 6,
+};
+
+std::span<bcj_architecture const> bcj_architectures();
+
+std::string_view bcj_architecture_name(bcj_architecture arch);
+std::optional<bcj_architecture> parse_bcj_architecture(std::string_view name);
+
+std::ostream& operator<<(std::ostream& os, bcj_architecture arch);
+
+/**
+ * Reversible in-place branch conversion for machine code
+ *
+ * `bcj_encode` converts relative branch/call targets to absolute
+ * addresses (relative to the start of `data`), which makes repeated
+ * calls to the same function look identical and thus much easier to
+ * compress. `bcj_decode` reverts the conversion. The transformations
+ * are compatible with the corresponding simple filters in liblzma.
+ */
+void bcj_encode(bcj_architecture arch, std::span<uint8_t> data);
+void bcj_decode(bcj_architecture arch, std::span<uint8_t> data);
+
+} // namespace dwarfs
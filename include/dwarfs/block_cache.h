@@ -26,6 +26,11 @@
 
 #include <future>
 #include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <folly/CancellationToken.h>
 
 #include "dwarfs/block_compressor.h"
 #include "dwarfs/block_range.h"
@@ -42,6 +47,15 @@ class mmif;
 class os_access;
 class performance_monitor;
 
+/**
+ * Scheduling priority of a block request
+ *
+ * Queued decompression jobs are always dispatched in priority order.
+ * Speculative requests (everything except `DEMAND`) may be canceled
+ * while queued, in which case their futures will hold an exception.
+ */
+enum class block_request_priority { DEMAND, READAHEAD, PREFETCH };
+
 class block_cache {
  public:
   block_cache(logger& lgr, os_access const& os, std::shared_ptr<mmif> mm,
@@ -60,9 +74,56 @@ class block_cache {
     impl_->set_tidy_config(cfg);
   }
 
+  /**
+   * Request a range of a block
+   *
+   * If cancellation is requested through `cancel` before the range has
+   * been decompressed, the request is dropped and the future will hold
+   * an exception. Once no request for a block is left, the block is not
+   * decompressed any further.
+   */
   std::future<block_range>
-  get(size_t block_no, size_t offset, size_t size) const {
-    return impl_->get(block_no, offset, size);
+  get(size_t block_no, size_t offset, size_t size,
+      block_request_priority prio = block_request_priority::DEMAND,
+      folly::CancellationToken cancel = {}) const {
+    return impl_->get(block_no, offset, size, prio, std::move(cancel));
+  }
+
+  /**
+   * Like `get()`, but pass the result to a continuation instead of
+   * returning a future
+   */
+  void get(size_t block_no, size_t offset, size_t size,
+           block_range_continuation cont,
+           block_request_priority prio = block_request_priority::DEMAND) const {
+    impl_->get(block_no, offset, size, std::move(cont), prio);
+  }
+
+  /**
+   * Keep blocks resident in the cache
+   *
+   * The blocks are fully decompressed in the background by the cache
+   * workers. Once decompressed, they are never evicted or tidied, and
+   * they don't count towards the configured cache size.
+   */
+  void pin(std::vector<size_t> const& blocks) { impl_->pin(blocks); }
+
+  /**
+   * Temporarily keep blocks in memory once they have been decompressed
+   *
+   * Holds are counted per block. A held block is kept outside of the
+   * regular cache until the last hold is released, at which point it
+   * goes back into the cache and is subject to eviction again.
+   */
+  void hold(std::span<size_t const> blocks) const { impl_->hold(blocks); }
+
+  void unhold(std::span<size_t const> blocks) const { impl_->unhold(blocks); }
+
+  /**
+   * Start decompressing blocks that are not yet in memory
+   */
+  void prefetch(std::span<size_t const> blocks) const {
+    impl_->prefetch(blocks);
   }
 
   class impl {
@@ -75,7 +136,15 @@ class block_cache {
     virtual void set_num_workers(size_t num) = 0;
     virtual void set_tidy_config(cache_tidy_config const& cfg) = 0;
     virtual std::future<block_range>
-    get(size_t block_no, size_t offset, size_t length) const = 0;
+    get(size_t block_no, size_t offset, size_t length,
+        block_request_priority prio, folly::CancellationToken cancel) const = 0;
+    virtual void get(size_t block_no, size_t offset, size_t length,
+                     block_range_continuation cont,
+                     block_request_priority prio) const = 0;
+    virtual void pin(std::vector<size_t> const& blocks) = 0;
+    virtual void hold(std::span<size_t const> blocks) const = 0;
+    virtual void unhold(std::span<size_t const> blocks) const = 0;
+    virtual void prefetch(std::span<size_t const> blocks) const = 0;
   };
 
  private:
@@ -60,22 +60,61 @@ class block_compressor {
   block_compressor(block_compressor&& bc) = default;
   block_compressor& operator=(block_compressor&& rhs) = default;
 
-  std::vector<uint8_t> compress(std::vector<uint8_t> const& data) const {
-    return impl_->compress(data, nullptr);
+  std::vector<uint8_t> compress(std::span<uint8_t const> data) const {
+    std::vector<uint8_t> target;
+    impl_->compress(data, nullptr, target);
+    return target;
+  }
+
+  std::vector<uint8_t> compress(std::span<uint8_t const> data,
+                                std::string const& metadata) const {
+    std::vector<uint8_t> target;
+    impl_->compress(data, &metadata, target);
+    return target;
   }
 
-  std::vector<uint8_t> compress(std::vector<uint8_t>&& data) const {
-    return impl_->compress(std::move(data), nullptr);
+  /**
+   * Compress into a caller-provided buffer
+   *
+   * The previous contents of `target` are discarded, but its capacity
+   * is reused. This allows callers to recycle output buffers between
+   * blocks instead of allocating a fresh one for each block.
+   */
+  void compress(std::span<uint8_t const> data, std::vector<uint8_t>& target,
+                std::string const* metadata = nullptr) const {
+    target.clear();
+    impl_->compress(data, metadata, target);
   }
 
-  std::vector<uint8_t> compress(std::vector<uint8_t> const& data,
-                                std::string const& metadata) const {
-    return impl_->compress(data, &metadata);
+  /**
+   * Compress using up to `num_threads` threads for this single block
+   *
+   * Compressors without support for intra-block parallelism ignore
+   * `num_threads` and behave exactly like `compress()`. The output is
+   * always decodable by the regular decompressor, but may differ from
+   * (and be slightly larger than) the single-threaded output.
+   */
+  void compress(std::span<uint8_t const> data, std::vector<uint8_t>& target,
+                std::string const* metadata, size_t num_threads) const {
+    target.clear();
+    compress_append(data, target, metadata, num_threads);
   }
 
-  std::vector<uint8_t>
-  compress(std::vector<uint8_t>&& data, std::string const& metadata) const {
-    return impl_->compress(std::move(data), &metadata);
+  /**
+   * Same as compress(), but keeps the current contents of `target`
+   *
+   * The compressed data is appended to `target`. This allows wrapping
+   * compressors to put a header in front of the compressed data without
+   * having to move the data around afterwards.
+   */
+  void compress_append(std::span<uint8_t const> data,
+                       std::vector<uint8_t>& target,
+                       std::string const* metadata, size_t num_threads) const {
+    if (num_threads > 1) {
+      impl_->compress_parallel(data, metadata, target, num_threads);
+    } else {
+      impl_->compress(data, metadata, target);
+    }
   }
 
   compression_type type() const { return impl_->type(); }
@@ -97,12 +136,21 @@ class block_compressor {
 
     virtual std::unique_ptr<impl> clone() const = 0;
 
-    virtual std::vector<uint8_t>
-    compress(const std::vector<uint8_t>& data,
-             std::string const* metadata) const = 0;
-    virtual std::vector<uint8_t>
-    compress(std::vector<uint8_t>&& data,
-             std::string const* metadata) const = 0;
+    // Implementations must append the compressed data to `target`,
+    // keeping its current contents, and must never shrink its capacity.
+    // The check for a bad compression ratio only takes the appended data
+    // into account.
+    virtual void compress(std::span<uint8_t const> data,
+                          std::string const* metadata,
+                          std::vector<uint8_t>& target) const = 0;
+
+    // Same as compress(), but may use up to `num_threads` threads.
+    virtual void compress_parallel(std::span<uint8_t const> data,
+                                   std::string const* metadata,
+                                   std::vector<uint8_t>& target,
+                                   size_t /*num_threads*/) const {
+      compress(data, metadata, target);
+    }
 
     virtual compression_type type() const = 0;
     virtual std::string describe() const = 0;
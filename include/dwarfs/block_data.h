@@ -22,19 +22,42 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 namespace dwarfs {
 
 class block_data {
  public:
+  using recycler_type = std::function<void(std::vector<uint8_t>&&)>;
+
   block_data() = default;
   explicit block_data(std::vector<uint8_t>&& vec)
       : vec_{std::move(vec)} {}
   explicit block_data(std::string_view str)
       : vec_{str.begin(), str.end()} {}
 
+  /**
+   * Adopt a (pooled) buffer
+   *
+   * The buffer is handed back to `recycler` when the block data is
+   * destroyed, so its memory can be reused for another block.
+   */
+  block_data(std::vector<uint8_t>&& vec, recycler_type recycler)
+      : vec_{std::move(vec)}
+      , recycler_{std::move(recycler)} {}
+
+  ~block_data() {
+    if (recycler_) {
+      recycler_(std::move(vec_));
+    }
+  }
+
+  block_data(block_data const&) = delete;
+  block_data& operator=(block_data const&) = delete;
+
   std::vector<uint8_t> const& vec() const { return vec_; }
   std::vector<uint8_t>& vec() { return vec_; }
 
@@ -49,6 +72,7 @@ class block_data {
 
  private:
   std::vector<uint8_t> vec_;
+  recycler_type recycler_;
 };
 
 } // namespace dwarfs
@@ -0,0 +1,89 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "dwarfs/compression.h"
+#include "dwarfs/types.h"
+
+namespace dwarfs {
+
+/**
+ * Maps a contiguous range of a file onto a range of an uncompressed block
+ */
+struct block_map_extent {
+  file_off_t offset{0};
+  uint64_t size{0};
+  uint32_t block{0};
+  uint32_t block_offset{0};
+
+  bool operator==(block_map_extent const&) const = default;
+};
+
+struct block_map_block {
+  uint32_t block{0};
+  compression_type compression{compression_type::NONE};
+  uint64_t compressed_size{0};
+  uint64_t uncompressed_size{0};
+
+  bool operator==(block_map_block const&) const = default;
+};
+
+/**
+ * How a regular file maps onto the blocks of the image
+ *
+ * Extents are ordered by file offset and adjacent chunks that are also
+ * adjacent within the same block are merged. `blocks` contains every
+ * block referenced by any extent exactly once, ordered by block number.
+ */
+struct file_block_map {
+  std::vector<block_map_extent> extents;
+  std::vector<block_map_block> blocks;
+
+  /**
+   * Compact binary representation, as exposed by the FUSE driver
+   *
+   * All integers are little endian:
+   *
+   *   char[4]   magic ("DWBM")
+   *   uint16    version (1)
+   *   uint16    reserved
+   *   uint32    number of blocks
+   *   uint32    number of extents
+   *   blocks:   uint32 block, uint16 compression, uint16 reserved,
+   *             uint64 compressed size, uint64 uncompressed size
+   *   extents:  uint64 file offset, uint64 size, uint32 block,
+   *             uint32 offset within block
+   */
+  std::string serialize() const;
+
+  static file_block_map deserialize(std::span<uint8_t const> data);
+
+  bool operator==(file_block_map const&) const = default;
+};
+
+} // namespace dwarfs
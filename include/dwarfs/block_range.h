@@ -22,8 +22,12 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <span>
+#include <vector>
+
+#include <folly/Try.h>
 
 namespace dwarfs {
 
@@ -34,6 +38,8 @@ class block_range {
   block_range(uint8_t const* data, size_t offset, size_t size);
   block_range(std::shared_ptr<cached_block const> block, size_t offset,
               size_t size);
+  block_range(std::shared_ptr<std::vector<uint8_t> const> data, size_t offset,
+              size_t size);
 
   auto data() const { return span_.data(); }
   auto begin() const { return span_.begin(); }
@@ -43,6 +49,24 @@ class block_range {
  private:
   std::span<uint8_t const> span_;
   std::shared_ptr<cached_block const> block_;
+  std::shared_ptr<std::vector<uint8_t> const> data_;
 };
 
+/**
+ * Receives an asynchronously requested block range, or the error that
+ * prevented it from being read
+ *
+ * Continuations run on whichever thread completes the request, possibly
+ * before the request function returns and possibly while internal locks
+ * are held. They must not block or call back into the file system.
+ */
+using block_range_continuation = std::function<void(folly::Try<block_range>&&)>;
+
+/**
+ * Like `block_range_continuation`, but also receives the index of the
+ * range within a read that was split into multiple block ranges
+ */
+using indexed_block_range_continuation =
+    std::function<void(size_t, folly::Try<block_range>&&)>;
+
 } // namespace dwarfs
@@ -0,0 +1,81 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace dwarfs {
+
+class fs_section;
+class logger;
+class mmif;
+
+/**
+ * Reads compressed block data from the image using explicit I/O
+ *
+ * As an alternative to accessing blocks through the memory mapping, which
+ * faults in the data in small synchronous pieces, this reads each block
+ * into memory using large read requests. Sections announced before they
+ * are read are hinted to the OS so it can start fetching them, and runs
+ * of announced sections that are adjacent in the image are fetched using
+ * a single request of at most `max_request_size` bytes.
+ */
+class block_reader {
+ public:
+  block_reader(logger& lgr, std::shared_ptr<mmif> mm, size_t max_request_size);
+
+  /**
+   * Announce that the section data will be read soon
+   */
+  void announce(fs_section const& section) { impl_->announce(section); }
+
+  /**
+   * Drop an announced section that will no longer be read
+   */
+  void cancel(fs_section const& section) { impl_->cancel(section); }
+
+  /**
+   * Read the section data, blocking until it is available
+   *
+   * The returned data only keeps the section itself alive, even if it
+   * was read along with other sections using a single request.
+   */
+  std::shared_ptr<uint8_t const> read(fs_section const& section) {
+    return impl_->read(section);
+  }
+
+  class impl {
+   public:
+    virtual ~impl() = default;
+
+    virtual void announce(fs_section const& section) = 0;
+    virtual void cancel(fs_section const& section) = 0;
+    virtual std::shared_ptr<uint8_t const> read(fs_section const& section) = 0;
+  };
+
+ private:
+  std::unique_ptr<impl> impl_;
+};
+
+} // namespace dwarfs
@@ -0,0 +1,179 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/*
+ * C interface for reading DwarFS images from within other programs
+ *
+ * All functions that can fail return zero on success or a negative errno
+ * value on failure. A description of the most recent failure on the
+ * calling thread can be retrieved with dwarfs_last_error(). The structs
+ * declared here are part of the ABI and will not be changed; new fields
+ * will only ever be added through new functions.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#if defined(DWARFS_C_API_BUILD)
+#define DWARFS_C_API __declspec(dllexport)
+#elif defined(DWARFS_C_API_SHARED)
+#define DWARFS_C_API __declspec(dllimport)
+#else
+#define DWARFS_C_API
+#endif
+#else
+#define DWARFS_C_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct dwarfs_fs dwarfs_fs;
+typedef struct dwarfs_reader dwarfs_reader;
+typedef struct dwarfs_buffer dwarfs_buffer;
+
+typedef struct dwarfs_fs_options {
+  size_t cache_size;   /* block cache size in bytes, 0 for default */
+  size_t num_workers;  /* decompression threads, 0 for default */
+  int64_t image_offset; /* offset of the image within the file */
+} dwarfs_fs_options;
+
+typedef struct dwarfs_read_request {
+  uint32_t inode;   /* from dwarfs_fs_open_file() */
+  int64_t offset;
+  size_t size;
+  void* buffer;     /* destination, or NULL for a zero-copy read */
+  uint64_t user_data;
+} dwarfs_read_request;
+
+typedef struct dwarfs_range {
+  void const* data;
+  size_t size;
+} dwarfs_range;
+
+typedef struct dwarfs_read_completion {
+  uint64_t user_data;
+  int64_t result;   /* number of bytes read or negative errno value */
+  /*
+   * Zero-copy reads only: the data is returned as a list of ranges that
+   * remain valid until the buffer is released with dwarfs_buffer_release().
+   * For all other reads, ranges is NULL and buffer must not be released.
+   */
+  dwarfs_range const* ranges;
+  size_t num_ranges;
+  dwarfs_buffer* buffer;
+} dwarfs_read_completion;
+
+typedef enum dwarfs_log_level {
+  DWARFS_LOG_FATAL,
+  DWARFS_LOG_ERROR,
+  DWARFS_LOG_WARN,
+  DWARFS_LOG_INFO,
+  DWARFS_LOG_VERBOSE,
+  DWARFS_LOG_DEBUG,
+  DWARFS_LOG_TRACE,
+} dwarfs_log_level;
+
+/*
+ * Called for each log message; may be called from any thread, and
+ * concurrently from several threads
+ */
+typedef void (*dwarfs_log_fn)(dwarfs_log_level level, char const* message,
+                              void* arg);
+
+/* Called whenever the completion queue of a reader becomes non-empty */
+typedef void (*dwarfs_notify_fn)(void* arg);
+
+/* Called for each completion of a request submitted with a callback */
+typedef void (*dwarfs_completion_fn)(dwarfs_read_completion const* comp,
+                                     void* arg);
+
+DWARFS_C_API char const* dwarfs_last_error(void);
+
+DWARFS_C_API int dwarfs_fs_open(char const* image,
+                                dwarfs_fs_options const* opts, dwarfs_fs** fs);
+
+/*
+ * Like dwarfs_fs_open(), but pass all log messages up to log_level to
+ * the log function instead of writing them to stderr; if log is NULL,
+ * all messages are discarded
+ */
+DWARFS_C_API int
+dwarfs_fs_open_with_log(char const* image, dwarfs_fs_options const* opts,
+                        dwarfs_log_level log_level, dwarfs_log_fn log,
+                        void* log_arg, dwarfs_fs** fs);
+
+DWARFS_C_API void dwarfs_fs_close(dwarfs_fs* fs);
+
+/* Look up a regular file by path and prepare it for reading */
+DWARFS_C_API int dwarfs_fs_open_file(dwarfs_fs* fs, char const* path,
+                                     uint32_t* inode, uint64_t* size);
+
+DWARFS_C_API int64_t dwarfs_fs_read(dwarfs_fs* fs, uint32_t inode, void* buf,
+                                    size_t size, int64_t offset);
+
+/*
+ * Create an asynchronous reader; num_threads is the number of threads
+ * harvesting results (0 for default), notify may be NULL
+ */
+DWARFS_C_API int
+dwarfs_reader_create(dwarfs_fs* fs, size_t num_threads, dwarfs_notify_fn notify,
+                     void* notify_arg, dwarfs_reader** reader);
+
+/* Waits for all outstanding requests before destroying the reader */
+DWARFS_C_API void dwarfs_reader_destroy(dwarfs_reader* reader);
+
+DWARFS_C_API int
+dwarfs_reader_submit(dwarfs_reader* reader, dwarfs_read_request const* reqs,
+                     size_t count);
+
+/*
+ * The callback is run on one of the reader's threads and must not block;
+ * the completion (except for the buffer) is only valid during the call
+ */
+DWARFS_C_API int
+dwarfs_reader_submit_cb(dwarfs_reader* reader, dwarfs_read_request const* req,
+                        dwarfs_completion_fn cb, void* arg);
+
+/* Harvest up to max completions without blocking */
+DWARFS_C_API size_t
+dwarfs_reader_poll(dwarfs_reader* reader, dwarfs_read_completion* comps,
+                   size_t max);
+
+/*
+ * Harvest up to max completions, blocking until at least min completions
+ * are available or timeout_ms milliseconds have passed (-1 = no timeout)
+ */
+DWARFS_C_API size_t
+dwarfs_reader_wait(dwarfs_reader* reader, dwarfs_read_completion* comps,
+                   size_t min, size_t max, int timeout_ms);
+
+DWARFS_C_API size_t dwarfs_reader_in_flight(dwarfs_reader const* reader);
+
+DWARFS_C_API void dwarfs_buffer_release(dwarfs_buffer* buffer);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,101 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "dwarfs/options.h"
+
+namespace dwarfs {
+
+/**
+ * Replacement and admission policy for a cache of blocks
+ *
+ * The policy only tracks block numbers; the owner of the policy keeps
+ * the cached data and drops whatever the policy evicts. A `capacity`
+ * of zero means the cache is unbounded. `num_keys` is the number of
+ * distinct blocks that could be cached and is used to size frequency
+ * estimates, if the policy needs them.
+ */
+class cache_policy {
+ public:
+  cache_policy(cache_replacement_policy policy, size_t capacity,
+               size_t num_keys);
+
+  /**
+   * Record an access to a block
+   *
+   * \returns `true` if the block is cached, `false` otherwise.
+   */
+  bool access(size_t key) { return impl_->access(key); }
+
+  /**
+   * Mark a cached block as most recently used
+   *
+   * Unlike `access()`, this doesn't count as a use of the block, so it
+   * doesn't affect frequency-based decisions. This is used when a block
+   * that is already cached is stored again.
+   */
+  void touch(size_t key) { impl_->touch(key); }
+
+  /**
+   * Check if a block is cached without recording an access
+   */
+  bool contains(size_t key) const { return impl_->contains(key); }
+
+  /**
+   * Insert a block that is not currently cached
+   *
+   * All blocks that must be evicted as a result are appended to
+   * `evicted`. This may include `key` itself if the policy decides
+   * not to admit the block.
+   */
+  void insert(size_t key, std::vector<size_t>& evicted) {
+    impl_->insert(key, evicted);
+  }
+
+  /**
+   * Remove a block from the cache without recording it as evicted
+   */
+  void erase(size_t key) { impl_->erase(key); }
+
+  size_t size() const { return impl_->size(); }
+
+  class impl {
+   public:
+    virtual ~impl() = default;
+
+    virtual bool access(size_t key) = 0;
+    virtual void touch(size_t key) = 0;
+    virtual bool contains(size_t key) const = 0;
+    virtual void insert(size_t key, std::vector<size_t>& evicted) = 0;
+    virtual void erase(size_t key) = 0;
+    virtual size_t size() const = 0;
+  };
+
+ private:
+  std::unique_ptr<impl> impl_;
+};
+
+} // namespace dwarfs
@@ -28,6 +28,7 @@
 
 namespace dwarfs {
 
+class block_reader;
 class logger;
 class fs_section;
 class mmif;
@@ -38,6 +39,12 @@ class cached_block {
   create(logger& lgr, fs_section const& b, std::shared_ptr<mmif> mm,
          bool release, bool disable_integrity_check);
 
+  // The compressed data is read using `reader` when the block is first
+  // decompressed, rather than at construction time.
+  static std::unique_ptr<cached_block>
+  create(logger& lgr, fs_section const& b, std::shared_ptr<block_reader> reader,
+         bool disable_integrity_check);
+
   virtual ~cached_block() = default;
 
   virtual size_t range_end() const = 0;
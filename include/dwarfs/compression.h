@@ -25,14 +25,16 @@
 
 // clang-format off
 #define DWARFS_COMPRESSION_TYPE_LIST(DWARFS_COMPRESSION_TYPE, SEPARATOR) \
-  DWARFS_COMPRESSION_TYPE(NONE,   0) SEPARATOR                           \
-  DWARFS_COMPRESSION_TYPE(LZMA,   1) SEPARATOR                           \
-  DWARFS_COMPRESSION_TYPE(ZSTD,   2) SEPARATOR                           \
-  DWARFS_COMPRESSION_TYPE(LZ4,    3) SEPARATOR                           \
-  DWARFS_COMPRESSION_TYPE(LZ4HC,  4) SEPARATOR                           \
-  DWARFS_COMPRESSION_TYPE(BROTLI, 5) SEPARATOR                           \
-  DWARFS_COMPRESSION_TYPE(FLAC,   6) SEPARATOR                           \
-  DWARFS_COMPRESSION_TYPE(RICEPP, 7)
+  DWARFS_COMPRESSION_TYPE(NONE,    0) SEPARATOR                          \
+  DWARFS_COMPRESSION_TYPE(LZMA,    1) SEPARATOR                          \
+  DWARFS_COMPRESSION_TYPE(ZSTD,    2) SEPARATOR                          \
+  DWARFS_COMPRESSION_TYPE(LZ4,     3) SEPARATOR                          \
+  DWARFS_COMPRESSION_TYPE(LZ4HC,   4) SEPARATOR                          \
+  DWARFS_COMPRESSION_TYPE(BROTLI,  5) SEPARATOR                          \
+  DWARFS_COMPRESSION_TYPE(FLAC,    6) SEPARATOR                          \
+  DWARFS_COMPRESSION_TYPE(RICEPP,  7) SEPARATOR                          \
+  DWARFS_COMPRESSION_TYPE(BCJ,     8) SEPARATOR                          \
+  DWARFS_COMPRESSION_TYPE(SHUFFLE, 9)
 // clang-format on
 
 namespace dwarfs {
@@ -0,0 +1,132 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "dwarfs/compression.h"
+
+namespace dwarfs {
+
+class file_access;
+class logger;
+
+/**
+ * Support for resuming interrupted builds
+ *
+ * The partially written image itself serves as the checkpoint. Alongside
+ * the image, a small index file (*image*`.checkpoint`) maps the key of
+ * each block written so far to the offset of its section in the image.
+ * Keys are a hash of the uncompressed block data and of the compressor
+ * configuration used to compress it. As the segmenter is deterministic,
+ * a resumed build with the same input and options will produce the same
+ * uncompressed blocks and can pick up the compressed data from the old
+ * image instead of compressing them again. Any block whose input has
+ * changed will simply not be found.
+ *
+ * When resuming, the old image and its index are moved aside to
+ * *image*`.partial` and *image*`.partial.checkpoint`, and are only
+ * deleted by `remove()` once the new image is complete. Blocks are read
+ * from the partial image only when they are taken.
+ *
+ * Both index records and image sections carry checksums, so torn writes
+ * at the end of either file (e.g. after the process was killed) are
+ * detected and dropped.
+ */
+class compression_checkpoint {
+ public:
+  using key_type = std::array<uint8_t, 32>;
+
+  struct block {
+    compression_type compression;
+    std::vector<uint8_t> data;
+  };
+
+  /**
+   * Open a checkpoint for `image`
+   *
+   * `source` describes the input of the build, e.g. its path, size and
+   * modification time. A checkpoint is only resumed from if it was
+   * created with the same `source`.
+   *
+   * If `resume` is true, all blocks that can be recovered from an existing
+   * (partial) image and its index are made available through `take()`.
+   * This must happen before `image` is opened for writing. The index is
+   * (re-)created in any case.
+   */
+  compression_checkpoint(logger& lgr, file_access const& fa,
+                         std::filesystem::path const& image,
+                         std::string_view source, bool resume);
+
+  static key_type
+  make_key(std::string_view config, std::span<uint8_t const> data);
+
+  /**
+   * Take a previously compressed block out of the checkpoint
+   *
+   * For blocks that were stored uncompressed, the returned `data` is empty
+   * and `compression` is `compression_type::NONE`.
+   */
+  std::optional<block> take(key_type const& key) { return impl_->take(key); }
+
+  /**
+   * Record that the block identified by `key` has been written to the
+   * image at `offset`
+   *
+   * This is only called by the filesystem writer thread, in image order.
+   */
+  void add(key_type const& key, uint64_t offset) { impl_->add(key, offset); }
+
+  /**
+   * Number of recovered blocks that have not been taken yet
+   */
+  size_t num_blocks() const { return impl_->num_blocks(); }
+
+  /**
+   * Close and delete the index and any partial image once the image is
+   * complete
+   */
+  void remove() { impl_->remove(); }
+
+  class impl {
+   public:
+    virtual ~impl() = default;
+
+    virtual std::optional<block> take(key_type const& key) = 0;
+    virtual void add(key_type const& key, uint64_t offset) = 0;
+    virtual size_t num_blocks() const = 0;
+    virtual void remove() = 0;
+  };
+
+ private:
+  std::unique_ptr<impl> impl_;
+};
+
+} // namespace dwarfs
@@ -73,6 +73,16 @@ class file_access {
   virtual std::unique_ptr<output_stream>
   open_output_binary(std::filesystem::path const& path,
                      std::error_code& ec) const = 0;
+
+  virtual void remove(std::filesystem::path const& path) const = 0;
+  virtual void
+  remove(std::filesystem::path const& path, std::error_code& ec) const = 0;
+
+  virtual void rename(std::filesystem::path const& from,
+                      std::filesystem::path const& to) const = 0;
+  virtual void rename(std::filesystem::path const& from,
+                      std::filesystem::path const& to,
+                      std::error_code& ec) const = 0;
 };
 
 } // namespace dwarfs
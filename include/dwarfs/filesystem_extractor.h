@@ -23,6 +23,7 @@
 
 #include <filesystem>
 #include <memory>
+#include <optional>
 #include <ostream>
 #include <string>
 #include <string_view>
@@ -41,17 +42,27 @@ struct filesystem_extractor_options {
   folly::Function<void(std::string_view, uint64_t, uint64_t) const> progress;
 };
 
+struct filesystem_extractor_archive_options {
+  std::string compression;
+  std::optional<int> compression_level;
+  size_t compression_threads{0};
+};
+
 class filesystem_extractor {
  public:
   filesystem_extractor(logger& lgr, os_access const& os);
 
-  void
-  open_archive(std::filesystem::path const& output, std::string const& format) {
-    return impl_->open_archive(output, format);
+  void open_archive(std::filesystem::path const& output,
+                    std::string const& format,
+                    filesystem_extractor_archive_options const& opts =
+                        filesystem_extractor_archive_options()) {
+    return impl_->open_archive(output, format, opts);
   }
 
-  void open_stream(std::ostream& os, std::string const& format) {
-    return impl_->open_stream(os, format);
+  void open_stream(std::ostream& os, std::string const& format,
+                   filesystem_extractor_archive_options const& opts =
+                       filesystem_extractor_archive_options()) {
+    return impl_->open_stream(os, format, opts);
   }
 
   void open_disk(std::filesystem::path const& output) {
@@ -70,9 +81,12 @@ class filesystem_extractor {
    public:
     virtual ~impl() = default;
 
-    virtual void open_archive(std::filesystem::path const& output,
-                              std::string const& format) = 0;
-    virtual void open_stream(std::ostream& os, std::string const& format) = 0;
+    virtual void
+    open_archive(std::filesystem::path const& output, std::string const& format,
+                 filesystem_extractor_archive_options const& opts) = 0;
+    virtual void
+    open_stream(std::ostream& os, std::string const& format,
+                filesystem_extractor_archive_options const& opts) = 0;
     virtual void open_disk(std::filesystem::path const& output) = 0;
     virtual void close() = 0;
     virtual bool extract(filesystem_v2 const& fs,
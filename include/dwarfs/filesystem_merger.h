@@ -0,0 +1,88 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+namespace dwarfs {
+
+class filesystem_v2;
+class filesystem_writer;
+class logger;
+class progress;
+
+struct merge_options;
+struct scanner_options;
+
+/**
+ * Combine several file system images into a single image
+ *
+ * All data blocks of the inputs are copied to the output as they are,
+ * without recompressing them. The metadata is rebuilt from the union
+ * of the input directory trees, with block numbers remapped to the
+ * position of each block in the output. Directories present in more
+ * than one input are merged, any other entry must only be present in
+ * a single input. Each input can be placed below a mount point in the
+ * merged tree; missing parent directories are created on the fly.
+ *
+ * If deduplication is enabled, regular files with identical contents
+ * share their data in the merged image. Blocks that are no longer
+ * referenced by any file are not copied.
+ *
+ * This is used to combine the partial images of a partitioned build
+ * (see `scanner_options::partition_count`).
+ */
+class filesystem_merger {
+ public:
+  filesystem_merger(logger& lgr, scanner_options const& options,
+                    merge_options const& merge_opts);
+
+  /**
+   * Add an input image; `fs` must stay valid until `merge()` returns
+   *
+   * The contents of `fs` are placed below `mount_point`, which is a
+   * path relative to the root of the merged image.
+   */
+  void add_input(filesystem_v2 const& fs,
+                 std::string const& mount_point = std::string()) {
+    impl_->add_input(fs, mount_point);
+  }
+
+  void merge(filesystem_writer& fsw, progress& prog) {
+    impl_->merge(fsw, prog);
+  }
+
+  class impl {
+   public:
+    virtual ~impl() = default;
+
+    virtual void
+    add_input(filesystem_v2 const& fs, std::string const& mount_point) = 0;
+    virtual void merge(filesystem_writer& fsw, progress& prog) = 0;
+  };
+
+ private:
+  std::unique_ptr<impl> impl_;
+};
+
+} // namespace dwarfs
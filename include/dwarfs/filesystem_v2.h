@@ -31,10 +31,12 @@
 #include <span>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include <folly/Expected.h>
 #include <folly/dynamic.h>
 
+#include "dwarfs/block_map.h"
 #include "dwarfs/block_range.h"
 #include "dwarfs/fstypes.h"
 #include "dwarfs/metadata_types.h"
@@ -166,6 +168,21 @@ class filesystem_v2 {
     return impl_->readv(inode, size, offset);
   }
 
+  /**
+   * Request all block ranges of a read without waiting for them
+   *
+   * The continuation is called once for each range, in no particular
+   * order, as soon as the range is available.
+   *
+   * \returns the number of ranges, i.e. the number of times the
+   *          continuation will be called, or a negative error code
+   */
+  folly::Expected<size_t, int>
+  readv(uint32_t inode, size_t size, file_off_t offset,
+        indexed_block_range_continuation cont) const {
+    return impl_->readv(inode, size, offset, std::move(cont));
+  }
+
   std::optional<std::span<uint8_t const>> header() const {
     return impl_->header();
   }
@@ -177,6 +194,16 @@ class filesystem_v2 {
 
   size_t num_blocks() const { return impl_->num_blocks(); }
 
+  /**
+   * Pin all blocks of regular files matching any of the glob patterns
+   *
+   * Patterns are matched against the path relative to the file system
+   * root (see `glob_match`). Returns the number of blocks pinned.
+   */
+  size_t pin_paths(std::vector<std::string> const& patterns) {
+    return impl_->pin_paths(patterns);
+  }
+
   bool has_symlinks() const { return impl_->has_symlinks(); }
 
   history const& get_history() const { return impl_->get_history(); }
@@ -185,6 +212,19 @@ class filesystem_v2 {
     return impl_->get_inode_info(entry);
   }
 
+  /**
+   * Return the extents and blocks backing a regular file
+   *
+   * Returns `std::nullopt` if `entry` is not a regular file.
+   */
+  std::optional<file_block_map> get_block_map(inode_view entry) const {
+    return impl_->get_block_map(entry);
+  }
+
+  std::optional<std::string> get_block_category(size_t block) const {
+    return impl_->get_block_category(block);
+  }
+
   std::vector<std::string> get_all_block_categories() const {
     return impl_->get_all_block_categories();
   }
@@ -203,6 +243,13 @@ class filesystem_v2 {
     return impl_->rewrite(prog, writer, cat_resolver, opts);
   }
 
+  /**
+   * Write a data block to `writer` as-is, without recompressing it
+   */
+  void copy_block(size_t block, filesystem_writer& writer) const {
+    impl_->copy_block(block, writer);
+  }
+
   class impl {
    public:
     virtual ~impl() = default;
@@ -241,19 +288,29 @@ class filesystem_v2 {
                           file_off_t offset) const = 0;
     virtual folly::Expected<std::vector<std::future<block_range>>, int>
     readv(uint32_t inode, size_t size, file_off_t offset) const = 0;
+    virtual folly::Expected<size_t, int>
+    readv(uint32_t inode, size_t size, file_off_t offset,
+          indexed_block_range_continuation cont) const = 0;
     virtual std::optional<std::span<uint8_t const>> header() const = 0;
     virtual void set_num_workers(size_t num) = 0;
     virtual void set_cache_tidy_config(cache_tidy_config const& cfg) = 0;
     virtual size_t num_blocks() const = 0;
+    virtual size_t pin_paths(std::vector<std::string> const& patterns) = 0;
     virtual bool has_symlinks() const = 0;
     virtual history const& get_history() const = 0;
     virtual folly::dynamic get_inode_info(inode_view entry) const = 0;
+    virtual std::optional<file_block_map>
+    get_block_map(inode_view entry) const = 0;
+    virtual std::optional<std::string>
+    get_block_category(size_t block) const = 0;
     virtual std::vector<std::string> get_all_block_categories() const = 0;
     virtual std::vector<file_stat::uid_type> get_all_uids() const = 0;
     virtual std::vector<file_stat::gid_type> get_all_gids() const = 0;
     virtual void rewrite(progress& prog, filesystem_writer& writer,
                          category_resolver const& cat_resolver,
                          rewrite_options const& opts) const = 0;
+    virtual void
+    copy_block(size_t block, filesystem_writer& writer) const = 0;
   };
 
  private:
@@ -0,0 +1,127 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace dwarfs {
+
+/**
+ * Matcher for an ordered list of filter rules
+ *
+ * All rules are compiled into a single automaton that is turned into
+ * a DFA lazily while matching, so each character of a path is looked
+ * at exactly once, no matter how many rules there are.
+ *
+ * Paths can be fed to the matcher incrementally: a `cursor` captures
+ * the state after a prefix of the path (e.g. a parent directory) and
+ * can be advanced by the remaining components any number of times.
+ * Floating rules are matched against the whole path, anchored rules
+ * only against the part of the path starting at the cursor's anchor
+ * offset.
+ *
+ * The DFA is rebuilt from scratch if it grows too large. This bumps
+ * the generation of the matcher and invalidates all cursors created
+ * before, which can be checked using `valid()`.
+ */
+class filter_matcher {
+ public:
+  enum class rule_type {
+    include,
+    exclude,
+  };
+
+  struct cursor {
+    uint32_t state{0};
+    uint32_t generation{0};
+    size_t offset{0};
+    size_t anchor{0};
+  };
+
+  filter_matcher();
+  ~filter_matcher();
+
+  /**
+   * Add a rule of the form `+ pattern` or `- pattern`
+   *
+   * Throws if the rule cannot be parsed. Adding a rule invalidates
+   * all existing cursors.
+   */
+  void add_rule(std::string const& rule) { impl_->add_rule(rule); }
+
+  bool empty() const { return impl_->size() == 0; }
+  size_t size() const { return impl_->size(); }
+
+  rule_type type(size_t index) const { return impl_->type(index); }
+  bool floating(size_t index) const { return impl_->floating(index); }
+  std::string const& rule(size_t index) const { return impl_->rule(index); }
+
+  /**
+   * Human readable (regex-like) representation of a compiled rule
+   */
+  std::string const& pattern(size_t index) const {
+    return impl_->pattern(index);
+  }
+
+  cursor start(size_t anchor) { return impl_->start(anchor); }
+
+  cursor advance(cursor const& c, std::string_view s) {
+    return impl_->advance(c, s);
+  }
+
+  bool valid(cursor const& c) const { return impl_->valid(c); }
+
+  /**
+   * Index of the first rule matching the path consumed by `c`
+   */
+  std::optional<size_t> match(cursor const& c) { return impl_->match(c); }
+
+  std::optional<size_t> match(std::string_view path, size_t anchor) {
+    return match(advance(start(anchor), path));
+  }
+
+  class impl {
+   public:
+    virtual ~impl() = default;
+
+    virtual void add_rule(std::string const& rule) = 0;
+    virtual size_t size() const = 0;
+    virtual rule_type type(size_t index) const = 0;
+    virtual bool floating(size_t index) const = 0;
+    virtual std::string const& rule(size_t index) const = 0;
+    virtual std::string const& pattern(size_t index) const = 0;
+    virtual cursor start(size_t anchor) = 0;
+    virtual cursor advance(cursor const& c, std::string_view s) = 0;
+    virtual bool valid(cursor const& c) const = 0;
+    virtual std::optional<size_t> match(cursor const& c) = 0;
+  };
+
+ private:
+  std::unique_ptr<impl> impl_;
+};
+
+} // namespace dwarfs
@@ -0,0 +1,101 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "dwarfs/mmif.h"
+
+namespace dwarfs {
+
+class logger;
+
+struct http_mmif_options {
+  std::filesystem::path cache_file{};
+  size_t chunk_size{static_cast<size_t>(1) << 20};
+  size_t max_parallel_requests{8};
+  size_t max_retries{3};
+  std::chrono::milliseconds connect_timeout{std::chrono::seconds(10)};
+};
+
+/**
+ * Remote image accessed via HTTP range requests
+ *
+ * The image is divided into chunks of `chunk_size` bytes. A chunk is
+ * only fetched from the server the first time a range overlapping it is
+ * accessed; contiguous missing chunks are fetched using a single range
+ * request. Fetched chunks are kept in `cache_file`, which is reused by
+ * later instances as long as the remote image doesn't change. Without a
+ * cache file, fetched chunks are kept in anonymous memory.
+ */
+class http_mmif : public mmif {
+ public:
+  http_mmif(logger& lgr, std::string const& url,
+            http_mmif_options const& opts = http_mmif_options());
+  ~http_mmif() override;
+
+  static bool is_url(std::string_view path);
+
+  void const* addr() const override { return impl_->addr(); }
+  size_t size() const override { return impl_->size(); }
+
+  void const* range_addr(file_off_t offset, size_t length) const override {
+    return impl_->range_addr(offset, length);
+  }
+
+  std::error_code prefetch(std::span<file_range const> ranges) override {
+    return impl_->prefetch(ranges);
+  }
+
+  std::error_code lock(file_off_t, size_t) override { return {}; }
+  std::error_code release(file_off_t, size_t) override { return {}; }
+  std::error_code release_until(file_off_t) override { return {}; }
+
+  std::filesystem::path const& path() const override { return impl_->path(); }
+
+  /**
+   * Number of bytes fetched from the server by this instance
+   */
+  size_t bytes_fetched() const { return impl_->bytes_fetched(); }
+
+  class impl {
+   public:
+    virtual ~impl() = default;
+
+    virtual void const* addr() const = 0;
+    virtual size_t size() const = 0;
+    virtual void const* range_addr(file_off_t offset, size_t length) = 0;
+    virtual std::error_code prefetch(std::span<file_range const> ranges) = 0;
+    virtual std::filesystem::path const& path() const = 0;
+    virtual size_t bytes_fetched() const = 0;
+  };
+
+ private:
+  std::unique_ptr<impl> impl_;
+};
+
+} // namespace dwarfs
@@ -42,14 +42,17 @@ class inode_ordering {
     impl_->by_inode_number(sp);
   }
 
-  void by_path(sortable_inode_span& sp) const { impl_->by_path(sp); }
+  void by_path(worker_group& wg, sortable_inode_span& sp) const {
+    impl_->by_path(wg, sp);
+  }
 
-  void by_reverse_path(sortable_inode_span& sp) const {
-    impl_->by_reverse_path(sp);
+  void by_reverse_path(worker_group& wg, sortable_inode_span& sp) const {
+    impl_->by_reverse_path(wg, sp);
   }
 
-  void by_similarity(sortable_inode_span& sp, fragment_category cat) const {
-    impl_->by_similarity(sp, cat);
+  void by_similarity(worker_group& wg, sortable_inode_span& sp,
+                     fragment_category cat) const {
+    impl_->by_similarity(wg, sp, cat);
   }
 
   void by_nilsimsa(worker_group& wg, similarity_ordering_options const& opts,
@@ -62,10 +65,11 @@ class inode_ordering {
     virtual ~impl() = default;
 
     virtual void by_inode_number(sortable_inode_span& sp) const = 0;
-    virtual void by_path(sortable_inode_span& sp) const = 0;
-    virtual void by_reverse_path(sortable_inode_span& sp) const = 0;
+    virtual void by_path(worker_group& wg, sortable_inode_span& sp) const = 0;
     virtual void
-    by_similarity(sortable_inode_span& sp, fragment_category cat) const = 0;
+    by_reverse_path(worker_group& wg, sortable_inode_span& sp) const = 0;
+    virtual void by_similarity(worker_group& wg, sortable_inode_span& sp,
+                               fragment_category cat) const = 0;
     virtual void
     by_nilsimsa(worker_group& wg, similarity_ordering_options const& opts,
                 sortable_inode_span& sp, fragment_category cat) const = 0;
@@ -24,7 +24,10 @@
 #include <cstddef>
 #include <iosfwd>
 #include <memory>
+#include <span>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <folly/Expected.h>
 
@@ -67,6 +70,12 @@ class inode_reader_v2 {
     return impl_->readv(inode, size, offset, chunks);
   }
 
+  folly::Expected<size_t, int>
+  readv(uint32_t inode, size_t size, file_off_t offset, chunk_range chunks,
+        indexed_block_range_continuation cont) const {
+    return impl_->readv(inode, size, offset, chunks, std::move(cont));
+  }
+
   void
   dump(std::ostream& os, const std::string& indent, chunk_range chunks) const {
     impl_->dump(os, indent, chunks);
@@ -80,6 +89,22 @@ class inode_reader_v2 {
 
   size_t num_blocks() const { return impl_->num_blocks(); }
 
+  void pin_blocks(std::vector<size_t> const& blocks) {
+    impl_->pin_blocks(blocks);
+  }
+
+  void hold_blocks(std::span<size_t const> blocks) const {
+    impl_->hold_blocks(blocks);
+  }
+
+  void unhold_blocks(std::span<size_t const> blocks) const {
+    impl_->unhold_blocks(blocks);
+  }
+
+  void prefetch_blocks(std::span<size_t const> blocks) const {
+    impl_->prefetch_blocks(blocks);
+  }
+
   class impl {
    public:
     virtual ~impl() = default;
@@ -91,11 +116,18 @@ class inode_reader_v2 {
     virtual folly::Expected<std::vector<std::future<block_range>>, int>
     readv(uint32_t inode, size_t size, file_off_t offset,
           chunk_range chunks) const = 0;
+    virtual folly::Expected<size_t, int>
+    readv(uint32_t inode, size_t size, file_off_t offset, chunk_range chunks,
+          indexed_block_range_continuation cont) const = 0;
     virtual void dump(std::ostream& os, const std::string& indent,
                       chunk_range chunks) const = 0;
     virtual void set_num_workers(size_t num) = 0;
     virtual void set_cache_tidy_config(cache_tidy_config const& cfg) = 0;
     virtual size_t num_blocks() const = 0;
+    virtual void pin_blocks(std::vector<size_t> const& blocks) = 0;
+    virtual void hold_blocks(std::span<size_t const> blocks) const = 0;
+    virtual void unhold_blocks(std::span<size_t const> blocks) const = 0;
+    virtual void prefetch_blocks(std::span<size_t const> blocks) const = 0;
   };
 
  private:
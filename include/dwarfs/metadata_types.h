@@ -26,6 +26,7 @@
 #include <filesystem>
 #include <optional>
 #include <string>
+#include <utility>
 #include <variant>
 
 #include <boost/iterator/iterator_facade.hpp>
@@ -35,6 +36,7 @@
 
 #include "dwarfs/file_stat.h"
 #include "dwarfs/file_type.h"
+#include "dwarfs/packed_tables.h"
 #include "dwarfs/string_table.h"
 
 #include "dwarfs/gen-cpp2/metadata_layouts.h"
@@ -70,14 +72,14 @@ class global_metadata {
 
   string_table const& names() const { return names_; }
 
-  std::vector<thrift::metadata::directory> const& directories() const {
-    return directories_storage_;
-  }
+  bool has_packed_directories() const { return first_entry_index_.has_value(); }
+
+  std::vector<thrift::metadata::directory> unpack_directories() const;
 
  private:
   Meta const& meta_;
-  std::vector<thrift::metadata::directory> const directories_storage_;
-  thrift::metadata::directory const* const directories_;
+  std::optional<delta_list_index> const first_entry_index_;
+  packed_int_vector const parent_entries_;
   string_table const names_;
 };
 
@@ -272,6 +274,15 @@ class chunk_range {
 
   chunk_view operator[](uint32_t index) const { return meta_->chunks()[index]; }
 
+  /**
+   * Find a chunk close to a file offset using the chunk offset index
+   *
+   * Returns the index of the last sampled chunk that starts at or before
+   * `offset` along with its file offset. If the file isn't indexed, this
+   * returns `{0, 0}`, i.e. the start of the file.
+   */
+  std::pair<uint32_t, uint64_t> find_offset(uint64_t offset) const;
+
  private:
   chunk_range(Meta const& meta, uint32_t begin, uint32_t end)
       : meta_(&meta)
@@ -47,6 +47,7 @@ struct file_stat;
 struct vfs_stat;
 
 namespace thrift::metadata {
+class chunk_offset_index;
 class metadata;
 }
 
@@ -162,6 +163,11 @@ class metadata_v2 {
   static std::pair<std::vector<uint8_t>, std::vector<uint8_t>>
   freeze(const thrift::metadata::metadata& data);
 
+  // Must be called before the chunk table is packed
+  static thrift::metadata::chunk_offset_index
+  build_chunk_offset_index(thrift::metadata::metadata const& data,
+                           size_t min_chunks, size_t interval);
+
   class impl {
    public:
     virtual ~impl() = default;
@@ -22,6 +22,7 @@
 #pragma once
 
 #include <cstddef>
+#include <mutex>
 
 #include <boost/iostreams/device/mapped_file.hpp>
 
@@ -36,6 +37,7 @@ class mmap : public mmif {
   explicit mmap(char const* path);
   mmap(std::filesystem::path const& path, size_t size);
   mmap(std::string const& path, size_t size);
+  ~mmap() override;
 
   void const* addr() const override;
   size_t size() const override;
@@ -44,11 +46,19 @@ class mmap : public mmif {
   std::error_code release(file_off_t offset, size_t size) override;
   std::error_code release_until(file_off_t offset) override;
 
+  std::error_code
+  read(void* buf, file_off_t offset, size_t length) const override;
+  std::error_code willneed(file_off_t offset, size_t size) const override;
+
   std::filesystem::path const& path() const override;
 
  private:
+  int read_fd() const;
+
   boost::iostreams::mapped_file mutable mf_;
   uint64_t const page_size_;
+  std::once_flag mutable fd_once_;
+  int mutable fd_{-1};
   std::filesystem::path const path_;
 };
 } // namespace dwarfs
@@ -21,10 +21,13 @@
 
 #pragma once
 
+#include <cstring>
 #include <filesystem>
 #include <span>
 #include <string>
 #include <system_error>
+#include <type_traits>
+#include <utility>
 
 #include <boost/noncopyable.hpp>
 
@@ -36,15 +39,22 @@ class mmif : public boost::noncopyable {
  public:
   virtual ~mmif() = default;
 
+  using file_range = std::pair<file_off_t, size_t>;
+
   template <typename T>
   T const* as(file_off_t offset = 0) const {
-    return reinterpret_cast<T const*>(
-        reinterpret_cast<char const*>(this->addr()) + offset);
+    if constexpr (std::is_void_v<T>) {
+      return this->range_addr(offset, 0);
+    } else {
+      return reinterpret_cast<T const*>(this->range_addr(offset, sizeof(T)));
+    }
   }
 
   template <typename T = uint8_t>
   std::span<T const> span(file_off_t offset, size_t length) const {
-    return std::span(this->as<T>(offset), length);
+    return std::span(reinterpret_cast<T const*>(
+                         this->range_addr(offset, length * sizeof(T))),
+                     length);
   }
 
   template <typename T = uint8_t>
@@ -55,6 +65,45 @@ class mmif : public boost::noncopyable {
   virtual void const* addr() const = 0;
   virtual size_t size() const = 0;
 
+  /**
+   * Address of `length` bytes starting at `offset`
+   *
+   * Implementations that don't have the whole file available upfront
+   * must make sure the range is accessible before returning. Accessing
+   * anything beyond the range is only valid if it has been requested
+   * separately.
+   */
+  virtual void const* range_addr(file_off_t offset, size_t /*length*/) const {
+    return static_cast<char const*>(this->addr()) + offset;
+  }
+
+  /**
+   * Hint that the given ranges are going to be accessed soon
+   */
+  virtual std::error_code prefetch(std::span<file_range const> /*ranges*/) {
+    return {};
+  }
+
+  /**
+   * Copy `length` bytes starting at `offset` into `buf`
+   *
+   * Unlike accessing the mapping, this allows implementations to fetch
+   * the data using large explicit reads rather than page faults.
+   */
+  virtual std::error_code
+  read(void* buf, file_off_t offset, size_t length) const {
+    std::memcpy(buf, this->range_addr(offset, length), length);
+    return {};
+  }
+
+  /**
+   * Ask the OS to start reading the range in the background
+   */
+  virtual std::error_code
+  willneed(file_off_t /*offset*/, size_t /*size*/) const {
+    return {};
+  }
+
   virtual std::error_code lock(file_off_t offset, size_t size) = 0;
   virtual std::error_code release(file_off_t offset, size_t size) = 0;
   virtual std::error_code release_until(file_off_t offset) = 0;
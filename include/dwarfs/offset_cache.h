@@ -134,9 +134,17 @@ class basic_offset_cache {
 
     void set_first_index(chunk_index_type first_ix) { first_index_ = first_ix; }
 
+    // Stop recording offsets, e.g. because the chunk walk started at a
+    // chunk found by other means. The last chunk is still updated.
+    void disable() {
+      disabled_ = true;
+      first_index_ = 0;
+      offsets_.clear();
+    }
+
     void add_offset(chunk_index_type index, file_offset_type offset) {
-      if (index < chunk_index_interval || index % chunk_index_interval != 0)
-          [[likely]] {
+      if (disabled_ || index < chunk_index_interval ||
+          index % chunk_index_interval != 0) [[likely]] {
         return;
       }
 
@@ -155,6 +163,7 @@ class basic_offset_cache {
    private:
     folly::small_vector<file_offset_type, max_inline_offsets> offsets_;
     chunk_index_type first_index_{0};
+    bool disabled_{false};
   };
 
   basic_offset_cache(size_t cache_size)
@@ -37,12 +37,17 @@
 namespace dwarfs {
 
 class categorizer_manager;
+class compression_checkpoint;
 class entry;
 
 enum class mlock_mode { NONE, TRY, MUST };
 
 enum class cache_tidy_strategy { NONE, EXPIRY_TIME, BLOCK_SWAPPED_OUT };
 
+enum class cache_replacement_policy { LRU, W_TINYLFU, ARC };
+
+enum class block_io_mode { MMAP, PREAD };
+
 enum class filesystem_check_level { CHECKSUM, INTEGRITY, FULL };
 
 struct block_cache_options {
@@ -53,6 +58,13 @@ struct block_cache_options {
   bool init_workers{true};
   bool disable_block_integrity_check{false};
   size_t sequential_access_detector_threshold{0};
+  size_t max_queued_speculative_requests{64};
+  bool numa_aware{false};
+  cache_replacement_policy replacement_policy{cache_replacement_policy::LRU};
+  size_t range_cache_max_bytes{0};
+  size_t range_cache_max_extent{static_cast<size_t>(64) << 10};
+  block_io_mode io_mode{block_io_mode::MMAP};
+  size_t io_max_request_size{static_cast<size_t>(64) << 20};
 };
 
 struct history_config {
@@ -76,6 +88,21 @@ struct inode_reader_options {
   size_t readahead{0};
 };
 
+struct tree_scan_options {
+  // Number of distinct files opened within `window` that is considered
+  // a scan of the whole tree; 0 disables scan detection
+  size_t threshold{0};
+  std::chrono::milliseconds window{std::chrono::seconds(1)};
+  // A scan is considered finished if no files are opened or read for
+  // this long
+  std::chrono::milliseconds idle_timeout{std::chrono::seconds(10)};
+  // Maximum amount of decompressed data held on top of the block cache;
+  // 0 means the size of the block cache
+  size_t max_held_bytes{0};
+  // Maximum number of blocks to prefetch when a file is opened
+  size_t max_prefetch_blocks{8};
+};
+
 struct filesystem_options {
   static constexpr file_off_t IMAGE_OFFSET_AUTO{-1};
 
@@ -84,6 +111,7 @@ struct filesystem_options {
   block_cache_options block_cache{};
   metadata_options metadata{};
   inode_reader_options inode_reader{};
+  tree_scan_options tree_scan{};
   int inode_offset{0};
 };
 
@@ -92,6 +120,8 @@ struct filesystem_writer_options {
   size_t worst_case_block_size{4 << 20};
   bool remove_header{false};
   bool no_section_index{false};
+  bool parallel_block_compression{false};
+  std::shared_ptr<compression_checkpoint> checkpoint;
 };
 
 // TODO: rename
@@ -120,11 +150,15 @@ struct scanner_options {
   std::optional<uint64_t> timestamp;
   bool keep_all_times{false};
   bool remove_empty_dirs{false};
+  size_t partition_index{0};
+  size_t partition_count{1};
   bool with_devices{false};
   bool with_specials{false};
   uint32_t time_resolution_sec{1};
   inode_options inode;
   bool pack_chunk_table{false};
+  size_t chunk_index_min_chunks{0};
+  size_t chunk_index_interval{256};
   bool pack_directories{false};
   bool pack_shared_files_table{false};
   bool plain_names_table{false};
@@ -152,9 +186,18 @@ struct rewrite_options {
   history_config history;
 };
 
+struct merge_options {
+  bool deduplicate{false};
+};
+
 std::ostream& operator<<(std::ostream& os, file_order_mode mode);
 std::ostream& operator<<(std::ostream& os, block_cache_options const& opts);
+std::ostream& operator<<(std::ostream& os, cache_replacement_policy policy);
+std::ostream& operator<<(std::ostream& os, block_io_mode mode);
 
 mlock_mode parse_mlock_mode(std::string_view mode);
+cache_replacement_policy
+parse_cache_replacement_policy(std::string_view policy);
+block_io_mode parse_block_io_mode(std::string_view mode);
 
 } // namespace dwarfs
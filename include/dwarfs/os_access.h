@@ -29,6 +29,7 @@
 #include <string>
 #include <system_error>
 #include <thread>
+#include <vector>
 
 #include "dwarfs/file_stat.h"
 
@@ -68,5 +69,9 @@ class os_access {
   thread_get_cpu_time(std::thread::id tid, std::error_code& ec) const = 0;
   virtual std::filesystem::path
   find_executable(std::filesystem::path const& name) const = 0;
+  // CPUs of each NUMA node, indexed by node number; empty if unknown
+  virtual std::vector<std::vector<int>> numa_node_cpus() const = 0;
+  // NUMA node the calling thread is currently running on
+  virtual int current_numa_node(std::error_code& ec) const = 0;
 };
 } // namespace dwarfs
@@ -26,6 +26,7 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <vector>
 
 #include "dwarfs/os_access.h"
 
@@ -55,5 +56,7 @@ class os_access_generic : public os_access {
   thread_get_cpu_time(std::thread::id tid, std::error_code& ec) const override;
   std::filesystem::path
   find_executable(std::filesystem::path const& name) const override;
+  std::vector<std::vector<int>> numa_node_cpus() const override;
+  int current_numa_node(std::error_code& ec) const override;
 };
 } // namespace dwarfs
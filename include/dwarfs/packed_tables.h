@@ -0,0 +1,254 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace dwarfs {
+
+/**
+ * Random access to a delta encoded list without decoding it
+ *
+ * Only every `kSampleInterval`-th absolute value is kept in memory. All
+ * other values are recovered by adding up at most `kSampleInterval - 1`
+ * deltas from the encoded list, which can stay in the memory mapped
+ * metadata. The list is passed to each call rather than stored so that
+ * this works with any frozen view type.
+ */
+class delta_list_index {
+ public:
+  static constexpr size_t const kSampleShift{4};
+  static constexpr size_t const kSampleInterval{size_t(1) << kSampleShift};
+
+  template <typename List, typename Proj = std::identity>
+  explicit delta_list_index(List const& deltas, Proj proj = {}) {
+    samples_.reserve((deltas.size() + kSampleInterval - 1) >> kSampleShift);
+
+    uint32_t value = 0;
+
+    for (auto d : deltas) {
+      value += proj(d);
+
+      if ((size_ & (kSampleInterval - 1)) == 0) {
+        samples_.push_back(value);
+      }
+
+      ++size_;
+    }
+  }
+
+  size_t size() const { return size_; }
+
+  size_t memory_usage() const {
+    return sizeof(samples_.front()) * samples_.capacity();
+  }
+
+  template <typename List, typename Proj = std::identity>
+  uint32_t lookup(List const& deltas, size_t i, Proj proj = {}) const {
+    assert(i < size_);
+
+    auto const k = i >> kSampleShift;
+    auto value = samples_[k];
+
+    for (auto j = (k << kSampleShift) + 1; j <= i; ++j) {
+      value += proj(deltas[j]);
+    }
+
+    return value;
+  }
+
+  template <typename List, typename Proj = std::identity>
+  std::vector<uint32_t> unpack(List const& deltas, Proj proj = {}) const {
+    std::vector<uint32_t> values;
+    values.reserve(size_);
+
+    uint32_t value = 0;
+
+    for (auto d : deltas) {
+      value += proj(d);
+      values.push_back(value);
+    }
+
+    return values;
+  }
+
+ private:
+  std::vector<uint32_t> samples_;
+  size_t size_{0};
+};
+
+/**
+ * Random access to a run length encoded list without decoding it
+ *
+ * The encoded list stores, for each run, the run length minus
+ * `kMinRunLength`. The decoded list contains the index of the run
+ * covering each position. For every `kSampleInterval`-th position, the
+ * covering run and its start position are kept in memory. Lookups scan
+ * forward from there, which takes at most `kSampleInterval /
+ * kMinRunLength` steps.
+ */
+class run_length_index {
+ public:
+  static constexpr size_t const kSampleShift{4};
+  static constexpr size_t const kSampleInterval{size_t(1) << kSampleShift};
+  static constexpr uint32_t const kMinRunLength{2};
+
+  template <typename List>
+  explicit run_length_index(List const& runs) {
+    uint32_t run = 0;
+
+    for (auto r : runs) {
+      auto const end = size_ + r + kMinRunLength;
+
+      // sample all positions covered by this run
+      for (auto pos = (size_ + kSampleInterval - 1) & ~(kSampleInterval - 1);
+           pos < end; pos += kSampleInterval) {
+        samples_.push_back({run, static_cast<uint32_t>(size_)});
+      }
+
+      size_ = end;
+      ++run;
+    }
+  }
+
+  size_t size() const { return size_; }
+
+  size_t memory_usage() const {
+    return sizeof(samples_.front()) * samples_.capacity();
+  }
+
+  template <typename List>
+  uint32_t lookup(List const& runs, size_t i) const {
+    assert(i < size_);
+
+    auto [run, start] = samples_[i >> kSampleShift];
+
+    for (;;) {
+      start += runs[run] + kMinRunLength;
+
+      if (i < start) {
+        return run;
+      }
+
+      ++run;
+    }
+  }
+
+  template <typename List>
+  std::vector<uint32_t> unpack(List const& runs) const {
+    std::vector<uint32_t> values;
+    values.reserve(size_);
+
+    uint32_t run = 0;
+
+    for (auto r : runs) {
+      values.insert(values.end(), r + kMinRunLength, run++);
+    }
+
+    return values;
+  }
+
+ private:
+  struct sample {
+    uint32_t run;
+    uint32_t start;
+  };
+
+  std::vector<sample> samples_;
+  size_t size_{0};
+};
+
+/**
+ * Fixed-size vector of unsigned integers using the minimum number of
+ * bits per element
+ */
+class packed_int_vector {
+ public:
+  packed_int_vector() = default;
+
+  packed_int_vector(size_t size, uint64_t max_value)
+      : data_((size * std::bit_width(max_value) + 63) / 64)
+      , size_{size}
+      , bits_{static_cast<unsigned>(std::bit_width(max_value))}
+      , mask_{bits_ == 64 ? ~uint64_t(0) : (uint64_t(1) << bits_) - 1} {}
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  unsigned bits() const { return bits_; }
+
+  size_t memory_usage() const {
+    return sizeof(data_.front()) * data_.capacity();
+  }
+
+  uint64_t operator[](size_t i) const {
+    assert(i < size_);
+
+    if (bits_ == 0) {
+      return 0;
+    }
+
+    auto const pos = i * bits_;
+    auto const word = pos / 64;
+    auto const shift = pos % 64;
+    auto value = data_[word] >> shift;
+
+    if (shift + bits_ > 64) {
+      value |= data_[word + 1] << (64 - shift);
+    }
+
+    return value & mask_;
+  }
+
+  void set(size_t i, uint64_t value) {
+    assert(i < size_);
+    assert((value & ~mask_) == 0);
+
+    if (bits_ == 0) {
+      return;
+    }
+
+    auto const pos = i * bits_;
+    auto const word = pos / 64;
+    auto const shift = pos % 64;
+
+    data_[word] = (data_[word] & ~(mask_ << shift)) | (value << shift);
+
+    if (shift + bits_ > 64) {
+      auto const hi = 64 - shift;
+      data_[word + 1] =
+          (data_[word + 1] & ~(mask_ >> hi)) | (value >> hi);
+    }
+  }
+
+ private:
+  std::vector<uint64_t> data_;
+  size_t size_{0};
+  unsigned bits_{0};
+  uint64_t mask_{0};
+};
+
+} // namespace dwarfs
@@ -0,0 +1,140 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <future>
+#include <iterator>
+#include <vector>
+
+#include "dwarfs/worker_group.h"
+
+namespace dwarfs {
+
+namespace detail {
+
+template <typename Func>
+void run_parallel(worker_group& wg, size_t count, Func const& func) {
+  if (count == 1) {
+    func(0);
+    return;
+  }
+
+  std::vector<std::future<void>> futures;
+  futures.reserve(count);
+
+  for (size_t i = 0; i < count; ++i) {
+    std::packaged_task<void()> task([&func, i] { func(i); });
+    futures.push_back(task.get_future());
+    wg.add_job(std::move(task));
+  }
+
+  // func is referenced by all jobs, so wait for every one of them
+  // before propagating the first exception
+  for (auto& f : futures) {
+    f.wait();
+  }
+
+  for (auto& f : futures) {
+    f.get();
+  }
+}
+
+inline size_t
+parallel_chunk_count(worker_group& wg, size_t size, size_t min_chunk) {
+  if (!wg) {
+    return 1;
+  }
+  return std::max<size_t>(
+      1, std::min(wg.size(), size / std::max<size_t>(min_chunk, 1)));
+}
+
+} // namespace detail
+
+/**
+ * Call `func(begin, end)` for consecutive ranges covering `[0, size)`
+ *
+ * The ranges are processed concurrently on `wg`, with each range holding
+ * at least `min_chunk` elements. Blocks until all ranges are done, so
+ * this must not be called from one of the threads of `wg`.
+ */
+template <typename Func>
+void parallel_for_ranges(worker_group& wg, size_t size, size_t min_chunk,
+                         Func const& func) {
+  auto const chunks = detail::parallel_chunk_count(wg, size, min_chunk);
+
+  detail::run_parallel(wg, chunks, [&](size_t i) {
+    func(size * i / chunks, size * (i + 1) / chunks);
+  });
+}
+
+/**
+ * Sort `[first, last)` using the threads of `wg`
+ *
+ * Each worker sorts a contiguous chunk, and the chunks are then merged
+ * pairwise in parallel rounds. For a strict total order (i.e. no two
+ * distinct elements compare equal) the result is identical to that of
+ * `std::sort`. The same restrictions as for `parallel_for_ranges` apply.
+ */
+template <typename RandomIt, typename Compare>
+void parallel_sort(worker_group& wg, RandomIt first, RandomIt last,
+                   Compare const& comp, size_t min_chunk = 4096) {
+  size_t const size = std::distance(first, last);
+  auto const chunks = detail::parallel_chunk_count(wg, size, min_chunk);
+
+  if (chunks == 1) {
+    std::sort(first, last, comp);
+    return;
+  }
+
+  std::vector<size_t> bounds;
+  bounds.reserve(chunks + 1);
+  for (size_t i = 0; i <= chunks; ++i) {
+    bounds.push_back(size * i / chunks);
+  }
+
+  detail::run_parallel(wg, chunks, [&](size_t i) {
+    std::sort(first + bounds[i], first + bounds[i + 1], comp);
+  });
+
+  while (bounds.size() > 2) {
+    auto const merges = (bounds.size() - 1) / 2;
+
+    detail::run_parallel(wg, merges, [&](size_t i) {
+      std::inplace_merge(first + bounds[2 * i], first + bounds[2 * i + 1],
+                         first + bounds[2 * i + 2], comp);
+    });
+
+    std::vector<size_t> next;
+    next.reserve(merges + 2);
+    for (size_t i = 0; i < bounds.size(); i += 2) {
+      next.push_back(bounds[i]);
+    }
+    if (next.back() != bounds.back()) {
+      next.push_back(bounds.back());
+    }
+    bounds.swap(next);
+  }
+}
+
+} // namespace dwarfs
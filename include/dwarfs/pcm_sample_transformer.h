@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <iosfwd>
 #include <memory>
 #include <span>
@@ -30,16 +31,28 @@ namespace dwarfs {
 enum class pcm_sample_endianness { Big, Little };
 enum class pcm_sample_signedness { Signed, Unsigned };
 enum class pcm_sample_padding { Lsb, Msb };
+enum class pcm_sample_cpu_variant { Fallback, Sse41, Avx2, Neon };
 
 std::ostream& operator<<(std::ostream& os, pcm_sample_endianness e);
 std::ostream& operator<<(std::ostream& os, pcm_sample_signedness s);
 std::ostream& operator<<(std::ostream& os, pcm_sample_padding p);
+std::ostream& operator<<(std::ostream& os, pcm_sample_cpu_variant v);
+
+/**
+ * CPU variants supported on this machine, starting with `Fallback`
+ *
+ * The last entry is the fastest variant and used by default.
+ */
+std::span<pcm_sample_cpu_variant const> pcm_sample_cpu_variants();
 
 template <typename UnpackedType>
 class pcm_sample_transformer {
  public:
   pcm_sample_transformer(pcm_sample_endianness end, pcm_sample_signedness sig,
                          pcm_sample_padding pad, int bytes, int bits);
+  pcm_sample_transformer(pcm_sample_endianness end, pcm_sample_signedness sig,
+                         pcm_sample_padding pad, int bytes, int bits,
+                         pcm_sample_cpu_variant cpu);
 
   void unpack(std::span<UnpackedType> dst, std::span<uint8_t const> src) const {
     impl_->unpack(dst, src);
@@ -30,6 +30,7 @@
 #include <span>
 #include <string>
 #include <unordered_set>
+#include <utility>
 
 #include <folly/small_vector.h>
 
@@ -77,23 +78,44 @@ class performance_monitor_proxy {
       }
     }
 
+    // Timers can be moved, e.g. to time how long an item is queued; the
+    // sample is added when the last owner goes away.
+    section_timer(section_timer&& other) noexcept
+        : mon_{std::exchange(other.mon_, nullptr)}
+        , id_{other.id_}
+        , start_{other.start_}
+        , context_{std::move(other.context_)} {}
+
+    section_timer& operator=(section_timer&& other) noexcept {
+      if (this != &other) {
+        finish();
+        mon_ = std::exchange(other.mon_, nullptr);
+        id_ = other.id_;
+        start_ = other.start_;
+        context_ = std::move(other.context_);
+      }
+      return *this;
+    }
+
     void set_context(std::initializer_list<uint64_t> ctx) {
       if (context_) {
         context_->assign(ctx);
       }
     }
 
-    ~section_timer() {
-      if (mon_) {
-        mon_->add_sample(id_, start_,
-                         context_ ? *context_ : std::span<uint64_t const>{});
+    ~section_timer() { finish(); }
+
+   private:
+    void finish() {
+      if (auto mon = std::exchange(mon_, nullptr)) {
+        mon->add_sample(id_, start_,
+                        context_ ? *context_ : std::span<uint64_t const>{});
       }
     }
 
-   private:
     performance_monitor const* mon_{nullptr};
-    performance_monitor::timer_id id_;
-    performance_monitor::time_type start_;
+    performance_monitor::timer_id id_{0};
+    performance_monitor::time_type start_{0};
     std::optional<
         folly::small_vector<uint64_t, performance_monitor::kNumInlineContext>>
         context_;
@@ -165,6 +187,8 @@ class performance_monitor_proxy {
   PERFMON_TIMER_INIT(PERFMON_PROXY_INSTNAME, id, __VA_ARGS__)
 #define PERFMON_CLS_SCOPED_SECTION(id)                                         \
   PERFMON_SCOPED_SECTION(PERFMON_PROXY_INSTNAME, id)
+#define PERFMON_CLS_SECTION_TIMER(id)                                          \
+  PERFMON_PROXY_INSTNAME.scoped_section(perfmon_##id##_id_)
 
 #define PERFMON_SET_CONTEXT(...)                                               \
   perfmon_scoped_section_.set_context({__VA_ARGS__});
@@ -192,6 +216,7 @@ class performance_monitor_proxy {
 #define PERFMON_CLS_TIMER_DECL(id)
 #define PERFMON_CLS_TIMER_INIT(id, ...)
 #define PERFMON_CLS_SCOPED_SECTION(id)
+#define PERFMON_CLS_SECTION_TIMER(id) performance_monitor_proxy::section_timer()
 
 #define PERFMON_SET_CONTEXT(...)
 
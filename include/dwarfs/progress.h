@@ -30,6 +30,7 @@
 #include <memory>
 #include <mutex>
 #include <optional>
+#include <string_view>
 #include <thread>
 #include <vector>
 
@@ -65,12 +66,19 @@ class progress {
 
   using status_function_type =
       folly::Function<std::string(progress const&, size_t) const>;
+  using stage_function_type = folly::Function<void(std::string_view)>;
 
   progress(folly::Function<void(progress&, bool)>&& func, unsigned interval_ms);
   ~progress() noexcept;
 
   void set_status_function(status_function_type status_fun);
 
+  // Called with a stable, machine-readable name whenever a new stage of
+  // the pipeline starts, e.g. to record per-stage timings
+  void set_stage_function(stage_function_type stage_fun);
+
+  void stage(std::string_view name);
+
   std::string status(size_t max_len);
 
   template <typename T, typename... Args>
@@ -153,6 +161,8 @@ class progress {
   mutable std::mutex mx_;
   std::condition_variable cond_;
   std::shared_ptr<status_function_type> status_fun_;
+  std::mutex stage_mx_;
+  stage_function_type stage_fun_;
   std::vector<std::weak_ptr<context>> mutable contexts_;
   std::thread thread_;
 };
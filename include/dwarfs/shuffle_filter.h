@@ -0,0 +1,61 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace dwarfs {
+
+/**
+ * Reversible transformations for arrays of fixed-width numeric elements
+ *
+ * `byte_shuffle` groups the n-th byte of all elements together, so that
+ * e.g. the mostly constant exponent bytes of floating point values end up
+ * in a contiguous run. `bit_shuffle` additionally splits each of these
+ * byte lanes into bit planes. If the size of the input isn't a multiple
+ * of the element size, the remaining bytes are copied as is. Input and
+ * output must not overlap and must be of the same size.
+ *
+ * `delta_encode` replaces each element by its (wrapping) difference to
+ * the previous element and works in-place. It supports element sizes of
+ * 1, 2, 4 and 8 bytes.
+ */
+void byte_shuffle(std::span<uint8_t const> src, std::span<uint8_t> dst,
+                  size_t element_size);
+void byte_unshuffle(std::span<uint8_t const> src, std::span<uint8_t> dst,
+                    size_t element_size);
+
+void bit_shuffle(std::span<uint8_t const> src, std::span<uint8_t> dst,
+                 size_t element_size);
+void bit_unshuffle(std::span<uint8_t const> src, std::span<uint8_t> dst,
+                   size_t element_size);
+
+bool delta_supported(size_t element_size);
+void delta_encode(std::span<uint8_t> data, size_t element_size,
+                  std::endian byteorder);
+void delta_decode(std::span<uint8_t> data, size_t element_size,
+                  std::endian byteorder);
+
+} // namespace dwarfs
@@ -0,0 +1,79 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "dwarfs/types.h"
+
+namespace dwarfs {
+
+class inode_reader_v2;
+class logger;
+class metadata_v2;
+struct tree_scan_options;
+
+/**
+ * Detect and assist scans of the whole file system tree
+ *
+ * Tools like `tar` or `rsync` read all files in directory order, which
+ * usually differs from the order in which the data is stored in the image.
+ * This makes each block be accessed several times with lots of unrelated
+ * accesses in between, so with a cache smaller than the image, blocks get
+ * decompressed over and over again.
+ *
+ * Once many distinct files are opened in quick succession, the blocks of
+ * each opened file are held in memory after they have been decompressed
+ * until all files referencing them have been read to the end, up to a
+ * configurable amount of memory. Opening a file also starts decompression
+ * of its blocks in the order they're stored. The scan ends when all files
+ * have been read or when no files have been opened or read for a while.
+ */
+class tree_scan_tracker {
+ public:
+  tree_scan_tracker(logger& lgr, metadata_v2 const& meta,
+                    inode_reader_v2 const& ir, tree_scan_options const& opts);
+
+  void open(uint32_t inode) { impl_->open(inode); }
+
+  void read(uint32_t inode, file_off_t offset, size_t size) {
+    impl_->read(inode, offset, size);
+  }
+
+  bool active() const { return impl_->active(); }
+
+  class impl {
+   public:
+    virtual ~impl() = default;
+
+    virtual void open(uint32_t inode) = 0;
+    virtual void read(uint32_t inode, file_off_t offset, size_t size) = 0;
+    virtual bool active() const = 0;
+  };
+
+ private:
+  std::unique_ptr<impl> impl_;
+};
+
+} // namespace dwarfs
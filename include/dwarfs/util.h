@@ -27,6 +27,7 @@
 #include <span>
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include "dwarfs/types.h"
 
@@ -42,6 +43,7 @@ std::chrono::milliseconds parse_time_with_unit(std::string const& str);
 std::chrono::system_clock::time_point parse_time_point(std::string const& str);
 
 file_off_t parse_image_offset(std::string const& str);
+std::vector<int> parse_cpu_list(std::string_view str);
 
 inline std::u8string string_to_u8string(std::string const& in) {
   return std::u8string(reinterpret_cast<char8_t const*>(in.data()), in.size());
@@ -75,4 +77,12 @@ void setup_default_locale();
 
 std::string_view basename(std::string_view path);
 
+/**
+ * Match a path against a shell-style glob pattern
+ *
+ * `*`, `?` and `[...]` never match a `/`; `**` matches across
+ * directory boundaries.
+ */
+bool glob_match(std::string_view pattern, std::string_view path);
+
 } // namespace dwarfs
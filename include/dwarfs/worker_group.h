@@ -72,6 +72,13 @@ class worker_group {
   bool add_job(job_t&& job) { return impl_->add_job(std::move(job)); }
   size_t size() const { return impl_->size(); }
   size_t queue_size() const { return impl_->queue_size(); }
+  size_t idle_workers() const { return impl_->idle_workers(); }
+  size_t reserve_idle_workers(size_t max) {
+    return impl_->reserve_idle_workers(max);
+  }
+  void release_idle_workers(size_t count) {
+    impl_->release_idle_workers(count);
+  }
   folly::Expected<std::chrono::nanoseconds, std::error_code>
   get_cpu_time() const {
     return impl_->get_cpu_time();
@@ -95,6 +102,9 @@ class worker_group {
     virtual bool add_job(job_t&& job) = 0;
     virtual size_t size() const = 0;
     virtual size_t queue_size() const = 0;
+    virtual size_t idle_workers() const = 0;
+    virtual size_t reserve_idle_workers(size_t max) = 0;
+    virtual void release_idle_workers(size_t count) = 0;
     virtual folly::Expected<std::chrono::nanoseconds, std::error_code>
     get_cpu_time() const = 0;
     virtual bool set_affinity(std::vector<int> const& cpus) = 0;
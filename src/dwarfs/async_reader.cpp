@@ -0,0 +1,289 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <cstddef>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <mutex>
+
+#include <folly/ExceptionWrapper.h>
+#include <folly/Expected.h>
+#include <folly/String.h>
+#include <folly/Try.h>
+
+#include "dwarfs/async_reader.h"
+#include "dwarfs/filesystem_v2.h"
+#include "dwarfs/logger.h"
+#include "dwarfs/worker_group.h"
+
+namespace dwarfs {
+
+template <typename LoggerPolicy>
+class async_reader_ final : public async_reader::impl {
+ public:
+  using callback_type = async_reader::callback_type;
+
+  async_reader_(logger& lgr, os_access const& os, filesystem_v2 const& fs,
+                async_reader_options const& opts)
+      : LOG_PROXY_INIT(lgr)
+      , fs_{fs}
+      , notify_{opts.notify}
+      , wg_{lgr, os, "async", std::max<size_t>(opts.num_threads, 1)} {}
+
+  ~async_reader_() override {
+    {
+      std::unique_lock lock(mx_);
+      cond_.wait(lock, [this] { return unfinished_ == 0; });
+    }
+    wg_.wait();
+    wg_.stop();
+  }
+
+  void submit(async_read_request const& req, callback_type cb) override {
+    {
+      std::lock_guard lock(mx_);
+      ++in_flight_;
+      ++unfinished_;
+      if (!cb) {
+        ++queued_;
+      }
+    }
+
+    auto rs = std::make_shared<request_state>(req, std::move(cb));
+
+    // All block requests are handed to the block cache right away; the
+    // request is finished from the continuation of whichever range comes
+    // in last, so no thread is ever parked waiting for a block.
+    folly::Expected<size_t, int> count = folly::makeUnexpected(-EIO);
+
+    try {
+      count = fs_.readv(
+          req.inode, req.size, req.offset,
+          [this, rs](size_t index, folly::Try<block_range>&& range) {
+            add_range(this, rs, index, std::move(range));
+          });
+    } catch (...) {
+      LOG_ERROR << folly::exceptionStr(std::current_exception());
+    }
+
+    bool finished;
+
+    {
+      std::lock_guard lock(rs->mx);
+      rs->submitted = true;
+      if (count) {
+        rs->pending += static_cast<ptrdiff_t>(count.value());
+        rs->ranges.resize(count.value());
+      } else {
+        // Any ranges that were already requested will still come in,
+        // but they no longer matter
+        rs->error = count.error();
+        rs->pending = 0;
+      }
+      finished = rs->pending == 0;
+    }
+
+    if (finished) {
+      finish(rs);
+    }
+  }
+
+  size_t wait(std::vector<async_read_completion>& out, size_t min, size_t max,
+              std::optional<std::chrono::milliseconds> timeout) override {
+    std::unique_lock lock(mx_);
+
+    // Don't wait for more completions than can possibly arrive
+    auto ready = [&] { return done_.size() >= min || done_.size() == queued_; };
+
+    if (timeout) {
+      cond_.wait_for(lock, *timeout, ready);
+    } else {
+      cond_.wait(lock, ready);
+    }
+
+    auto count = std::min(max, done_.size());
+
+    std::move(done_.begin(), done_.begin() + count, std::back_inserter(out));
+    done_.erase(done_.begin(), done_.begin() + count);
+
+    queued_ -= count;
+    in_flight_ -= count;
+
+    return count;
+  }
+
+  size_t in_flight() const override {
+    std::lock_guard lock(mx_);
+    return in_flight_;
+  }
+
+ private:
+  struct request_state {
+    request_state(async_read_request const& r, callback_type&& c)
+        : req{r}
+        , cb{std::move(c)} {}
+
+    async_read_request const req;
+    callback_type cb;
+    std::mutex mx;
+    std::vector<block_range> ranges;
+    folly::exception_wrapper ex;
+    int error{0};
+    // Goes negative if ranges complete before the request has been fully
+    // submitted and the number of ranges is known
+    ptrdiff_t pending{0};
+    bool submitted{false};
+  };
+
+  // Runs on whatever thread completes the block, possibly with block cache
+  // locks held, so this must only record the result. Ranges of a request
+  // that failed to submit may still come in after the reader is gone,
+  // which is why `self` is only used to finish the request.
+  static void add_range(async_reader_* self,
+                        std::shared_ptr<request_state> const& rs, size_t index,
+                        folly::Try<block_range>&& range) {
+    bool finished;
+
+    {
+      std::lock_guard lock(rs->mx);
+
+      if (rs->submitted && rs->error != 0) {
+        return;
+      }
+
+      if (range.hasException()) {
+        if (!rs->ex) {
+          rs->ex = std::move(range.exception());
+        }
+      } else {
+        if (index >= rs->ranges.size()) {
+          rs->ranges.resize(index + 1);
+        }
+        rs->ranges[index] = std::move(range.value());
+      }
+
+      --rs->pending;
+      finished = rs->submitted && rs->pending == 0;
+    }
+
+    if (finished) {
+      self->finish(rs);
+    }
+  }
+
+  void finish(std::shared_ptr<request_state> const& rs) {
+    wg_.add_job([this, rs] { complete(rs->cb, collect(*rs)); });
+
+    {
+      std::lock_guard lock(mx_);
+      --unfinished_;
+    }
+
+    cond_.notify_all();
+  }
+
+  async_read_completion collect(request_state& rs) {
+    async_read_completion comp;
+    comp.user_data = rs.req.user_data;
+
+    if (rs.error != 0) {
+      comp.result = rs.error;
+      return comp;
+    }
+
+    if (rs.ex) {
+      LOG_ERROR << folly::exceptionStr(rs.ex);
+      comp.result = -EIO;
+      return comp;
+    }
+
+    auto dest = static_cast<uint8_t*>(rs.req.buffer);
+
+    for (auto& br : rs.ranges) {
+      comp.result += br.size();
+
+      if (dest) {
+        std::memcpy(dest, br.data(), br.size());
+        dest += br.size();
+      }
+    }
+
+    if (!dest) {
+      comp.ranges = std::move(rs.ranges);
+    }
+
+    return comp;
+  }
+
+  void complete(callback_type& cb, async_read_completion&& comp) {
+    if (cb) {
+      try {
+        cb(std::move(comp));
+      } catch (...) {
+        LOG_ERROR << "exception in read completion callback: "
+                  << folly::exceptionStr(std::current_exception());
+      }
+
+      std::lock_guard lock(mx_);
+      --in_flight_;
+
+      return;
+    }
+
+    bool was_empty;
+
+    {
+      std::lock_guard lock(mx_);
+      was_empty = done_.empty();
+      done_.push_back(std::move(comp));
+    }
+
+    cond_.notify_all();
+
+    if (was_empty && notify_) {
+      notify_();
+    }
+  }
+
+  LOG_PROXY_DECL(LoggerPolicy);
+  filesystem_v2 const& fs_;
+  std::function<void()> const notify_;
+  std::mutex mutable mx_;
+  std::condition_variable cond_;
+  std::deque<async_read_completion> done_;
+  size_t in_flight_{0};
+  size_t queued_{0};
+  size_t unfinished_{0};
+  worker_group wg_;
+};
+
+async_reader::async_reader(logger& lgr, os_access const& os,
+                           filesystem_v2 const& fs,
+                           async_reader_options const& opts)
+    : impl_(make_unique_logging_object<impl, async_reader_, logger_policies>(
+          lgr, os, fs, opts)) {}
+
+} // namespace dwarfs
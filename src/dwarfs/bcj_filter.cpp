@@ -0,0 +1,334 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <array>
+#include <ostream>
+#include <utility>
+
+#include <folly/lang/Assume.h>
+
+#include "dwarfs/bcj_filter.h"
+
+namespace dwarfs {
+
+namespace {
+
+// The algorithms below are modeled after the "simple" BCJ filters
+// in liblzma, so blocks filtered by one can be unfiltered by the other.
+
+constexpr std::array<std::pair<bcj_architecture, std::string_view>, 6> const
+    bcj_arch_names{{
+        {bcj_architecture::X86, "x86"},
+        {bcj_architecture::ARM, "arm"},
+        {bcj_architecture::ARMTHUMB, "armthumb"},
+        {bcj_architecture::ARM64, "arm64"},
+        {bcj_architecture::POWERPC, "powerpc"},
+        {bcj_architecture::SPARC, "sparc"},
+    }};
+
+constexpr std::array<bcj_architecture, bcj_arch_names.size()> const
+    bcj_arch_list{{
+        bcj_architecture::X86,
+        bcj_architecture::ARM,
+        bcj_architecture::ARMTHUMB,
+        bcj_architecture::ARM64,
+        bcj_architecture::POWERPC,
+        bcj_architecture::SPARC,
+    }};
+
+inline uint32_t load_le32(uint8_t const* p) {
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline void store_le32(uint8_t* p, uint32_t v) {
+  p[0] = static_cast<uint8_t>(v);
+  p[1] = static_cast<uint8_t>(v >> 8);
+  p[2] = static_cast<uint8_t>(v >> 16);
+  p[3] = static_cast<uint8_t>(v >> 24);
+}
+
+inline uint32_t load_be32(uint8_t const* p) {
+  return (static_cast<uint32_t>(p[0]) << 24) |
+         (static_cast<uint32_t>(p[1]) << 16) |
+         (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+inline void store_be32(uint8_t* p, uint32_t v) {
+  p[0] = static_cast<uint8_t>(v >> 24);
+  p[1] = static_cast<uint8_t>(v >> 16);
+  p[2] = static_cast<uint8_t>(v >> 8);
+  p[3] = static_cast<uint8_t>(v);
+}
+
+template <bool Encode>
+inline uint32_t convert(uint32_t src, uint32_t pos) {
+  if constexpr (Encode) {
+    return src + pos;
+  } else {
+    return src - pos;
+  }
+}
+
+template <bool Encode>
+void bcj_x86(std::span<uint8_t> data) {
+  static constexpr std::array<bool, 8> const kMaskToAllowedStatus{
+      true, true, true, false, true, false, false, false};
+  static constexpr std::array<uint32_t, 8> const kMaskToBitNumber{
+      0, 1, 2, 2, 3, 3, 3, 3};
+
+  auto test_ms_byte = [](uint8_t b) { return ((b + 1) & 0xFE) == 0; };
+
+  if (data.size() < 5) {
+    return;
+  }
+
+  auto buf = data.data();
+  uint32_t prev_mask = 0;
+  uint32_t prev_pos = static_cast<uint32_t>(-5);
+  size_t const limit = data.size() - 5;
+  size_t i = 0;
+
+  while (i <= limit) {
+    uint8_t b = buf[i];
+
+    if (b != 0xE8 && b != 0xE9) {
+      ++i;
+      continue;
+    }
+
+    uint32_t const pos = static_cast<uint32_t>(i);
+    uint32_t const offset = pos - prev_pos;
+    prev_pos = pos;
+
+    if (offset > 5) {
+      prev_mask = 0;
+    } else {
+      for (uint32_t k = 0; k < offset; ++k) {
+        prev_mask &= 0x77;
+        prev_mask <<= 1;
+      }
+    }
+
+    b = buf[i + 4];
+
+    if (test_ms_byte(b) && kMaskToAllowedStatus[(prev_mask >> 1) & 0x7] &&
+        (prev_mask >> 1) < 0x10) {
+      uint32_t src = load_le32(&buf[i + 1]);
+      uint32_t dest;
+
+      for (;;) {
+        dest = convert<Encode>(src, pos + 5);
+
+        if (prev_mask == 0) {
+          break;
+        }
+
+        uint32_t const bit = kMaskToBitNumber[prev_mask >> 1];
+        b = static_cast<uint8_t>(dest >> (24 - bit * 8));
+
+        if (!test_ms_byte(b)) {
+          break;
+        }
+
+        src = dest ^ ((UINT32_C(1) << (32 - bit * 8)) - 1);
+      }
+
+      dest &= 0x01FFFFFF;
+      dest |= 0 - (dest & 0x01000000);
+      store_le32(&buf[i + 1], dest);
+      i += 5;
+      prev_mask = 0;
+    } else {
+      ++i;
+      prev_mask |= 1;
+      if (test_ms_byte(b)) {
+        prev_mask |= 0x10;
+      }
+    }
+  }
+}
+
+template <bool Encode>
+void bcj_arm(std::span<uint8_t> data) {
+  auto buf = data.data();
+
+  for (size_t i = 0; i + 4 <= data.size(); i += 4) {
+    if (buf[i + 3] == 0xEB) {
+      uint32_t src = (load_le32(&buf[i]) & 0x00FFFFFF) << 2;
+      uint32_t dest = convert<Encode>(src, static_cast<uint32_t>(i) + 8) >> 2;
+      buf[i + 2] = static_cast<uint8_t>(dest >> 16);
+      buf[i + 1] = static_cast<uint8_t>(dest >> 8);
+      buf[i + 0] = static_cast<uint8_t>(dest);
+    }
+  }
+}
+
+template <bool Encode>
+void bcj_armthumb(std::span<uint8_t> data) {
+  auto buf = data.data();
+
+  for (size_t i = 0; i + 4 <= data.size(); i += 2) {
+    if ((buf[i + 1] & 0xF8) == 0xF0 && (buf[i + 3] & 0xF8) == 0xF8) {
+      uint32_t src = ((static_cast<uint32_t>(buf[i + 1]) & 7) << 19) |
+                     (static_cast<uint32_t>(buf[i + 0]) << 11) |
+                     ((static_cast<uint32_t>(buf[i + 3]) & 7) << 8) |
+                     static_cast<uint32_t>(buf[i + 2]);
+      src <<= 1;
+      uint32_t dest = convert<Encode>(src, static_cast<uint32_t>(i) + 4) >> 1;
+      buf[i + 1] = static_cast<uint8_t>(0xF0 | ((dest >> 19) & 0x7));
+      buf[i + 0] = static_cast<uint8_t>(dest >> 11);
+      buf[i + 3] = static_cast<uint8_t>(0xF8 | ((dest >> 8) & 0x7));
+      buf[i + 2] = static_cast<uint8_t>(dest);
+      i += 2;
+    }
+  }
+}
+
+template <bool Encode>
+void bcj_arm64(std::span<uint8_t> data) {
+  auto buf = data.data();
+
+  for (size_t i = 0; i + 4 <= data.size(); i += 4) {
+    uint32_t pc = static_cast<uint32_t>(i);
+    uint32_t instr = load_le32(&buf[i]);
+
+    if ((instr >> 26) == 0x25) {
+      // BL
+      uint32_t const src = instr;
+      pc >>= 2;
+      if constexpr (!Encode) {
+        pc = 0U - pc;
+      }
+      instr = 0x94000000 | ((src + pc) & 0x03FFFFFF);
+      store_le32(&buf[i], instr);
+    } else if ((instr & 0x9F000000) == 0x90000000) {
+      // ADRP
+      uint32_t const src = ((instr >> 29) & 3) | ((instr >> 3) & 0x001FFFFC);
+
+      // Only convert values in the range +/-512 MiB, like liblzma.
+      if ((src + 0x00020000) & 0x001C0000) {
+        continue;
+      }
+
+      pc >>= 12;
+      if constexpr (!Encode) {
+        pc = 0U - pc;
+      }
+
+      uint32_t const dest = src + pc;
+      instr &= 0x9000001F;
+      instr |= (dest & 3) << 29;
+      instr |= (dest & 0x0003FFFC) << 3;
+      instr |= (0U - (dest & 0x00020000)) & 0x00E00000;
+      store_le32(&buf[i], instr);
+    }
+  }
+}
+
+template <bool Encode>
+void bcj_powerpc(std::span<uint8_t> data) {
+  auto buf = data.data();
+
+  for (size_t i = 0; i + 4 <= data.size(); i += 4) {
+    if ((buf[i] >> 2) == 0x12 && (buf[i + 3] & 3) == 1) {
+      uint32_t src = load_be32(&buf[i]) & 0x03FFFFFC;
+      uint32_t dest = convert<Encode>(src, static_cast<uint32_t>(i));
+      buf[i + 0] = static_cast<uint8_t>(0x48 | ((dest >> 24) & 0x03));
+      buf[i + 1] = static_cast<uint8_t>(dest >> 16);
+      buf[i + 2] = static_cast<uint8_t>(dest >> 8);
+      buf[i + 3] = static_cast<uint8_t>((buf[i + 3] & 0x03) | (dest & 0xFC));
+    }
+  }
+}
+
+template <bool Encode>
+void bcj_sparc(std::span<uint8_t> data) {
+  auto buf = data.data();
+
+  for (size_t i = 0; i + 4 <= data.size(); i += 4) {
+    if ((buf[i] == 0x40 && (buf[i + 1] & 0xC0) == 0x00) ||
+        (buf[i] == 0x7F && (buf[i + 1] & 0xC0) == 0xC0)) {
+      uint32_t src = load_be32(&buf[i]) << 2;
+      uint32_t dest = convert<Encode>(src, static_cast<uint32_t>(i)) >> 2;
+      dest = (((0 - ((dest >> 22) & 1)) << 22) & 0x3FFFFFFF) |
+             (dest & 0x3FFFFF) | 0x40000000;
+      store_be32(&buf[i], dest);
+    }
+  }
+}
+
+template <bool Encode>
+void bcj_filter(bcj_architecture arch, std::span<uint8_t> data) {
+  switch (arch) {
+  case bcj_architecture::X86:
+    return bcj_x86<Encode>(data);
+  case bcj_architecture::ARM:
+    return bcj_arm<Encode>(data);
+  case bcj_architecture::ARMTHUMB:
+    return bcj_armthumb<Encode>(data);
+  case bcj_architecture::ARM64:
+    return bcj_arm64<Encode>(data);
+  case bcj_architecture::POWERPC:
+    return bcj_powerpc<Encode>(data);
+  case bcj_architecture::SPARC:
+    return bcj_sparc<Encode>(data);
+  }
+
+  folly::assume_unreachable();
+}
+
+} // namespace
+
+std::span<bcj_architecture const> bcj_architectures() { return bcj_arch_list; }
+
+std::string_view bcj_architecture_name(bcj_architecture arch) {
+  for (auto const& [a, name] : bcj_arch_names) {
+    if (a == arch) {
+      return name;
+    }
+  }
+  return "unknown";
+}
+
+std::optional<bcj_architecture> parse_bcj_architecture(std::string_view name) {
+  for (auto const& [arch, n] : bcj_arch_names) {
+    if (n == name) {
+      return arch;
+    }
+  }
+  return std::nullopt;
+}
+
+std::ostream& operator<<(std::ostream& os, bcj_architecture arch) {
+  return os << bcj_architecture_name(arch);
+}
+
+void bcj_encode(bcj_architecture arch, std::span<uint8_t> data) {
+  bcj_filter<true>(arch, data);
+}
+
+void bcj_decode(bcj_architecture arch, std::span<uint8_t> data) {
+  bcj_filter<false>(arch, data);
+}
+
+} // namespace dwarfs
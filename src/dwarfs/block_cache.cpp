@@ -20,36 +20,51 @@
  */
 
 #include <algorithm>
+#include <array>
 #include <atomic>
 #include <cassert>
 #include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <exception>
+#include <functional>
 #include <future>
 #include <iterator>
+#include <list>
 #include <mutex>
 #include <new>
+#include <optional>
 #include <shared_mutex>
+#include <string_view>
+#include <system_error>
 #include <thread>
 #include <utility>
 #include <vector>
 
 #include <fmt/format.h>
 
+#include <folly/ExceptionString.h>
+#include <folly/ExceptionWrapper.h>
 #include <folly/ScopeGuard.h>
+#include <folly/Try.h>
 #include <folly/container/EvictingCacheMap.h>
 #include <folly/container/F14Map.h>
+#include <folly/small_vector.h>
 #include <folly/stats/Histogram.h>
 #include <folly/system/HardwareConcurrency.h>
 #include <folly/system/ThreadName.h>
 
 #include "dwarfs/block_cache.h"
+#include "dwarfs/block_reader.h"
+#include "dwarfs/cache_policy.h"
 #include "dwarfs/cached_block.h"
 #include "dwarfs/fs_section.h"
 #include "dwarfs/logger.h"
 #include "dwarfs/mmif.h"
+#include "dwarfs/os_access.h"
 #include "dwarfs/options.h"
 #include "dwarfs/performance_monitor.h"
+#include "dwarfs/util.h"
 #include "dwarfs/worker_group.h"
 
 namespace dwarfs {
@@ -126,11 +141,50 @@ class lru_sequential_access_detector : public sequential_access_detector {
   size_t const seq_blocks_;
 };
 
+// Delivers a block range either through a future or a continuation
+class range_promise {
+ public:
+  range_promise() = default;
+
+  explicit range_promise(block_range_continuation&& cont)
+      : cont_{std::move(cont)} {}
+
+  explicit range_promise(folly::CancellationToken&& cancel)
+      : cancel_{std::move(cancel)} {}
+
+  std::future<block_range> get_future() { return promise_.get_future(); }
+
+  // True if the requester has lost interest in the result
+  bool canceled() const { return cancel_.isCancellationRequested(); }
+
+  void set_value(block_range&& range) {
+    // The continuation must only ever be called once, even if it throws
+    if (auto cont = std::exchange(cont_, nullptr)) {
+      cont(folly::Try<block_range>(std::move(range)));
+    } else {
+      promise_.set_value(std::move(range));
+    }
+  }
+
+  void set_exception(std::exception_ptr error) {
+    if (auto cont = std::exchange(cont_, nullptr)) {
+      cont(folly::Try<block_range>(folly::exception_wrapper(error)));
+    } else {
+      promise_.set_exception(std::move(error));
+    }
+  }
+
+ private:
+  std::promise<block_range> promise_;
+  block_range_continuation cont_;
+  folly::CancellationToken cancel_;
+};
+
 class block_request {
  public:
   block_request() = default;
 
-  block_request(size_t begin, size_t end, std::promise<block_range>&& promise)
+  block_request(size_t begin, size_t end, range_promise&& promise)
       : begin_(begin)
       , end_(end)
       , promise_(std::move(promise)) {
@@ -144,6 +198,8 @@ class block_request {
 
   size_t end() const { return end_; }
 
+  bool canceled() const { return promise_.canceled(); }
+
   void fulfill(std::shared_ptr<cached_block const> block) {
     promise_.set_value(block_range(std::move(block), begin_, end_ - begin_));
   }
@@ -153,21 +209,23 @@ class block_request {
  private:
   size_t begin_{0};
   size_t end_{0};
-  std::promise<block_range> promise_;
+  range_promise promise_;
 };
 
 class block_request_set {
  public:
-  block_request_set(std::shared_ptr<cached_block> block, size_t block_no)
+  block_request_set(std::shared_ptr<cached_block> block, size_t block_no,
+                    size_t node)
       : range_end_(0)
       , block_(std::move(block))
-      , block_no_(block_no) {}
+      , block_no_(block_no)
+      , node_(node) {}
 
   ~block_request_set() { assert(queue_.empty()); }
 
   size_t range_end() const { return range_end_; }
 
-  void add(size_t begin, size_t end, std::promise<block_range>&& promise) {
+  void add(size_t begin, size_t end, range_promise&& promise) {
     if (end > range_end_) {
       range_end_ = end;
     }
@@ -192,17 +250,297 @@ class block_request_set {
     return tmp;
   }
 
+  void cancel(std::exception_ptr error) {
+    for (auto& req : queue_) {
+      req.error(error);
+    }
+    queue_.clear();
+  }
+
+  // Drop all requests whose requesters have lost interest
+  size_t drop_canceled() {
+    auto it = std::partition(queue_.begin(), queue_.end(),
+                             [](auto const& req) { return !req.canceled(); });
+    size_t const count = std::distance(it, queue_.end());
+
+    if (count > 0) {
+      auto error = std::make_exception_ptr(runtime_error(
+          fmt::format("request for block {} canceled", block_no_), __FILE__,
+          __LINE__));
+
+      for (auto i = it; i != queue_.end(); ++i) {
+        i->error(error);
+      }
+
+      queue_.erase(it, queue_.end());
+      std::make_heap(queue_.begin(), queue_.end());
+    }
+
+    return count;
+  }
+
   bool empty() const { return queue_.empty(); }
 
   std::shared_ptr<cached_block> block() const { return block_; }
 
   size_t block_no() const { return block_no_; }
 
+  size_t node() const { return node_; }
+
+  block_request_priority priority() const { return priority_; }
+
+  void set_priority(block_request_priority prio) { priority_ = prio; }
+
  private:
   std::vector<block_request> queue_;
   size_t range_end_;
   std::shared_ptr<cached_block> block_;
   const size_t block_no_;
+  const size_t node_;
+  block_request_priority priority_{block_request_priority::DEMAND};
+};
+
+// cached blocks, managed by a replacement policy
+class cached_block_map {
+ public:
+  using prune_hook_type =
+      std::function<void(size_t, std::shared_ptr<cached_block>&&)>;
+
+  cached_block_map(cache_replacement_policy policy, size_t max_blocks,
+                   size_t num_blocks, prune_hook_type prune_hook = {})
+      : policy_{policy, max_blocks, num_blocks}
+      , prune_hook_{std::move(prune_hook)} {}
+
+  bool exists(size_t block_no) const { return blocks_.contains(block_no); }
+
+  std::shared_ptr<cached_block> find(size_t block_no) {
+    if (policy_.access(block_no)) {
+      return blocks_.at(block_no);
+    }
+    return nullptr;
+  }
+
+  void set(size_t block_no, std::shared_ptr<cached_block> block) {
+    if (auto it = blocks_.find(block_no); it != blocks_.end()) {
+      it->second = std::move(block);
+      policy_.touch(block_no);
+      return;
+    }
+
+    blocks_.emplace(block_no, std::move(block));
+
+    evicted_.clear();
+    policy_.insert(block_no, evicted_);
+
+    for (auto evicted_no : evicted_) {
+      auto it = blocks_.find(evicted_no);
+      auto evicted_block = std::move(it->second);
+      blocks_.erase(it);
+
+      if (prune_hook_) {
+        prune_hook_(evicted_no, std::move(evicted_block));
+      }
+    }
+  }
+
+  bool erase(size_t block_no) {
+    if (blocks_.erase(block_no) > 0) {
+      policy_.erase(block_no);
+      return true;
+    }
+    return false;
+  }
+
+  template <typename Func>
+  void for_each(Func const& func) const {
+    for (auto const& [block_no, block] : blocks_) {
+      func(block_no, *block);
+    }
+  }
+
+  template <typename Pred, typename Func>
+  size_t remove_if(Pred const& predicate, Func const& on_remove) {
+    size_t removed = 0;
+
+    for (auto it = blocks_.begin(); it != blocks_.end();) {
+      if (predicate(*it->second)) {
+        on_remove(it->first, *it->second);
+        policy_.erase(it->first);
+        it = blocks_.erase(it);
+        ++removed;
+      } else {
+        ++it;
+      }
+    }
+
+    return removed;
+  }
+
+ private:
+  cache_policy policy_;
+  folly::F14FastMap<size_t, std::shared_ptr<cached_block>> blocks_;
+  std::vector<size_t> evicted_;
+  prune_hook_type prune_hook_;
+};
+
+// Small extents of blocks that have been accessed recently. When a block
+// is evicted, its hot extents are copied and retained within a separate
+// byte budget, so re-reading e.g. a small file packed into a large block
+// doesn't require decompressing the whole block again.
+class range_cache {
+ public:
+  static constexpr size_t kMaxHotExtents{8};
+  static constexpr size_t kMinHotBlocks{64};
+
+  range_cache(size_t max_bytes, size_t max_extent)
+      : max_bytes_{max_bytes}
+      , max_extent_{std::min(max_extent, max_bytes)}
+      , hot_{kMinHotBlocks} {}
+
+  bool enabled() const { return max_bytes_ > 0; }
+
+  // Hot extents only matter for blocks that can still be in the cache,
+  // so only track the most recently accessed blocks
+  void set_max_hot_blocks(size_t max_blocks) {
+    hot_.setMaxSize(std::max(max_blocks, kMinHotBlocks));
+  }
+
+  size_t size() const { return lru_.size(); }
+  size_t bytes() const { return bytes_; }
+
+  // Record an access to a block
+  void touch(size_t block_no, size_t begin, size_t end) {
+    if (end - begin > max_extent_) {
+      return;
+    }
+
+    auto ih = hot_.find(block_no);
+
+    if (ih == hot_.end()) {
+      hot_.set(block_no, {});
+      ih = hot_.find(block_no);
+    }
+
+    auto& hot = ih->second;
+    extent ext{begin, end};
+
+    // Merge with all overlapping or adjacent extents
+    for (auto it = hot.begin(); it != hot.end();) {
+      if (it->begin <= ext.end && ext.begin <= it->end) {
+        ext.begin = std::min(ext.begin, it->begin);
+        ext.end = std::max(ext.end, it->end);
+        it = hot.erase(it);
+      } else {
+        ++it;
+      }
+    }
+
+    if (ext.end - ext.begin > max_extent_) {
+      // Not small anymore, so not worth retaining
+      return;
+    }
+
+    if (hot.size() >= kMaxHotExtents) {
+      hot.erase(hot.begin());
+    }
+
+    hot.push_back(ext);
+  }
+
+  // Retain the hot extents of a block that is about to be dropped
+  void retain(size_t block_no, cached_block const& block) {
+    auto ih = hot_.findWithoutPromotion(block_no);
+
+    if (ih == hot_.end()) {
+      return;
+    }
+
+    drop(block_no);
+
+    auto& index = index_[block_no];
+
+    for (auto const& ext : ih->second) {
+      if (ext.end <= block.range_end()) {
+        auto data = std::make_shared<std::vector<uint8_t>>(
+            block.data() + ext.begin, block.data() + ext.end);
+        bytes_ += data->size();
+        lru_.push_front({block_no, ext.begin, std::move(data)});
+        index.push_back(lru_.begin());
+      }
+    }
+
+    hot_.erase(block_no);
+
+    if (index.empty()) {
+      index_.erase(block_no);
+    }
+
+    while (bytes_ > max_bytes_) {
+      evict_oldest();
+    }
+  }
+
+  // Drop all retained extents of a block
+  void drop(size_t block_no) {
+    if (auto ii = index_.find(block_no); ii != index_.end()) {
+      for (auto it : ii->second) {
+        bytes_ -= it->data->size();
+        lru_.erase(it);
+      }
+      index_.erase(ii);
+    }
+  }
+
+  std::optional<block_range> find(size_t block_no, size_t offset, size_t size) {
+    if (auto ii = index_.find(block_no); ii != index_.end()) {
+      for (auto it : ii->second) {
+        if (it->begin <= offset &&
+            offset + size <= it->begin + it->data->size()) {
+          lru_.splice(lru_.begin(), lru_, it);
+          return block_range(it->data, offset - it->begin, size);
+        }
+      }
+    }
+
+    return std::nullopt;
+  }
+
+ private:
+  struct extent {
+    size_t begin;
+    size_t end;
+  };
+
+  struct retained_extent {
+    size_t block_no;
+    size_t begin;
+    std::shared_ptr<std::vector<uint8_t> const> data;
+  };
+
+  using lru_type = std::list<retained_extent>;
+
+  void evict_oldest() {
+    auto it = std::prev(lru_.end());
+    auto ii = index_.find(it->block_no);
+    auto& index = ii->second;
+
+    index.erase(std::find(index.begin(), index.end(), it));
+
+    if (index.empty()) {
+      index_.erase(ii);
+    }
+
+    bytes_ -= it->data->size();
+    lru_.erase(it);
+  }
+
+  size_t const max_bytes_;
+  size_t const max_extent_;
+  size_t bytes_{0};
+  lru_type lru_;
+  folly::F14FastMap<size_t, folly::small_vector<lru_type::iterator, 4>> index_;
+  folly::EvictingCacheMap<size_t, folly::small_vector<extent, kMaxHotExtents>>
+      hot_;
 };
 
 // multi-threaded block cache
@@ -213,24 +551,40 @@ class block_cache_ final : public block_cache::impl {
                block_cache_options const& options,
                std::shared_ptr<performance_monitor const> perfmon
                [[maybe_unused]])
-      : cache_(0)
+      : range_cache_{options.range_cache_max_bytes,
+                     options.range_cache_max_extent}
       , mm_(std::move(mm))
       , LOG_PROXY_INIT(lgr)
       // clang-format off
       PERFMON_CLS_PROXY_INIT(perfmon, "block_cache")
       PERFMON_CLS_TIMER_INIT(get, "block_no", "offset", "size")
       PERFMON_CLS_TIMER_INIT(process, "block_no")
-      PERFMON_CLS_TIMER_INIT(decompress, "range_end") // clang-format on
+      PERFMON_CLS_TIMER_INIT(decompress, "range_end")
+      PERFMON_CLS_TIMER_INIT(demand_queue) // clang-format on
       , seq_access_detector_{create_seq_access_detector(
             options.sequential_access_detector_threshold)}
       , os_{os}
       , options_(options) {
+    if (options.numa_aware) {
+      init_numa_nodes();
+    }
+
+    for (size_t i = 0; i < num_nodes(); ++i) {
+      cache_.emplace_back(cache_replacement_policy::LRU, 0, 0);
+    }
+
+    sched_queue_.resize(num_nodes());
+
+    if (options.io_mode == block_io_mode::PREAD) {
+      reader_ = std::make_shared<block_reader>(lgr, mm_,
+                                               options.io_max_request_size);
+    }
+
     if (options.init_workers) {
-      wg_ = worker_group(lgr, os_, "blkcache",
-                         std::max(options.num_workers > 0
-                                      ? options.num_workers
-                                      : folly::hardware_concurrency(),
-                                  static_cast<size_t>(1)));
+      create_workers(std::max(options.num_workers > 0
+                                  ? options.num_workers
+                                  : folly::hardware_concurrency(),
+                              static_cast<size_t>(1)));
     }
   }
 
@@ -241,8 +595,8 @@ class block_cache_ final : public block_cache::impl {
       stop_tidy_thread();
     }
 
-    if (wg_) {
-      wg_.stop();
+    for (auto& wg : wg_) {
+      wg.stop();
     }
 
     if (!blocks_created_.load()) {
@@ -251,15 +605,20 @@ class block_cache_ final : public block_cache::impl {
 
     LOG_DEBUG << "cached blocks:";
 
-    for (const auto& cb : cache_) {
-      LOG_DEBUG << "  block " << cb.first << ", decompression ratio = "
-                << double(cb.second->range_end()) /
-                       double(cb.second->uncompressed_size());
-      update_block_stats(*cb.second);
+    for (auto const& cache : cache_) {
+      cache.for_each([this](size_t block_no, cached_block const& block) {
+        LOG_DEBUG << "  block " << block_no << ", decompression ratio = "
+                  << double(block.range_end()) /
+                         double(block.uncompressed_size());
+        update_block_stats(block);
+      });
     }
 
     double fast_hit_rate =
-        100.0 * (active_hits_fast_ + cache_hits_fast_) / range_requests_;
+        100.0 *
+        (active_hits_fast_ + cache_hits_fast_ + pinned_hits_ +
+         range_cache_hits_) /
+        range_requests_;
     double slow_hit_rate =
         100.0 * (active_hits_slow_ + cache_hits_slow_) / range_requests_;
     double miss_rate = 100.0 - (fast_hit_rate + slow_hit_rate);
@@ -281,6 +640,27 @@ class block_cache_ final : public block_cache::impl {
     LOG_VERBOSE << "cache hits (fast): " << cache_hits_fast_.load();
     LOG_VERBOSE << "cache hits (slow): " << cache_hits_slow_.load();
 
+    if (held_hits_.load() > 0 || scan_prefetches_.load() > 0) {
+      LOG_VERBOSE << "held block hits: " << held_hits_.load();
+      LOG_VERBOSE << "scan prefetches: " << scan_prefetches_.load();
+    }
+
+    if (!pinned_.empty()) {
+      LOG_VERBOSE << "pinned blocks: " << pinned_.size() << " ("
+                  << size_with_unit(pinned_bytes_) << ")";
+      LOG_VERBOSE << "pinned hits: " << pinned_hits_.load();
+    }
+
+    if (range_cache_.enabled()) {
+      LOG_VERBOSE << "range cache hits: " << range_cache_hits_.load();
+      LOG_VERBOSE << "retained extents: " << range_cache_.size() << " ("
+                  << size_with_unit(range_cache_.bytes()) << ")";
+    }
+
+    if (num_nodes() > 1) {
+      LOG_VERBOSE << "cache hits (remote node): " << cache_hits_remote_.load();
+    }
+
     LOG_VERBOSE << "total bytes decompressed: " << total_decompressed_bytes_;
     LOG_VERBOSE << "average block decompression: "
                 << fmt::format("{:.1f}", avg_decompression) << "%";
@@ -293,6 +673,28 @@ class block_cache_ final : public block_cache::impl {
 
     LOG_VERBOSE << "expired active requests: " << active_expired_.load();
 
+    LOG_VERBOSE << "dispatched requests: "
+                << dispatched_[priority_index(block_request_priority::DEMAND)]
+                << " demand, "
+                << dispatched_[priority_index(
+                       block_request_priority::READAHEAD)]
+                << " readahead, "
+                << dispatched_[priority_index(
+                       block_request_priority::PREFETCH)]
+                << " prefetch";
+    LOG_VERBOSE << "promoted requests: " << promoted_requests_;
+    LOG_VERBOSE << "canceled speculative requests: " << canceled_requests_;
+    LOG_VERBOSE << "canceled demand requests: "
+                << canceled_demand_requests_.load();
+
+    auto delay_pct = [&](double p) {
+      return demand_queue_delay_.getPercentileEstimate(p);
+    };
+
+    LOG_VERBOSE << "demand queueing delay [us] p50: " << delay_pct(0.5)
+                << ", p75: " << delay_pct(0.75) << ", p90: " << delay_pct(0.9)
+                << ", p95: " << delay_pct(0.95) << ", p99: " << delay_pct(0.99);
+
     auto active_pct = [&](double p) {
       return active_set_size_.getPercentileEstimate(p);
     };
@@ -321,28 +723,45 @@ class block_cache_ final : public block_cache::impl {
       max_blocks = block_.size();
     }
 
+    // Each NUMA node gets its own share of the cache
+    auto const max_node_blocks = std::max<size_t>(max_blocks / num_nodes(), 1);
+
+    LOG_VERBOSE << "using " << options_.replacement_policy
+                << " cache replacement policy for " << max_blocks << " blocks";
+
     std::lock_guard lock(mx_);
-    cache_.~lru_type();
-    new (&cache_) lru_type(max_blocks);
-    cache_.setPruneHook(
-        [this](size_t block_no, std::shared_ptr<cached_block>&& block) {
-          LOG_DEBUG << "evicting block " << block_no
-                    << " from cache, decompression ratio = "
-                    << double(block->range_end()) /
-                           double(block->uncompressed_size());
-          blocks_evicted_.fetch_add(1, std::memory_order_relaxed);
-          update_block_stats(*block);
-        });
+    cache_.clear();
+    range_cache_.set_max_hot_blocks(2 * max_blocks);
+
+    for (size_t i = 0; i < num_nodes(); ++i) {
+      cache_.emplace_back(
+          options_.replacement_policy, max_node_blocks, block_.size(),
+          [this](size_t block_no, std::shared_ptr<cached_block>&& block) {
+            LOG_DEBUG << "evicting block " << block_no
+                      << " from cache, decompression ratio = "
+                      << double(block->range_end()) /
+                             double(block->uncompressed_size());
+            blocks_evicted_.fetch_add(1, std::memory_order_relaxed);
+            update_block_stats(*block);
+            // Speculatively decompressing the block would only bring it
+            // back into the cache right after the policy evicted it
+            cancel_speculative_jobs(block_no, "evicted");
+            if (range_cache_.enabled()) {
+              range_cache_.retain(block_no, *block);
+            }
+          });
+    }
   }
 
   void set_num_workers(size_t num) override {
     std::unique_lock lock(mx_wg_);
 
-    if (wg_) {
-      wg_.stop();
+    for (auto& wg : wg_) {
+      wg.stop();
     }
 
-    wg_ = worker_group(LOG_GET_LOGGER, os_, "blkcache", num);
+    wg_.clear();
+    create_workers(num);
   }
 
   void set_tidy_config(cache_tidy_config const& cfg) override {
@@ -369,29 +788,240 @@ class block_cache_ final : public block_cache::impl {
   }
 
   std::future<block_range>
-  get(size_t block_no, size_t offset, size_t size) const override {
+  get(size_t block_no, size_t offset, size_t size, block_request_priority prio,
+      folly::CancellationToken cancel) const override {
+    range_promise promise{std::move(cancel)};
+    auto future = promise.get_future();
+    request(block_no, offset, size, std::move(promise), prio);
+    return future;
+  }
+
+  void get(size_t block_no, size_t offset, size_t size,
+           block_range_continuation cont,
+           block_request_priority prio) const override {
+    request(block_no, offset, size, range_promise{std::move(cont)}, prio);
+  }
+
+  void hold(std::span<size_t const> blocks) const override {
+    std::lock_guard lock(mx_);
+
+    for (auto block_no : blocks) {
+      auto& held = held_[block_no];
+
+      if (held.count++ == 0) {
+        // Take over the block if it's already in the cache
+        for (size_t node = 0; node < cache_.size(); ++node) {
+          if (cache_[node].exists(block_no)) {
+            held.block = cache_[node].find(block_no);
+            held.node = node;
+            cache_[node].erase(block_no);
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  void unhold(std::span<size_t const> blocks) const override {
+    std::lock_guard lock(mx_);
+
+    for (auto block_no : blocks) {
+      auto it = held_.find(block_no);
+
+      if (it == held_.end()) {
+        continue;
+      }
+
+      if (--it->second.count == 0) {
+        if (auto& block = it->second.block) {
+          // Back to being a regular cached block
+          cache_[it->second.node].set(block_no, std::move(block));
+        }
+
+        held_.erase(it);
+      }
+    }
+  }
+
+  void prefetch(std::span<size_t const> blocks) const override {
+    auto const node = current_node();
+
+    std::lock_guard lock(mx_);
+
+    for (auto block_no : blocks) {
+      if (!needs_prefetch(block_no)) {
+        continue;
+      }
+
+      create_cached_block(block_no, range_promise{}, 0,
+                          std::numeric_limits<size_t>::max(),
+                          block_request_priority::PREFETCH, node);
+      scan_prefetches_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  void pin(std::vector<size_t> const& blocks) override {
+    std::vector<size_t> todo;
+
+    {
+      std::lock_guard lock(mx_);
+
+      for (auto block_no : blocks) {
+        if (block_no >= block_.size()) {
+          DWARFS_THROW(runtime_error,
+                       fmt::format("block number out of range {0} >= {1}",
+                                   block_no, block_.size()));
+        }
+
+        // Uncompressed blocks bypass the cache anyway
+        if (block_[block_no].compression() == compression_type::NONE) {
+          continue;
+        }
+
+        if (pinned_.emplace(block_no, nullptr).second) {
+          todo.push_back(block_no);
+        }
+      }
+
+      pins_pending_ += todo.size();
+    }
+
+    if (todo.empty()) {
+      return;
+    }
+
+    LOG_VERBOSE << "pinning " << todo.size() << " blocks";
+
+    std::shared_lock lock(mx_wg_);
+
+    if (wg_.empty()) {
+      DWARFS_THROW(runtime_error, "cannot pin blocks without workers");
+    }
+
+    for (auto block_no : todo) {
+      wg_[block_no % wg_.size()].add_job(
+          [this, block_no] { pin_block(block_no); });
+    }
+  }
+
+ private:
+  static std::unique_ptr<sequential_access_detector>
+  create_seq_access_detector(size_t threshold) {
+    if (threshold == 0) {
+      return std::make_unique<no_sequential_access_detector>();
+    }
+
+    return std::make_unique<lru_sequential_access_detector>(threshold);
+  }
+
+  void init_numa_nodes() {
+    auto topology = os_.numa_node_cpus();
+    std::vector<int> node_index(topology.size(), -1);
+    std::vector<std::vector<int>> node_cpus;
+
+    // Memory-only nodes cannot run workers and are ignored
+    for (size_t i = 0; i < topology.size(); ++i) {
+      if (!topology[i].empty()) {
+        node_index[i] = static_cast<int>(node_cpus.size());
+        node_cpus.push_back(std::move(topology[i]));
+      }
+    }
+
+    if (node_cpus.size() < 2) {
+      LOG_VERBOSE << "found " << node_cpus.size()
+                  << " NUMA node(s) with CPUs, not using NUMA mode";
+      return;
+    }
+
+    LOG_VERBOSE << "using NUMA mode with " << node_cpus.size() << " nodes";
+
+    node_index_ = std::move(node_index);
+    node_cpus_ = std::move(node_cpus);
+  }
+
+  size_t num_nodes() const { return std::max<size_t>(node_cpus_.size(), 1); }
+
+  // Must be called with `mx_wg_` held or from the constructor.
+  void create_workers(size_t num) {
+    if (node_cpus_.empty()) {
+      wg_.emplace_back(LOG_GET_LOGGER, os_, "blkcache", num);
+      return;
+    }
+
+    // Each node gets its own workers, pinned to the node's CPUs, so blocks
+    // are decompressed into node-local memory. Without an explicit number
+    // of workers, there's one worker per CPU.
+    auto const per_node = std::max<size_t>(num / node_cpus_.size(), 1);
+
+    for (auto const& cpus : node_cpus_) {
+      auto& wg = wg_.emplace_back(LOG_GET_LOGGER, os_, "blkcache",
+                                  num > 0 ? per_node : cpus.size());
+
+      if (!wg.set_affinity(cpus)) {
+        LOG_WARN << "failed to pin block cache workers to NUMA node";
+      }
+    }
+  }
+
+  size_t current_node() const {
+    if (node_cpus_.empty()) {
+      return 0;
+    }
+
+    std::error_code ec;
+    auto node = os_.current_numa_node(ec);
+
+    if (ec || node < 0 || static_cast<size_t>(node) >= node_index_.size() ||
+        node_index_[node] < 0) {
+      return 0;
+    }
+
+    return node_index_[node];
+  }
+
+  // Prefer the local node, but a block cached on another node is still
+  // a lot cheaper than decompressing it again. Must be called with `mx_`
+  // held.
+  size_t find_cache_node(size_t block_no, size_t node) const {
+    if (cache_[node].exists(block_no)) {
+      return node;
+    }
+
+    for (size_t i = 0; i < cache_.size(); ++i) {
+      if (i != node && cache_[i].exists(block_no)) {
+        return i;
+      }
+    }
+
+    return node;
+  }
+
+  void request(size_t block_no, size_t offset, size_t size,
+               range_promise&& promise, block_request_priority prio) const {
     PERFMON_CLS_SCOPED_SECTION(get)
     PERFMON_SET_CONTEXT(block_no, offset, size)
 
     seq_access_detector_->touch(block_no);
 
+    auto const node = current_node();
+
     SCOPE_EXIT {
       if (auto next = seq_access_detector_->prefetch()) {
         sequential_prefetches_.fetch_add(1, std::memory_order_relaxed);
 
         {
           std::lock_guard lock(mx_);
-          create_cached_block(*next, std::promise<block_range>{}, 0,
-                              std::numeric_limits<size_t>::max());
+          if (needs_prefetch(*next)) {
+            create_cached_block(*next, range_promise{}, 0,
+                                std::numeric_limits<size_t>::max(),
+                                block_request_priority::PREFETCH, node);
+          }
         }
       }
     };
 
     range_requests_.fetch_add(1, std::memory_order_relaxed);
 
-    std::promise<block_range> promise;
-    auto future = promise.get_future();
-
     // First, let's see if it's an uncompressed block, in which case we
     // can completely bypass the cache
     try {
@@ -407,11 +1037,11 @@ class block_cache_ final : public block_cache::impl {
         LOG_TRACE << "block " << block_no
                   << " is uncompressed, bypassing cache";
         promise.set_value(block_range(section.data(*mm_).data(), offset, size));
-        return future;
+        return;
       }
     } catch (...) {
       promise.set_exception(std::current_exception());
-      return future;
+      return;
     }
 
     // That is a mighty long lock, let's see how it works...
@@ -419,6 +1049,18 @@ class block_cache_ final : public block_cache::impl {
 
     const auto range_end = offset + size;
 
+    // Pinned blocks are always fully decompressed
+    if (auto ip = pinned_.find(block_no); ip != pinned_.end() && ip->second) {
+      LOG_TRACE << "block " << block_no << " is pinned";
+      promise.set_value(block_range(ip->second, offset, size));
+      pinned_hits_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    if (range_cache_.enabled()) {
+      range_cache_.touch(block_no, offset, range_end);
+    }
+
     // See if the block is currently active (about-to-be decompressed)
     auto ia = active_.find(block_no);
 
@@ -475,45 +1117,62 @@ class block_cache_ final : public block_cache::impl {
           active_hits_fast_.fetch_add(1, std::memory_order_relaxed);
         } else {
           if (!add_to_set) {
-            // Make a new set for the same block
-            brs =
-                std::make_shared<block_request_set>(std::move(block), block_no);
+            // Make a new set for the same block, on the same node
+            brs = std::make_shared<block_request_set>(std::move(block),
+                                                      block_no, brs->node());
           }
 
           // Promise will be fulfilled asynchronously
           brs->add(offset, range_end, std::move(promise));
           active_hits_slow_.fetch_add(1, std::memory_order_relaxed);
 
-          if (!add_to_set) {
+          if (add_to_set) {
+            // The set might still be queued with a lower priority
+            promote_job(brs, prio);
+          } else {
             ia->second.emplace_back(brs);
             active_set_size_.addValue(ia->second.size());
-            enqueue_job(std::move(brs));
+            enqueue_job(std::move(brs), prio);
           }
         }
 
-        return future;
+        return;
       }
 
       LOG_TRACE << "block " << block_no << " not found in active set";
     }
 
-    // See if it's cached (fully or partially decompressed)
-    auto ic = cache_.find(block_no);
+    // See if it's held or cached (fully or partially decompressed)
+    auto cache_node = find_cache_node(block_no, node);
+    std::shared_ptr<cached_block> block;
 
-    if (ic != cache_.end()) {
+    if (auto ih = held_.find(block_no);
+        ih != held_.end() && ih->second.block) {
+      LOG_TRACE << "block " << block_no << " is held";
+      block = ih->second.block;
+      cache_node = ih->second.node;
+      held_hits_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      block = cache_[cache_node].find(block_no);
+    }
+
+    if (block) {
       // Nice, at least the block is already there.
 
       LOG_TRACE << "block " << block_no << " found in cache";
 
-      auto block = ic->second;
+      if (cache_node != node) {
+        cache_hits_remote_.fetch_add(1, std::memory_order_relaxed);
+      }
 
       if (range_end <= block->range_end()) {
         // We can immediately satisfy the promise
         promise.set_value(block_range(std::move(block), offset, size));
         cache_hits_fast_.fetch_add(1, std::memory_order_relaxed);
       } else {
-        // Make a new set for the block
-        brs = std::make_shared<block_request_set>(std::move(block), block_no);
+        // Make a new set for the block on the node that owns it
+        brs = std::make_shared<block_request_set>(std::move(block), block_no,
+                                                  cache_node);
 
         // Promise will be fulfilled asynchronously
         brs->add(offset, range_end, std::move(promise));
@@ -522,42 +1181,46 @@ class block_cache_ final : public block_cache::impl {
         auto& active = active_[block_no];
         active.emplace_back(brs);
         active_set_size_.addValue(active.size());
-        enqueue_job(std::move(brs));
+        enqueue_job(std::move(brs), prio);
       }
 
-      return future;
+      return;
+    }
+
+    // The block is gone, but maybe the range we need has been retained
+    if (range_cache_.enabled()) {
+      if (auto range = range_cache_.find(block_no, offset, size)) {
+        LOG_TRACE << "block " << block_no << " range found in range cache";
+        promise.set_value(std::move(*range));
+        range_cache_hits_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
     }
 
     // Bummer. We don't know anything about the block.
 
     LOG_TRACE << "block " << block_no << " not found";
 
-    create_cached_block(block_no, std::move(promise), offset, range_end);
-
-    return future;
+    create_cached_block(block_no, std::move(promise), offset, range_end, prio,
+                        node);
   }
 
- private:
-  static std::unique_ptr<sequential_access_detector>
-  create_seq_access_detector(size_t threshold) {
-    if (threshold == 0) {
-      return std::make_unique<no_sequential_access_detector>();
-    }
-
-    return std::make_unique<lru_sequential_access_detector>(threshold);
-  }
-
-  void create_cached_block(size_t block_no, std::promise<block_range>&& promise,
-                           size_t offset, size_t range_end) const {
+  void create_cached_block(size_t block_no, range_promise&& promise,
+                           size_t offset, size_t range_end,
+                           block_request_priority prio, size_t node) const {
     try {
-      std::shared_ptr<cached_block> block = cached_block::create(
-          LOG_GET_LOGGER, DWARFS_NOTHROW(block_.at(block_no)), mm_,
-          options_.mm_release, options_.disable_block_integrity_check);
+      std::shared_ptr<cached_block> block = make_cached_block(block_no);
       blocks_created_.fetch_add(1, std::memory_order_relaxed);
 
+      if (reader_) {
+        // Give the reader a chance to combine this block with others
+        // requested around the same time before a worker picks it up
+        reader_->announce(DWARFS_NOTHROW(block_.at(block_no)));
+      }
+
       // Make a new set for the block
       auto brs =
-          std::make_shared<block_request_set>(std::move(block), block_no);
+          std::make_shared<block_request_set>(std::move(block), block_no, node);
 
       // Promise will be fulfilled asynchronously
       brs->add(offset, range_end, std::move(promise));
@@ -565,12 +1228,87 @@ class block_cache_ final : public block_cache::impl {
       auto& active = active_[block_no];
       active.emplace_back(brs);
       active_set_size_.addValue(active.size());
-      enqueue_job(std::move(brs));
+      enqueue_job(std::move(brs), prio);
     } catch (...) {
       promise.set_exception(std::current_exception());
     }
   }
 
+  std::unique_ptr<cached_block> make_cached_block(size_t block_no) const {
+    auto const& section = DWARFS_NOTHROW(block_.at(block_no));
+
+    if (reader_) {
+      return cached_block::create(LOG_GET_LOGGER, section, reader_,
+                                  options_.disable_block_integrity_check);
+    }
+
+    return cached_block::create(LOG_GET_LOGGER, section, mm_,
+                                options_.mm_release,
+                                options_.disable_block_integrity_check);
+  }
+
+  // Speculative work is only worth doing for compressed blocks that are
+  // neither available nor about to become available. Must be called with
+  // `mx_` held.
+  bool needs_prefetch(size_t block_no) const {
+    if (block_no >= block_.size() ||
+        block_[block_no].compression() == compression_type::NONE ||
+        is_pinned(block_no) || active_.contains(block_no)) {
+      return false;
+    }
+
+    if (auto ih = held_.find(block_no);
+        ih != held_.end() && ih->second.block) {
+      return false;
+    }
+
+    return std::none_of(cache_.begin(), cache_.end(), [block_no](auto& cache) {
+      return cache.exists(block_no);
+    });
+  }
+
+  // Must be called with `mx_` held.
+  bool is_pinned(size_t block_no) const {
+    auto it = pinned_.find(block_no);
+    return it != pinned_.end() && it->second;
+  }
+
+  void pin_block(size_t block_no) const {
+    std::shared_ptr<cached_block> block;
+
+    try {
+      block = make_cached_block(block_no);
+      block->decompress_until(block->uncompressed_size());
+    } catch (...) {
+      LOG_ERROR << "failed to pin block " << block_no << ": "
+                << folly::exceptionStr(std::current_exception());
+      block.reset();
+    }
+
+    std::lock_guard lock(mx_);
+
+    if (block) {
+      // The pinned copy supersedes any cached copy of the block
+      for (auto& cache : cache_) {
+        cache.erase(block_no);
+      }
+
+      range_cache_.drop(block_no);
+
+      pinned_bytes_ += block->uncompressed_size();
+      pinned_[block_no] = std::move(block);
+
+      cancel_speculative_jobs(block_no, "pinned");
+    } else {
+      pinned_.erase(block_no);
+    }
+
+    if (--pins_pending_ == 0) {
+      LOG_VERBOSE << "pinned " << pinned_.size() << " blocks ("
+                  << size_with_unit(pinned_bytes_) << ")";
+    }
+  }
+
   void stop_tidy_thread() {
     {
       std::lock_guard lock(mx_);
@@ -590,19 +1328,214 @@ class block_cache_ final : public block_cache::impl {
                                  std::memory_order_relaxed);
   }
 
-  void enqueue_job(std::shared_ptr<block_request_set> brs) const {
+  static constexpr size_t priority_index(block_request_priority prio) {
+    return static_cast<size_t>(prio);
+  }
+
+  // Request sets are not handed to the worker group directly. Instead,
+  // they are queued by priority, and each worker job picks the most
+  // urgent request set when it starts running. That way, a demand read
+  // never has to wait for speculative work that was queued before it.
+  // Must be called with `mx_` held.
+  void enqueue_job(std::shared_ptr<block_request_set> brs,
+                   block_request_priority prio) const {
+    auto const node = brs->node();
+
+    {
+      std::lock_guard lock(mx_sched_);
+
+      if (prio != block_request_priority::DEMAND) {
+        auto const max_queued = options_.max_queued_speculative_requests;
+
+        // Stale speculative work is the first to go if the queue is full
+        if (max_queued > 0 && speculative_queued_ >= max_queued) {
+          cancel_oldest_speculative_job();
+        }
+
+        ++speculative_queued_;
+      }
+
+      brs->set_priority(prio);
+      sched_queue_[node][priority_index(prio)].push_back(
+          {std::move(brs), std::chrono::steady_clock::now(),
+           demand_queue_timer(prio)});
+    }
+
     std::shared_lock lock(mx_wg_);
 
-    // Lambda needs to be mutable so we can actually move out of it
-    wg_.add_job([this, brs = std::move(brs)]() mutable {
+    wg_[node].add_job([this, node] { run_next_job(node); });
+  }
+
+  // Must be called with `mx_` held.
+  void promote_job(std::shared_ptr<block_request_set> const& brs,
+                   block_request_priority prio) const {
+    std::lock_guard lock(mx_sched_);
+
+    auto const current = brs->priority();
+
+    if (priority_index(prio) >= priority_index(current)) {
+      return;
+    }
+
+    auto& node_queue = sched_queue_[brs->node()];
+    auto& queue = node_queue[priority_index(current)];
+    auto it = std::find_if(queue.begin(), queue.end(),
+                           [&](auto const& qrs) { return qrs.brs == brs; });
+
+    if (it == queue.end()) {
+      // already being processed
+      return;
+    }
+
+    queue.erase(it);
+
+    if (current != block_request_priority::DEMAND) {
+      --speculative_queued_;
+    }
+
+    if (prio != block_request_priority::DEMAND) {
+      ++speculative_queued_;
+    }
+
+    brs->set_priority(prio);
+    node_queue[priority_index(prio)].push_back(
+        {brs, std::chrono::steady_clock::now(), demand_queue_timer(prio)});
+    ++promoted_requests_;
+  }
+
+  performance_monitor_proxy::section_timer
+  demand_queue_timer(block_request_priority prio) const {
+    if (prio == block_request_priority::DEMAND) {
+      return PERFMON_CLS_SECTION_TIMER(demand_queue);
+    }
+    return {};
+  }
+
+  // Must be called with `mx_` and `mx_sched_` held.
+  void cancel_oldest_speculative_job() const {
+    for (auto prio : {block_request_priority::PREFETCH,
+                      block_request_priority::READAHEAD}) {
+      std::deque<queued_request_set>* oldest{nullptr};
+
+      for (auto& node_queue : sched_queue_) {
+        auto& queue = node_queue[priority_index(prio)];
+
+        if (!queue.empty() &&
+            (!oldest || queue.front().enqueued < oldest->front().enqueued)) {
+          oldest = &queue;
+        }
+      }
+
+      if (!oldest) {
+        continue;
+      }
+
+      auto brs = std::move(oldest->front().brs);
+      oldest->pop_front();
+      cancel_queued_job(std::move(brs), "queue full");
+
+      return;
+    }
+  }
+
+  // Cancel all queued speculative request sets for a block, e.g. because
+  // the block has been evicted or is already fully available. Must be
+  // called with `mx_` held.
+  void
+  cancel_speculative_jobs(size_t block_no, std::string_view reason) const {
+    std::lock_guard lock(mx_sched_);
+
+    if (speculative_queued_ == 0) {
+      return;
+    }
+
+    for (auto& node_queue : sched_queue_) {
+      for (auto prio : {block_request_priority::READAHEAD,
+                        block_request_priority::PREFETCH}) {
+        auto& queue = node_queue[priority_index(prio)];
+
+        for (auto it = queue.begin(); it != queue.end();) {
+          if (it->brs->block_no() == block_no) {
+            auto brs = std::move(it->brs);
+            it = queue.erase(it);
+            cancel_queued_job(std::move(brs), reason);
+          } else {
+            ++it;
+          }
+        }
+      }
+    }
+  }
+
+  // Must be called with `mx_` and `mx_sched_` held, after the request
+  // set has been removed from its queue.
+  void cancel_queued_job(std::shared_ptr<block_request_set> brs,
+                         std::string_view reason) const {
+    --speculative_queued_;
+    ++canceled_requests_;
+
+    LOG_TRACE << "canceling speculative request for block " << brs->block_no()
+              << " (" << reason << ")";
+
+    // Make sure no new requests can be added to this set
+    if (auto ia = active_.find(brs->block_no()); ia != active_.end()) {
+      std::erase_if(ia->second, [&](auto const& wp) {
+        auto rs = wp.lock();
+        return !rs || rs == brs;
+      });
+
+      if (ia->second.empty()) {
+        active_.erase(ia);
+      }
+    }
+
+    brs->cancel(std::make_exception_ptr(runtime_error(
+        fmt::format("speculative request for block {} canceled ({})",
+                    brs->block_no(), reason),
+        __FILE__, __LINE__)));
+  }
+
+  void run_next_job(size_t node) const {
+    std::shared_ptr<block_request_set> brs;
+
+    {
+      std::lock_guard lock(mx_sched_);
+      auto& node_queue = sched_queue_[node];
+
+      for (size_t i = 0; i < node_queue.size(); ++i) {
+        auto& queue = node_queue[i];
+
+        if (!queue.empty()) {
+          auto& qrs = queue.front();
+          brs = std::move(qrs.brs);
+
+          if (i == priority_index(block_request_priority::DEMAND)) {
+            demand_queue_delay_.addValue(
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - qrs.enqueued)
+                    .count());
+          } else {
+            --speculative_queued_;
+          }
+
+          ++dispatched_[i];
+          queue.pop_front();
+          break;
+        }
+      }
+    }
+
+    // There are more jobs than queued request sets if sets were canceled
+    if (brs) {
       process_job(std::move(brs));
-    });
+    }
   }
 
   void process_job(std::shared_ptr<block_request_set> brs) const {
     PERFMON_CLS_SCOPED_SECTION(process)
 
     auto block_no = brs->block_no();
+    auto node = brs->node();
     PERFMON_SET_CONTEXT(block_no)
 
     LOG_TRACE << "processing block " << block_no;
@@ -638,6 +1571,14 @@ class block_cache_ final : public block_cache::impl {
       {
         std::lock_guard lock(mx_);
 
+        // Don't decompress anything for requesters that are gone
+        if (auto dropped = brs->drop_canceled(); dropped > 0) {
+          LOG_TRACE << "dropped " << dropped << " canceled requests for block "
+                    << block_no;
+          canceled_demand_requests_.fetch_add(dropped,
+                                              std::memory_order_relaxed);
+        }
+
         if (brs->empty()) {
           // This is absolutely crucial! At this point, we can no longer
           // allow other code to add to this request set, so we need to
@@ -691,25 +1632,53 @@ class block_cache_ final : public block_cache::impl {
     {
       std::lock_guard lock(mx_);
 
+      if (is_pinned(block_no)) {
+        return;
+      }
+
+      // Any queued speculative work for this block is now redundant
+      if (block->range_end() == block->uncompressed_size()) {
+        cancel_speculative_jobs(block_no, "already cached");
+      }
+
+      if (auto ih = held_.find(block_no); ih != held_.end()) {
+        for (auto& cache : cache_) {
+          cache.erase(block_no);
+        }
+        range_cache_.drop(block_no);
+        ih->second.block = std::move(block);
+        ih->second.node = node;
+        return;
+      }
+
       if (tidy_config_.strategy == cache_tidy_strategy::EXPIRY_TIME) {
         block->touch();
       }
 
-      cache_.set(block_no, std::move(block));
+      // Make sure the block is only cached on the node that owns it
+      for (size_t i = 0; i < cache_.size(); ++i) {
+        if (i != node) {
+          cache_[i].erase(block_no);
+        }
+      }
+
+      // Retained extents are redundant while the full block is cached
+      range_cache_.drop(block_no);
+
+      cache_[node].set(block_no, std::move(block));
     }
   }
 
   template <typename Pred>
   void remove_block_if(Pred const& predicate) {
-    auto it = cache_.begin();
-
-    while (it != cache_.end()) {
-      if (predicate(*it->second)) {
-        it = cache_.erase(it);
-        blocks_tidied_.fetch_add(1, std::memory_order_relaxed);
-      } else {
-        ++it;
-      }
+    for (auto& cache : cache_) {
+      auto removed = cache.remove_if(
+          predicate, [this](size_t block_no, cached_block const& block) {
+            if (range_cache_.enabled()) {
+              range_cache_.retain(block_no, block);
+            }
+          });
+      blocks_tidied_.fetch_add(removed, std::memory_order_relaxed);
     }
   }
 
@@ -744,18 +1713,29 @@ class block_cache_ final : public block_cache::impl {
     }
   }
 
-  using lru_type =
-      folly::EvictingCacheMap<size_t, std::shared_ptr<cached_block>>;
-
   mutable std::mutex mx_;
-  mutable lru_type cache_;
+  mutable std::deque<cached_block_map> cache_;
   mutable folly::F14FastMap<size_t,
                             std::vector<std::weak_ptr<block_request_set>>>
       active_;
+  mutable range_cache range_cache_;
   std::thread tidy_thread_;
   std::condition_variable tidy_cond_;
   bool tidy_running_{false};
 
+  mutable folly::F14FastMap<size_t, std::shared_ptr<cached_block const>>
+      pinned_;
+  mutable size_t pins_pending_{0};
+  mutable size_t pinned_bytes_{0};
+
+  struct held_block {
+    size_t count{0};
+    std::shared_ptr<cached_block> block;
+    size_t node{0};
+  };
+
+  mutable folly::F14FastMap<size_t, held_block> held_;
+
   mutable std::mutex mx_dec_;
   mutable folly::F14FastMap<size_t, std::weak_ptr<block_request_set>>
       decompressing_;
@@ -768,26 +1748,52 @@ class block_cache_ final : public block_cache::impl {
   mutable std::atomic<size_t> active_hits_slow_{0};
   mutable std::atomic<size_t> cache_hits_fast_{0};
   mutable std::atomic<size_t> cache_hits_slow_{0};
+  mutable std::atomic<size_t> cache_hits_remote_{0};
+  mutable std::atomic<size_t> pinned_hits_{0};
+  mutable std::atomic<size_t> held_hits_{0};
+  mutable std::atomic<size_t> scan_prefetches_{0};
+  mutable std::atomic<size_t> range_cache_hits_{0};
   mutable std::atomic<size_t> partially_decompressed_{0};
   mutable std::atomic<size_t> total_block_bytes_{0};
   mutable std::atomic<size_t> total_decompressed_bytes_{0};
   mutable std::atomic<size_t> blocks_tidied_{0};
   mutable std::atomic<size_t> active_expired_{0};
   mutable std::atomic<size_t> sequential_prefetches_{0};
+  mutable std::atomic<size_t> canceled_demand_requests_{0};
   mutable folly::Histogram<size_t> active_set_size_{1, 0, 1024};
 
+  struct queued_request_set {
+    std::shared_ptr<block_request_set> brs;
+    std::chrono::steady_clock::time_point enqueued;
+    // only set for demand requests; adds a sample once dequeued
+    performance_monitor_proxy::section_timer demand_timer{};
+  };
+
+  mutable std::mutex mx_sched_;
+  mutable std::vector<std::array<std::deque<queued_request_set>, 3>>
+      sched_queue_;
+  mutable size_t speculative_queued_{0};
+  mutable std::array<size_t, 3> dispatched_{};
+  mutable size_t promoted_requests_{0};
+  mutable size_t canceled_requests_{0};
+  mutable folly::Histogram<size_t> demand_queue_delay_{50, 0, 100000};
+
   mutable std::shared_mutex mx_wg_;
-  mutable worker_group wg_;
+  mutable std::vector<worker_group> wg_;
   std::vector<fs_section> block_;
   std::shared_ptr<mmif> mm_;
+  std::shared_ptr<block_reader> reader_;
   LOG_PROXY_DECL(LoggerPolicy);
   PERFMON_CLS_PROXY_DECL
   PERFMON_CLS_TIMER_DECL(get)
   PERFMON_CLS_TIMER_DECL(process)
   PERFMON_CLS_TIMER_DECL(decompress)
+  PERFMON_CLS_TIMER_DECL(demand_queue)
   std::unique_ptr<sequential_access_detector> seq_access_detector_;
   os_access const& os_;
   const block_cache_options options_;
+  std::vector<int> node_index_;
+  std::vector<std::vector<int>> node_cpus_;
   cache_tidy_config tidy_config_;
 };
 
@@ -0,0 +1,159 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <string_view>
+
+#include <fmt/format.h>
+
+#include "dwarfs/block_map.h"
+#include "dwarfs/error.h"
+
+namespace dwarfs {
+
+namespace {
+
+constexpr std::string_view const kMagic{"DWBM"};
+constexpr uint16_t const kVersion{1};
+constexpr size_t const kHeaderSize{16};
+constexpr size_t const kBlockSize{24};
+constexpr size_t const kExtentSize{24};
+
+class le_writer {
+ public:
+  explicit le_writer(std::string& out)
+      : out_{out} {}
+
+  template <typename T>
+  void put(T value) {
+    auto v = static_cast<uint64_t>(value);
+    for (size_t i = 0; i < sizeof(T); ++i) {
+      out_.push_back(static_cast<char>(v & 0xff));
+      v >>= 8;
+    }
+  }
+
+ private:
+  std::string& out_;
+};
+
+class le_reader {
+ public:
+  explicit le_reader(std::span<uint8_t const> data)
+      : data_{data} {}
+
+  template <typename T>
+  T get() {
+    if (pos_ + sizeof(T) > data_.size()) {
+      DWARFS_THROW(runtime_error, "truncated block map");
+    }
+    uint64_t v{0};
+    for (size_t i = 0; i < sizeof(T); ++i) {
+      v |= static_cast<uint64_t>(data_[pos_ + i]) << (8 * i);
+    }
+    pos_ += sizeof(T);
+    return static_cast<T>(v);
+  }
+
+ private:
+  std::span<uint8_t const> data_;
+  size_t pos_{0};
+};
+
+} // namespace
+
+std::string file_block_map::serialize() const {
+  std::string rv;
+  rv.reserve(kHeaderSize + kBlockSize * blocks.size() +
+             kExtentSize * extents.size());
+
+  le_writer w(rv);
+
+  rv.append(kMagic);
+  w.put<uint16_t>(kVersion);
+  w.put<uint16_t>(0);
+  w.put<uint32_t>(blocks.size());
+  w.put<uint32_t>(extents.size());
+
+  for (auto const& b : blocks) {
+    w.put<uint32_t>(b.block);
+    w.put<uint16_t>(static_cast<uint16_t>(b.compression));
+    w.put<uint16_t>(0);
+    w.put<uint64_t>(b.compressed_size);
+    w.put<uint64_t>(b.uncompressed_size);
+  }
+
+  for (auto const& e : extents) {
+    w.put<uint64_t>(e.offset);
+    w.put<uint64_t>(e.size);
+    w.put<uint32_t>(e.block);
+    w.put<uint32_t>(e.block_offset);
+  }
+
+  return rv;
+}
+
+file_block_map file_block_map::deserialize(std::span<uint8_t const> data) {
+  if (data.size() < kHeaderSize ||
+      std::string_view(reinterpret_cast<char const*>(data.data()),
+                       kMagic.size()) != kMagic) {
+    DWARFS_THROW(runtime_error, "invalid block map");
+  }
+
+  le_reader r(data.subspan(kMagic.size()));
+
+  if (auto version = r.get<uint16_t>(); version != kVersion) {
+    DWARFS_THROW(runtime_error,
+                 fmt::format("unsupported block map version {}", version));
+  }
+
+  r.get<uint16_t>();
+
+  auto num_blocks = r.get<uint32_t>();
+  auto num_extents = r.get<uint32_t>();
+
+  if (data.size() != kHeaderSize + kBlockSize * num_blocks +
+                         kExtentSize * static_cast<size_t>(num_extents)) {
+    DWARFS_THROW(runtime_error, "block map size mismatch");
+  }
+
+  file_block_map rv;
+  rv.blocks.resize(num_blocks);
+  rv.extents.resize(num_extents);
+
+  for (auto& b : rv.blocks) {
+    b.block = r.get<uint32_t>();
+    b.compression = static_cast<compression_type>(r.get<uint16_t>());
+    r.get<uint16_t>();
+    b.compressed_size = r.get<uint64_t>();
+    b.uncompressed_size = r.get<uint64_t>();
+  }
+
+  for (auto& e : rv.extents) {
+    e.offset = r.get<uint64_t>();
+    e.size = r.get<uint64_t>();
+    e.block = r.get<uint32_t>();
+    e.block_offset = r.get<uint32_t>();
+  }
+
+  return rv;
+}
+
+} // namespace dwarfs
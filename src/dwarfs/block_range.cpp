@@ -48,4 +48,18 @@ block_range::block_range(std::shared_ptr<cached_block const> block,
   }
 }
 
+block_range::block_range(std::shared_ptr<std::vector<uint8_t> const> data,
+                         size_t offset, size_t size)
+    : data_{std::move(data)} {
+  if (!data_) {
+    DWARFS_THROW(runtime_error, "block_range: block data is null");
+  }
+  if (offset + size > data_->size()) {
+    DWARFS_THROW(runtime_error,
+                 fmt::format("block_range: size out of range ({0} > {1})",
+                             offset + size, data_->size()));
+  }
+  span_ = std::span<uint8_t const>(data_->data() + offset, size);
+}
+
 } // namespace dwarfs
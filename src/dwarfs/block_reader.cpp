@@ -0,0 +1,260 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <map>
+#include <mutex>
+#include <system_error>
+
+#include <fmt/format.h>
+
+#include <folly/ScopeGuard.h>
+
+#include "dwarfs/block_reader.h"
+#include "dwarfs/error.h"
+#include "dwarfs/fs_section.h"
+#include "dwarfs/logger.h"
+#include "dwarfs/mmif.h"
+#include "dwarfs/util.h"
+
+namespace dwarfs {
+
+namespace {
+
+// Sections are separated by their headers, so two blocks that are next to
+// each other in the image are never exactly adjacent. Reading a small gap
+// is a lot cheaper than issuing another request.
+constexpr size_t const kMaxGap{static_cast<size_t>(64) << 10};
+
+using buffer_ptr = std::shared_ptr<uint8_t[]>;
+
+} // namespace
+
+template <typename LoggerPolicy>
+class block_reader_ final : public block_reader::impl {
+ public:
+  block_reader_(logger& lgr, std::shared_ptr<mmif> mm, size_t max_request_size)
+      : mm_{std::move(mm)}
+      , LOG_PROXY_INIT(lgr)
+      , max_request_size_{max_request_size} {}
+
+  ~block_reader_() override {
+    LOG_VERBOSE << "block reads: " << reads_ << " ("
+                << size_with_unit(bytes_read_) << "), coalesced sections: "
+                << coalesced_;
+  }
+
+  void announce(fs_section const& section) override {
+    {
+      std::lock_guard lock(mx_);
+
+      auto [it, inserted] = pending_.try_emplace(section.start());
+
+      ++it->second.refs;
+
+      if (!inserted) {
+        return;
+      }
+
+      it->second.length = static_cast<file_off_t>(section.length());
+    }
+
+    if (auto ec = mm_->willneed(section.start(), section.length())) {
+      LOG_DEBUG << "willneed() failed: " << ec.message();
+    }
+  }
+
+  void cancel(fs_section const& section) override {
+    std::lock_guard lock(mx_);
+
+    if (auto it = pending_.find(section.start()); it != pending_.end()) {
+      release(it);
+    }
+  }
+
+  std::shared_ptr<uint8_t const> read(fs_section const& section) override {
+    auto const start = section.start();
+    std::shared_future<buffer_ptr> run;
+    size_t run_offset;
+    size_t run_size;
+
+    {
+      std::unique_lock lock(mx_);
+
+      auto it = pending_.find(start);
+
+      if (it == pending_.end()) {
+        lock.unlock();
+        auto buf = read_range(start, section.length());
+        return {buf, buf.get()};
+      }
+
+      if (!it->second.run.valid()) {
+        issue(lock, it);
+      }
+
+      run = it->second.run;
+      run_offset = it->second.run_offset;
+      run_size = it->second.run_size;
+    }
+
+    // Whatever happens, this section has now been consumed
+    SCOPE_EXIT { cancel(section); };
+
+    auto buf = run.get();
+
+    if (run_size == section.length()) {
+      return {buf, buf.get()};
+    }
+
+    // The caller may hold on to the data for a long time, e.g. while a
+    // block is only partially decompressed. Copy the section so that it
+    // doesn't keep the whole run alive.
+    buffer_ptr copy(new uint8_t[section.length()]);
+    std::memcpy(copy.get(), buf.get() + run_offset, section.length());
+
+    return {copy, copy.get()};
+  }
+
+ private:
+  struct entry {
+    file_off_t length{0};
+    size_t refs{0};
+    std::shared_future<buffer_ptr> run;
+    size_t run_offset{0};
+    size_t run_size{0};
+  };
+
+  using entry_map = std::map<file_off_t, entry>;
+
+  // Must be called with `mx_` held.
+  void release(entry_map::iterator it) {
+    if (--it->second.refs == 0) {
+      pending_.erase(it);
+    }
+  }
+
+  // Read the run of announced sections around `it` that haven't been read
+  // yet and that are close enough to each other. Expects `lock` to be held
+  // and returns with `lock` held.
+  void issue(std::unique_lock<std::mutex>& lock, entry_map::iterator it) {
+    auto first = it;
+    auto last = it;
+    auto run_end = it->first + it->second.length;
+
+    auto fits = [&](file_off_t begin, file_off_t end) {
+      return static_cast<size_t>(end - begin) <= max_request_size_;
+    };
+
+    while (first != pending_.begin()) {
+      auto prev = std::prev(first);
+      auto prev_end = prev->first + prev->second.length;
+
+      if (prev->second.run.valid() || prev_end > first->first ||
+          static_cast<size_t>(first->first - prev_end) > kMaxGap ||
+          !fits(prev->first, run_end)) {
+        break;
+      }
+
+      first = prev;
+    }
+
+    for (auto next = std::next(last); next != pending_.end(); ++next) {
+      if (next->second.run.valid() || next->first < run_end ||
+          static_cast<size_t>(next->first - run_end) > kMaxGap ||
+          !fits(first->first, next->first + next->second.length)) {
+        break;
+      }
+
+      last = next;
+      run_end = next->first + next->second.length;
+    }
+
+    auto const run_start = first->first;
+    std::promise<buffer_ptr> promise;
+    std::shared_future<buffer_ptr> run = promise.get_future().share();
+    size_t sections = 0;
+
+    for (auto i = first;; ++i) {
+      i->second.run = run;
+      i->second.run_offset = i->first - run_start;
+      i->second.run_size = run_end - run_start;
+      ++sections;
+
+      if (i == last) {
+        break;
+      }
+    }
+
+    coalesced_ += sections - 1;
+
+    LOG_TRACE << "reading " << sections << " section(s), "
+              << size_with_unit(run_end - run_start) << " at offset "
+              << run_start;
+
+    lock.unlock();
+
+    try {
+      promise.set_value(read_range(run_start, run_end - run_start));
+    } catch (...) {
+      promise.set_exception(std::current_exception());
+    }
+
+    lock.lock();
+  }
+
+  buffer_ptr read_range(file_off_t offset, size_t length) {
+    buffer_ptr buf(new uint8_t[length]);
+
+    if (auto ec = mm_->read(buf.get(), offset, length)) {
+      DWARFS_THROW(system_error,
+                   fmt::format("failed to read {} bytes at offset {}", length,
+                               offset),
+                   ec.value());
+    }
+
+    {
+      std::lock_guard lock(mx_);
+      ++reads_;
+      bytes_read_ += length;
+    }
+
+    return buf;
+  }
+
+  std::shared_ptr<mmif> mm_;
+  LOG_PROXY_DECL(LoggerPolicy);
+  size_t const max_request_size_;
+  std::mutex mx_;
+  entry_map pending_;
+  size_t reads_{0};
+  size_t bytes_read_{0};
+  size_t coalesced_{0};
+};
+
+block_reader::block_reader(logger& lgr, std::shared_ptr<mmif> mm,
+                           size_t max_request_size)
+    : impl_(make_unique_logging_object<impl, block_reader_, logger_policies>(
+          lgr, std::move(mm), max_request_size)) {}
+
+} // namespace dwarfs
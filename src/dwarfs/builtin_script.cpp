@@ -20,39 +20,25 @@
  */
 
 #include <cassert>
+#include <optional>
 #include <regex>
 #include <unordered_set>
 
 #include <fmt/format.h>
 
+#include <folly/container/F14Map.h>
+
 #include "dwarfs/builtin_script.h"
+#include "dwarfs/entry.h"
 #include "dwarfs/entry_interface.h"
 #include "dwarfs/entry_transformer.h"
 #include "dwarfs/file_access.h"
+#include "dwarfs/filter_matcher.h"
 #include "dwarfs/logger.h"
 #include "dwarfs/util.h"
 
 namespace dwarfs {
 
-struct filter_rule {
-  enum class rule_type {
-    include,
-    exclude,
-  };
-
-  filter_rule(rule_type type, bool floating, std::string const& re,
-              std::string const& rule)
-      : type{type}
-      , floating{floating}
-      , re{re}
-      , rule{rule} {}
-
-  rule_type type;
-  bool floating;
-  std::regex re;
-  std::string rule;
-};
-
 template <typename LoggerPolicy>
 class builtin_script_ : public builtin_script::impl {
  public:
@@ -79,106 +65,21 @@ class builtin_script_ : public builtin_script::impl {
   void add_filter_rules(std::unordered_set<std::string>& seen_files,
                         std::istream& is);
 
-  filter_rule compile_filter_rule(std::string const& rule);
+  filter_matcher::cursor dir_cursor(std::shared_ptr<entry> const& dir);
+
+  struct dir_state {
+    std::weak_ptr<entry> dir;
+    filter_matcher::cursor cursor;
+  };
 
   LOG_PROXY_DECL(LoggerPolicy);
   std::string root_path_;
-  std::vector<filter_rule> filter_;
+  filter_matcher filter_;
+  folly::F14FastMap<entry const*, dir_state> dir_states_;
   std::vector<std::unique_ptr<entry_transformer>> transformer_;
   std::shared_ptr<file_access const> fa_;
 };
 
-template <typename LoggerPolicy>
-auto builtin_script_<LoggerPolicy>::compile_filter_rule(std::string const& rule)
-    -> filter_rule {
-  std::string r;
-  filter_rule::rule_type type;
-
-  auto* p = rule.c_str();
-
-  switch (*p) {
-  case '+':
-    type = filter_rule::rule_type::include;
-    break;
-  case '-':
-    type = filter_rule::rule_type::exclude;
-    break;
-  default:
-    throw std::runtime_error("rules must start with + or -");
-  }
-
-  while (*++p == ' ')
-    ;
-
-  // If the start of the pattern is not explicitly anchored, make it floating.
-  bool floating = *p && *p != '/';
-
-  if (floating) {
-    r += ".*/";
-  }
-
-  while (*p) {
-    switch (*p) {
-    case '\\':
-      r += *p++;
-      if (p) {
-        r += *p++;
-      }
-      continue;
-
-    case '*': {
-      int nstar = 1;
-      while (*++p == '*') {
-        ++nstar;
-      }
-      switch (nstar) {
-      case 1:
-        if (r.ends_with('/') and (*p == '/' or *p == '\0')) {
-          r += "[^/]+";
-        } else {
-          r += "[^/]*";
-        }
-        break;
-      case 2:
-        r += ".*";
-        break;
-      default:
-        throw std::runtime_error("too many *s");
-      }
-    }
-      continue;
-
-    case '?':
-      r += "[^/]";
-      break;
-
-    case '.':
-    case '+':
-    case '^':
-    case '$':
-    case '(':
-    case ')':
-    case '{':
-    case '}':
-    case '|':
-      r += '\\';
-      r += *p;
-      break;
-
-    default:
-      r += *p;
-      break;
-    }
-
-    ++p;
-  }
-
-  LOG_DEBUG << "'" << rule << "' -> '" << r << "' [floating=" << floating
-            << "]";
-
-  return filter_rule(type, floating, r, rule);
-}
-
 template <typename LoggerPolicy>
 builtin_script_<LoggerPolicy>::builtin_script_(
     logger& lgr, std::shared_ptr<file_access const> fa)
@@ -190,6 +91,7 @@ void builtin_script_<LoggerPolicy>::set_root_path(
     std::filesystem::path const& path) {
   // TODO: this whole thing needs to be windowsized
   root_path_ = u8string_to_string(path.u8string());
+  dir_states_.clear();
 }
 
 template <typename LoggerPolicy>
@@ -220,7 +122,13 @@ void builtin_script_<LoggerPolicy>::add_filter_rule(
 
     seen_files.erase(file);
   } else {
-    filter_.push_back(compile_filter_rule(rule));
+    filter_.add_rule(rule);
+    dir_states_.clear();
+
+    auto ix = filter_.size() - 1;
+
+    LOG_DEBUG << "'" << rule << "' -> '" << filter_.pattern(ix)
+              << "' [floating=" << filter_.floating(ix) << "]";
   }
 }
 
@@ -240,30 +148,77 @@ void builtin_script_<LoggerPolicy>::add_filter_rules(
   }
 }
 
+// Returns the matcher state after consuming the full path of `dir`,
+// including the trailing separator. States are cached per directory,
+// so matching an entry only needs to look at the entry's own name.
+template <typename LoggerPolicy>
+filter_matcher::cursor
+builtin_script_<LoggerPolicy>::dir_cursor(std::shared_ptr<entry> const& dir) {
+  if (auto it = dir_states_.find(dir.get()); it != dir_states_.end()) {
+    auto& ds = it->second;
+    if (ds.dir.lock() == dir && filter_.valid(ds.cursor)) {
+      return ds.cursor;
+    }
+  }
+
+  filter_matcher::cursor c;
+
+  if (auto parent = dir->parent()) {
+    c = filter_.advance(dir_cursor(parent), dir->name());
+    c = filter_.advance(c, "/");
+  } else {
+    auto path = dir->unix_dpath();
+    c = filter_.advance(filter_.start(root_path_.size()), path);
+  }
+
+  dir_states_[dir.get()] = dir_state{dir, c};
+
+  return c;
+}
+
 template <typename LoggerPolicy>
 bool builtin_script_<LoggerPolicy>::filter(entry_interface const& ei) {
-  std::string path = ei.unix_dpath();
-  std::string relpath = path;
+  std::optional<size_t> rule;
+
+  auto e = dynamic_cast<entry const*>(&ei);
+  auto parent = e ? e->parent() : nullptr;
 
-  if (relpath.size() >= root_path_.size()) {
-    assert(relpath.substr(0, root_path_.size()) == root_path_);
-    relpath.erase(0, root_path_.size());
+  if (parent) {
+    auto c = filter_.advance(dir_cursor(parent), e->name());
+    if (ei.is_directory()) {
+      c = filter_.advance(c, "/");
+    }
+    if (c.offset >= root_path_.size()) {
+      rule = filter_.match(c);
+    } else {
+      parent.reset();
+    }
+  }
+
+  if (!parent) {
+    std::string path = ei.unix_dpath();
+
+    if (path.size() >= root_path_.size()) {
+      assert(path.substr(0, root_path_.size()) == root_path_);
+      rule = filter_.match(path, root_path_.size());
+    } else {
+      rule = filter_.match(path, 0);
+    }
   }
 
-  for (const auto& r : filter_) {
-    if (std::regex_match(r.floating ? path : relpath, r.re)) {
-      LOG_TRACE << path << " matched rule '" << r.rule << "'";
-      switch (r.type) {
-      case filter_rule::rule_type::include:
-        return true;
+  if (rule) {
+    LOG_TRACE << ei.unix_dpath() << " matched rule '" << filter_.rule(*rule)
+              << "'";
+    switch (filter_.type(*rule)) {
+    case filter_matcher::rule_type::include:
+      return true;
 
-      case filter_rule::rule_type::exclude:
-        return false;
-      }
+    case filter_matcher::rule_type::exclude:
+      return false;
     }
   }
 
-  LOG_TRACE << path << " matched no rule";
+  LOG_TRACE << ei.unix_dpath() << " matched no rule";
 
   return true;
 }
@@ -0,0 +1,397 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cerrno>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "dwarfs/async_reader.h"
+#include "dwarfs/c_api.h"
+#include "dwarfs/error.h"
+#include "dwarfs/file_stat.h"
+#include "dwarfs/filesystem_v2.h"
+#include "dwarfs/logger.h"
+#include "dwarfs/mmap.h"
+#include "dwarfs/options.h"
+#include "dwarfs/os_access_generic.h"
+#include "dwarfs/terminal.h"
+
+namespace {
+
+class callback_logger : public dwarfs::logger {
+ public:
+  callback_logger(dwarfs_log_level threshold, dwarfs_log_fn fn, void* arg)
+      : threshold_{static_cast<level_type>(threshold)}
+      , fn_{fn}
+      , arg_{arg} {
+    if (threshold_ >= DEBUG) {
+      set_policy<dwarfs::debug_logger_policy>();
+    } else {
+      set_policy<dwarfs::prod_logger_policy>();
+    }
+  }
+
+  void write(level_type level, std::string const& output, char const*,
+             int) override {
+    if (fn_ && level <= threshold_) {
+      fn_(static_cast<dwarfs_log_level>(level), output.c_str(), arg_);
+    }
+  }
+
+ private:
+  level_type const threshold_;
+  dwarfs_log_fn const fn_;
+  void* const arg_;
+};
+
+} // namespace
+
+struct dwarfs_fs {
+  explicit dwarfs_fs(std::unique_ptr<dwarfs::logger> l)
+      : lgr{std::move(l)} {}
+
+  std::unique_ptr<dwarfs::logger> lgr;
+  dwarfs::os_access_generic os;
+  dwarfs::filesystem_v2 fs;
+};
+
+struct dwarfs_reader {
+  dwarfs_reader(dwarfs_fs& fs, dwarfs::async_reader_options const& opts)
+      : reader{*fs.lgr, fs.os, fs.fs, opts} {}
+
+  dwarfs::async_reader reader;
+};
+
+struct dwarfs_buffer {
+  explicit dwarfs_buffer(std::vector<dwarfs::block_range>&& br)
+      : blocks{std::move(br)} {
+    ranges.reserve(blocks.size());
+    for (auto const& b : blocks) {
+      ranges.push_back({b.data(), b.size()});
+    }
+  }
+
+  std::vector<dwarfs::block_range> blocks;
+  std::vector<dwarfs_range> ranges;
+};
+
+namespace {
+
+thread_local std::string last_error;
+
+template <typename T>
+int guarded(T&& f) {
+  try {
+    last_error.clear();
+    return std::forward<T>(f)();
+  } catch (dwarfs::system_error const& e) {
+    last_error = e.what();
+    return -e.get_errno();
+  } catch (std::bad_alloc const&) {
+    last_error = "out of memory";
+    return -ENOMEM;
+  } catch (std::exception const& e) {
+    last_error = e.what();
+  } catch (...) {
+    last_error = "unknown exception";
+  }
+  return -EIO;
+}
+
+int fail(int err, std::string msg) {
+  last_error = std::move(msg);
+  return err;
+}
+
+// The buffer, if any, is owned by the C completion after this
+dwarfs_read_completion to_c(dwarfs::async_read_completion&& comp) {
+  dwarfs_read_completion rv{};
+  rv.user_data = comp.user_data;
+  rv.result = comp.result;
+
+  if (!comp.ranges.empty()) {
+    rv.buffer = new dwarfs_buffer(std::move(comp.ranges));
+    rv.ranges = rv.buffer->ranges.data();
+    rv.num_ranges = rv.buffer->ranges.size();
+  }
+
+  return rv;
+}
+
+// Never throws; if the conversion fails, the completion carries the error
+dwarfs_read_completion to_c_guarded(dwarfs::async_read_completion&& comp) {
+  dwarfs_read_completion rv{};
+
+  if (auto err = guarded([&] {
+        rv = to_c(std::move(comp));
+        return 0;
+      });
+      err != 0) {
+    rv = dwarfs_read_completion{};
+    rv.user_data = comp.user_data;
+    rv.result = err;
+  }
+
+  return rv;
+}
+
+dwarfs::async_read_request from_c(dwarfs_read_request const& req) {
+  return {
+      .inode = req.inode,
+      .offset = req.offset,
+      .size = req.size,
+      .buffer = req.buffer,
+      .user_data = req.user_data,
+  };
+}
+
+size_t harvest(dwarfs_reader* reader, dwarfs_read_completion* comps,
+               size_t min, size_t max,
+               std::optional<std::chrono::milliseconds> timeout) {
+  std::vector<dwarfs::async_read_completion> out;
+  size_t count = 0;
+
+  guarded([&] {
+    out.reserve(max);
+    count = reader->reader.wait(out, min, max, timeout);
+    return 0;
+  });
+
+  for (size_t i = 0; i < count; ++i) {
+    comps[i] = to_c_guarded(std::move(out[i]));
+  }
+
+  return count;
+}
+
+int open_fs(char const* image, dwarfs_fs_options const* opts,
+            std::unique_ptr<dwarfs::logger> lgr, dwarfs_fs** fs) {
+  dwarfs::filesystem_options fsopts;
+
+  if (opts) {
+    if (opts->cache_size > 0) {
+      fsopts.block_cache.max_bytes = opts->cache_size;
+    }
+    if (opts->num_workers > 0) {
+      fsopts.block_cache.num_workers = opts->num_workers;
+    }
+    fsopts.image_offset = opts->image_offset;
+  }
+
+  auto handle = std::make_unique<dwarfs_fs>(std::move(lgr));
+  handle->fs = dwarfs::filesystem_v2(
+      *handle->lgr, handle->os, std::make_shared<dwarfs::mmap>(image), fsopts);
+
+  *fs = handle.release();
+
+  return 0;
+}
+
+} // namespace
+
+extern "C" {
+
+char const* dwarfs_last_error(void) { return last_error.c_str(); }
+
+int dwarfs_fs_open(char const* image, dwarfs_fs_options const* opts,
+                   dwarfs_fs** fs) {
+  if (!image || !fs) {
+    return fail(-EINVAL, "invalid argument");
+  }
+
+  return guarded([&] {
+    return open_fs(image, opts,
+                   std::make_unique<dwarfs::stream_logger>(
+                       dwarfs::terminal::create(), std::cerr),
+                   fs);
+  });
+}
+
+int dwarfs_fs_open_with_log(char const* image, dwarfs_fs_options const* opts,
+                            dwarfs_log_level log_level, dwarfs_log_fn log,
+                            void* log_arg, dwarfs_fs** fs) {
+  if (!image || !fs || log_level < DWARFS_LOG_FATAL ||
+      log_level > DWARFS_LOG_TRACE) {
+    return fail(-EINVAL, "invalid argument");
+  }
+
+  return guarded([&] {
+    return open_fs(
+        image, opts,
+        std::make_unique<callback_logger>(log_level, log, log_arg), fs);
+  });
+}
+
+void dwarfs_fs_close(dwarfs_fs* fs) { delete fs; }
+
+int dwarfs_fs_open_file(dwarfs_fs* fs, char const* path, uint32_t* inode,
+                        uint64_t* size) {
+  if (!fs || !path || !inode) {
+    return fail(-EINVAL, "invalid argument");
+  }
+
+  return guarded([&] {
+    auto iv = fs->fs.find(path);
+
+    if (!iv) {
+      return fail(-ENOENT, "no such file");
+    }
+
+    dwarfs::file_stat st;
+
+    if (auto err = fs->fs.getattr(*iv, &st); err != 0) {
+      return fail(err, "getattr failed");
+    }
+
+    if (!st.is_regular_file()) {
+      return fail(-EINVAL, "not a regular file");
+    }
+
+    auto ino = fs->fs.open(*iv);
+
+    if (ino < 0) {
+      return fail(ino, "open failed");
+    }
+
+    *inode = ino;
+
+    if (size) {
+      *size = st.size;
+    }
+
+    return 0;
+  });
+}
+
+int64_t dwarfs_fs_read(dwarfs_fs* fs, uint32_t inode, void* buf, size_t size,
+                       int64_t offset) {
+  if (!fs || (!buf && size > 0)) {
+    return fail(-EINVAL, "invalid argument");
+  }
+
+  int64_t rv = 0;
+
+  if (auto err = guarded([&] {
+        rv = fs->fs.read(inode, static_cast<char*>(buf), size, offset);
+        return 0;
+      });
+      err != 0) {
+    return err;
+  }
+
+  return rv;
+}
+
+int dwarfs_reader_create(dwarfs_fs* fs, size_t num_threads,
+                         dwarfs_notify_fn notify, void* notify_arg,
+                         dwarfs_reader** reader) {
+  if (!fs || !reader) {
+    return fail(-EINVAL, "invalid argument");
+  }
+
+  return guarded([&] {
+    dwarfs::async_reader_options opts;
+
+    if (num_threads > 0) {
+      opts.num_threads = num_threads;
+    }
+
+    if (notify) {
+      opts.notify = [notify, notify_arg] { notify(notify_arg); };
+    }
+
+    *reader = new dwarfs_reader(*fs, opts);
+
+    return 0;
+  });
+}
+
+void dwarfs_reader_destroy(dwarfs_reader* reader) { delete reader; }
+
+int dwarfs_reader_submit(dwarfs_reader* reader, dwarfs_read_request const* reqs,
+                         size_t count) {
+  if (!reader || (!reqs && count > 0)) {
+    return fail(-EINVAL, "invalid argument");
+  }
+
+  return guarded([&] {
+    for (size_t i = 0; i < count; ++i) {
+      reader->reader.submit(from_c(reqs[i]));
+    }
+    return 0;
+  });
+}
+
+int dwarfs_reader_submit_cb(dwarfs_reader* reader,
+                            dwarfs_read_request const* req,
+                            dwarfs_completion_fn cb, void* arg) {
+  if (!reader || !req || !cb) {
+    return fail(-EINVAL, "invalid argument");
+  }
+
+  return guarded([&] {
+    reader->reader.submit(from_c(*req),
+                          [cb, arg](dwarfs::async_read_completion&& comp) {
+                            auto c = to_c_guarded(std::move(comp));
+                            cb(&c, arg);
+                          });
+    return 0;
+  });
+}
+
+size_t dwarfs_reader_poll(dwarfs_reader* reader, dwarfs_read_completion* comps,
+                          size_t max) {
+  if (!reader || !comps) {
+    fail(-EINVAL, "invalid argument");
+    return 0;
+  }
+
+  return harvest(reader, comps, 0, max, std::chrono::milliseconds::zero());
+}
+
+size_t dwarfs_reader_wait(dwarfs_reader* reader, dwarfs_read_completion* comps,
+                          size_t min, size_t max, int timeout_ms) {
+  if (!reader || !comps) {
+    fail(-EINVAL, "invalid argument");
+    return 0;
+  }
+
+  std::optional<std::chrono::milliseconds> timeout;
+
+  if (timeout_ms >= 0) {
+    timeout = std::chrono::milliseconds(timeout_ms);
+  }
+
+  return harvest(reader, comps, min, max, timeout);
+}
+
+size_t dwarfs_reader_in_flight(dwarfs_reader const* reader) {
+  return reader ? reader->reader.in_flight() : 0;
+}
+
+void dwarfs_buffer_release(dwarfs_buffer* buffer) { delete buffer; }
+
+} // extern "C"
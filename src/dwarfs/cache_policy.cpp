@@ -0,0 +1,425 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <list>
+
+#include <folly/container/F14Map.h>
+
+#include "dwarfs/cache_policy.h"
+
+namespace dwarfs {
+
+namespace {
+
+/**
+ * Count-min sketch with 4-bit counters
+ *
+ * Used to estimate how often a block was accessed in the recent past.
+ * All counters are halved periodically, so the estimates adapt to
+ * changes in the access pattern.
+ */
+class frequency_sketch {
+ public:
+  frequency_sketch(size_t num_keys, size_t sample_size)
+      : width_{std::bit_ceil(std::max<size_t>(num_keys, 16))}
+      , sample_size_{std::max<size_t>(sample_size, 16)}
+      , table_(kDepth * width_ / kCountersPerWord) {}
+
+  void increment(size_t key) {
+    bool added = false;
+
+    for (size_t i = 0; i < kDepth; ++i) {
+      auto [word, shift] = index_of(key, i);
+
+      if (((table_[word] >> shift) & kCounterMask) < kCounterMask) {
+        table_[word] += uint64_t{1} << shift;
+        added = true;
+      }
+    }
+
+    if (added && ++samples_ >= sample_size_) {
+      reset();
+    }
+  }
+
+  size_t estimate(size_t key) const {
+    size_t freq = kCounterMask;
+
+    for (size_t i = 0; i < kDepth; ++i) {
+      auto [word, shift] = index_of(key, i);
+      freq = std::min<size_t>(freq, (table_[word] >> shift) & kCounterMask);
+    }
+
+    return freq;
+  }
+
+ private:
+  static constexpr size_t kDepth{4};
+  static constexpr size_t kCounterBits{4};
+  static constexpr size_t kCountersPerWord{64 / kCounterBits};
+  static constexpr uint64_t kCounterMask{(uint64_t{1} << kCounterBits) - 1};
+  static constexpr uint64_t kResetMask{0x7777777777777777};
+
+  static constexpr std::array<uint64_t, kDepth> kSeeds{
+      0x9e3779b97f4a7c15, 0xc2b2ae3d27d4eb4f, 0x165667b19e3779f9,
+      0x27d4eb2f165667c5};
+
+  std::pair<size_t, unsigned> index_of(size_t key, size_t row) const {
+    uint64_t h = (static_cast<uint64_t>(key) + 1) * kSeeds[row];
+    h ^= h >> 32;
+    auto counter = row * width_ + (h & (width_ - 1));
+    return {counter / kCountersPerWord,
+            (counter % kCountersPerWord) * kCounterBits};
+  }
+
+  void reset() {
+    for (auto& w : table_) {
+      w = (w >> 1) & kResetMask;
+    }
+    samples_ /= 2;
+  }
+
+  size_t const width_;
+  size_t const sample_size_;
+  size_t samples_{0};
+  std::vector<uint64_t> table_;
+};
+
+/**
+ * A set of keys in recency order, most recently used first
+ */
+class recency_list {
+ public:
+  bool empty() const { return list_.empty(); }
+  size_t size() const { return list_.size(); }
+  bool contains(size_t key) const { return index_.contains(key); }
+
+  void push_front(size_t key) {
+    list_.push_front(key);
+    index_[key] = list_.begin();
+  }
+
+  void move_to_front(size_t key) {
+    list_.splice(list_.begin(), list_, index_.at(key));
+  }
+
+  bool try_move_to_front(size_t key) {
+    if (auto it = index_.find(key); it != index_.end()) {
+      list_.splice(list_.begin(), list_, it->second);
+      return true;
+    }
+    return false;
+  }
+
+  size_t back() const { return list_.back(); }
+
+  size_t pop_back() {
+    auto key = list_.back();
+    index_.erase(key);
+    list_.pop_back();
+    return key;
+  }
+
+  bool erase(size_t key) {
+    if (auto it = index_.find(key); it != index_.end()) {
+      list_.erase(it->second);
+      index_.erase(it);
+      return true;
+    }
+    return false;
+  }
+
+ private:
+  std::list<size_t> list_;
+  folly::F14FastMap<size_t, std::list<size_t>::iterator> index_;
+};
+
+class lru_policy final : public cache_policy::impl {
+ public:
+  explicit lru_policy(size_t capacity)
+      : capacity_{capacity} {}
+
+  bool access(size_t key) override {
+    if (lru_.contains(key)) {
+      lru_.move_to_front(key);
+      return true;
+    }
+    return false;
+  }
+
+  void touch(size_t key) override { lru_.try_move_to_front(key); }
+
+  bool contains(size_t key) const override { return lru_.contains(key); }
+
+  void insert(size_t key, std::vector<size_t>& evicted) override {
+    lru_.push_front(key);
+
+    while (capacity_ > 0 && lru_.size() > capacity_) {
+      evicted.push_back(lru_.pop_back());
+    }
+  }
+
+  void erase(size_t key) override { lru_.erase(key); }
+
+  size_t size() const override { return lru_.size(); }
+
+ private:
+  recency_list lru_;
+  size_t const capacity_;
+};
+
+/**
+ * Window TinyLFU
+ *
+ * New blocks enter a small LRU window. Blocks falling out of the window
+ * only make it into the main cache (a segmented LRU) if they have been
+ * accessed more frequently than the block they would replace. This way,
+ * a single scan over lots of blocks cannot flush the working set.
+ */
+class w_tinylfu_policy final : public cache_policy::impl {
+ public:
+  w_tinylfu_policy(size_t capacity, size_t num_keys)
+      : window_capacity_{std::max<size_t>(capacity / 100, 1)}
+      , main_capacity_{capacity - window_capacity_}
+      , protected_capacity_{main_capacity_ * 8 / 10}
+      , sketch_{num_keys, 10 * capacity} {}
+
+  bool access(size_t key) override {
+    sketch_.increment(key);
+
+    if (window_.contains(key)) {
+      window_.move_to_front(key);
+    } else if (protected_.contains(key)) {
+      protected_.move_to_front(key);
+    } else if (probation_.contains(key)) {
+      probation_.erase(key);
+      protected_.push_front(key);
+
+      if (protected_.size() > protected_capacity_) {
+        probation_.push_front(protected_.pop_back());
+      }
+    } else {
+      return false;
+    }
+
+    return true;
+  }
+
+  void touch(size_t key) override {
+    if (!window_.try_move_to_front(key) &&
+        !probation_.try_move_to_front(key)) {
+      protected_.try_move_to_front(key);
+    }
+  }
+
+  bool contains(size_t key) const override {
+    return window_.contains(key) || probation_.contains(key) ||
+           protected_.contains(key);
+  }
+
+  void insert(size_t key, std::vector<size_t>& evicted) override {
+    window_.push_front(key);
+
+    if (window_.size() <= window_capacity_) {
+      return;
+    }
+
+    auto candidate = window_.pop_back();
+
+    if (probation_.size() + protected_.size() < main_capacity_) {
+      probation_.push_front(candidate);
+      return;
+    }
+
+    auto& victims = probation_.empty() ? protected_ : probation_;
+
+    if (victims.empty()) {
+      evicted.push_back(candidate);
+      return;
+    }
+
+    if (sketch_.estimate(candidate) > sketch_.estimate(victims.back())) {
+      evicted.push_back(victims.pop_back());
+      probation_.push_front(candidate);
+    } else {
+      evicted.push_back(candidate);
+    }
+  }
+
+  void erase(size_t key) override {
+    if (!window_.erase(key) && !probation_.erase(key)) {
+      protected_.erase(key);
+    }
+  }
+
+  size_t size() const override {
+    return window_.size() + probation_.size() + protected_.size();
+  }
+
+ private:
+  size_t const window_capacity_;
+  size_t const main_capacity_;
+  size_t const protected_capacity_;
+  recency_list window_;
+  recency_list probation_;
+  recency_list protected_;
+  frequency_sketch sketch_;
+};
+
+/**
+ * Adaptive Replacement Cache
+ *
+ * Balances between blocks seen once (T1) and blocks seen at least twice
+ * (T2). Ghost lists (B1, B2) remember recently evicted blocks and are
+ * used to adapt the target size of T1.
+ */
+class arc_policy final : public cache_policy::impl {
+ public:
+  explicit arc_policy(size_t capacity)
+      : capacity_{capacity} {}
+
+  bool access(size_t key) override {
+    if (t1_.erase(key)) {
+      t2_.push_front(key);
+    } else if (t2_.contains(key)) {
+      t2_.move_to_front(key);
+    } else {
+      return false;
+    }
+
+    return true;
+  }
+
+  void touch(size_t key) override {
+    if (!t1_.try_move_to_front(key)) {
+      t2_.try_move_to_front(key);
+    }
+  }
+
+  bool contains(size_t key) const override {
+    return t1_.contains(key) || t2_.contains(key);
+  }
+
+  void insert(size_t key, std::vector<size_t>& evicted) override {
+    if (b1_.contains(key)) {
+      auto delta = std::max<size_t>(b2_.size() / b1_.size(), 1);
+      target_t1_ = std::min(capacity_, target_t1_ + delta);
+      replace(false, evicted);
+      b1_.erase(key);
+      t2_.push_front(key);
+      return;
+    }
+
+    if (b2_.contains(key)) {
+      auto delta = std::max<size_t>(b1_.size() / b2_.size(), 1);
+      target_t1_ = target_t1_ > delta ? target_t1_ - delta : 0;
+      replace(true, evicted);
+      b2_.erase(key);
+      t2_.push_front(key);
+      return;
+    }
+
+    auto const l1 = t1_.size() + b1_.size();
+    auto const total = l1 + t2_.size() + b2_.size();
+
+    if (l1 >= capacity_) {
+      if (t1_.size() < capacity_) {
+        b1_.pop_back();
+        replace(false, evicted);
+      } else {
+        evicted.push_back(t1_.pop_back());
+      }
+    } else if (total >= capacity_) {
+      if (total >= 2 * capacity_) {
+        b2_.pop_back();
+      }
+      replace(false, evicted);
+    }
+
+    t1_.push_front(key);
+  }
+
+  void erase(size_t key) override {
+    if (!t1_.erase(key)) {
+      t2_.erase(key);
+    }
+  }
+
+  size_t size() const override { return t1_.size() + t2_.size(); }
+
+ private:
+  void replace(bool in_b2, std::vector<size_t>& evicted) {
+    if (t1_.size() + t2_.size() < capacity_) {
+      return;
+    }
+
+    if (!t1_.empty() && (t1_.size() > target_t1_ ||
+                         (in_b2 && t1_.size() == target_t1_) || t2_.empty())) {
+      auto key = t1_.pop_back();
+      b1_.push_front(key);
+      evicted.push_back(key);
+    } else if (!t2_.empty()) {
+      auto key = t2_.pop_back();
+      b2_.push_front(key);
+      evicted.push_back(key);
+    }
+  }
+
+  size_t const capacity_;
+  size_t target_t1_{0};
+  recency_list t1_;
+  recency_list t2_;
+  recency_list b1_;
+  recency_list b2_;
+};
+
+std::unique_ptr<cache_policy::impl>
+make_cache_policy(cache_replacement_policy policy, size_t capacity,
+                  size_t num_keys) {
+  // An unbounded cache never evicts, so all policies are equivalent
+  if (capacity == 0) {
+    return std::make_unique<lru_policy>(capacity);
+  }
+
+  switch (policy) {
+  case cache_replacement_policy::W_TINYLFU:
+    return std::make_unique<w_tinylfu_policy>(capacity, num_keys);
+
+  case cache_replacement_policy::ARC:
+    return std::make_unique<arc_policy>(capacity);
+
+  default:
+    return std::make_unique<lru_policy>(capacity);
+  }
+}
+
+} // namespace
+
+cache_policy::cache_policy(cache_replacement_policy policy, size_t capacity,
+                           size_t num_keys)
+    : impl_{make_cache_policy(policy, capacity, num_keys)} {}
+
+} // namespace dwarfs
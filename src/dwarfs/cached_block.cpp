@@ -20,12 +20,18 @@
  */
 
 #include <atomic>
+#include <exception>
+#include <mutex>
+#include <span>
 
 #ifndef _WIN32
 #include <sys/mman.h>
 #endif
 
+#include <folly/ExceptionString.h>
+
 #include "dwarfs/block_compressor.h"
+#include "dwarfs/block_reader.h"
 #include "dwarfs/cached_block.h"
 #include "dwarfs/error.h"
 #include "dwarfs/fs_section.h"
@@ -40,19 +46,35 @@ class cached_block_ final : public cached_block {
   cached_block_(logger& lgr, fs_section const& b, std::shared_ptr<mmif> mm,
                 bool release, bool disable_integrity_check)
       : decompressor_(std::make_unique<block_decompressor>(
-            b.compression(), mm->as<uint8_t>(b.start()), b.length(), data_))
+            b.compression(), mm->span(b.start(), b.length()).data(),
+            b.length(), data_))
       , mm_(std::move(mm))
       , section_(b)
       , LOG_PROXY_INIT(lgr)
       , release_(release)
-      , uncompressed_size_{decompressor_->uncompressed_size()} {
+      , disable_integrity_check_(disable_integrity_check)
+      , uncompressed_size_{decompressor_->uncompressed_size()}
+      , loaded_{true} {
     if (!disable_integrity_check && !section_.check(*mm_)) {
       DWARFS_THROW(runtime_error, "block data integrity check failed");
     }
   }
 
+  cached_block_(logger& lgr, fs_section const& b,
+                std::shared_ptr<block_reader> reader,
+                bool disable_integrity_check)
+      : reader_(std::move(reader))
+      , section_(b)
+      , LOG_PROXY_INIT(lgr)
+      , release_(false)
+      , disable_integrity_check_(disable_integrity_check) {}
+
   ~cached_block_() override {
-    if (decompressor_) {
+    if (reader_) {
+      if (!loaded_) {
+        reader_->cancel(section_);
+      }
+    } else if (decompressor_) {
       try_release();
     }
   }
@@ -65,6 +87,12 @@ class cached_block_ final : public cached_block {
   const uint8_t* data() const override { return data_.data(); }
 
   void decompress_until(size_t end) override {
+    load();
+
+    if (load_error_) {
+      std::rethrow_exception(load_error_);
+    }
+
     while (data_.size() < end) {
       if (!decompressor_) {
         DWARFS_THROW(runtime_error, "no decompressor for block");
@@ -73,6 +101,7 @@ class cached_block_ final : public cached_block {
       if (decompressor_->decompress_frame()) {
         // We're done, free the memory
         decompressor_.reset();
+        compressed_.reset();
 
         // And release the memory from the mapping
         try_release();
@@ -82,7 +111,12 @@ class cached_block_ final : public cached_block {
     }
   }
 
-  size_t uncompressed_size() const override { return uncompressed_size_; }
+  // Returns 0 if the compressed data could not be loaded, in which case
+  // `decompress_until()` will throw.
+  size_t uncompressed_size() const override {
+    load();
+    return uncompressed_size_;
+  }
 
   void touch() override { last_access_ = std::chrono::steady_clock::now(); }
 
@@ -108,6 +142,40 @@ class cached_block_ final : public cached_block {
   }
 
  private:
+  void load() const {
+    if (!reader_) {
+      return;
+    }
+
+    std::lock_guard lock(load_mx_);
+
+    if (loaded_) {
+      return;
+    }
+
+    // Even if reading fails, the reader is done with this section
+    loaded_ = true;
+
+    try {
+      auto data = reader_->read(section_);
+
+      std::span<uint8_t const> span(data.get(), section_.length());
+
+      if (!disable_integrity_check_ && !section_.check(span)) {
+        DWARFS_THROW(runtime_error, "block data integrity check failed");
+      }
+
+      decompressor_ = std::make_unique<block_decompressor>(
+          section_.compression(), span.data(), span.size(), data_);
+      uncompressed_size_ = decompressor_->uncompressed_size();
+      compressed_ = std::move(data);
+    } catch (...) {
+      LOG_ERROR << "failed to load block at offset " << section_.start()
+                << ": " << folly::exceptionStr(std::current_exception());
+      load_error_ = std::current_exception();
+    }
+  }
+
   void try_release() {
     if (release_) {
       if (auto ec = mm_->release(section_.start(), section_.length())) {
@@ -117,13 +185,19 @@ class cached_block_ final : public cached_block {
   }
 
   std::atomic<size_t> range_end_{0};
-  std::vector<uint8_t> data_;
-  std::unique_ptr<block_decompressor> decompressor_;
+  std::vector<uint8_t> mutable data_;
+  std::unique_ptr<block_decompressor> mutable decompressor_;
   std::shared_ptr<mmif> mm_;
+  std::shared_ptr<block_reader> reader_;
+  std::shared_ptr<uint8_t const> mutable compressed_;
   fs_section section_;
   LOG_PROXY_DECL(LoggerPolicy);
   bool const release_;
-  size_t const uncompressed_size_;
+  bool const disable_integrity_check_;
+  size_t mutable uncompressed_size_{0};
+  std::mutex mutable load_mx_;
+  bool mutable loaded_{false};
+  std::exception_ptr mutable load_error_;
   std::chrono::steady_clock::time_point last_access_;
 };
 
@@ -135,4 +209,13 @@ cached_block::create(logger& lgr, fs_section const& b, std::shared_ptr<mmif> mm,
       lgr, b, std::move(mm), release, disable_integrity_check);
 }
 
+std::unique_ptr<cached_block>
+cached_block::create(logger& lgr, fs_section const& b,
+                     std::shared_ptr<block_reader> reader,
+                     bool disable_integrity_check) {
+  return make_unique_logging_object<cached_block, cached_block_,
+                                    logger_policies>(
+      lgr, b, std::move(reader), disable_integrity_check);
+}
+
 } // namespace dwarfs
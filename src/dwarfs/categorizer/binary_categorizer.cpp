@@ -19,33 +19,407 @@
  * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <array>
+#include <cassert>
 #include <cstring>
 #include <map>
-#include <stack>
-#include <unordered_set>
+#include <optional>
+#include <shared_mutex>
 #include <vector>
 
 #include <boost/program_options.hpp>
 
 #include <fmt/format.h>
 
-// TODO: this should obvs. work everywhere
-#ifndef _WIN32
-#include <elf.h>
-#endif
+#include <folly/Synchronized.h>
+#include <folly/json.h>
+#include <folly/lang/Bits.h>
 
 #include "dwarfs/categorizer.h"
+#include "dwarfs/compression_metadata_requirements.h"
 #include "dwarfs/error.h"
 #include "dwarfs/logger.h"
 
 namespace dwarfs {
 
+namespace fs = std::filesystem;
 namespace po = boost::program_options;
 
 namespace {
 
-constexpr std::string_view const SOME_CATEGORY{"bla"};
+constexpr std::string_view const CODE_CATEGORY{"binary/code"};
+constexpr std::string_view const DATA_CATEGORY{"binary/data"};
+
+// Code sections smaller than this aren't worth a separate fragment
+constexpr size_t const MIN_CODE_FRAGMENT_SIZE{4096};
+
+// Some sanity limits to avoid wasting time on garbage
+constexpr size_t const MAX_SECTION_COUNT{65536};
+constexpr size_t const MAX_FAT_ARCH_COUNT{20};
+
+struct code_range {
+  size_t offset;
+  size_t size;
+};
+
+struct executable_info {
+  std::string architecture;
+  std::vector<code_range> code;
+};
+
+class truncated_error : public std::exception {};
+
+class byte_reader {
+ public:
+  byte_reader(std::span<uint8_t const> data, bool big_endian)
+      : data_{data}
+      , big_endian_{big_endian} {}
+
+  template <typename T>
+  T read(size_t offset) const {
+    if (offset > data_.size() || data_.size() - offset < sizeof(T)) {
+      throw truncated_error();
+    }
+    T value;
+    std::memcpy(&value, data_.data() + offset, sizeof(T));
+    return big_endian_ ? folly::Endian::big(value)
+                       : folly::Endian::little(value);
+  }
+
+  uint8_t u8(size_t offset) const { return read<uint8_t>(offset); }
+  uint16_t u16(size_t offset) const { return read<uint16_t>(offset); }
+  uint32_t u32(size_t offset) const { return read<uint32_t>(offset); }
+  uint64_t u64(size_t offset) const { return read<uint64_t>(offset); }
+
+  size_t size() const { return data_.size(); }
+
+ private:
+  std::span<uint8_t const> data_;
+  bool const big_endian_;
+};
+
+std::optional<executable_info> parse_elf(std::span<uint8_t const> data) {
+  static constexpr size_t const EI_NIDENT{16};
+  static constexpr uint32_t const SHT_PROGBITS{1};
+  static constexpr uint64_t const SHF_EXECINSTR{0x4};
+
+  if (data.size() < EI_NIDENT || std::memcmp(data.data(), "\177ELF", 4) != 0) {
+    return std::nullopt;
+  }
+
+  auto ei_class = data[4];
+  auto ei_data = data[5];
+
+  if ((ei_class != 1 && ei_class != 2) || (ei_data != 1 && ei_data != 2)) {
+    return std::nullopt;
+  }
+
+  bool const is64 = ei_class == 2;
+  bool const big_endian = ei_data == 2;
+  byte_reader r(data, big_endian);
+
+  auto machine = r.u16(18);
+  uint64_t entry = is64 ? r.u64(24) : r.u32(24);
+  uint64_t shoff = is64 ? r.u64(40) : r.u32(32);
+  size_t shentsize = r.u16(is64 ? 58 : 46);
+  size_t shnum = r.u16(is64 ? 60 : 48);
+
+  executable_info info;
+
+  switch (machine) {
+  case 3:  // EM_386
+  case 62: // EM_X86_64
+    info.architecture = "x86";
+    break;
+  case 40: // EM_ARM
+    info.architecture = big_endian ? "arm-be" : entry & 1 ? "armthumb" : "arm";
+    break;
+  case 183: // EM_AARCH64
+    info.architecture = big_endian ? "arm64-be" : "arm64";
+    break;
+  case 20: // EM_PPC
+  case 21: // EM_PPC64
+    info.architecture = big_endian ? "powerpc" : "powerpc-le";
+    break;
+  case 2:  // EM_SPARC
+  case 18: // EM_SPARC32PLUS
+  case 43: // EM_SPARCV9
+    info.architecture = "sparc";
+    break;
+  case 8: // EM_MIPS
+    info.architecture = "mips";
+    break;
+  case 243: // EM_RISCV
+    info.architecture = "riscv";
+    break;
+  default:
+    info.architecture = fmt::format("elf-{}", machine);
+    break;
+  }
+
+  if (shnum == 0 || shnum > MAX_SECTION_COUNT ||
+      shentsize < (is64 ? 64 : 40)) {
+    return info;
+  }
+
+  for (size_t i = 0; i < shnum; ++i) {
+    auto sh = shoff + i * shentsize;
+    auto type = r.u32(sh + 4);
+    uint64_t flags = is64 ? r.u64(sh + 8) : r.u32(sh + 8);
+
+    if (type == SHT_PROGBITS && (flags & SHF_EXECINSTR)) {
+      uint64_t offset = is64 ? r.u64(sh + 24) : r.u32(sh + 16);
+      uint64_t size = is64 ? r.u64(sh + 32) : r.u32(sh + 20);
+      info.code.push_back({offset, size});
+    }
+  }
+
+  return info;
+}
+
+std::optional<executable_info> parse_pe(std::span<uint8_t const> data) {
+  static constexpr uint32_t const IMAGE_SCN_CNT_CODE{0x00000020};
+  static constexpr uint32_t const IMAGE_SCN_MEM_EXECUTE{0x20000000};
+
+  if (data.size() < 0x40 || data[0] != 'M' || data[1] != 'Z') {
+    return std::nullopt;
+  }
+
+  byte_reader r(data, false);
+
+  size_t pe = r.u32(0x3c);
+
+  if (r.u32(pe) != 0x00004550) { // "PE\0\0"
+    return std::nullopt;
+  }
+
+  auto machine = r.u16(pe + 4);
+  size_t nsections = r.u16(pe + 6);
+  size_t opthdr_size = r.u16(pe + 20);
+
+  executable_info info;
+
+  switch (machine) {
+  case 0x014c: // IMAGE_FILE_MACHINE_I386
+  case 0x8664: // IMAGE_FILE_MACHINE_AMD64
+    info.architecture = "x86";
+    break;
+  case 0x01c0: // IMAGE_FILE_MACHINE_ARM
+    info.architecture = "arm";
+    break;
+  case 0x01c2: // IMAGE_FILE_MACHINE_THUMB
+  case 0x01c4: // IMAGE_FILE_MACHINE_ARMNT
+    info.architecture = "armthumb";
+    break;
+  case 0xaa64: // IMAGE_FILE_MACHINE_ARM64
+    info.architecture = "arm64";
+    break;
+  default:
+    info.architecture = fmt::format("pe-{:04x}", machine);
+    break;
+  }
+
+  auto sections = pe + 24 + opthdr_size;
+
+  for (size_t i = 0; i < nsections; ++i) {
+    auto sh = sections + i * 40;
+    auto size = r.u32(sh + 16);   // SizeOfRawData
+    auto offset = r.u32(sh + 20); // PointerToRawData
+    auto characteristics = r.u32(sh + 36);
+
+    if (characteristics & (IMAGE_SCN_CNT_CODE | IMAGE_SCN_MEM_EXECUTE)) {
+      info.code.push_back({offset, size});
+    }
+  }
+
+  return info;
+}
+
+std::string macho_architecture(uint32_t cputype) {
+  switch (cputype) {
+  case 7:          // CPU_TYPE_X86
+  case 0x01000007: // CPU_TYPE_X86_64
+    return "x86";
+  case 12: // CPU_TYPE_ARM
+    return "arm";
+  case 0x0100000c: // CPU_TYPE_ARM64
+    return "arm64";
+  case 18: // CPU_TYPE_POWERPC
+    return "powerpc";
+  default:
+    return fmt::format("macho-{:x}", cputype);
+  }
+}
+
+void parse_macho_image(std::span<uint8_t const> data, size_t base,
+                       executable_info& info) {
+  static constexpr uint32_t const LC_SEGMENT{0x1};
+  static constexpr uint32_t const LC_SEGMENT_64{0x19};
+  static constexpr uint32_t const S_ATTR_PURE_INSTRUCTIONS{0x80000000};
+  static constexpr uint32_t const S_ATTR_SOME_INSTRUCTIONS{0x00000400};
+
+  byte_reader le(data, false);
+  auto magic = le.u32(base);
+  bool is64;
+  bool big_endian;
+
+  switch (magic) {
+  case 0xfeedface:
+    is64 = false;
+    big_endian = false;
+    break;
+  case 0xfeedfacf:
+    is64 = true;
+    big_endian = false;
+    break;
+  case 0xcefaedfe:
+    is64 = false;
+    big_endian = true;
+    break;
+  case 0xcffaedfe:
+    is64 = true;
+    big_endian = true;
+    break;
+  default:
+    return;
+  }
+
+  byte_reader r(data, big_endian);
+
+  auto arch = macho_architecture(r.u32(base + 4));
+
+  if (info.architecture.empty()) {
+    info.architecture = arch;
+  } else if (info.architecture != arch) {
+    // universal binary with different architectures, only keep the first
+    return;
+  }
+
+  size_t ncmds = r.u32(base + 16);
+  auto cmd = base + (is64 ? 32 : 28);
+
+  if (ncmds > MAX_SECTION_COUNT) {
+    return;
+  }
+
+  for (size_t i = 0; i < ncmds; ++i) {
+    auto type = r.u32(cmd);
+    auto cmdsize = r.u32(cmd + 4);
+
+    if (cmdsize < 8) {
+      break;
+    }
+
+    if (type == (is64 ? LC_SEGMENT_64 : LC_SEGMENT)) {
+      size_t nsects = r.u32(cmd + (is64 ? 64 : 48));
+      auto sect = cmd + (is64 ? 72 : 56);
+      size_t sectsize = is64 ? 80 : 68;
+
+      for (size_t s = 0; s < nsects && s < MAX_SECTION_COUNT; ++s) {
+        auto sh = sect + s * sectsize;
+        uint64_t size = is64 ? r.u64(sh + 40) : r.u32(sh + 36);
+        uint64_t offset = r.u32(sh + (is64 ? 48 : 40));
+        auto flags = r.u32(sh + (is64 ? 64 : 56));
+
+        if (flags & (S_ATTR_PURE_INSTRUCTIONS | S_ATTR_SOME_INSTRUCTIONS)) {
+          info.code.push_back({base + offset, size});
+        }
+      }
+    }
+
+    cmd += cmdsize;
+  }
+}
+
+std::optional<executable_info> parse_macho(std::span<uint8_t const> data) {
+  if (data.size() < 32) {
+    return std::nullopt;
+  }
+
+  byte_reader be(data, true);
+  executable_info info;
+
+  if (be.u32(0) == 0xcafebabe) {
+    // Universal binary; this magic is shared with Java class files, which
+    // have a much larger value in the following field.
+    size_t nfat = be.u32(4);
+
+    if (nfat == 0 || nfat > MAX_FAT_ARCH_COUNT) {
+      return std::nullopt;
+    }
+
+    for (size_t i = 0; i < nfat; ++i) {
+      parse_macho_image(data, be.u32(8 + i * 20 + 8), info);
+    }
+  } else {
+    parse_macho_image(data, 0, info);
+  }
+
+  if (info.architecture.empty()) {
+    return std::nullopt;
+  }
+
+  return info;
+}
+
+std::optional<executable_info> parse_executable(std::span<uint8_t const> data) {
+  try {
+    if (auto info = parse_elf(data)) {
+      return info;
+    }
+    if (auto info = parse_pe(data)) {
+      return info;
+    }
+    return parse_macho(data);
+  } catch (truncated_error const&) {
+    return std::nullopt;
+  }
+}
+
+struct binary_metadata {
+  std::string architecture;
+
+  auto operator<=>(binary_metadata const&) const = default;
+};
+
+std::ostream& operator<<(std::ostream& os, binary_metadata const& m) {
+  os << "[arch=" << m.architecture << "]";
+  return os;
+}
+
+class binary_metadata_store {
+ public:
+  binary_metadata_store() = default;
+
+  size_t add(binary_metadata const& m) {
+    auto it = reverse_index_.find(m);
+    if (it == reverse_index_.end()) {
+      auto r = reverse_index_.emplace(m, forward_index_.size());
+      assert(r.second);
+      forward_index_.emplace_back(m);
+      it = r.first;
+    }
+    return it->second;
+  }
+
+  std::string lookup(size_t ix) const {
+    auto const& m = DWARFS_NOTHROW(forward_index_.at(ix));
+    folly::dynamic obj = folly::dynamic::object;
+    obj.insert("architecture", m.architecture);
+    return folly::toJson(obj);
+  }
+
+  bool less(size_t a, size_t b) const {
+    auto const& ma = DWARFS_NOTHROW(forward_index_.at(a));
+    auto const& mb = DWARFS_NOTHROW(forward_index_.at(b));
+    return ma < mb;
+  }
+
+ private:
+  std::vector<binary_metadata> forward_index_;
+  std::map<binary_metadata, size_t> reverse_index_;
+};
 
 class binary_categorizer_base : public random_access_categorizer {
  public:
@@ -56,63 +430,144 @@ template <typename LoggerPolicy>
 class binary_categorizer_ final : public binary_categorizer_base {
  public:
   explicit binary_categorizer_(logger& lgr)
-      : LOG_PROXY_INIT(lgr) {}
+      : LOG_PROXY_INIT(lgr) {
+    code_req_.add_set<std::string>("architecture",
+                                   &binary_metadata::architecture);
+  }
 
   inode_fragments
-  categorize(std::filesystem::path const& path, std::span<uint8_t const> data,
+  categorize(fs::path const& path, std::span<uint8_t const> data,
              category_mapper const& mapper) const override;
 
+  std::string category_metadata(std::string_view category_name,
+                                fragment_category c) const override {
+    if (category_name == CODE_CATEGORY) {
+      DWARFS_CHECK(c.has_subcategory(), "expected CODE to have subcategory");
+      return meta_.rlock()->lookup(c.subcategory());
+    }
+    return std::string();
+  }
+
+  void set_metadata_requirements(std::string_view category_name,
+                                 std::string requirements) override;
+
   bool
   subcategory_less(fragment_category a, fragment_category b) const override;
 
  private:
   LOG_PROXY_DECL(LoggerPolicy);
+  folly::Synchronized<binary_metadata_store, std::shared_mutex> mutable meta_;
+  compression_metadata_requirements<binary_metadata> code_req_;
 };
 
 std::span<std::string_view const> binary_categorizer_base::categories() const {
   static constexpr std::array const s_categories{
-      SOME_CATEGORY,
+      CODE_CATEGORY,
+      DATA_CATEGORY,
   };
   return s_categories;
 }
 
 template <typename LoggerPolicy>
 inode_fragments binary_categorizer_<LoggerPolicy>::categorize(
-    std::filesystem::path const&,
-    std::span<uint8_t const> data [[maybe_unused]],
-    category_mapper const& /*mapper*/) const {
+    fs::path const& path, std::span<uint8_t const> data,
+    category_mapper const& mapper) const {
   inode_fragments fragments;
 
-#ifndef _WIN32
-  auto p = data.data();
-  if (data.size() >= EI_NIDENT && ::memcmp(p, ELFMAG, 4) == 0) {
-    switch (p[EI_OSABI]) {
-    case ELFOSABI_SYSV:       // 0	/* UNIX System V ABI */
-    case ELFOSABI_HPUX:       // 1	/* HP-UX */
-    case ELFOSABI_NETBSD:     // 2	/* NetBSD.  */
-    case ELFOSABI_GNU:        // 3	/* Object uses GNU ELF extensions.  */
-    case ELFOSABI_SOLARIS:    // 6	/* Sun Solaris.  */
-    case ELFOSABI_AIX:        // 7	/* IBM AIX.  */
-    case ELFOSABI_IRIX:       // 8	/* SGI Irix.  */
-    case ELFOSABI_FREEBSD:    // 9	/* FreeBSD.  */
-    case ELFOSABI_TRU64:      // 10	/* Compaq TRU64 UNIX.  */
-    case ELFOSABI_MODESTO:    // 11	/* Novell Modesto.  */
-    case ELFOSABI_OPENBSD:    // 12	/* OpenBSD.  */
-    case ELFOSABI_ARM_AEABI:  // 64	/* ARM EABI */
-    case ELFOSABI_ARM:        // 97	/* ARM */
-    case ELFOSABI_STANDALONE: // 255	/* Standalone (embedded) application */
-      break;
+  auto info = parse_executable(data);
+
+  if (!info) {
+    return fragments;
+  }
+
+  // clip to file size, drop tiny sections, then sort and merge
+  std::vector<code_range> code;
+
+  for (auto r : info->code) {
+    if (r.offset < data.size()) {
+      r.size = std::min(r.size, data.size() - r.offset);
+      if (r.size > 0) {
+        code.push_back(r);
+      }
+    }
+  }
+
+  std::sort(code.begin(), code.end(), [](auto const& a, auto const& b) {
+    return a.offset < b.offset;
+  });
+
+  std::vector<code_range> merged;
+
+  for (auto const& r : code) {
+    if (!merged.empty() &&
+        r.offset <= merged.back().offset + merged.back().size) {
+      auto end = std::max(merged.back().offset + merged.back().size,
+                          r.offset + r.size);
+      merged.back().size = end - merged.back().offset;
+    } else {
+      merged.push_back(r);
     }
   }
-#endif
+
+  std::erase_if(merged, [](auto const& r) {
+    return r.size < MIN_CODE_FRAGMENT_SIZE;
+  });
+
+  if (merged.empty()) {
+    LOG_TRACE << path << ": no code sections found (" << info->architecture
+              << ")";
+    return fragments;
+  }
+
+  binary_metadata meta;
+  meta.architecture = info->architecture;
+
+  try {
+    code_req_.check(meta);
+  } catch (std::exception const& e) {
+    LOG_DEBUG << path << ": " << e.what();
+    return fragments;
+  }
+
+  LOG_TRACE << path << ": meta=" << meta << ", " << merged.size()
+            << " code fragment(s)";
+
+  fragment_category code_cat(mapper(CODE_CATEGORY), meta_.wlock()->add(meta));
+  fragment_category data_cat(mapper(DATA_CATEGORY));
+  size_t pos = 0;
+
+  for (auto const& r : merged) {
+    if (r.offset > pos) {
+      fragments.emplace_back(data_cat, r.offset - pos);
+    }
+    fragments.emplace_back(code_cat, r.size);
+    pos = r.offset + r.size;
+  }
+
+  if (pos < data.size()) {
+    fragments.emplace_back(data_cat, data.size() - pos);
+  }
 
   return fragments;
 }
 
+template <typename LoggerPolicy>
+void binary_categorizer_<LoggerPolicy>::set_metadata_requirements(
+    std::string_view category_name, std::string requirements) {
+  if (!requirements.empty()) {
+    auto req = folly::parseJson(requirements);
+    if (category_name == CODE_CATEGORY) {
+      code_req_.parse(req);
+    } else {
+      compression_metadata_requirements().parse(req);
+    }
+  }
+}
+
 template <typename LoggerPolicy>
 bool binary_categorizer_<LoggerPolicy>::subcategory_less(
-    fragment_category, fragment_category) const {
-  return false; // TODO
+    fragment_category a, fragment_category b) const {
+  return meta_.rlock()->less(a.subcategory(), b.subcategory());
 }
 
 class binary_categorizer_factory : public categorizer_factory {
@@ -0,0 +1,526 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <shared_mutex>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include <folly/Synchronized.h>
+#include <folly/json.h>
+
+#include "dwarfs/categorizer.h"
+#include "dwarfs/compression_metadata_requirements.h"
+#include "dwarfs/error.h"
+#include "dwarfs/logger.h"
+#include "dwarfs/map_util.h"
+#include "dwarfs/util.h"
+
+namespace dwarfs {
+
+namespace fs = std::filesystem;
+namespace po = boost::program_options;
+
+namespace {
+
+constexpr std::string_view const METADATA_CATEGORY{"numeric/metadata"};
+constexpr std::string_view const ARRAY_CATEGORY{"numeric/array"};
+
+constexpr std::string_view const NPY_MAGIC{"\x93NUMPY"};
+
+// Maximum number of bytes to look at when detecting raw arrays
+constexpr size_t const RAW_SAMPLE_SIZE{1 << 20};
+
+// Minimum difference (in bits) between the entropy of the least and
+// most random byte lanes for data to be considered a numeric array
+constexpr double const RAW_MIN_ENTROPY_SPREAD{2.0};
+
+// A wider element size must improve the spread by at least this much
+constexpr double const RAW_WIDER_ELEMENT_GAIN{1.0};
+
+struct numeric_categorizer_config {
+  size_t raw_min_size{0};
+};
+
+std::optional<std::endian> parse_endian(std::string_view e) {
+  static std::unordered_map<std::string_view, std::endian> const lookup{
+      {"big", std::endian::big},
+      {"little", std::endian::little},
+  };
+  return get_optional(lookup, e);
+}
+
+std::optional<std::endian> parse_endian_dyn(folly::dynamic const& e) {
+  return parse_endian(e.asString());
+}
+
+std::string_view endian_name(std::endian e) {
+  return e == std::endian::big ? "big" : "little";
+}
+
+struct numeric_array_info {
+  std::endian endianness;
+  size_t element_size;
+  size_t header_size;
+  size_t array_size;
+};
+
+/**
+ * Parse a NumPy `.npy` file header
+ *
+ * Only simple (non-structured) numeric dtypes are supported. The header
+ * is a Python dict literal, e.g.:
+ *
+ *   {'descr': '<f4', 'fortran_order': False, 'shape': (100, 3), }
+ */
+std::optional<numeric_array_info> parse_npy(std::span<uint8_t const> data) {
+  if (data.size() < 10 ||
+      std::memcmp(data.data(), NPY_MAGIC.data(), NPY_MAGIC.size()) != 0) {
+    return std::nullopt;
+  }
+
+  auto major = data[6];
+  size_t header_len;
+  size_t offset;
+
+  if (major == 1) {
+    header_len = data[8] | (static_cast<size_t>(data[9]) << 8);
+    offset = 10;
+  } else if (major == 2 || major == 3) {
+    if (data.size() < 12) {
+      return std::nullopt;
+    }
+    header_len = data[8] | (static_cast<size_t>(data[9]) << 8) |
+                 (static_cast<size_t>(data[10]) << 16) |
+                 (static_cast<size_t>(data[11]) << 24);
+    offset = 12;
+  } else {
+    return std::nullopt;
+  }
+
+  if (data.size() < offset + header_len) {
+    return std::nullopt;
+  }
+
+  std::string_view header(reinterpret_cast<char const*>(data.data()) + offset,
+                          header_len);
+
+  auto quoted_value = [&](std::string_view key) -> std::string_view {
+    auto pos = header.find(key);
+    if (pos == std::string_view::npos) {
+      return {};
+    }
+    pos = header.find_first_of("'\"", pos + key.size());
+    if (pos == std::string_view::npos) {
+      return {};
+    }
+    auto end = header.find(header[pos], pos + 1);
+    if (end == std::string_view::npos) {
+      return {};
+    }
+    return header.substr(pos + 1, end - pos - 1);
+  };
+
+  auto descr = quoted_value("'descr':");
+
+  if (descr.size() < 3) {
+    return std::nullopt;
+  }
+
+  numeric_array_info info;
+
+  switch (descr[0]) {
+  case '<':
+  case '=': // .npy files are almost always written on little-endian machines
+    info.endianness = std::endian::little;
+    break;
+  case '>':
+    info.endianness = std::endian::big;
+    break;
+  default:
+    return std::nullopt;
+  }
+
+  size_t itemsize{0};
+  auto sz = descr.substr(2);
+  if (auto [p, ec] = std::from_chars(sz.data(), sz.data() + sz.size(), itemsize);
+      ec != std::errc() || p != sz.data() + sz.size()) {
+    return std::nullopt;
+  }
+
+  switch (descr[1]) {
+  case 'f':
+  case 'i':
+  case 'u':
+    info.element_size = itemsize;
+    break;
+  case 'c': // complex numbers are pairs of floats
+    info.element_size = itemsize / 2;
+    break;
+  default:
+    return std::nullopt;
+  }
+
+  if (info.element_size != 2 && info.element_size != 4 &&
+      info.element_size != 8) {
+    return std::nullopt;
+  }
+
+  auto shape_pos = header.find("'shape':");
+  if (shape_pos == std::string_view::npos) {
+    return std::nullopt;
+  }
+  auto open = header.find('(', shape_pos);
+  auto close = header.find(')', open);
+  if (open == std::string_view::npos || close == std::string_view::npos) {
+    return std::nullopt;
+  }
+
+  size_t count = 1;
+  auto shape = header.substr(open + 1, close - open - 1);
+
+  while (!shape.empty()) {
+    auto comma = shape.find(',');
+    auto dim = shape.substr(0, comma);
+    while (!dim.empty() && dim.front() == ' ') {
+      dim.remove_prefix(1);
+    }
+    if (!dim.empty()) {
+      size_t n{0};
+      if (auto [p, ec] = std::from_chars(dim.data(), dim.data() + dim.size(), n);
+          ec != std::errc()) {
+        return std::nullopt;
+      }
+      count *= n;
+    }
+    if (comma == std::string_view::npos) {
+      break;
+    }
+    shape.remove_prefix(comma + 1);
+  }
+
+  info.header_size = offset + header_len;
+  info.array_size = std::min(count * itemsize, data.size() - info.header_size);
+  info.array_size -= info.array_size % info.element_size;
+
+  return info;
+}
+
+double byte_entropy(std::array<size_t, 256> const& hist, size_t total) {
+  double h = 0.0;
+  for (auto c : hist) {
+    if (c > 0) {
+      double p = static_cast<double>(c) / total;
+      h -= p * std::log2(p);
+    }
+  }
+  return h;
+}
+
+/**
+ * Heuristically detect headerless arrays of fixed-width numbers
+ *
+ * In such arrays, the byte lanes (i.e. all n-th bytes of each element)
+ * have very different entropies: the most significant bytes and the
+ * exponent bytes of floating point numbers are much more predictable
+ * than the least significant bytes. Text, machine code or compressed
+ * data don't show this pattern.
+ */
+std::optional<numeric_array_info> detect_raw(std::span<uint8_t const> data) {
+  auto sample = data.subspan(0, std::min(data.size(), RAW_SAMPLE_SIZE));
+  sample = sample.subspan(0, sample.size() - sample.size() % 8);
+
+  if (sample.empty()) {
+    return std::nullopt;
+  }
+
+  std::array<std::array<size_t, 256>, 8> hist{};
+
+  for (size_t i = 0; i < sample.size(); ++i) {
+    ++hist[i % 8][sample[i]];
+  }
+
+  std::optional<numeric_array_info> best;
+  double best_spread = 0.0;
+
+  for (size_t width : {2, 4, 8}) {
+    if (data.size() % width != 0) {
+      continue;
+    }
+
+    std::array<double, 8> lane_entropy{};
+    auto lane_total = sample.size() / width;
+
+    for (size_t lane = 0; lane < width; ++lane) {
+      std::array<size_t, 256> lh{};
+      for (size_t k = lane; k < 8; k += width) {
+        for (size_t b = 0; b < 256; ++b) {
+          lh[b] += hist[k][b];
+        }
+      }
+      lane_entropy[lane] = byte_entropy(lh, lane_total);
+    }
+
+    auto [min, max] = std::minmax_element(lane_entropy.begin(),
+                                          lane_entropy.begin() + width);
+    auto spread = *max - *min;
+
+    if (spread >= RAW_MIN_ENTROPY_SPREAD &&
+        spread > best_spread + RAW_WIDER_ELEMENT_GAIN) {
+      double lower = 0.0;
+      double upper = 0.0;
+      for (size_t lane = 0; lane < width / 2; ++lane) {
+        lower += lane_entropy[lane];
+        upper += lane_entropy[width - 1 - lane];
+      }
+
+      numeric_array_info info;
+      info.endianness = upper < lower ? std::endian::little : std::endian::big;
+      info.element_size = width;
+      info.header_size = 0;
+      info.array_size = data.size();
+
+      best = info;
+      best_spread = spread;
+    }
+  }
+
+  return best;
+}
+
+struct numeric_metadata {
+  std::endian endianness;
+  uint8_t element_size;
+
+  auto operator<=>(numeric_metadata const&) const = default;
+};
+
+std::ostream& operator<<(std::ostream& os, numeric_metadata const& m) {
+  os << "[" << endian_name(m.endianness) << "-endian, "
+     << "element_size=" << static_cast<int>(m.element_size) << "]";
+  return os;
+}
+
+class numeric_metadata_store {
+ public:
+  numeric_metadata_store() = default;
+
+  size_t add(numeric_metadata const& m) {
+    auto it = reverse_index_.find(m);
+    if (it == reverse_index_.end()) {
+      auto r = reverse_index_.emplace(m, forward_index_.size());
+      assert(r.second);
+      forward_index_.emplace_back(m);
+      it = r.first;
+    }
+    return it->second;
+  }
+
+  std::string lookup(size_t ix) const {
+    auto const& m = DWARFS_NOTHROW(forward_index_.at(ix));
+    folly::dynamic obj = folly::dynamic::object;
+    obj.insert("endianness", std::string(endian_name(m.endianness)));
+    obj.insert("element_size", m.element_size);
+    return folly::toJson(obj);
+  }
+
+  bool less(size_t a, size_t b) const {
+    auto const& ma = DWARFS_NOTHROW(forward_index_.at(a));
+    auto const& mb = DWARFS_NOTHROW(forward_index_.at(b));
+    return ma < mb;
+  }
+
+ private:
+  std::vector<numeric_metadata> forward_index_;
+  std::map<numeric_metadata, size_t> reverse_index_;
+};
+
+class numeric_categorizer_base : public random_access_categorizer {
+ public:
+  std::span<std::string_view const> categories() const override;
+};
+
+template <typename LoggerPolicy>
+class numeric_categorizer_ final : public numeric_categorizer_base {
+ public:
+  numeric_categorizer_(logger& lgr, numeric_categorizer_config const& cfg)
+      : LOG_PROXY_INIT(lgr)
+      , cfg_{cfg} {
+    array_req_.add_set("endianness", &numeric_metadata::endianness,
+                       parse_endian_dyn);
+    array_req_.add_set<int>("element_size", &numeric_metadata::element_size);
+  }
+
+  inode_fragments
+  categorize(fs::path const& path, std::span<uint8_t const> data,
+             category_mapper const& mapper) const override;
+
+  std::string category_metadata(std::string_view category_name,
+                                fragment_category c) const override {
+    if (category_name == ARRAY_CATEGORY) {
+      DWARFS_CHECK(c.has_subcategory(), "expected ARRAY to have subcategory");
+      return meta_.rlock()->lookup(c.subcategory());
+    }
+    return std::string();
+  }
+
+  void set_metadata_requirements(std::string_view category_name,
+                                 std::string requirements) override;
+
+  bool
+  subcategory_less(fragment_category a, fragment_category b) const override;
+
+ private:
+  bool check_metadata(numeric_metadata const& meta, fs::path const& path) const;
+
+  LOG_PROXY_DECL(LoggerPolicy);
+  numeric_categorizer_config const cfg_;
+  folly::Synchronized<numeric_metadata_store, std::shared_mutex> mutable meta_;
+  compression_metadata_requirements<numeric_metadata> array_req_;
+};
+
+std::span<std::string_view const> numeric_categorizer_base::categories() const {
+  static constexpr std::array const s_categories{
+      METADATA_CATEGORY,
+      ARRAY_CATEGORY,
+  };
+  return s_categories;
+}
+
+template <typename LoggerPolicy>
+bool numeric_categorizer_<LoggerPolicy>::check_metadata(
+    numeric_metadata const& meta, fs::path const& path) const {
+  try {
+    array_req_.check(meta);
+  } catch (std::exception const& e) {
+    LOG_DEBUG << path << ": " << e.what();
+    return false;
+  }
+
+  LOG_TRACE << path << ": meta=" << meta;
+
+  return true;
+}
+
+template <typename LoggerPolicy>
+inode_fragments numeric_categorizer_<LoggerPolicy>::categorize(
+    fs::path const& path, std::span<uint8_t const> data,
+    category_mapper const& mapper) const {
+  inode_fragments fragments;
+
+  auto info = parse_npy(data);
+
+  if (!info && cfg_.raw_min_size > 0 && data.size() >= cfg_.raw_min_size) {
+    info = detect_raw(data);
+  }
+
+  if (info && info->array_size > 0) {
+    numeric_metadata meta;
+    meta.endianness = info->endianness;
+    meta.element_size = info->element_size;
+
+    if (check_metadata(meta, path)) {
+      auto subcategory = meta_.wlock()->add(meta);
+      auto trailer = data.size() - info->header_size - info->array_size;
+
+      if (info->header_size > 0) {
+        fragments.emplace_back(fragment_category(mapper(METADATA_CATEGORY)),
+                               info->header_size);
+      }
+      fragments.emplace_back(
+          fragment_category(mapper(ARRAY_CATEGORY), subcategory),
+          info->array_size);
+      if (trailer > 0) {
+        fragments.emplace_back(fragment_category(mapper(METADATA_CATEGORY)),
+                               trailer);
+      }
+    }
+  }
+
+  return fragments;
+}
+
+template <typename LoggerPolicy>
+void numeric_categorizer_<LoggerPolicy>::set_metadata_requirements(
+    std::string_view category_name, std::string requirements) {
+  if (!requirements.empty()) {
+    auto req = folly::parseJson(requirements);
+    if (category_name == ARRAY_CATEGORY) {
+      array_req_.parse(req);
+    } else {
+      compression_metadata_requirements().parse(req);
+    }
+  }
+}
+
+template <typename LoggerPolicy>
+bool numeric_categorizer_<LoggerPolicy>::subcategory_less(
+    fragment_category a, fragment_category b) const {
+  return meta_.rlock()->less(a.subcategory(), b.subcategory());
+}
+
+class numeric_categorizer_factory : public categorizer_factory {
+ public:
+  numeric_categorizer_factory()
+      : opts_{std::make_shared<po::options_description>(
+            "Numeric categorizer options")} {
+    // clang-format off
+    opts_->add_options()
+      ("numeric-raw-min-size",
+          po::value<std::string>(&raw_min_size_str_)->default_value("64K"),
+          "minimum file size to check for headerless numeric arrays (0 to disable)")
+      ;
+    // clang-format on
+  }
+
+  std::string_view name() const override { return "numeric"; }
+
+  std::shared_ptr<po::options_description const> options() const override {
+    return opts_;
+  }
+
+  std::unique_ptr<categorizer>
+  create(logger& lgr, po::variables_map const& /*vm*/) const override {
+    auto cfg = cfg_;
+    cfg.raw_min_size = parse_size_with_unit(raw_min_size_str_);
+    return make_unique_logging_object<categorizer, numeric_categorizer_,
+                                      logger_policies>(lgr, cfg);
+  }
+
+ private:
+  std::string raw_min_size_str_;
+  numeric_categorizer_config cfg_;
+  std::shared_ptr<po::options_description> opts_;
+};
+
+} // namespace
+
+REGISTER_CATEGORIZER_FACTORY(numeric_categorizer_factory)
+
+} // namespace dwarfs
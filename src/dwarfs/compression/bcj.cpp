@@ -0,0 +1,299 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include <thrift/lib/cpp2/protocol/Serializer.h>
+
+#include <fmt/format.h>
+
+#include <folly/Range.h>
+#include <folly/json.h>
+
+#include "dwarfs/bcj_filter.h"
+#include "dwarfs/block_compressor.h"
+#include "dwarfs/compression.h"
+#include "dwarfs/error.h"
+#include "dwarfs/fstypes.h"
+#include "dwarfs/option_map.h"
+
+#include "dwarfs/gen-cpp2/compression_types.h"
+
+namespace dwarfs {
+
+namespace {
+
+class bcj_block_compressor final : public block_compressor::impl {
+ public:
+  bcj_block_compressor(std::optional<bcj_architecture> arch,
+                       block_compressor inner)
+      : arch_{arch}
+      , inner_{std::move(inner)} {
+    if (inner_.type() == compression_type::BCJ) {
+      DWARFS_THROW(runtime_error, "bcj compression cannot be nested");
+    }
+  }
+
+  bcj_block_compressor(const bcj_block_compressor& rhs) = default;
+
+  std::unique_ptr<block_compressor::impl> clone() const override {
+    return std::make_unique<bcj_block_compressor>(*this);
+  }
+
+  void compress(std::span<uint8_t const> data, std::string const* metadata,
+                std::vector<uint8_t>& target) const override {
+    compress_parallel(data, metadata, target, 1);
+  }
+
+  void compress_parallel(std::span<uint8_t const> data,
+                         std::string const* metadata,
+                         std::vector<uint8_t>& target,
+                         size_t num_threads) const override {
+    auto arch = arch_;
+
+    if (!arch) {
+      if (!metadata) {
+        DWARFS_THROW(runtime_error,
+                     "internal error: bcj compression requires metadata");
+      }
+
+      auto meta = folly::parseJson(*metadata);
+      auto name = meta["architecture"].asString();
+
+      arch = parse_bcj_architecture(name);
+
+      if (!arch) {
+        DWARFS_THROW(runtime_error,
+                     fmt::format("[BCJ] unsupported architecture: {}", name));
+      }
+    }
+
+    // The filter works in place. Reuse a per-thread scratch buffer for
+    // the filtered data rather than allocating a new one for each block.
+    thread_local std::vector<uint8_t> filtered;
+    filtered.assign(data.begin(), data.end());
+    bcj_encode(*arch, filtered);
+
+    auto const pos = target.size();
+
+    {
+      using namespace ::apache::thrift;
+
+      thrift::compression::bcj_block_header hdr;
+      hdr.architecture() = static_cast<uint8_t>(*arch);
+      hdr.compression() = static_cast<uint16_t>(inner_.type());
+
+      std::string hdrbuf;
+      CompactSerializer::serialize(hdr, &hdrbuf);
+      target.insert(target.end(), hdrbuf.begin(), hdrbuf.end());
+    }
+
+    inner_.compress_append(filtered, target, metadata, num_threads);
+
+    if (target.size() - pos >= data.size()) {
+      throw bad_compression_ratio_error();
+    }
+  }
+
+  compression_type type() const override { return compression_type::BCJ; }
+
+  std::string describe() const override {
+    return fmt::format("bcj [arch={}, compression={}]",
+                       arch_ ? bcj_architecture_name(*arch_) : "auto",
+                       inner_.describe());
+  }
+
+  std::string metadata_requirements() const override {
+    auto inner_req = inner_.metadata_requirements();
+
+    if (arch_) {
+      return inner_req;
+    }
+
+    folly::dynamic req = inner_req.empty() ? folly::dynamic::object
+                                           : folly::parseJson(inner_req);
+    folly::dynamic archs = folly::dynamic::array;
+
+    for (auto arch : bcj_architectures()) {
+      archs.push_back(std::string(bcj_architecture_name(arch)));
+    }
+
+    req["architecture"] = folly::dynamic::array("set", archs);
+
+    return folly::toJson(req);
+  }
+
+  compression_constraints
+  get_compression_constraints(std::string const& metadata) const override {
+    return inner_.get_compression_constraints(metadata);
+  }
+
+ private:
+  std::optional<bcj_architecture> const arch_;
+  block_compressor inner_;
+};
+
+class bcj_block_decompressor final : public block_decompressor::impl {
+ public:
+  bcj_block_decompressor(const uint8_t* data, size_t size,
+                         std::vector<uint8_t>& target)
+      : bcj_block_decompressor(folly::Range<uint8_t const*>(data, size),
+                               target) {}
+
+  bcj_block_decompressor(folly::Range<uint8_t const*> data,
+                         std::vector<uint8_t>& target)
+      : decompressed_{target}
+      , header_{decode_header(data)}
+      , arch_{static_cast<bcj_architecture>(header_.architecture().value())}
+      , inner_{compression_registry::instance().make_decompressor(
+            inner_type(header_),
+            std::span<uint8_t const>(data.data(), data.size()), target)}
+      , uncompressed_size_{inner_->uncompressed_size()}
+      , inner_metadata_{inner_->metadata()} {}
+
+  compression_type type() const override { return compression_type::BCJ; }
+
+  std::optional<std::string> metadata() const override {
+    folly::dynamic meta = inner_metadata_ ? folly::parseJson(*inner_metadata_)
+                                          : folly::dynamic::object;
+    meta["architecture"] = std::string(bcj_architecture_name(arch_));
+    return folly::toJson(meta);
+  }
+
+  bool decompress_frame(size_t) override {
+    if (!inner_) {
+      return false;
+    }
+
+    // The filter needs to see all data at once, so we have to
+    // decompress the whole block before undoing the conversion.
+    while (!inner_->decompress_frame(uncompressed_size_)) {
+    }
+
+    bcj_decode(arch_, decompressed_);
+
+    inner_.reset();
+
+    return true;
+  }
+
+  size_t uncompressed_size() const override { return uncompressed_size_; }
+
+ private:
+  static thrift::compression::bcj_block_header
+  decode_header(folly::Range<uint8_t const*>& range) {
+    using namespace ::apache::thrift;
+    thrift::compression::bcj_block_header hdr;
+    auto size = CompactSerializer::deserialize(range, hdr);
+    range.advance(size);
+    auto arch = static_cast<bcj_architecture>(hdr.architecture().value());
+    auto archs = bcj_architectures();
+    if (std::find(archs.begin(), archs.end(), arch) == archs.end()) {
+      DWARFS_THROW(runtime_error,
+                   fmt::format("[BCJ] unsupported architecture: {}",
+                               hdr.architecture().value()));
+    }
+    return hdr;
+  }
+
+  static compression_type
+  inner_type(thrift::compression::bcj_block_header const& hdr) {
+    auto type = static_cast<compression_type>(hdr.compression().value());
+    if (type == compression_type::BCJ) {
+      DWARFS_THROW(runtime_error, "[BCJ] nested bcj compression");
+    }
+    return type;
+  }
+
+  std::vector<uint8_t>& decompressed_;
+  thrift::compression::bcj_block_header const header_;
+  bcj_architecture const arch_;
+  std::unique_ptr<block_decompressor::impl> inner_;
+  size_t const uncompressed_size_;
+  std::optional<std::string> const inner_metadata_;
+};
+
+class bcj_compression_factory : public compression_factory {
+ public:
+  bcj_compression_factory()
+      : options_{
+            fmt::format("arch=[auto|{}]", fmt::join(arch_names(), "|")),
+            "compression=<spec> (use ',' instead of ':')",
+        } {}
+
+  std::string_view name() const override { return "bcj"; }
+
+  std::string_view description() const override {
+    static std::string const s_desc{
+        "BCJ branch conversion filter for executable code"};
+    return s_desc;
+  }
+
+  std::vector<std::string> const& options() const override { return options_; }
+
+  std::set<std::string> library_dependencies() const override { return {}; }
+
+  std::unique_ptr<block_compressor::impl>
+  make_compressor(option_map& om) const override {
+    auto arch_str = om.get<std::string>("arch", "auto");
+    auto inner = om.get<std::string>("compression", "zstd");
+
+    std::optional<bcj_architecture> arch;
+
+    if (arch_str != "auto") {
+      arch = parse_bcj_architecture(arch_str);
+      if (!arch) {
+        DWARFS_THROW(runtime_error,
+                     fmt::format("unsupported bcj architecture: {}", arch_str));
+      }
+    }
+
+    std::replace(inner.begin(), inner.end(), ',', ':');
+
+    return std::make_unique<bcj_block_compressor>(arch,
+                                                  block_compressor(inner));
+  }
+
+  std::unique_ptr<block_decompressor::impl>
+  make_decompressor(std::span<uint8_t const> data,
+                    std::vector<uint8_t>& target) const override {
+    return std::make_unique<bcj_block_decompressor>(data.data(), data.size(),
+                                                    target);
+  }
+
+ private:
+  static std::vector<std::string_view> arch_names() {
+    std::vector<std::string_view> names;
+    for (auto arch : bcj_architectures()) {
+      names.push_back(bcj_architecture_name(arch));
+    }
+    return names;
+  }
+
+  std::vector<std::string> const options_;
+};
+
+} // namespace
+
+REGISTER_COMPRESSION_FACTORY(compression_type::BCJ, bcj_compression_factory)
+
+} // namespace dwarfs
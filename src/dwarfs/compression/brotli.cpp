@@ -49,30 +49,22 @@ class brotli_block_compressor final : public block_compressor::impl {
     return std::make_unique<brotli_block_compressor>(*this);
   }
 
-  std::vector<uint8_t>
-  compress(const std::vector<uint8_t>& data,
-           std::string const* /*metadata*/) const override {
-    std::vector<uint8_t> compressed;
-    compressed.resize(folly::kMaxVarintLength64 +
-                      ::BrotliEncoderMaxCompressedSize(data.size()));
-    size_t size_size = folly::encodeVarint(data.size(), compressed.data());
-    size_t compressed_size = compressed.size() - size_size;
+  void compress(std::span<uint8_t const> data, std::string const* /*metadata*/,
+                std::vector<uint8_t>& target) const override {
+    auto const pos = target.size();
+    target.resize(pos + folly::kMaxVarintLength64 +
+                  ::BrotliEncoderMaxCompressedSize(data.size()));
+    size_t size_size = folly::encodeVarint(data.size(), target.data() + pos);
+    size_t compressed_size = target.size() - pos - size_size;
     if (!::BrotliEncoderCompress(quality_, window_bits_, BROTLI_DEFAULT_MODE,
                                  data.size(), data.data(), &compressed_size,
-                                 compressed.data() + size_size)) {
+                                 target.data() + pos + size_size)) {
       DWARFS_THROW(runtime_error, "brotli: error during compression");
     }
-    compressed.resize(size_size + compressed_size);
-    if (compressed.size() >= data.size()) {
+    target.resize(pos + size_size + compressed_size);
+    if (size_size + compressed_size >= data.size()) {
       throw bad_compression_ratio_error();
     }
-    compressed.shrink_to_fit();
-    return compressed;
-  }
-
-  std::vector<uint8_t> compress(std::vector<uint8_t>&& data,
-                                std::string const* metadata) const override {
-    return compress(data, metadata);
   }
 
   compression_type type() const override { return compression_type::BROTLI; }
@@ -204,8 +204,8 @@ class flac_block_compressor final : public block_compressor::impl {
     return std::make_unique<flac_block_compressor>(*this);
   }
 
-  std::vector<uint8_t> compress(const std::vector<uint8_t>& data,
-                                std::string const* metadata) const override {
+  void compress(std::span<uint8_t const> data, std::string const* metadata,
+                std::vector<uint8_t>& target) const override {
     if (!metadata) {
       DWARFS_THROW(runtime_error,
                    "internal error: flac compression requires metadata");
@@ -261,17 +261,16 @@ class flac_block_compressor final : public block_compressor::impl {
       pcm_pad = pcm_sample_padding::Msb;
     }
 
-    std::vector<uint8_t> compressed;
-
     {
       using namespace ::apache::thrift;
 
-      compressed.reserve(5 * data.size() / 8); // optimistic guess
-      compressed.resize(folly::kMaxVarintLength64);
+      size_t pos = target.size();
+
+      target.reserve(pos + 5 * data.size() / 8); // optimistic guess
+      target.resize(pos + folly::kMaxVarintLength64);
 
-      size_t pos = 0;
-      pos += folly::encodeVarint(data.size(), compressed.data() + pos);
-      compressed.resize(pos);
+      pos += folly::encodeVarint(data.size(), target.data() + pos);
+      target.resize(pos);
 
       thrift::compression::flac_block_header hdr;
       hdr.num_channels() = num_channels;
@@ -281,11 +280,11 @@ class flac_block_compressor final : public block_compressor::impl {
       std::string hdrbuf;
       CompactSerializer::serialize(hdr, &hdrbuf);
 
-      compressed.resize(pos + hdrbuf.size());
-      ::memcpy(&compressed[pos], hdrbuf.data(), hdrbuf.size());
+      target.resize(pos + hdrbuf.size());
+      ::memcpy(&target[pos], hdrbuf.data(), hdrbuf.size());
     }
 
-    dwarfs_flac_stream_encoder encoder(compressed);
+    dwarfs_flac_stream_encoder encoder(target);
 
     encoder.set_streamable_subset(false);
     encoder.set_channels(num_channels);
@@ -331,18 +330,9 @@ class flac_block_compressor final : public block_compressor::impl {
     }
 
     // XXX: don't throw this as we're losing metadata
-    // if (compressed.size() >= data.size()) {
+    // if (target.size() >= data.size()) {
     //   throw bad_compression_ratio_error();
     // }
-
-    compressed.shrink_to_fit();
-
-    return compressed;
-  }
-
-  std::vector<uint8_t> compress(std::vector<uint8_t>&& data,
-                                std::string const* metadata) const override {
-    return compress(data, metadata);
   }
 
   compression_type type() const override { return compression_type::FLAC; }
@@ -19,6 +19,8 @@
  * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <cstring>
+
 #include <lz4.h>
 #include <lz4hc.h>
 
@@ -66,28 +68,24 @@ class lz4_block_compressor final : public block_compressor::impl {
     return std::make_unique<lz4_block_compressor>(*this);
   }
 
-  std::vector<uint8_t>
-  compress(const std::vector<uint8_t>& data,
-           std::string const* /*metadata*/) const override {
-    std::vector<uint8_t> compressed(
-        sizeof(uint32_t) + LZ4_compressBound(folly::to<int>(data.size())));
-    *reinterpret_cast<uint32_t*>(&compressed[0]) = data.size();
-    auto csize =
-        Policy::compress(&data[0], &compressed[sizeof(uint32_t)], data.size(),
-                         compressed.size() - sizeof(uint32_t), level_);
+  void compress(std::span<uint8_t const> data, std::string const* /*metadata*/,
+                std::vector<uint8_t>& target) const override {
+    auto const pos = target.size();
+    target.resize(pos + sizeof(uint32_t) +
+                  LZ4_compressBound(folly::to<int>(data.size())));
+    uint32_t const size = data.size();
+    ::memcpy(&target[pos], &size, sizeof(size));
+    auto csize = Policy::compress(data.data(), &target[pos + sizeof(uint32_t)],
+                                  data.size(),
+                                  target.size() - pos - sizeof(uint32_t),
+                                  level_);
     if (csize == 0) {
       DWARFS_THROW(runtime_error, "error during compression");
     }
     if (sizeof(uint32_t) + csize >= data.size()) {
       throw bad_compression_ratio_error();
     }
-    compressed.resize(sizeof(uint32_t) + csize);
-    return compressed;
-  }
-
-  std::vector<uint8_t> compress(std::vector<uint8_t>&& data,
-                                std::string const* metadata) const override {
-    return compress(data, metadata);
+    target.resize(pos + sizeof(uint32_t) + csize);
   }
 
   compression_type type() const override { return compression_type::LZ4; }
@@ -19,6 +19,8 @@
  * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+
 #include <lzma.h>
 
 #include "dwarfs/block_compressor.h"
@@ -27,6 +29,10 @@
 #include "dwarfs/option_map.h"
 #include "dwarfs/types.h"
 
+#if LZMA_VERSION >= UINT32_C(50020002)
+#define LZMA_HAVE_PARALLEL_COMPRESSION
+#endif
+
 namespace dwarfs {
 
 namespace {
@@ -63,12 +69,13 @@ class lzma_block_compressor final : public block_compressor::impl {
     return std::make_unique<lzma_block_compressor>(*this);
   }
 
-  std::vector<uint8_t> compress(const std::vector<uint8_t>& data,
-                                std::string const* metadata) const override;
-  std::vector<uint8_t> compress(std::vector<uint8_t>&& data,
-                                std::string const* metadata) const override {
-    return compress(data, metadata);
-  }
+  void compress(std::span<uint8_t const> data, std::string const* metadata,
+                std::vector<uint8_t>& target) const override;
+
+  void compress_parallel(std::span<uint8_t const> data,
+                         std::string const* metadata,
+                         std::vector<uint8_t>& target,
+                         size_t num_threads) const override;
 
   compression_type type() const override { return compression_type::LZMA; }
 
@@ -82,8 +89,13 @@ class lzma_block_compressor final : public block_compressor::impl {
   }
 
  private:
-  std::vector<uint8_t>
-  compress(const std::vector<uint8_t>& data, const lzma_filter* filters) const;
+  void compress(std::span<uint8_t const> data, const lzma_filter* filters,
+                std::vector<uint8_t>& target, size_t num_threads) const;
+  void compress_all(std::span<uint8_t const> data, std::vector<uint8_t>& target,
+                    size_t num_threads) const;
+
+  static lzma_ret init_encoder(lzma_stream* s, std::span<uint8_t const> data,
+                               const lzma_filter* filters, size_t num_threads);
 
   static uint32_t get_preset(unsigned level, bool extreme) {
     uint32_t preset = level;
@@ -143,27 +155,58 @@ lzma_block_compressor::lzma_block_compressor(unsigned level, bool extreme,
   filters_[2].options = NULL;
 }
 
-std::vector<uint8_t>
-lzma_block_compressor::compress(const std::vector<uint8_t>& data,
-                                const lzma_filter* filters) const {
+lzma_ret lzma_block_compressor::init_encoder(lzma_stream* s,
+                                             std::span<uint8_t const> data,
+                                             const lzma_filter* filters,
+                                             size_t num_threads) {
+#ifdef LZMA_HAVE_PARALLEL_COMPRESSION
+  if (num_threads > 1) {
+    // The multi-threaded encoder splits the input into independently
+    // compressed blocks of the same stream, which the regular stream
+    // decoder handles just fine. By default, blocks are much larger
+    // than a typical filesystem block.
+    static constexpr uint64_t kMinBlockSize{1 << 20};
+
+    lzma_mt mt{};
+    mt.threads = static_cast<uint32_t>(num_threads);
+    mt.block_size = std::max<uint64_t>(
+        (data.size() + num_threads - 1) / num_threads, kMinBlockSize);
+    mt.filters = filters;
+    mt.check = LZMA_CHECK_CRC64;
+
+    // fails if liblzma was built without threading support
+    if (lzma_stream_encoder_mt(s, &mt) == LZMA_OK) {
+      return LZMA_OK;
+    }
+  }
+#endif
+
+  return lzma_stream_encoder(s, filters, LZMA_CHECK_CRC64);
+}
+
+void lzma_block_compressor::compress(std::span<uint8_t const> data,
+                                     const lzma_filter* filters,
+                                     std::vector<uint8_t>& target,
+                                     size_t num_threads) const {
   lzma_stream s = LZMA_STREAM_INIT;
 
-  if (lzma_stream_encoder(&s, filters, LZMA_CHECK_CRC64)) {
+  if (init_encoder(&s, data, filters, num_threads)) {
     DWARFS_THROW(runtime_error, "lzma_stream_encoder");
   }
 
   lzma_action action = LZMA_FINISH;
 
-  std::vector<uint8_t> compressed(data.size() - 1);
+  auto const pos = target.size();
+  target.resize(pos + data.size() - 1);
 
   s.next_in = data.data();
   s.avail_in = data.size();
-  s.next_out = compressed.data();
-  s.avail_out = compressed.size();
+  s.next_out = target.data() + pos;
+  s.avail_out = target.size() - pos;
 
   lzma_ret ret = lzma_code(&s, action);
 
-  compressed.resize(compressed.size() - s.avail_out);
+  target.resize(target.size() - s.avail_out);
 
   lzma_end(&s);
 
@@ -171,30 +214,41 @@ lzma_block_compressor::compress(const std::vector<uint8_t>& data,
     throw bad_compression_ratio_error();
   }
 
-  if (ret == LZMA_STREAM_END) {
-    compressed.shrink_to_fit();
-  } else {
+  if (ret != LZMA_STREAM_END) {
     DWARFS_THROW(runtime_error, fmt::format("LZMA compression failed: {}",
                                             lzma_error_string(ret)));
   }
-
-  return compressed;
 }
 
-std::vector<uint8_t>
-lzma_block_compressor::compress(const std::vector<uint8_t>& data,
-                                std::string const* /*metadata*/) const {
-  std::vector<uint8_t> best = compress(data, &filters_[1]);
+void lzma_block_compressor::compress_all(std::span<uint8_t const> data,
+                                         std::vector<uint8_t>& target,
+                                         size_t num_threads) const {
+  auto const pos = target.size();
+
+  compress(data, &filters_[1], target, num_threads);
 
   if (filters_[0].id != LZMA_VLI_UNKNOWN) {
-    std::vector<uint8_t> compressed = compress(data, &filters_[0]);
+    std::vector<uint8_t> compressed;
+    compress(data, &filters_[0], compressed, num_threads);
 
-    if (compressed.size() < best.size()) {
-      best.swap(compressed);
+    if (compressed.size() < target.size() - pos) {
+      target.resize(pos);
+      target.insert(target.end(), compressed.begin(), compressed.end());
     }
   }
+}
+
+void lzma_block_compressor::compress(std::span<uint8_t const> data,
+                                     std::string const* /*metadata*/,
+                                     std::vector<uint8_t>& target) const {
+  compress_all(data, target, 1);
+}
 
-  return best;
+void lzma_block_compressor::compress_parallel(std::span<uint8_t const> data,
+                                              std::string const* /*metadata*/,
+                                              std::vector<uint8_t>& target,
+                                              size_t num_threads) const {
+  compress_all(data, target, num_threads);
 }
 
 class lzma_block_decompressor final : public block_decompressor::impl {
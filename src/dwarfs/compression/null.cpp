@@ -37,16 +37,9 @@ class null_block_compressor final : public block_compressor::impl {
     return std::make_unique<null_block_compressor>(*this);
   }
 
-  std::vector<uint8_t>
-  compress(const std::vector<uint8_t>& data,
-           std::string const* /*metadata*/) const override {
-    return data;
-  }
-
-  std::vector<uint8_t>
-  compress(std::vector<uint8_t>&& data,
-           std::string const* /*metadata*/) const override {
-    return std::move(data);
+  void compress(std::span<uint8_t const> data, std::string const* /*metadata*/,
+                std::vector<uint8_t>& target) const override {
+    target.insert(target.end(), data.begin(), data.end());
   }
 
   compression_type type() const override { return compression_type::NONE; }
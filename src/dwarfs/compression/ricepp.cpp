@@ -52,8 +52,8 @@ class ricepp_block_compressor final : public block_compressor::impl {
     return std::make_unique<ricepp_block_compressor>(*this);
   }
 
-  std::vector<uint8_t> compress(const std::vector<uint8_t>& data,
-                                std::string const* metadata) const override {
+  void compress(std::span<uint8_t const> data, std::string const* metadata,
+                std::vector<uint8_t>& target) const override {
     if (!metadata) {
       DWARFS_THROW(runtime_error,
                    "internal error: ricepp compression requires metadata");
@@ -88,16 +88,15 @@ class ricepp_block_compressor final : public block_compressor::impl {
         .unused_lsb_count = static_cast<unsigned>(unused_lsb_count),
     });
 
-    std::vector<uint8_t> compressed;
-
     {
       using namespace ::apache::thrift;
 
-      compressed.resize(folly::kMaxVarintLength64);
+      size_t pos = target.size();
+
+      target.resize(pos + folly::kMaxVarintLength64);
 
-      size_t pos = 0;
-      pos += folly::encodeVarint(data.size(), compressed.data() + pos);
-      compressed.resize(pos);
+      pos += folly::encodeVarint(data.size(), target.data() + pos);
+      target.resize(pos);
 
       thrift::compression::ricepp_block_header hdr;
       hdr.block_size() = block_size_;
@@ -110,29 +109,21 @@ class ricepp_block_compressor final : public block_compressor::impl {
       std::string hdrbuf;
       CompactSerializer::serialize(hdr, &hdrbuf);
 
-      compressed.resize(pos + hdrbuf.size());
-      ::memcpy(&compressed[pos], hdrbuf.data(), hdrbuf.size());
+      target.resize(pos + hdrbuf.size());
+      ::memcpy(&target[pos], hdrbuf.data(), hdrbuf.size());
     }
 
     std::span<pixel_type const> input{
         reinterpret_cast<pixel_type const*>(data.data()),
         data.size() / bytes_per_sample};
 
-    size_t header_size = compressed.size();
-    compressed.resize(header_size + codec->worst_case_encoded_bytes(input));
+    size_t header_size = target.size();
+    target.resize(header_size + codec->worst_case_encoded_bytes(input));
 
-    std::span<uint8_t> buffer(compressed);
+    std::span<uint8_t> buffer(target);
 
     auto output = codec->encode(buffer.subspan(header_size), input);
-    compressed.resize(header_size + output.size());
-    compressed.shrink_to_fit();
-
-    return compressed;
-  }
-
-  std::vector<uint8_t> compress(std::vector<uint8_t>&& data,
-                                std::string const* metadata) const override {
-    return compress(data, metadata);
+    target.resize(header_size + output.size());
   }
 
   compression_type type() const override { return compression_type::RICEPP; }
@@ -0,0 +1,432 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <numeric>
+
+#include <thrift/lib/cpp2/protocol/Serializer.h>
+
+#include <fmt/format.h>
+
+#include <folly/Range.h>
+#include <folly/json.h>
+
+#include "dwarfs/block_compressor.h"
+#include "dwarfs/compression.h"
+#include "dwarfs/error.h"
+#include "dwarfs/option_map.h"
+#include "dwarfs/shuffle_filter.h"
+
+#include "dwarfs/gen-cpp2/compression_types.h"
+
+namespace dwarfs {
+
+namespace {
+
+constexpr size_t const kMaxElementSize{16};
+
+// stored in the block header, values must never change
+enum class shuffle_mode : uint8_t { NONE = 0, BYTE = 1, BIT = 2 };
+
+std::optional<std::endian> parse_byteorder(std::string_view s) {
+  if (s == "big") {
+    return std::endian::big;
+  }
+  if (s == "little") {
+    return std::endian::little;
+  }
+  return std::nullopt;
+}
+
+std::string_view byteorder_name(std::endian e) {
+  return e == std::endian::big ? "big" : "little";
+}
+
+class shuffle_block_compressor final : public block_compressor::impl {
+ public:
+  shuffle_block_compressor(shuffle_mode mode, bool delta, size_t element_size,
+                           std::optional<std::endian> byteorder,
+                           block_compressor inner)
+      : mode_{mode}
+      , delta_{delta}
+      , element_size_{element_size}
+      , byteorder_{byteorder}
+      , inner_{std::move(inner)} {
+    if (inner_.type() == compression_type::SHUFFLE) {
+      DWARFS_THROW(runtime_error, "shuffle compression cannot be nested");
+    }
+    if (element_size_ > kMaxElementSize) {
+      DWARFS_THROW(runtime_error,
+                   fmt::format("unsupported element size: {}", element_size_));
+    }
+    if (delta_ && element_size_ > 0 && !delta_supported(element_size_)) {
+      DWARFS_THROW(runtime_error,
+                   fmt::format("unsupported element size for delta: {}",
+                               element_size_));
+    }
+  }
+
+  shuffle_block_compressor(const shuffle_block_compressor& rhs) = default;
+
+  std::unique_ptr<block_compressor::impl> clone() const override {
+    return std::make_unique<shuffle_block_compressor>(*this);
+  }
+
+  void compress(std::span<uint8_t const> data, std::string const* metadata,
+                std::vector<uint8_t>& target) const override {
+    compress_parallel(data, metadata, target, 1);
+  }
+
+  void compress_parallel(std::span<uint8_t const> data,
+                         std::string const* metadata,
+                         std::vector<uint8_t>& target,
+                         size_t num_threads) const override {
+    auto [element_size, byteorder] = get_layout(metadata);
+
+    // Reuse per-thread scratch buffers for the transformed data rather
+    // than allocating new ones for each block.
+    thread_local std::vector<uint8_t> tmp;
+    thread_local std::vector<uint8_t> shuffled;
+    std::span<uint8_t const> input = data;
+
+    if (delta_) {
+      tmp.assign(data.begin(), data.end());
+      delta_encode(tmp, element_size, byteorder);
+      input = tmp;
+    }
+
+    if (mode_ != shuffle_mode::NONE) {
+      shuffled.resize(input.size());
+      if (mode_ == shuffle_mode::BIT) {
+        bit_shuffle(input, shuffled, element_size);
+      } else {
+        byte_shuffle(input, shuffled, element_size);
+      }
+      input = shuffled;
+    }
+
+    auto const pos = target.size();
+
+    {
+      using namespace ::apache::thrift;
+
+      thrift::compression::shuffle_block_header hdr;
+      hdr.element_size() = element_size;
+      hdr.shuffle() = static_cast<uint8_t>(mode_);
+      hdr.delta() = delta_;
+      hdr.big_endian() = byteorder == std::endian::big;
+      hdr.compression() = static_cast<uint16_t>(inner_.type());
+
+      std::string hdrbuf;
+      CompactSerializer::serialize(hdr, &hdrbuf);
+      target.insert(target.end(), hdrbuf.begin(), hdrbuf.end());
+    }
+
+    inner_.compress_append(input, target, metadata, num_threads);
+
+    if (target.size() - pos >= data.size()) {
+      throw bad_compression_ratio_error();
+    }
+  }
+
+  compression_type type() const override { return compression_type::SHUFFLE; }
+
+  std::string describe() const override {
+    return fmt::format(
+        "shuffle [mode={}{}, element_size={}, compression={}]",
+        mode_ == shuffle_mode::BIT    ? "bit"
+        : mode_ == shuffle_mode::BYTE ? "byte"
+                                      : "none",
+        delta_ ? ", delta" : "",
+        element_size_ > 0 ? std::to_string(element_size_) : "auto",
+        inner_.describe());
+  }
+
+  std::string metadata_requirements() const override {
+    auto inner_req = inner_.metadata_requirements();
+    folly::dynamic req = inner_req.empty() ? folly::dynamic::object
+                                           : folly::parseJson(inner_req);
+
+    if (element_size_ == 0) {
+      req["element_size"] = folly::dynamic::array(
+          "set", delta_ ? folly::dynamic::array(1, 2, 4, 8)
+                        : folly::dynamic::array(1, 2, 4, 8, 16));
+    }
+
+    if (delta_ && !byteorder_) {
+      req["endianness"] =
+          folly::dynamic::array("set", folly::dynamic::array("big", "little"));
+    }
+
+    return req.empty() ? std::string() : folly::toJson(req);
+  }
+
+  compression_constraints
+  get_compression_constraints(std::string const& metadata) const override {
+    auto cc = inner_.get_compression_constraints(metadata);
+
+    uint32_t element_size = element_size_;
+
+    if (element_size == 0 && !metadata.empty()) {
+      element_size = folly::parseJson(metadata)["element_size"].asInt();
+    }
+
+    if (element_size > 0) {
+      cc.granularity = std::lcm(cc.granularity.value_or(1), element_size);
+    }
+
+    return cc;
+  }
+
+ private:
+  std::pair<size_t, std::endian> get_layout(std::string const* metadata) const {
+    size_t element_size = element_size_;
+    auto byteorder = byteorder_;
+
+    if (element_size == 0 || (delta_ && !byteorder)) {
+      if (!metadata || metadata->empty()) {
+        DWARFS_THROW(runtime_error,
+                     "internal error: shuffle compression requires metadata");
+      }
+
+      auto meta = folly::parseJson(*metadata);
+
+      if (element_size == 0) {
+        element_size = meta["element_size"].asInt();
+
+        if (element_size == 0 || element_size > kMaxElementSize) {
+          DWARFS_THROW(runtime_error,
+                       fmt::format("[SHUFFLE] unsupported element size: {}",
+                                   element_size));
+        }
+      }
+
+      if (!byteorder) {
+        if (auto it = meta.find("endianness"); it != meta.items().end()) {
+          byteorder = parse_byteorder(it->second.asString());
+        }
+      }
+    }
+
+    return {element_size, byteorder.value_or(std::endian::little)};
+  }
+
+  shuffle_mode const mode_;
+  bool const delta_;
+  size_t const element_size_;
+  std::optional<std::endian> const byteorder_;
+  block_compressor inner_;
+};
+
+class shuffle_block_decompressor final : public block_decompressor::impl {
+ public:
+  shuffle_block_decompressor(const uint8_t* data, size_t size,
+                             std::vector<uint8_t>& target)
+      : shuffle_block_decompressor(folly::Range<uint8_t const*>(data, size),
+                                   target) {}
+
+  shuffle_block_decompressor(folly::Range<uint8_t const*> data,
+                             std::vector<uint8_t>& target)
+      : decompressed_{target}
+      , header_{decode_header(data)}
+      , inner_{compression_registry::instance().make_decompressor(
+            inner_type(header_),
+            std::span<uint8_t const>(data.data(), data.size()),
+            shuffled() ? shuffled_ : target)}
+      , uncompressed_size_{inner_->uncompressed_size()}
+      , inner_metadata_{inner_->metadata()} {}
+
+  compression_type type() const override { return compression_type::SHUFFLE; }
+
+  std::optional<std::string> metadata() const override {
+    folly::dynamic meta = inner_metadata_ ? folly::parseJson(*inner_metadata_)
+                                          : folly::dynamic::object;
+    meta["element_size"] = header_.element_size().value();
+    if (header_.delta().value()) {
+      meta["endianness"] = std::string(byteorder_name(byteorder()));
+    }
+    return folly::toJson(meta);
+  }
+
+  bool decompress_frame(size_t) override {
+    if (!inner_) {
+      return false;
+    }
+
+    // All elements must be available before the data can be unshuffled.
+    while (!inner_->decompress_frame(uncompressed_size_)) {
+    }
+
+    inner_.reset();
+
+    size_t const element_size = header_.element_size().value();
+
+    if (shuffled()) {
+      // The inner decompressor wrote to `shuffled_`, so we can unshuffle
+      // straight into the target without another copy.
+      decompressed_.resize(shuffled_.size());
+
+      if (mode() == shuffle_mode::BYTE) {
+        byte_unshuffle(shuffled_, decompressed_, element_size);
+      } else {
+        bit_unshuffle(shuffled_, decompressed_, element_size);
+      }
+
+      shuffled_.clear();
+      shuffled_.shrink_to_fit();
+    }
+
+    if (header_.delta().value()) {
+      delta_decode(decompressed_, element_size, byteorder());
+    }
+
+    return true;
+  }
+
+  size_t uncompressed_size() const override { return uncompressed_size_; }
+
+ private:
+  std::endian byteorder() const {
+    return header_.big_endian().value() ? std::endian::big
+                                        : std::endian::little;
+  }
+
+  shuffle_mode mode() const {
+    return static_cast<shuffle_mode>(header_.shuffle().value());
+  }
+
+  bool shuffled() const { return mode() != shuffle_mode::NONE; }
+
+  static thrift::compression::shuffle_block_header
+  decode_header(folly::Range<uint8_t const*>& range) {
+    using namespace ::apache::thrift;
+    thrift::compression::shuffle_block_header hdr;
+    auto size = CompactSerializer::deserialize(range, hdr);
+    range.advance(size);
+    if (hdr.shuffle().value() > static_cast<uint8_t>(shuffle_mode::BIT)) {
+      DWARFS_THROW(runtime_error,
+                   fmt::format("[SHUFFLE] unsupported shuffle mode: {}",
+                               hdr.shuffle().value()));
+    }
+    auto element_size = hdr.element_size().value();
+    if (element_size == 0 || element_size > kMaxElementSize ||
+        (hdr.delta().value() && !delta_supported(element_size))) {
+      DWARFS_THROW(runtime_error,
+                   fmt::format("[SHUFFLE] unsupported element size: {}",
+                               element_size));
+    }
+    return hdr;
+  }
+
+  static compression_type
+  inner_type(thrift::compression::shuffle_block_header const& hdr) {
+    auto type = static_cast<compression_type>(hdr.compression().value());
+    if (type == compression_type::SHUFFLE) {
+      DWARFS_THROW(runtime_error, "[SHUFFLE] nested shuffle compression");
+    }
+    return type;
+  }
+
+  std::vector<uint8_t>& decompressed_;
+  thrift::compression::shuffle_block_header const header_;
+  std::vector<uint8_t> shuffled_;
+  std::unique_ptr<block_decompressor::impl> inner_;
+  size_t const uncompressed_size_;
+  std::optional<std::string> const inner_metadata_;
+};
+
+class shuffle_compression_factory : public compression_factory {
+ public:
+  shuffle_compression_factory()
+      : options_{
+            "mode=[none|byte|bit]",
+            "delta",
+            fmt::format("element_size=[1..{}]", kMaxElementSize),
+            "endianness=[big|little]",
+            "compression=<spec> (use ',' instead of ':')",
+        } {}
+
+  std::string_view name() const override { return "shuffle"; }
+
+  std::string_view description() const override {
+    static std::string const s_desc{
+        "byte/bit shuffle and delta filter for numeric arrays"};
+    return s_desc;
+  }
+
+  std::vector<std::string> const& options() const override { return options_; }
+
+  std::set<std::string> library_dependencies() const override { return {}; }
+
+  std::unique_ptr<block_compressor::impl>
+  make_compressor(option_map& om) const override {
+    auto mode_str = om.get<std::string>("mode", "byte");
+    auto delta = om.get<bool>("delta", false);
+    auto element_size = om.get<size_t>("element_size", 0);
+    auto endianness = om.get<std::string>("endianness");
+    auto inner = om.get<std::string>("compression", "zstd");
+
+    shuffle_mode mode;
+
+    if (mode_str == "byte") {
+      mode = shuffle_mode::BYTE;
+    } else if (mode_str == "bit") {
+      mode = shuffle_mode::BIT;
+    } else if (mode_str == "none") {
+      mode = shuffle_mode::NONE;
+    } else {
+      DWARFS_THROW(runtime_error,
+                   fmt::format("unsupported shuffle mode: {}", mode_str));
+    }
+
+    std::optional<std::endian> byteorder;
+
+    if (!endianness.empty()) {
+      byteorder = parse_byteorder(endianness);
+      if (!byteorder) {
+        DWARFS_THROW(runtime_error,
+                     fmt::format("unsupported endianness: {}", endianness));
+      }
+    }
+
+    std::replace(inner.begin(), inner.end(), ',', ':');
+
+    return std::make_unique<shuffle_block_compressor>(
+        mode, delta, element_size, byteorder, block_compressor(inner));
+  }
+
+  std::unique_ptr<block_decompressor::impl>
+  make_decompressor(std::span<uint8_t const> data,
+                    std::vector<uint8_t>& target) const override {
+    return std::make_unique<shuffle_block_decompressor>(data.data(),
+                                                        data.size(), target);
+  }
+
+ private:
+  std::vector<std::string> const options_;
+};
+
+} // namespace
+
+REGISTER_COMPRESSION_FACTORY(compression_type::SHUFFLE,
+                             shuffle_compression_factory)
+
+} // namespace dwarfs
@@ -19,6 +19,8 @@
  * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <memory>
 #include <mutex>
 
 #include <zstd.h>
@@ -38,6 +40,10 @@
 #define ZSTD_MIN_LEVEL 1
 #endif
 
+#if ZSTD_VERSION_NUMBER >= 10400
+#define ZSTD_HAVE_PARALLEL_COMPRESSION
+#endif
+
 namespace dwarfs {
 
 namespace {
@@ -54,13 +60,15 @@ class zstd_block_compressor final : public block_compressor::impl {
     return std::make_unique<zstd_block_compressor>(*this);
   }
 
-  std::vector<uint8_t> compress(const std::vector<uint8_t>& data,
-                                std::string const* metadata) const override;
+  void compress(std::span<uint8_t const> data, std::string const* metadata,
+                std::vector<uint8_t>& target) const override;
 
-  std::vector<uint8_t> compress(std::vector<uint8_t>&& data,
-                                std::string const* metadata) const override {
-    return compress(data, std::move(metadata));
-  }
+#ifdef ZSTD_HAVE_PARALLEL_COMPRESSION
+  void compress_parallel(std::span<uint8_t const> data,
+                         std::string const* metadata,
+                         std::vector<uint8_t>& target,
+                         size_t num_threads) const override;
+#endif
 
   compression_type type() const override { return compression_type::ZSTD; }
 
@@ -93,13 +101,15 @@ class zstd_block_compressor final : public block_compressor::impl {
   const int level_;
 };
 
-std::vector<uint8_t>
-zstd_block_compressor::compress(const std::vector<uint8_t>& data,
-                                std::string const* /*metadata*/) const {
-  std::vector<uint8_t> compressed(ZSTD_compressBound(data.size()));
+void zstd_block_compressor::compress(std::span<uint8_t const> data,
+                                     std::string const* /*metadata*/,
+                                     std::vector<uint8_t>& target) const {
+  auto const pos = target.size();
+  target.resize(pos + ZSTD_compressBound(data.size()));
   auto ctx = ctxmgr_->make_context();
-  auto size = ZSTD_compressCCtx(ctx.get(), compressed.data(), compressed.size(),
-                                data.data(), data.size(), level_);
+  auto size = ZSTD_compressCCtx(ctx.get(), target.data() + pos,
+                                target.size() - pos, data.data(), data.size(),
+                                level_);
   if (ZSTD_isError(size)) {
     DWARFS_THROW(runtime_error,
                  fmt::format("ZSTD: {}", ZSTD_getErrorName(size)));
@@ -107,11 +117,60 @@ zstd_block_compressor::compress(const std::vector<uint8_t>& data,
   if (size >= data.size()) {
     throw bad_compression_ratio_error();
   }
-  compressed.resize(size);
-  compressed.shrink_to_fit();
-  return compressed;
+  target.resize(pos + size);
 }
 
+#ifdef ZSTD_HAVE_PARALLEL_COMPRESSION
+void zstd_block_compressor::compress_parallel(
+    std::span<uint8_t const> data, std::string const* /*metadata*/,
+    std::vector<uint8_t>& target, size_t num_threads) const {
+  // Don't use a pooled context here: setting the number of workers
+  // would otherwise be carried over to unrelated (single-threaded)
+  // compression jobs, and the worker threads would be kept alive.
+  std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> ctx{ZSTD_createCCtx(),
+                                                          &ZSTD_freeCCtx};
+  auto cctx = ctx.get();
+
+  if (!cctx) {
+    DWARFS_THROW(runtime_error, "ZSTD: could not create context");
+  }
+
+  auto check = [](size_t rv) {
+    if (ZSTD_isError(rv)) {
+      DWARFS_THROW(runtime_error,
+                   fmt::format("ZSTD: {}", ZSTD_getErrorName(rv)));
+    }
+  };
+
+  check(ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level_));
+
+  // This fails if libzstd was built without multithreading support, in
+  // which case we simply compress using the calling thread.
+  if (!ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_nbWorkers,
+                                           static_cast<int>(num_threads)))) {
+    // The default job size depends on the window size and can easily
+    // exceed the size of a whole block, leaving all but one worker idle.
+    auto job_size = (data.size() + num_threads - 1) / num_threads;
+    check(ZSTD_CCtx_setParameter(
+        cctx, ZSTD_c_jobSize,
+        static_cast<int>(std::min<size_t>(job_size, 1 << 30))));
+  }
+
+  auto const pos = target.size();
+  target.resize(pos + ZSTD_compressBound(data.size()));
+  auto size = ZSTD_compress2(cctx, target.data() + pos, target.size() - pos,
+                             data.data(), data.size());
+
+  check(size);
+
+  if (size >= data.size()) {
+    throw bad_compression_ratio_error();
+  }
+
+  target.resize(pos + size);
+}
+#endif
+
 class zstd_block_decompressor final : public block_decompressor::impl {
  public:
   zstd_block_decompressor(const uint8_t* data, size_t size,
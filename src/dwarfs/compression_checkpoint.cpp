@@ -0,0 +1,469 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <istream>
+#include <mutex>
+#include <ostream>
+
+#include <fmt/format.h>
+
+#include <folly/container/F14Map.h>
+
+#include "dwarfs/checksum.h"
+#include "dwarfs/compression_checkpoint.h"
+#include "dwarfs/error.h"
+#include "dwarfs/file_access.h"
+#include "dwarfs/fstypes.h"
+#include "dwarfs/logger.h"
+#include "dwarfs/util.h"
+
+namespace dwarfs {
+
+namespace {
+
+constexpr char const kMagic[8] = {'D', 'W', 'A', 'R', 'F', 'S', 'C', 'K'};
+constexpr uint32_t const kVersion{3};
+
+using fingerprint_type = std::array<uint8_t, 16>;
+
+struct file_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  fingerprint_type source; // XXH3-128 of the source description
+};
+
+struct index_record {
+  compression_checkpoint::key_type key;
+  uint64_t offset;   // offset of the section header in the image
+  uint64_t checksum; // XXH3-64 of all previous fields
+};
+
+static_assert(sizeof(file_header) == 32);
+static_assert(sizeof(index_record) == 48);
+
+fingerprint_type make_fingerprint(std::string_view source) {
+  fingerprint_type rv;
+  checksum cs(checksum::algorithm::XXH3_128);
+  cs.update(source.data(), source.size());
+  cs.finalize(rv.data());
+  return rv;
+}
+
+uint64_t record_checksum(index_record const& rec) {
+  checksum cs(checksum::algorithm::XXH3_64);
+  cs.update(&rec, offsetof(index_record, checksum));
+  uint64_t rv;
+  cs.finalize(&rv);
+  return rv;
+}
+
+uint64_t section_checksum(section_header_v2 const& sh,
+                          std::span<uint8_t const> data) {
+  checksum cs(checksum::algorithm::XXH3_64);
+  cs.update(&sh.number,
+            sizeof(section_header_v2) - offsetof(section_header_v2, number));
+  cs.update(data.data(), data.size());
+  uint64_t rv;
+  cs.finalize(&rv);
+  return rv;
+}
+
+struct key_hash {
+  size_t operator()(compression_checkpoint::key_type const& key) const {
+    // the key is a hash already
+    size_t rv;
+    std::memcpy(&rv, key.data(), sizeof(rv));
+    return rv;
+  }
+};
+
+std::filesystem::path
+with_suffix(std::filesystem::path const& path, char const* suffix) {
+  return std::filesystem::path(path) += suffix;
+}
+
+template <typename LoggerPolicy>
+class compression_checkpoint_ final : public compression_checkpoint::impl {
+ public:
+  using key_type = compression_checkpoint::key_type;
+  using block = compression_checkpoint::block;
+
+  compression_checkpoint_(logger& lgr, file_access const& fa,
+                          std::filesystem::path const& image,
+                          std::string_view source, bool resume)
+      : LOG_PROXY_INIT(lgr)
+      , fa_{fa}
+      , image_{image}
+      , index_path_{with_suffix(image, ".checkpoint")}
+      , partial_{with_suffix(image, ".partial")}
+      , partial_index_{with_suffix(image, ".partial.checkpoint")}
+      , source_{make_fingerprint(source)} {
+    if (resume) {
+      load();
+    }
+
+    std::error_code ec;
+    index_ = fa_.open_output_binary(index_path_, ec);
+
+    if (ec) {
+      DWARFS_THROW(runtime_error,
+                   fmt::format("cannot create checkpoint '{}': {}",
+                               index_path_.string(), ec.message()));
+    }
+
+    file_header fh{};
+    std::memcpy(fh.magic, kMagic, sizeof(kMagic));
+    fh.version = kVersion;
+    fh.source = source_;
+
+    auto& os = index_->os();
+    os.write(reinterpret_cast<char const*>(&fh), sizeof(fh));
+    os.flush();
+
+    if (!os) {
+      DWARFS_THROW(runtime_error, fmt::format("cannot write checkpoint '{}'",
+                                              index_path_.string()));
+    }
+  }
+
+  ~compression_checkpoint_() override {
+    if (index_) {
+      std::error_code ec;
+      index_->close(ec);
+    }
+  }
+
+  std::optional<block> take(key_type const& key) override {
+    std::lock_guard lock(mx_);
+
+    auto it = entries_.find(key);
+
+    if (it == entries_.end()) {
+      return std::nullopt;
+    }
+
+    auto const ent = it->second;
+    entries_.erase(it);
+
+    if (ent.compression == compression_type::NONE) {
+      // the uncompressed data will be available anyway
+      ++hits_;
+      return block{compression_type::NONE, {}};
+    }
+
+    // Only now read the data from the partial image, so the recovered
+    // blocks never have to be in memory all at once.
+    auto& in = partial_is_->is();
+    section_header_v2 sh;
+    std::vector<uint8_t> data(ent.length);
+
+    in.clear();
+
+    if (!in.seekg(ent.offset) ||
+        !in.read(reinterpret_cast<char*>(&sh), sizeof(sh)) ||
+        sh.length != ent.length ||
+        !in.read(reinterpret_cast<char*>(data.data()), data.size()) ||
+        section_checksum(sh, data) != sh.xxh3_64) {
+      LOG_WARN << "corrupt block at offset " << ent.offset << " in "
+               << partial_ << ", compressing it again";
+      return std::nullopt;
+    }
+
+    ++hits_;
+
+    return block{ent.compression, std::move(data)};
+  }
+
+  void add(key_type const& key, uint64_t offset) override {
+    if (failed_) {
+      return;
+    }
+
+    index_record rec{};
+    rec.key = key;
+    rec.offset = offset;
+    rec.checksum = record_checksum(rec);
+
+    auto& os = index_->os();
+    os.write(reinterpret_cast<char const*>(&rec), sizeof(rec));
+    os.flush();
+
+    if (!os) {
+      LOG_ERROR << "failed to write to checkpoint " << index_path_
+                << ", checkpointing disabled";
+      failed_ = true;
+    }
+  }
+
+  size_t num_blocks() const override {
+    std::lock_guard lock(mx_);
+    return entries_.size();
+  }
+
+  void remove() override {
+    LOG_INFO << "reused " << hits_ << " compressed blocks from checkpoint";
+
+    {
+      std::error_code ec;
+      index_->close(ec);
+      index_.reset();
+    }
+
+    if (partial_is_) {
+      std::error_code ec;
+      partial_is_->close(ec);
+      partial_is_.reset();
+    }
+
+    // The new image is complete, so none of this is needed any more
+    for (auto const& path : {index_path_, partial_index_, partial_}) {
+      if (!fa_.exists(path)) {
+        continue;
+      }
+
+      std::error_code ec;
+      fa_.remove(path, ec);
+
+      if (ec) {
+        LOG_WARN << "failed to remove checkpoint " << path << ": "
+                 << ec.message();
+      }
+    }
+  }
+
+ private:
+  struct entry {
+    uint64_t offset; // offset of the section header in the partial image
+    uint64_t length;
+    compression_type compression;
+  };
+
+  using entry_map = folly::F14FastMap<key_type, entry, key_hash>;
+
+  std::vector<index_record> read_index(std::filesystem::path const& path) {
+    std::vector<index_record> rv;
+    std::error_code ec;
+    auto is = fa_.open_input_binary(path, ec);
+
+    if (ec) {
+      LOG_WARN << "cannot open checkpoint " << path << ": " << ec.message();
+      return rv;
+    }
+
+    auto& in = is->is();
+    file_header fh;
+
+    if (!in.read(reinterpret_cast<char*>(&fh), sizeof(fh)) ||
+        std::memcmp(fh.magic, kMagic, sizeof(kMagic)) != 0 ||
+        fh.version != kVersion) {
+      LOG_WARN << "ignoring invalid checkpoint " << path;
+      return rv;
+    }
+
+    if (fh.source != source_) {
+      LOG_WARN << "ignoring checkpoint " << path
+               << ", it was created from a different input";
+      return rv;
+    }
+
+    index_record rec;
+
+    while (in.read(reinterpret_cast<char*>(&rec), sizeof(rec))) {
+      if (record_checksum(rec) != rec.checksum) {
+        LOG_WARN << "dropping corrupt data from checkpoint " << path;
+        return rv;
+      }
+
+      rv.push_back(rec);
+    }
+
+    if (in.gcount() > 0) {
+      LOG_WARN << "dropping incomplete record from checkpoint " << path;
+    }
+
+    return rv;
+  }
+
+  // Build an index of all blocks that can be recovered from `image`. Only
+  // the section headers are read; the data is verified once it's taken.
+  entry_map scan(std::filesystem::path const& image,
+                 std::filesystem::path const& index) {
+    entry_map rv;
+
+    if (!fa_.exists(image) || !fa_.exists(index)) {
+      return rv;
+    }
+
+    auto records = read_index(index);
+
+    if (records.empty()) {
+      return rv;
+    }
+
+    std::error_code ec;
+    auto is = fa_.open_input_binary(image, ec);
+
+    if (ec) {
+      LOG_WARN << "cannot open partial image " << image << ": "
+               << ec.message();
+      return rv;
+    }
+
+    auto& in = is->is();
+    in.seekg(0, std::ios::end);
+    auto const image_size = static_cast<uint64_t>(in.tellg());
+
+    std::sort(records.begin(), records.end(),
+              [](auto const& a, auto const& b) { return a.offset < b.offset; });
+
+    section_header_v2 sh;
+
+    // Sections are written strictly in order, so everything past the
+    // first section that is missing or broken is lost as well.
+    for (auto const& rec : records) {
+      if (rec.offset > image_size ||
+          image_size - rec.offset < sizeof(sh) ||
+          !in.seekg(rec.offset) ||
+          !in.read(reinterpret_cast<char*>(&sh), sizeof(sh)) ||
+          std::memcmp(sh.magic, "DWARFS", 6) != 0 ||
+          sh.type != static_cast<uint16_t>(section_type::BLOCK) ||
+          sh.length > image_size - rec.offset - sizeof(sh)) {
+        break;
+      }
+
+      rv.emplace(rec.key,
+                 entry{rec.offset, sh.length,
+                       static_cast<compression_type>(sh.compression)});
+    }
+
+    is->close(ec);
+
+    if (rv.size() < records.size()) {
+      LOG_WARN << "could not recover " << (records.size() - rv.size())
+               << " blocks from partial image " << image;
+    }
+
+    return rv;
+  }
+
+  // The partial image is moved aside rather than overwritten, and it's
+  // only deleted once the new image is complete. If a resumed build is
+  // interrupted as well, the next attempt picks whichever partial image
+  // got further; builds are deterministic, so that one has all blocks
+  // the other one has.
+  void load() {
+    auto previous = scan(partial_, partial_index_);
+    auto current = scan(image_, index_path_);
+
+    if (current.size() > previous.size()) {
+      std::error_code ec;
+      fa_.rename(image_, partial_, ec);
+
+      if (!ec) {
+        fa_.rename(index_path_, partial_index_, ec);
+      }
+
+      if (ec) {
+        LOG_WARN << "cannot move partial image " << image_ << " to "
+                 << partial_ << ": " << ec.message()
+                 << ", starting from scratch";
+        return;
+      }
+
+      previous = std::move(current);
+    }
+
+    if (previous.empty()) {
+      LOG_WARN << "no usable checkpoint found for " << image_
+               << ", starting from scratch";
+      return;
+    }
+
+    std::error_code ec;
+    partial_is_ = fa_.open_input_binary(partial_, ec);
+
+    if (ec) {
+      LOG_WARN << "cannot open partial image " << partial_ << ": "
+               << ec.message() << ", starting from scratch";
+      partial_is_.reset();
+      return;
+    }
+
+    entries_ = std::move(previous);
+
+    uint64_t bytes{0};
+
+    for (auto const& [key, ent] : entries_) {
+      if (ent.compression != compression_type::NONE) {
+        bytes += ent.length;
+      }
+    }
+
+    LOG_INFO << "resuming with " << entries_.size() << " blocks ("
+             << size_with_unit(bytes) << ") from partial image " << partial_;
+  }
+
+  LOG_PROXY_DECL(LoggerPolicy);
+  file_access const& fa_;
+  std::filesystem::path const image_;
+  std::filesystem::path const index_path_;
+  std::filesystem::path const partial_;
+  std::filesystem::path const partial_index_;
+  fingerprint_type const source_;
+  std::unique_ptr<output_stream> index_;
+  std::unique_ptr<input_stream> partial_is_;
+  mutable std::mutex mx_;
+  entry_map entries_;
+  size_t hits_{0};
+  bool failed_{false};
+};
+
+} // namespace
+
+compression_checkpoint::compression_checkpoint(
+    logger& lgr, file_access const& fa, std::filesystem::path const& image,
+    std::string_view source, bool resume)
+    : impl_(make_unique_logging_object<impl, compression_checkpoint_,
+                                       logger_policies>(lgr, fa, image, source,
+                                                        resume)) {}
+
+auto compression_checkpoint::make_key(std::string_view config,
+                                      std::span<uint8_t const> data)
+    -> key_type {
+  key_type key;
+
+  checksum data_cs(checksum::algorithm::XXH3_128);
+  data_cs.update(data.data(), data.size());
+  data_cs.finalize(key.data());
+
+  checksum config_cs(checksum::algorithm::XXH3_128);
+  config_cs.update(config.data(), config.size());
+  config_cs.finalize(key.data() + 16);
+
+  return key;
+}
+
+} // namespace dwarfs
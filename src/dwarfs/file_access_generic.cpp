@@ -188,6 +188,37 @@ class file_access_generic : public file_access {
     }
     return rv;
   }
+
+  void remove(std::filesystem::path const& path,
+              std::error_code& ec) const override {
+    if (!std::filesystem::remove(path, ec) && !ec) {
+      ec = std::make_error_code(std::errc::no_such_file_or_directory);
+    }
+  }
+
+  void remove(std::filesystem::path const& path) const override {
+    std::error_code ec;
+    remove(path, ec);
+    if (ec) {
+      throw std::system_error(ec, fmt::format("remove('{}')", path.string()));
+    }
+  }
+
+  void rename(std::filesystem::path const& from,
+              std::filesystem::path const& to,
+              std::error_code& ec) const override {
+    std::filesystem::rename(from, to, ec);
+  }
+
+  void rename(std::filesystem::path const& from,
+              std::filesystem::path const& to) const override {
+    std::error_code ec;
+    rename(from, to, ec);
+    if (ec) {
+      throw std::system_error(ec, fmt::format("rename('{}', '{}')",
+                                              from.string(), to.string()));
+    }
+  }
 };
 
 } // namespace
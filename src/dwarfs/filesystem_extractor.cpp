@@ -19,10 +19,12 @@
  * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <array>
 #include <condition_variable>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
 
 // This is required to avoid Windows.h being pulled in by libarchive
@@ -105,10 +107,12 @@ class filesystem_extractor_ final : public filesystem_extractor::impl {
   }
 
   void open_archive(std::filesystem::path const& output,
-                    std::string const& format) override {
+                    std::string const& format,
+                    filesystem_extractor_archive_options const& opts) override {
     a_ = ::archive_write_new();
 
     check_result(::archive_write_set_format_by_name(a_, format.c_str()));
+    add_compression(opts);
 
 #ifdef _WIN32
     check_result(::archive_write_open_filename_w(
@@ -119,7 +123,8 @@ class filesystem_extractor_ final : public filesystem_extractor::impl {
 #endif
   }
 
-  void open_stream(std::ostream& os, std::string const& format) override {
+  void open_stream(std::ostream& os, std::string const& format,
+                   filesystem_extractor_archive_options const& opts) override {
 #ifdef _WIN32
     if (::_pipe(pipefd_, 8192, _O_BINARY) != 0) {
       DWARFS_THROW(system_error, "_pipe()");
@@ -136,6 +141,7 @@ class filesystem_extractor_ final : public filesystem_extractor::impl {
     a_ = ::archive_write_new();
 
     check_result(::archive_write_set_format_by_name(a_, format.c_str()));
+    add_compression(opts);
     check_result(::archive_write_open_fd(a_, pipefd_[1]));
   }
 
@@ -183,10 +189,42 @@ class filesystem_extractor_ final : public filesystem_extractor::impl {
     }
   }
 
+  void add_compression(filesystem_extractor_archive_options const& opts) {
+    if (opts.compression.empty()) {
+      return;
+    }
+
+    auto filter = opts.compression.c_str();
+
+    check_result(::archive_write_add_filter_by_name(a_, filter));
+
+    if (opts.compression_level) {
+      auto level = std::to_string(*opts.compression_level);
+      check_result(::archive_write_set_filter_option(
+          a_, filter, "compression-level", level.c_str()));
+    }
+
+    // Only these filters can compress using multiple threads. The
+    // archiver keeps feeding data while the compressor's own worker
+    // threads are busy, so this scales with the number of cores.
+    if (opts.compression == "zstd" || opts.compression == "xz") {
+      auto threads = opts.compression_threads > 0
+                         ? opts.compression_threads
+                         : std::max(1U, std::thread::hardware_concurrency());
+      LOG_DEBUG << "using " << threads << " " << opts.compression
+                << " compression threads";
+      check_result(::archive_write_set_filter_option(
+          a_, filter, "threads", std::to_string(threads).c_str()));
+    } else if (opts.compression_threads > 1) {
+      LOG_WARN << "'" << opts.compression
+               << "' compression does not support multiple threads";
+    }
+  }
+
   void pump(std::ostream& os, int fd) {
     folly::setThreadName("pump");
 
-    std::array<char, 1024> buf;
+    std::array<char, 65536> buf;
 
     for (;;) {
       // This is fine, we're simply reusing the buffer.
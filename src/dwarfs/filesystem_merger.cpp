@@ -0,0 +1,805 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <ctime>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <numeric>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include <folly/String.h>
+
+#include "dwarfs/block_data.h"
+#include "dwarfs/categorizer.h"
+#include "dwarfs/checksum.h"
+#include "dwarfs/error.h"
+#include "dwarfs/features.h"
+#include "dwarfs/file_stat.h"
+#include "dwarfs/filesystem_merger.h"
+#include "dwarfs/filesystem_v2.h"
+#include "dwarfs/filesystem_writer.h"
+#include "dwarfs/global_entry_data.h"
+#include "dwarfs/history.h"
+#include "dwarfs/logger.h"
+#include "dwarfs/metadata_v2.h"
+#include "dwarfs/options.h"
+#include "dwarfs/progress.h"
+#include "dwarfs/string_table.h"
+#include "dwarfs/util.h"
+#include "dwarfs/version.h"
+#include "dwarfs/vfs_stat.h"
+
+#include "dwarfs/gen-cpp2/metadata_types.h"
+
+namespace dwarfs {
+
+namespace {
+
+// A regular file inode of one of the inputs. Hardlinks share the same
+// `merged_file`.
+struct merged_file {
+  size_t input{0};
+  uint32_t source_inode{0};
+  uint64_t size{0};
+  std::vector<block_map_extent> extents;
+  // set if the contents are identical to those of another file
+  merged_file* same_as{nullptr};
+  uint32_t inode{0};
+  size_t links{0};
+  bool seen{false};
+};
+
+struct merged_entry {
+  size_t input{0};
+  std::string name;
+  file_stat stat;
+  merged_entry* parent{nullptr};
+  std::map<std::string, merged_entry*> children;
+  std::string link;
+  merged_file* file{nullptr};
+  uint32_t inode{0};
+  uint32_t entry_index{0};
+};
+
+// Mount points are paths inside the merged image, so they always use `/`
+// as a separator.
+std::vector<std::string> split_mount_point(std::string const& mount_point) {
+  std::vector<std::string> parts;
+  std::vector<std::string> rv;
+
+  folly::split('/', mount_point, parts);
+
+  for (auto& name : parts) {
+    if (name.empty() || name == ".") {
+      continue;
+    }
+
+    if (name == "..") {
+      DWARFS_THROW(runtime_error,
+                   fmt::format("invalid mount point: {}", mount_point));
+    }
+
+    rv.push_back(std::move(name));
+  }
+
+  return rv;
+}
+
+std::string merged_path(merged_entry const* e) {
+  std::string path;
+
+  for (; e && e->parent; e = e->parent) {
+    path = "/" + e->name + path;
+  }
+
+  return path.empty() ? "/" : path;
+}
+
+void pack_inode(thrift::metadata::inode_data& ino, file_stat const& st,
+                global_entry_data const& ge) {
+  ino.mode_index() = ge.get_mode_index(st.mode);
+  ino.owner_index() = ge.get_uid_index(st.uid);
+  ino.group_index() = ge.get_gid_index(st.gid);
+  ino.atime_offset() = ge.get_atime_offset(st.atime);
+  ino.mtime_offset() = ge.get_mtime_offset(st.mtime);
+  ino.ctime_offset() = ge.get_ctime_offset(st.ctime);
+}
+
+} // namespace
+
+template <typename LoggerPolicy>
+class filesystem_merger_ final : public filesystem_merger::impl {
+ public:
+  filesystem_merger_(logger& lgr, scanner_options const& options,
+                     merge_options const& merge_opts)
+      : LOG_PROXY_INIT(lgr)
+      , options_{options}
+      , merge_opts_{merge_opts} {}
+
+  void add_input(filesystem_v2 const& fs,
+                 std::string const& mount_point) override {
+    mount_points_.push_back(split_mount_point(mount_point));
+    inputs_.push_back(&fs);
+  }
+
+  void merge(filesystem_writer& fsw, progress& prog) override;
+
+ private:
+  void add_tree(size_t input, progress& prog);
+  merged_entry* mount(size_t input, file_stat const& st);
+  void share_identical_extents();
+  void deduplicate(progress& prog);
+  std::string file_hash(merged_file const& f, progress& prog) const;
+
+  merged_entry* new_entry(size_t input, std::string name, merged_entry* parent,
+                          file_stat const& st) {
+    auto& e = entries_.emplace_back();
+    e.input = input;
+    e.name = std::move(name);
+    e.parent = parent;
+    e.stat = st;
+    return &e;
+  }
+
+  LOG_PROXY_DECL(LoggerPolicy);
+  scanner_options const& options_;
+  merge_options const merge_opts_;
+  std::vector<filesystem_v2 const*> inputs_;
+  std::vector<std::vector<std::string>> mount_points_;
+  std::deque<merged_entry> entries_;
+  std::deque<merged_file> files_;
+  merged_entry* root_{nullptr};
+};
+
+template <typename LoggerPolicy>
+merged_entry*
+filesystem_merger_<LoggerPolicy>::mount(size_t input, file_stat const& st) {
+  if (!root_) {
+    root_ = new_entry(input, std::string(), nullptr, st);
+  }
+
+  auto e = root_;
+
+  for (auto const& name : mount_points_[input]) {
+    auto [it, inserted] = e->children.emplace(name, nullptr);
+
+    if (inserted) {
+      it->second = new_entry(input, name, e, st);
+    } else if (!it->second->stat.is_directory()) {
+      DWARFS_THROW(runtime_error,
+                   fmt::format("mount point '{}' of input {} is not a "
+                               "directory in input {}",
+                               merged_path(it->second), input + 1,
+                               it->second->input + 1));
+    }
+
+    e = it->second;
+  }
+
+  return e;
+}
+
+template <typename LoggerPolicy>
+void filesystem_merger_<LoggerPolicy>::add_tree(size_t input, progress& prog) {
+  auto const& fs = *inputs_[input];
+  std::unordered_map<uint32_t, merged_entry*> dirs;
+  std::unordered_map<uint32_t, merged_file*> files;
+
+  fs.walk([&](dir_entry_view dev) {
+    auto iv = dev.inode();
+    file_stat st;
+
+    if (auto err = fs.getattr(iv, &st); err != 0) {
+      DWARFS_THROW(runtime_error,
+                   fmt::format("cannot stat '{}' in input {}: {}",
+                               dev.unix_path(), input + 1, err));
+    }
+
+    merged_entry* e;
+
+    if (dev.is_root()) {
+      e = mount(input, st);
+    } else {
+      auto parent = dirs.at(dev.parent()->self_index());
+      auto name = dev.name();
+      auto [it, inserted] = parent->children.emplace(name, nullptr);
+
+      if (inserted) {
+        it->second = new_entry(input, name, parent, st);
+      } else if (!it->second->stat.is_directory() || !st.is_directory()) {
+        DWARFS_THROW(runtime_error,
+                     fmt::format("'{}' exists in both input {} and input {}",
+                                 merged_path(it->second),
+                                 it->second->input + 1, input + 1));
+      }
+
+      e = it->second;
+    }
+
+    switch (st.type()) {
+    case posix_file_type::directory:
+      dirs.emplace(dev.self_index(), e);
+      if (e->input == input) {
+        prog.dirs_found++;
+      }
+      break;
+
+    case posix_file_type::symlink:
+      if (auto link = fs.readlink(iv, readlink_mode::raw)) {
+        e->link = std::move(link).value();
+      } else {
+        DWARFS_THROW(runtime_error,
+                     fmt::format("cannot read link '{}' in input {}: {}",
+                                 dev.unix_path(), input + 1, link.error()));
+      }
+      prog.symlinks_found++;
+      break;
+
+    case posix_file_type::regular: {
+      auto& mf = files[iv.inode_num()];
+
+      if (!mf) {
+        mf = &files_.emplace_back();
+        mf->input = input;
+        mf->source_inode = iv.inode_num();
+        mf->size = st.size;
+        mf->extents = fs.get_block_map(iv).value().extents;
+        prog.original_size += st.size;
+      } else {
+        prog.hardlinks++;
+        prog.hardlink_size += st.size;
+      }
+
+      ++mf->links;
+      e->file = mf;
+      prog.files_found++;
+    } break;
+
+    default:
+      prog.specials_found++;
+      break;
+    }
+  });
+}
+
+template <typename LoggerPolicy>
+std::string
+filesystem_merger_<LoggerPolicy>::file_hash(merged_file const& f,
+                                            progress& prog) const {
+  auto const& fs = *inputs_[f.input];
+  progress::scan_updater supd(prog.hash, f.size);
+  checksum cs(*options_.file_hash_algorithm);
+  std::vector<char> buf(
+      std::min<uint64_t>(f.size, prog.hash.chunk_size.load()));
+  uint64_t offset{0};
+
+  while (offset < f.size) {
+    auto size = std::min<uint64_t>(f.size - offset, buf.size());
+    auto rv = fs.read(f.source_inode, buf.data(), size, offset);
+
+    if (rv <= 0) {
+      DWARFS_THROW(runtime_error,
+                   fmt::format("cannot read inode {} of input {}: {}",
+                               f.source_inode, f.input + 1, rv));
+    }
+
+    cs.update(buf.data(), rv);
+    offset += rv;
+  }
+
+  std::string hash(cs.digest_size(), '\0');
+
+  DWARFS_CHECK(cs.finalize(hash.data()), "checksum computation failed");
+
+  return hash;
+}
+
+template <typename LoggerPolicy>
+void filesystem_merger_<LoggerPolicy>::share_identical_extents() {
+  // Files already sharing their data in one of the inputs keep doing so.
+  std::unordered_map<std::string, merged_file*> by_extents;
+
+  for (auto& f : files_) {
+    std::string key = fmt::format("{}", f.input);
+
+    for (auto const& ext : f.extents) {
+      key += fmt::format(":{}.{}.{}", ext.block, ext.block_offset, ext.size);
+    }
+
+    if (auto [it, inserted] = by_extents.emplace(std::move(key), &f);
+        !inserted) {
+      f.same_as = it->second;
+    }
+  }
+}
+
+template <typename LoggerPolicy>
+void filesystem_merger_<LoggerPolicy>::deduplicate(progress& prog) {
+  if (!options_.file_hash_algorithm) {
+    DWARFS_THROW(runtime_error, "deduplication requires a file hash algorithm");
+  }
+
+  // The images don't store file hashes, so only files that have the same
+  // size as at least one other file need to be read and hashed.
+  std::unordered_map<uint64_t, std::vector<merged_file*>> by_size;
+
+  for (auto& f : files_) {
+    if (!f.same_as) {
+      by_size[f.size].push_back(&f);
+    }
+  }
+
+  size_t num_hashed{0};
+
+  for (auto& [size, candidates] : by_size) {
+    if (candidates.size() < 2) {
+      continue;
+    }
+
+    std::unordered_map<std::string, merged_file*> by_hash;
+
+    for (auto f : candidates) {
+      auto [it, inserted] = by_hash.emplace(file_hash(*f, prog), f);
+      ++num_hashed;
+
+      if (!inserted) {
+        f->same_as = it->second;
+        prog.duplicate_files++;
+        prog.saved_by_deduplication += size;
+      }
+    }
+  }
+
+  LOG_VERBOSE << "hashed " << num_hashed << " files, found "
+              << prog.duplicate_files << " duplicates";
+}
+
+template <typename LoggerPolicy>
+void filesystem_merger_<LoggerPolicy>::merge(filesystem_writer& fsw,
+                                             progress& prog) {
+  if (inputs_.empty()) {
+    DWARFS_THROW(runtime_error, "no input file systems to merge");
+  }
+
+  LOG_INFO << "merging " << inputs_.size() << " file systems...";
+
+  std::vector<size_t> block_base;
+  size_t num_blocks{0};
+  uint32_t block_size{0};
+
+  for (auto fs : inputs_) {
+    vfs_stat vfs;
+    fs->statvfs(&vfs);
+    block_size = std::max<uint32_t>(block_size, vfs.bsize);
+    block_base.push_back(num_blocks);
+    num_blocks += fs->num_blocks();
+  }
+
+  for (size_t i = 0; i < inputs_.size(); ++i) {
+    add_tree(i, prog);
+  }
+
+  share_identical_extents();
+
+  if (merge_opts_.deduplicate) {
+    LOG_INFO << "finding duplicate files...";
+    deduplicate(prog);
+  }
+
+  LOG_INFO << "assigning inodes...";
+
+  std::vector<merged_entry*> dirs;
+  std::vector<merged_entry*> links;
+  std::vector<merged_entry*> devices;
+  std::vector<merged_entry*> others;
+  std::vector<merged_file*> files;
+
+  // Visiting directories in breadth-first order ensures that parent
+  // directories always get lower inode numbers than their children.
+  std::deque<merged_entry*> queue{root_};
+
+  while (!queue.empty()) {
+    auto d = queue.front();
+    queue.pop_front();
+    dirs.push_back(d);
+
+    for (auto& [_, e] : d->children) {
+      switch (e->stat.type()) {
+      case posix_file_type::directory:
+        queue.push_back(e);
+        break;
+
+      case posix_file_type::symlink:
+        links.push_back(e);
+        break;
+
+      case posix_file_type::regular:
+        if (!e->file->seen) {
+          e->file->seen = true;
+          files.push_back(e->file);
+        }
+        break;
+
+      case posix_file_type::block:
+      case posix_file_type::character:
+        devices.push_back(e);
+        break;
+
+      default:
+        others.push_back(e);
+        break;
+      }
+    }
+  }
+
+  uint32_t inode{0};
+
+  for (auto e : dirs) {
+    e->inode = inode++;
+  }
+
+  for (auto e : links) {
+    e->inode = inode++;
+  }
+
+  // Files with unique contents come first, followed by groups of files
+  // sharing the same contents.
+  std::vector<merged_file*> unique_files;
+  std::vector<merged_file*> shared_data;
+  std::vector<merged_file*> all_data;
+  std::unordered_map<merged_file const*, std::vector<merged_file*>>
+      shared_files;
+
+  for (auto f : files) {
+    auto data = f;
+
+    while (data->same_as) {
+      data = data->same_as;
+    }
+
+    auto& group = shared_files[data];
+    if (group.empty()) {
+      all_data.push_back(data);
+    }
+    group.push_back(f);
+  }
+
+  for (auto data : all_data) {
+    if (auto const& group = shared_files[data]; group.size() == 1) {
+      unique_files.push_back(group.front());
+    } else {
+      shared_data.push_back(data);
+    }
+  }
+
+  for (auto f : unique_files) {
+    f->inode = inode++;
+  }
+
+  for (auto data : shared_data) {
+    for (auto f : shared_files[data]) {
+      f->inode = inode++;
+    }
+  }
+
+  for (auto e : devices) {
+    e->inode = inode++;
+  }
+
+  for (auto e : others) {
+    e->inode = inode++;
+  }
+
+  for (auto& e : entries_) {
+    if (e.file) {
+      e.inode = e.file->inode;
+    }
+  }
+
+  global_entry_data ge_data(options_);
+
+  for (auto& e : entries_) {
+    if (e.parent) {
+      ge_data.add_name(e.name);
+    }
+    if (e.stat.is_symlink()) {
+      ge_data.add_link(e.link);
+    }
+    ge_data.add_uid(e.stat.uid);
+    ge_data.add_gid(e.stat.gid);
+    ge_data.add_mode(e.stat.mode);
+    ge_data.add_atime(e.stat.atime);
+    ge_data.add_mtime(e.stat.mtime);
+    ge_data.add_ctime(e.stat.ctime);
+  }
+
+  ge_data.index();
+
+  LOG_INFO << "building metadata...";
+
+  thrift::metadata::metadata mv2;
+
+  for (auto e : links) {
+    mv2.symlink_table()->push_back(ge_data.get_symlink_table_entry(e->link));
+  }
+
+  mv2.devices() = std::vector<uint64_t>();
+
+  for (auto e : devices) {
+    mv2.devices()->push_back(e->stat.rdev);
+  }
+
+  uint64_t total_fs_size{0};
+  uint64_t total_hardlink_size{0};
+
+  auto add_chunks = [&](merged_file const* f) {
+    mv2.chunk_table()->push_back(mv2.chunks()->size());
+
+    for (auto const& ext : f->extents) {
+      auto& chunk = mv2.chunks()->emplace_back();
+      chunk.block() = block_base[f->input] + ext.block;
+      chunk.offset() = ext.block_offset;
+      chunk.size() = ext.size;
+    }
+  };
+
+  for (auto data : unique_files) {
+    add_chunks(data);
+  }
+
+  for (auto data : shared_data) {
+    add_chunks(data);
+  }
+
+  mv2.chunk_table()->push_back(mv2.chunks()->size());
+
+  for (auto f : files) {
+    total_fs_size += f->size;
+    total_hardlink_size += (f->links - 1) * f->size;
+  }
+
+  LOG_DEBUG << "total number of unique files: "
+            << unique_files.size() + shared_data.size();
+  LOG_DEBUG << "total number of chunks: " << mv2.chunks()->size();
+
+  // Only blocks that are still referenced are copied to the output,
+  // which may not be all blocks after deduplication.
+  std::vector<bool> referenced(num_blocks, false);
+
+  for (auto const& chunk : mv2.chunks().value()) {
+    referenced[chunk.block().value()] = true;
+  }
+
+  std::vector<uint32_t> block_remap(num_blocks, 0);
+  size_t num_copied{0};
+
+  for (size_t block = 0; block < num_blocks; ++block) {
+    if (referenced[block]) {
+      block_remap[block] = num_copied++;
+    }
+  }
+
+  for (auto& chunk : mv2.chunks().value()) {
+    chunk.block() = block_remap[chunk.block().value()];
+  }
+
+  prog.block_count = num_copied;
+
+  if (num_copied < num_blocks) {
+    LOG_VERBOSE << "skipping " << (num_blocks - num_copied)
+                << " unreferenced blocks";
+  }
+
+  if (options_.chunk_index_min_chunks > 0) {
+    mv2.chunk_offset_index() = metadata_v2::build_chunk_offset_index(
+        mv2, options_.chunk_index_min_chunks, options_.chunk_index_interval);
+  }
+
+  mv2.dir_entries() = std::vector<thrift::metadata::dir_entry>();
+  mv2.inodes()->resize(inode);
+  mv2.directories()->reserve(dirs.size() + 1);
+
+  {
+    auto& de = mv2.dir_entries()->emplace_back();
+    de.name_index() = 0;
+    de.inode_num() = root_->inode;
+    pack_inode(mv2.inodes()->at(root_->inode), root_->stat, ge_data);
+  }
+
+  for (auto d : dirs) {
+    auto& dir = mv2.directories()->emplace_back();
+    dir.parent_entry() = d->parent ? d->parent->entry_index : 0;
+    dir.first_entry() = mv2.dir_entries()->size();
+
+    for (auto& [name, e] : d->children) {
+      e->entry_index = mv2.dir_entries()->size();
+      auto& de = mv2.dir_entries()->emplace_back();
+      de.name_index() = ge_data.get_name_index(name);
+      de.inode_num() = e->inode;
+      pack_inode(mv2.inodes()->at(e->inode), e->stat, ge_data);
+    }
+  }
+
+  {
+    auto& dummy = mv2.directories()->emplace_back();
+    dummy.parent_entry() = 0;
+    dummy.first_entry() = mv2.dir_entries()->size();
+  }
+
+  if (options_.pack_directories) {
+    uint32_t last_first_entry = 0;
+
+    for (auto& d : mv2.directories().value()) {
+      d.parent_entry() = 0; // this will be recovered
+      auto delta = d.first_entry().value() - last_first_entry;
+      last_first_entry = d.first_entry().value();
+      d.first_entry() = delta;
+    }
+  }
+
+  if (options_.pack_chunk_table) {
+    std::adjacent_difference(mv2.chunk_table()->begin(),
+                             mv2.chunk_table()->end(),
+                             mv2.chunk_table()->begin());
+  }
+
+  mv2.shared_files_table() = std::vector<uint32_t>();
+
+  for (size_t i = 0; i < shared_data.size(); ++i) {
+    auto const& group = shared_files[shared_data[i]];
+
+    if (options_.pack_shared_files_table) {
+      mv2.shared_files_table()->push_back(group.size() - 2);
+    } else {
+      mv2.shared_files_table()->insert(mv2.shared_files_table()->end(),
+                                       group.size(), i);
+    }
+  }
+
+  thrift::metadata::fs_options fsopts;
+  fsopts.mtime_only() = !options_.keep_all_times;
+  if (options_.time_resolution_sec > 1) {
+    fsopts.time_resolution_sec() = options_.time_resolution_sec;
+  }
+  fsopts.packed_chunk_table() = options_.pack_chunk_table;
+  fsopts.packed_directories() = options_.pack_directories;
+  fsopts.packed_shared_files_table() = options_.pack_shared_files_table;
+
+  if (options_.plain_names_table) {
+    mv2.names() = ge_data.get_names();
+  } else {
+    mv2.compact_names() = string_table::pack(
+        ge_data.get_names(), string_table::pack_options(
+                                 options_.pack_names, options_.pack_names_index,
+                                 options_.force_pack_string_tables));
+  }
+
+  if (options_.plain_symlinks_table) {
+    mv2.symlinks() = ge_data.get_symlinks();
+  } else {
+    mv2.compact_symlinks() = string_table::pack(
+        ge_data.get_symlinks(),
+        string_table::pack_options(options_.pack_symlinks,
+                                   options_.pack_symlinks_index,
+                                   options_.force_pack_string_tables));
+  }
+
+  mv2.uids() = ge_data.get_uids();
+  mv2.gids() = ge_data.get_gids();
+  mv2.modes() = ge_data.get_modes();
+  mv2.timestamp_base() = ge_data.get_timestamp_base();
+  mv2.block_size() = block_size;
+  mv2.total_fs_size() = total_fs_size;
+  mv2.total_hardlink_size() = total_hardlink_size;
+  mv2.options() = fsopts;
+  mv2.dwarfs_version() = std::string("libdwarfs ") + PRJ_GIT_ID;
+  if (!options_.no_create_timestamp) {
+    mv2.create_timestamp() = std::time(nullptr);
+  }
+  mv2.preferred_path_separator() =
+      static_cast<uint32_t>(std::filesystem::path::preferred_separator);
+
+  {
+    // Blocks from inputs without categories are assigned to the
+    // default category if any of the other inputs uses categories.
+    std::vector<std::string> category_names;
+    std::unordered_map<std::string, uint32_t> category_indices;
+    std::vector<uint32_t> block_categories;
+    bool has_categories{false};
+
+    block_categories.reserve(num_copied);
+
+    for (size_t i = 0; i < inputs_.size(); ++i) {
+      auto fs = inputs_[i];
+
+      for (size_t block = 0; block < fs->num_blocks(); ++block) {
+        if (!referenced[block_base[i] + block]) {
+          continue;
+        }
+
+        auto cat = fs->get_block_category(block);
+        has_categories = has_categories || cat.has_value();
+        auto name = cat.value_or(std::string(categorizer::DEFAULT_CATEGORY));
+        auto [it, inserted] =
+            category_indices.emplace(name, category_names.size());
+        if (inserted) {
+          category_names.push_back(name);
+        }
+        block_categories.push_back(it->second);
+      }
+    }
+
+    if (has_categories) {
+      mv2.category_names() = std::move(category_names);
+      mv2.block_categories() = std::move(block_categories);
+    }
+  }
+
+  feature_set features;
+  mv2.features() = features.get();
+
+  LOG_INFO << "copying " << num_copied << " blocks...";
+
+  for (size_t i = 0; i < inputs_.size(); ++i) {
+    auto fs = inputs_[i];
+
+    for (size_t block = 0; block < fs->num_blocks(); ++block) {
+      if (referenced[block_base[i] + block]) {
+        fs->copy_block(block, fsw);
+      }
+    }
+  }
+
+  auto [schema, data] = metadata_v2::freeze(mv2);
+
+  LOG_VERBOSE << "uncompressed metadata size: " << size_with_unit(data.size());
+
+  fsw.write_metadata_v2_schema(std::make_shared<block_data>(std::move(schema)));
+  fsw.write_metadata_v2(std::make_shared<block_data>(std::move(data)));
+
+  if (options_.enable_history) {
+    history hist(options_.history);
+    hist.append(options_.command_line_arguments);
+    fsw.write_history(std::make_shared<block_data>(hist.serialize()));
+  }
+
+  LOG_INFO << "waiting for blocks to be written...";
+
+  fsw.flush();
+
+  LOG_INFO << "merged " << files.size() << " files and " << dirs.size()
+           << " directories from " << inputs_.size() << " file systems";
+}
+
+filesystem_merger::filesystem_merger(logger& lgr,
+                                     scanner_options const& options,
+                                     merge_options const& merge_opts)
+    : impl_(make_unique_logging_object<impl, filesystem_merger_,
+                                       logger_policies>(lgr, options,
+                                                        merge_opts)) {}
+
+} // namespace dwarfs
@@ -50,6 +50,7 @@
 #include "dwarfs/options.h"
 #include "dwarfs/performance_monitor.h"
 #include "dwarfs/progress.h"
+#include "dwarfs/tree_scan_tracker.h"
 #include "dwarfs/util.h"
 #include "dwarfs/worker_group.h"
 
@@ -138,10 +139,11 @@ class filesystem_parser {
           break;
         }
 
-        auto ps = mm.as<void>(pos + sh->length + sizeof(section_header_v2));
+        auto ps = mm.as<section_header_v2>(pos + sh->length +
+                                           sizeof(section_header_v2));
 
         if (::memcmp(ps, magic.data(), magic.size()) == 0 and
-            reinterpret_cast<section_header_v2 const*>(ps)->number == 1) {
+            ps->number == 1) {
           return pos;
         }
       }
@@ -244,7 +246,8 @@ class filesystem_parser {
   void find_index() {
     uint64_t index_pos;
 
-    ::memcpy(&index_pos, mm_->as<void>(mm_->size() - sizeof(uint64_t)),
+    ::memcpy(&index_pos,
+             mm_->span(mm_->size() - sizeof(uint64_t), sizeof(uint64_t)).data(),
              sizeof(uint64_t));
 
     if ((index_pos >> 48) ==
@@ -258,11 +261,35 @@ class filesystem_parser {
         if (section.check_fast(*mm_)) {
           index_.resize(section.length() / sizeof(uint64_t));
           ::memcpy(index_.data(), section.data(*mm_).data(), section.length());
+          prefetch_metadata();
         }
       }
     }
   }
 
+  // All non-block sections will be read when the file system is loaded,
+  // so let the image know early on. This is a no-op for mapped files,
+  // but allows remote images to fetch these sections in parallel.
+  void prefetch_metadata() {
+    std::vector<mmif::file_range> ranges;
+
+    for (size_t i = 0; i < index_.size(); ++i) {
+      if (static_cast<section_type>(index_[i] >> 48) != section_type::BLOCK) {
+        uint64_t offset = index_[i] & section_offset_mask;
+        uint64_t next_offset = i + 1 < index_.size()
+                                   ? index_[i + 1] & section_offset_mask
+                                   : mm_->size() - image_offset_;
+        if (offset < next_offset) {
+          ranges.emplace_back(image_offset_ + offset, next_offset - offset);
+        }
+      }
+    }
+
+    if (!ranges.empty()) {
+      mm_->prefetch(ranges);
+    }
+  }
+
   std::shared_ptr<mmif> mm_;
   file_off_t const image_offset_;
   file_off_t offset_{0};
@@ -419,17 +446,25 @@ class filesystem_ final : public filesystem_v2::impl {
                 file_off_t offset) const override;
   folly::Expected<std::vector<std::future<block_range>>, int>
   readv(uint32_t inode, size_t size, file_off_t offset) const override;
+  folly::Expected<size_t, int>
+  readv(uint32_t inode, size_t size, file_off_t offset,
+        indexed_block_range_continuation cont) const override;
   std::optional<std::span<uint8_t const>> header() const override;
   void set_num_workers(size_t num) override { ir_.set_num_workers(num); }
   void set_cache_tidy_config(cache_tidy_config const& cfg) override {
     ir_.set_cache_tidy_config(cfg);
   }
   size_t num_blocks() const override { return ir_.num_blocks(); }
+  size_t pin_paths(std::vector<std::string> const& patterns) override;
   bool has_symlinks() const override { return meta_.has_symlinks(); }
   history const& get_history() const override { return history_; }
   folly::dynamic get_inode_info(inode_view entry) const override {
     return meta_.get_inode_info(entry);
   }
+  std::optional<file_block_map> get_block_map(inode_view entry) const override;
+  std::optional<std::string> get_block_category(size_t block) const override {
+    return meta_.get_block_category(block);
+  }
   std::vector<std::string> get_all_block_categories() const override {
     return meta_.get_all_block_categories();
   }
@@ -442,17 +477,22 @@ class filesystem_ final : public filesystem_v2::impl {
   void rewrite(progress& prog, filesystem_writer& writer,
                category_resolver const& cat_resolver,
                rewrite_options const& opts) const override;
+  void copy_block(size_t block, filesystem_writer& writer) const override;
 
  private:
   filesystem_info const& get_info() const;
   void check_section(fs_section const& section) const;
+  uint64_t block_uncompressed_size(size_t block) const;
 
   LOG_PROXY_DECL(LoggerPolicy);
   os_access const& os_;
   std::shared_ptr<mmif> mm_;
   metadata_v2 meta_;
   inode_reader_v2 ir_;
+  std::unique_ptr<tree_scan_tracker> scan_tracker_;
   mutable std::mutex mx_;
+  std::vector<fs_section> block_sections_;
+  mutable std::vector<uint64_t> block_sizes_;
   std::vector<uint8_t> meta_buffer_;
   std::optional<std::span<uint8_t const>> header_;
   mutable std::unique_ptr<filesystem_info const> fsinfo_;
@@ -573,6 +613,7 @@ filesystem_<LoggerPolicy>::filesystem_(
                 << s->length() << " bytes]";
 
       cache.insert(*s);
+      block_sections_.push_back(*s);
     } else {
       check_section(*s);
 
@@ -607,6 +648,15 @@ filesystem_<LoggerPolicy>::filesystem_(
 
   ir_ = inode_reader_v2(lgr, std::move(cache), options.inode_reader, perfmon);
 
+  if (options.tree_scan.threshold > 0) {
+    auto tsopts = options.tree_scan;
+    if (tsopts.max_held_bytes == 0) {
+      tsopts.max_held_bytes = options.block_cache.max_bytes;
+    }
+    scan_tracker_ =
+        std::make_unique<tree_scan_tracker>(lgr, meta_, ir_, tsopts);
+  }
+
   if (auto it = sections.find(section_type::HISTORY); it != sections.end()) {
     for (auto& section : it->second) {
       if (section.check_fast(*mm_)) {
@@ -987,6 +1037,59 @@ void filesystem_<LoggerPolicy>::walk_data_order(
   meta_.walk_data_order(func);
 }
 
+template <typename LoggerPolicy>
+size_t filesystem_<LoggerPolicy>::pin_paths(
+    std::vector<std::string> const& patterns) {
+  std::vector<std::string_view> globs;
+
+  for (auto const& p : patterns) {
+    std::string_view glob{p};
+    while (glob.starts_with('/')) {
+      glob.remove_prefix(1);
+    }
+    if (!glob.empty()) {
+      globs.push_back(glob);
+    }
+  }
+
+  std::vector<size_t> blocks;
+  size_t num_files{0};
+
+  meta_.walk_data_order([&](dir_entry_view entry) {
+    auto iv = entry.inode();
+
+    if (!iv.is_regular_file()) {
+      return;
+    }
+
+    auto path = entry.unix_path();
+
+    if (std::none_of(globs.begin(), globs.end(), [&path](auto const& glob) {
+          return glob_match(glob, path);
+        })) {
+      return;
+    }
+
+    if (auto chunks = meta_.get_chunks(iv.inode_num())) {
+      LOG_DEBUG << "pinning " << path;
+      ++num_files;
+      for (auto const& chunk : *chunks) {
+        blocks.push_back(chunk.block());
+      }
+    }
+  });
+
+  std::sort(blocks.begin(), blocks.end());
+  blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+
+  LOG_INFO << "pinning " << blocks.size() << " blocks for " << num_files
+           << " files";
+
+  ir_.pin_blocks(blocks);
+
+  return blocks.size();
+}
+
 template <typename LoggerPolicy>
 std::optional<inode_view>
 filesystem_<LoggerPolicy>::find(const char* path) const {
@@ -1066,7 +1169,11 @@ int filesystem_<LoggerPolicy>::statvfs(vfs_stat* stbuf) const {
 template <typename LoggerPolicy>
 int filesystem_<LoggerPolicy>::open(inode_view entry) const {
   PERFMON_CLS_SCOPED_SECTION(open)
-  return meta_.open(entry);
+  auto inode = meta_.open(entry);
+  if (scan_tracker_ && inode >= 0) {
+    scan_tracker_->open(inode);
+  }
+  return inode;
 }
 
 template <typename LoggerPolicy>
@@ -1074,7 +1181,11 @@ ssize_t filesystem_<LoggerPolicy>::read(uint32_t inode, char* buf, size_t size,
                                         file_off_t offset) const {
   PERFMON_CLS_SCOPED_SECTION(read)
   if (auto chunks = meta_.get_chunks(inode)) {
-    return ir_.read(buf, inode, size, offset, *chunks);
+    auto rv = ir_.read(buf, inode, size, offset, *chunks);
+    if (scan_tracker_ && rv > 0) {
+      scan_tracker_->read(inode, offset, rv);
+    }
+    return rv;
   }
   return -EBADF;
 }
@@ -1084,7 +1195,11 @@ ssize_t filesystem_<LoggerPolicy>::readv(uint32_t inode, iovec_read_buf& buf,
                                          size_t size, file_off_t offset) const {
   PERFMON_CLS_SCOPED_SECTION(readv_iovec)
   if (auto chunks = meta_.get_chunks(inode)) {
-    return ir_.readv(buf, inode, size, offset, *chunks);
+    auto rv = ir_.readv(buf, inode, size, offset, *chunks);
+    if (scan_tracker_ && rv > 0) {
+      scan_tracker_->read(inode, offset, rv);
+    }
+    return rv;
   }
   return -EBADF;
 }
@@ -1095,11 +1210,107 @@ filesystem_<LoggerPolicy>::readv(uint32_t inode, size_t size,
                                  file_off_t offset) const {
   PERFMON_CLS_SCOPED_SECTION(readv_future)
   if (auto chunks = meta_.get_chunks(inode)) {
-    return ir_.readv(inode, size, offset, *chunks);
+    auto rv = ir_.readv(inode, size, offset, *chunks);
+    if (scan_tracker_ && rv) {
+      scan_tracker_->read(inode, offset, size);
+    }
+    return rv;
   }
   return folly::makeUnexpected(-EBADF);
 }
 
+template <typename LoggerPolicy>
+folly::Expected<size_t, int>
+filesystem_<LoggerPolicy>::readv(uint32_t inode, size_t size,
+                                 file_off_t offset,
+                                 indexed_block_range_continuation cont) const {
+  PERFMON_CLS_SCOPED_SECTION(readv_future)
+  if (auto chunks = meta_.get_chunks(inode)) {
+    auto rv = ir_.readv(inode, size, offset, *chunks, std::move(cont));
+    if (scan_tracker_ && rv) {
+      scan_tracker_->read(inode, offset, size);
+    }
+    return rv;
+  }
+  return folly::makeUnexpected(-EBADF);
+}
+
+template <typename LoggerPolicy>
+uint64_t
+filesystem_<LoggerPolicy>::block_uncompressed_size(size_t block) const {
+  std::lock_guard lock(mx_);
+
+  if (block_sizes_.empty()) {
+    block_sizes_.resize(block_sections_.size(), 0);
+  }
+
+  auto& size = block_sizes_.at(block);
+
+  if (size == 0) {
+    size = get_uncompressed_section_size(mm_, block_sections_[block]);
+  }
+
+  return size;
+}
+
+template <typename LoggerPolicy>
+std::optional<file_block_map>
+filesystem_<LoggerPolicy>::get_block_map(inode_view entry) const {
+  if (!entry.is_regular_file()) {
+    return std::nullopt;
+  }
+
+  auto chunks = meta_.get_chunks(entry.inode_num());
+
+  if (!chunks) {
+    return std::nullopt;
+  }
+
+  file_block_map rv;
+  std::vector<uint32_t> blocks;
+  file_off_t offset = 0;
+
+  for (auto const& chunk : *chunks) {
+    uint32_t block = chunk.block();
+    uint32_t block_offset = chunk.offset();
+    uint64_t size = chunk.size();
+
+    if (!rv.extents.empty()) {
+      auto& last = rv.extents.back();
+      if (last.block == block &&
+          last.block_offset + last.size == block_offset) {
+        last.size += size;
+        offset += size;
+        continue;
+      }
+    }
+
+    rv.extents.push_back({offset, size, block, block_offset});
+    blocks.push_back(block);
+    offset += size;
+  }
+
+  std::sort(blocks.begin(), blocks.end());
+  blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+
+  rv.blocks.reserve(blocks.size());
+
+  for (auto block : blocks) {
+    auto const& sec = block_sections_.at(block);
+    rv.blocks.push_back({block, sec.compression(), sec.length(),
+                         block_uncompressed_size(block)});
+  }
+
+  return rv;
+}
+
+template <typename LoggerPolicy>
+void filesystem_<LoggerPolicy>::copy_block(size_t block,
+                                           filesystem_writer& writer) const {
+  auto const& sec = block_sections_.at(block);
+  writer.write_compressed_section(sec, sec.data(*mm_));
+}
+
 template <typename LoggerPolicy>
 std::optional<std::span<uint8_t const>>
 filesystem_<LoggerPolicy>::header() const {
@@ -31,11 +31,13 @@
 #include <thread>
 #include <unordered_map>
 
+#include <folly/ScopeGuard.h>
 #include <folly/system/ThreadName.h>
 
 #include "dwarfs/block_compressor.h"
 #include "dwarfs/block_data.h"
 #include "dwarfs/checksum.h"
+#include "dwarfs/compression_checkpoint.h"
 #include "dwarfs/compression_metadata_requirements.h"
 #include "dwarfs/filesystem_writer.h"
 #include "dwarfs/fstypes.h"
@@ -90,12 +92,85 @@ class compression_progress : public progress::context {
   std::atomic<size_t> bytes_out{0};
 };
 
+class compression_buffer_pool
+    : public std::enable_shared_from_this<compression_buffer_pool> {
+ public:
+  explicit compression_buffer_pool(size_t max_free_buffers)
+      : max_free_buffers_{max_free_buffers} {}
+
+  std::vector<uint8_t> acquire() {
+    std::lock_guard lock(mx_);
+    if (free_.empty()) {
+      ++buffers_allocated_;
+      return {};
+    }
+    ++buffers_reused_;
+    auto buf = std::move(free_.back());
+    free_.pop_back();
+    return buf;
+  }
+
+  void release(std::vector<uint8_t>&& buf) {
+    std::lock_guard lock(mx_);
+    if (free_.size() < max_free_buffers_) {
+      free_.emplace_back(std::move(buf));
+    }
+  }
+
+  std::shared_ptr<block_data> adopt(std::vector<uint8_t>&& buf) {
+    // Compressed blocks can sit in the write queue for a while. Buffers
+    // are sized for the worst case, so unless a block is (almost) as big
+    // as its buffer, copy it out and recycle the buffer right away. This
+    // way, queued blocks only take up as much memory as their compressed
+    // size.
+    if (buf.size() < buf.capacity() - buf.capacity() / 8) {
+      auto rv = std::make_shared<block_data>(
+          std::vector<uint8_t>(buf.begin(), buf.end()));
+      release(std::move(buf));
+      std::lock_guard lock(mx_);
+      ++buffers_copied_;
+      return rv;
+    }
+
+    return std::make_shared<block_data>(
+        std::move(buf), [self = shared_from_this()](std::vector<uint8_t>&& v) {
+          self->release(std::move(v));
+        });
+  }
+
+  size_t buffers_allocated() const {
+    std::lock_guard lock(mx_);
+    return buffers_allocated_;
+  }
+
+  size_t buffers_reused() const {
+    std::lock_guard lock(mx_);
+    return buffers_reused_;
+  }
+
+  size_t buffers_copied() const {
+    std::lock_guard lock(mx_);
+    return buffers_copied_;
+  }
+
+ private:
+  mutable std::mutex mx_;
+  std::vector<std::vector<uint8_t>> free_;
+  size_t const max_free_buffers_;
+  size_t buffers_allocated_{0};
+  size_t buffers_reused_{0};
+  size_t buffers_copied_{0};
+};
+
 class fsblock {
  public:
   fsblock(section_type type, block_compressor const& bc,
           std::shared_ptr<block_data>&& data,
           std::shared_ptr<compression_progress> pctx,
-          folly::Function<void(size_t)> set_block_cb = nullptr);
+          std::shared_ptr<compression_buffer_pool> pool,
+          bool parallel_compression,
+          folly::Function<void(size_t)> set_block_cb = nullptr,
+          std::shared_ptr<compression_checkpoint> checkpoint = nullptr);
 
   fsblock(section_type type, compression_type compression,
           std::span<uint8_t const> data);
@@ -105,7 +180,8 @@ class fsblock {
 
   fsblock(section_type type, block_compressor const& bc,
           std::span<uint8_t const> data, compression_type data_comp_type,
-          std::shared_ptr<compression_progress> pctx);
+          std::shared_ptr<compression_progress> pctx,
+          std::shared_ptr<compression_buffer_pool> pool);
 
   void
   compress(worker_group& wg, std::optional<std::string> meta = std::nullopt) {
@@ -121,6 +197,9 @@ class fsblock {
   void set_block_no(uint32_t number) { impl_->set_block_no(number); }
   uint32_t block_no() const { return impl_->block_no(); }
   section_header_v2 const& header() const { return impl_->header(); }
+  std::optional<compression_checkpoint::key_type> checkpoint_key() const {
+    return impl_->checkpoint_key();
+  }
 
   class impl {
    public:
@@ -138,6 +217,8 @@ class fsblock {
     virtual void set_block_no(uint32_t number) = 0;
     virtual uint32_t block_no() const = 0;
     virtual section_header_v2 const& header() const = 0;
+    virtual std::optional<compression_checkpoint::key_type>
+    checkpoint_key() const = 0;
   };
 
   static void
@@ -171,38 +252,90 @@ class raw_fsblock : public fsblock::impl {
   raw_fsblock(section_type type, const block_compressor& bc,
               std::shared_ptr<block_data>&& data,
               std::shared_ptr<compression_progress> pctx,
-              folly::Function<void(size_t)> set_block_cb)
+              std::shared_ptr<compression_buffer_pool> pool,
+              bool parallel_compression,
+              folly::Function<void(size_t)> set_block_cb,
+              std::shared_ptr<compression_checkpoint> checkpoint)
       : type_{type}
       , bc_{bc}
       , uncompressed_size_{data->size()}
       , data_{std::move(data)}
       , comp_type_{bc_.type()}
       , pctx_{std::move(pctx)}
-      , set_block_cb_{std::move(set_block_cb)} {}
+      , pool_{std::move(pool)}
+      , parallel_compression_{parallel_compression}
+      , set_block_cb_{std::move(set_block_cb)}
+      , checkpoint_{std::move(checkpoint)} {}
 
   void compress(worker_group& wg, std::optional<std::string> meta) override {
     std::promise<void> prom;
     future_ = prom.get_future();
 
-    wg.add_job([this, prom = std::move(prom),
+    wg.add_job([this, &wg, prom = std::move(prom),
                 meta = std::move(meta)]() mutable {
-      try {
-        std::shared_ptr<block_data> tmp;
+      if (comp_type_ == compression_type::NONE) {
+        // no need to copy the data through the null compressor
+        pctx_->bytes_in += data_->size();
+        pctx_->bytes_out += data_->size();
+        prom.set_value();
+        return;
+      }
 
+      if (checkpoint_) {
+        auto config = bc_.describe();
         if (meta) {
-          tmp = std::make_shared<block_data>(bc_.compress(data_->vec(), *meta));
-        } else {
-          tmp = std::make_shared<block_data>(bc_.compress(data_->vec()));
+          config.push_back('\0');
+          config.append(*meta);
+        }
+
+        key_ = compression_checkpoint::make_key(config, data_->vec());
+
+        if (auto blk = checkpoint_->take(*key_)) {
+          pctx_->bytes_in += data_->size();
+
+          if (blk->compression == compression_type::NONE) {
+            pctx_->bytes_out += data_->size();
+            comp_type_ = compression_type::NONE;
+          } else {
+            pctx_->bytes_out += blk->data.size();
+            auto tmp = std::make_shared<block_data>(std::move(blk->data));
+            std::lock_guard lock(mx_);
+            data_.swap(tmp);
+          }
+
+          prom.set_value();
+          return;
         }
+      }
+
+      auto buffer = pool_->acquire();
+
+      // If there are fewer blocks left to compress than there are
+      // workers, let the compressor use the idle workers' share of
+      // CPU time for this block. This mostly avoids the single-threaded
+      // tail at the end of a build. The idle workers are reserved so
+      // that concurrently starting jobs don't claim the same workers.
+      size_t const extra_threads =
+          parallel_compression_ ? wg.reserve_idle_workers(wg.size()) : 0;
+      size_t const num_threads = 1 + extra_threads;
+
+      SCOPE_EXIT { wg.release_idle_workers(extra_threads); };
+
+      try {
+        bc_.compress(data_->vec(), buffer, meta ? &*meta : nullptr,
+                     num_threads);
+
+        pctx_->bytes_in += data_->size();
+        pctx_->bytes_out += buffer.size();
 
-        pctx_->bytes_in += data_->vec().size();
-        pctx_->bytes_out += tmp->vec().size();
+        auto tmp = pool_->adopt(std::move(buffer));
 
         {
           std::lock_guard lock(mx_);
           data_.swap(tmp);
         }
       } catch (bad_compression_ratio_error const&) {
+        pool_->release(std::move(buffer));
         comp_type_ = compression_type::NONE;
       }
 
@@ -255,6 +388,11 @@ class raw_fsblock : public fsblock::impl {
     return header_.value();
   }
 
+  std::optional<compression_checkpoint::key_type>
+  checkpoint_key() const override {
+    return key_;
+  }
+
  private:
   const section_type type_;
   block_compressor const& bc_;
@@ -266,7 +404,11 @@ class raw_fsblock : public fsblock::impl {
   std::optional<section_header_v2> mutable header_;
   compression_type comp_type_;
   std::shared_ptr<compression_progress> pctx_;
+  std::shared_ptr<compression_buffer_pool> pool_;
+  bool const parallel_compression_;
   folly::Function<void(size_t)> set_block_cb_;
+  std::shared_ptr<compression_checkpoint> checkpoint_;
+  std::optional<compression_checkpoint::key_type> key_;
 };
 
 class compressed_fsblock : public fsblock::impl {
@@ -318,6 +460,11 @@ class compressed_fsblock : public fsblock::impl {
 
   section_header_v2 const& header() const override { return header_; }
 
+  std::optional<compression_checkpoint::key_type>
+  checkpoint_key() const override {
+    return std::nullopt;
+  }
+
  private:
   section_type const type_;
   compression_type const compression_;
@@ -334,12 +481,14 @@ class rewritten_fsblock : public fsblock::impl {
   rewritten_fsblock(section_type type, block_compressor const& bc,
                     std::span<uint8_t const> data,
                     compression_type data_comp_type,
-                    std::shared_ptr<compression_progress> pctx)
+                    std::shared_ptr<compression_progress> pctx,
+                    std::shared_ptr<compression_buffer_pool> pool)
       : type_{type}
       , bc_{bc}
       , data_{data}
       , comp_type_{bc_.type()}
       , pctx_{std::move(pctx)}
+      , pool_{std::move(pool)}
       , data_comp_type_{data_comp_type} {}
 
   void compress(worker_group& wg, std::optional<std::string> meta) override {
@@ -350,7 +499,8 @@ class rewritten_fsblock : public fsblock::impl {
         [this, prom = std::move(prom), meta = std::move(meta)]() mutable {
           try {
             // TODO: we don't have to do this for uncompressed blocks
-            std::vector<uint8_t> block;
+            auto block = pool_->acquire();
+            block.clear();
             block_decompressor bd(data_comp_type_, data_.data(), data_.size(),
                                   block);
             bd.decompress_frame(bd.uncompressed_size());
@@ -361,21 +511,23 @@ class rewritten_fsblock : public fsblock::impl {
 
             pctx_->bytes_in += block.size(); // TODO: data_.size()?
 
+            auto compressed = pool_->acquire();
+
             try {
-              if (meta) {
-                block = bc_.compress(block, *meta);
-              } else {
-                block = bc_.compress(block);
-              }
+              bc_.compress(block, compressed, meta ? &*meta : nullptr);
+              block.swap(compressed);
             } catch (bad_compression_ratio_error const&) {
               comp_type_ = compression_type::NONE;
             }
 
+            pool_->release(std::move(compressed));
             pctx_->bytes_out += block.size();
 
+            auto tmp = pool_->adopt(std::move(block));
+
             {
               std::lock_guard lock(mx_);
-              block_data_.swap(block);
+              block_data_.swap(tmp);
             }
 
             prom.set_value();
@@ -393,13 +545,15 @@ class rewritten_fsblock : public fsblock::impl {
 
   std::string description() const override { return bc_.describe(); }
 
-  std::span<uint8_t const> data() const override { return block_data_; }
+  std::span<uint8_t const> data() const override {
+    return block_data_->vec();
+  }
 
   size_t uncompressed_size() const override { return data_.size(); }
 
   size_t size() const override {
     std::lock_guard lock(mx_);
-    return block_data_.size();
+    return block_data_->size();
   }
 
   void set_block_no(uint32_t number) override {
@@ -426,27 +580,37 @@ class rewritten_fsblock : public fsblock::impl {
     return header_.value();
   }
 
+  std::optional<compression_checkpoint::key_type>
+  checkpoint_key() const override {
+    return std::nullopt;
+  }
+
  private:
   const section_type type_;
   block_compressor const& bc_;
   mutable std::recursive_mutex mx_;
   std::span<uint8_t const> data_;
-  std::vector<uint8_t> block_data_;
+  std::shared_ptr<block_data> block_data_{std::make_shared<block_data>()};
   std::future<void> future_;
   std::optional<uint32_t> number_;
   std::optional<section_header_v2> mutable header_;
   compression_type comp_type_;
   std::shared_ptr<compression_progress> pctx_;
+  std::shared_ptr<compression_buffer_pool> pool_;
   compression_type const data_comp_type_;
 };
 
 fsblock::fsblock(section_type type, block_compressor const& bc,
                  std::shared_ptr<block_data>&& data,
                  std::shared_ptr<compression_progress> pctx,
-                 folly::Function<void(size_t)> set_block_cb)
-    : impl_(std::make_unique<raw_fsblock>(type, bc, std::move(data),
-                                          std::move(pctx),
-                                          std::move(set_block_cb))) {}
+                 std::shared_ptr<compression_buffer_pool> pool,
+                 bool parallel_compression,
+                 folly::Function<void(size_t)> set_block_cb,
+                 std::shared_ptr<compression_checkpoint> checkpoint)
+    : impl_(std::make_unique<raw_fsblock>(
+          type, bc, std::move(data), std::move(pctx), std::move(pool),
+          parallel_compression, std::move(set_block_cb),
+          std::move(checkpoint))) {}
 
 fsblock::fsblock(section_type type, compression_type compression,
                  std::span<uint8_t const> data)
@@ -459,9 +623,11 @@ fsblock::fsblock(fs_section sec, std::span<uint8_t const> data,
 
 fsblock::fsblock(section_type type, block_compressor const& bc,
                  std::span<uint8_t const> data, compression_type data_comp_type,
-                 std::shared_ptr<compression_progress> pctx)
+                 std::shared_ptr<compression_progress> pctx,
+                 std::shared_ptr<compression_buffer_pool> pool)
     : impl_(std::make_unique<rewritten_fsblock>(type, bc, data, data_comp_type,
-                                                std::move(pctx))) {}
+                                                std::move(pctx),
+                                                std::move(pool))) {}
 
 void fsblock::build_section_header(section_header_v2& sh,
                                    fsblock::impl const& fsb,
@@ -595,6 +761,7 @@ class filesystem_writer_ final : public filesystem_writer::impl {
   LOG_PROXY_DECL(LoggerPolicy);
   std::deque<block_holder_type> queue_;
   std::shared_ptr<compression_progress> pctx_;
+  std::shared_ptr<compression_buffer_pool> pool_;
   mutable std::mutex mx_;
   std::condition_variable cond_;
   volatile bool flush_;
@@ -622,6 +789,7 @@ filesystem_writer_<LoggerPolicy>::filesystem_writer_(
     , history_bc_(history_bc)
     , options_(options)
     , LOG_PROXY_INIT(lgr)
+    , pool_{std::make_shared<compression_buffer_pool>(wg.size() + 1)}
     , flush_{true} {
   if (header_) {
     if (options_.remove_header) {
@@ -744,9 +912,17 @@ void filesystem_writer_<LoggerPolicy>::write(fsblock const& fsb) {
     push_section_index(fsb.type());
   }
 
+  auto const offset = image_size_;
+
   write(fsb.header());
   write(fsb.data());
 
+  if (options_.checkpoint) {
+    if (auto key = fsb.checkpoint_key()) {
+      options_.checkpoint->add(*key, offset);
+    }
+  }
+
   if (fsb.type() == section_type::BLOCK) {
     prog_.blocks_written++;
   }
@@ -787,8 +963,11 @@ void filesystem_writer_<LoggerPolicy>::write_block_impl(
     pctx = pctx_;
   }
 
-  auto fsb = std::make_unique<fsblock>(section_type::BLOCK, bc, std::move(data),
-                                       pctx, std::move(physical_block_cb));
+  auto fsb =
+      std::make_unique<fsblock>(section_type::BLOCK, bc, std::move(data), pctx,
+                                pool_, options_.parallel_block_compression,
+                                std::move(physical_block_cb),
+                                options_.checkpoint);
 
   fsb->compress(wg_, meta);
 
@@ -840,7 +1019,9 @@ void filesystem_writer_<LoggerPolicy>::write_section_impl(
       pctx_ = prog_.create_context<compression_progress>();
     }
 
-    auto fsb = std::make_unique<fsblock>(type, bc, std::move(data), pctx_);
+    auto fsb =
+        std::make_unique<fsblock>(type, bc, std::move(data), pctx_, pool_,
+                                  options_.parallel_block_compression);
 
     number = section_number_;
     fsb->set_block_no(section_number_++);
@@ -903,7 +1084,8 @@ void filesystem_writer_<LoggerPolicy>::write_section(
 
     auto& bc = get_compressor(type, cat);
 
-    auto fsb = std::make_unique<fsblock>(type, bc, data, compression, pctx_);
+    auto fsb =
+        std::make_unique<fsblock>(type, bc, data, compression, pctx_, pool_);
 
     fsb->set_block_no(section_number_++);
     fsb->compress(wg_);
@@ -1064,6 +1246,10 @@ void filesystem_writer_<LoggerPolicy>::flush() {
 
   writer_thread_.join();
 
+  LOG_VERBOSE << "compression buffers: " << pool_->buffers_allocated()
+              << " allocated, " << pool_->buffers_reused() << " reused, "
+              << pool_->buffers_copied() << " copied out";
+
   if (!options_.no_section_index) {
     write_section_index();
   }
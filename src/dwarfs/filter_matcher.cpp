@@ -0,0 +1,628 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cassert>
+#include <cctype>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "dwarfs/filter_matcher.h"
+
+namespace dwarfs {
+
+namespace {
+
+constexpr size_t const kMaxDfaStates{4096};
+constexpr uint32_t const kNoTransition{UINT32_MAX};
+
+using char_set = std::bitset<256>;
+
+struct token {
+  char_set chars;
+  bool repeat{false};
+};
+
+struct compiled_rule {
+  filter_matcher::rule_type type;
+  bool floating;
+  std::string rule;
+  std::string pattern;
+  std::vector<token> tokens;
+};
+
+char_set single_char(char c) {
+  char_set cs;
+  cs.set(static_cast<uint8_t>(c));
+  return cs;
+}
+
+char_set all_chars_except(std::string_view except) {
+  char_set cs;
+  cs.set();
+  for (auto c : except) {
+    cs.reset(static_cast<uint8_t>(c));
+  }
+  return cs;
+}
+
+template <typename Pred>
+char_set chars_where(Pred&& pred) {
+  char_set cs;
+  for (int c = 0; c < 256; ++c) {
+    if (c < 128 && pred(c)) {
+      cs.set(c);
+    }
+  }
+  return cs;
+}
+
+// The ECMAScript `.` doesn't match line terminators.
+char_set const& dot_chars() {
+  static char_set const cs = all_chars_except("\n\r");
+  return cs;
+}
+
+char_set const& non_slash_chars() {
+  static char_set const cs = all_chars_except("/");
+  return cs;
+}
+
+std::optional<char_set> class_escape(char c) {
+  switch (c) {
+  case 'd':
+    return chars_where(::isdigit);
+  case 'D':
+    return ~chars_where(::isdigit);
+  case 's':
+    return chars_where(::isspace);
+  case 'S':
+    return ~chars_where(::isspace);
+  case 'w':
+    return chars_where([](int c) { return ::isalnum(c) || c == '_'; });
+  case 'W':
+    return ~chars_where([](int c) { return ::isalnum(c) || c == '_'; });
+  default:
+    break;
+  }
+  return std::nullopt;
+}
+
+std::optional<char> control_escape(char c) {
+  switch (c) {
+  case 'f':
+    return '\f';
+  case 'n':
+    return '\n';
+  case 'r':
+    return '\r';
+  case 't':
+    return '\t';
+  case 'v':
+    return '\v';
+  case '0':
+    return '\0';
+  default:
+    break;
+  }
+  return std::nullopt;
+}
+
+bool is_unsupported_escape(char c) {
+  return c == 'b' || c == 'B' || c == 'c' || c == 'x' || c == 'u' ||
+         (c >= '1' && c <= '9');
+}
+
+char_set posix_class(std::string_view name) {
+  static std::map<std::string_view, int (*)(int)> const classes{
+      {"alnum", ::isalnum}, {"alpha", ::isalpha}, {"blank", ::isblank},
+      {"cntrl", ::iscntrl}, {"digit", ::isdigit}, {"graph", ::isgraph},
+      {"lower", ::islower}, {"print", ::isprint}, {"punct", ::ispunct},
+      {"space", ::isspace}, {"upper", ::isupper}, {"xdigit", ::isxdigit},
+  };
+
+  if (auto it = classes.find(name); it != classes.end()) {
+    return chars_where(it->second);
+  }
+
+  throw std::runtime_error(fmt::format("unknown character class: {}", name));
+}
+
+// Parses a bracket expression starting at `p` (just after the `[`).
+// Like the regular expressions previously used to implement the
+// filter rules, a leading `^` or `!` does *not* negate the set.
+char const* parse_bracket(char const* p, char_set& cs) {
+  std::optional<uint8_t> prev;
+
+  while (*p != ']') {
+    if (*p == '\0') {
+      throw std::runtime_error("unterminated character class");
+    }
+
+    std::optional<uint8_t> c;
+
+    if (p[0] == '[' && p[1] == ':') {
+      auto end = std::string_view(p + 2).find(":]");
+      if (end == std::string_view::npos) {
+        throw std::runtime_error("unterminated character class");
+      }
+      cs |= posix_class(std::string_view(p + 2, end));
+      p += end + 4;
+      prev.reset();
+      continue;
+    }
+
+    if (*p == '\\') {
+      ++p;
+      if (*p == '\0') {
+        throw std::runtime_error("trailing backslash");
+      }
+      if (auto ce = class_escape(*p)) {
+        cs |= *ce;
+        ++p;
+        prev.reset();
+        continue;
+      }
+      if (*p == 'b') {
+        c = '\b';
+      } else if (auto ctl = control_escape(*p)) {
+        c = static_cast<uint8_t>(*ctl);
+      } else if (is_unsupported_escape(*p)) {
+        throw std::runtime_error(
+            fmt::format("unsupported escape sequence: \\{}", *p));
+      } else {
+        c = static_cast<uint8_t>(*p);
+      }
+    } else if (*p == '-' && prev && p[1] != ']') {
+      ++p;
+      uint8_t hi;
+      if (*p == '\\') {
+        ++p;
+        if (*p == '\0') {
+          throw std::runtime_error("trailing backslash");
+        }
+        auto ctl = control_escape(*p);
+        hi = static_cast<uint8_t>(ctl ? *ctl : *p);
+      } else if (*p == '\0') {
+        throw std::runtime_error("unterminated character class");
+      } else {
+        hi = static_cast<uint8_t>(*p);
+      }
+      if (hi < *prev) {
+        throw std::runtime_error("invalid range in character class");
+      }
+      for (unsigned i = *prev; i <= hi; ++i) {
+        cs.set(i);
+      }
+      ++p;
+      prev.reset();
+      continue;
+    } else {
+      c = static_cast<uint8_t>(*p);
+    }
+
+    cs.set(*c);
+    prev = c;
+    ++p;
+  }
+
+  return p + 1;
+}
+
+compiled_rule compile_rule(std::string const& rule) {
+  compiled_rule cr;
+  cr.rule = rule;
+
+  auto* p = rule.c_str();
+
+  switch (*p) {
+  case '+':
+    cr.type = filter_matcher::rule_type::include;
+    break;
+  case '-':
+    cr.type = filter_matcher::rule_type::exclude;
+    break;
+  default:
+    throw std::runtime_error("rules must start with + or -");
+  }
+
+  while (*++p == ' ')
+    ;
+
+  auto& r = cr.pattern;
+  auto& tok = cr.tokens;
+  bool after_slash = false;
+
+  auto add = [&](char_set const& cs, bool repeat = false) {
+    tok.push_back({cs, repeat});
+    after_slash = false;
+  };
+
+  auto add_char = [&](char c) {
+    add(single_char(c));
+    after_slash = c == '/';
+  };
+
+  // If the start of the pattern is not explicitly anchored, make it floating.
+  cr.floating = *p && *p != '/';
+
+  if (cr.floating) {
+    r += ".*/";
+    add(dot_chars(), true);
+    add_char('/');
+  }
+
+  while (*p) {
+    switch (*p) {
+    case '\\':
+      ++p;
+      if (*p == '\0') {
+        throw std::runtime_error("trailing backslash");
+      }
+      r += '\\';
+      r += *p;
+      if (auto ce = class_escape(*p)) {
+        add(*ce);
+      } else if (auto ctl = control_escape(*p)) {
+        add_char(*ctl);
+      } else if (is_unsupported_escape(*p)) {
+        throw std::runtime_error(
+            fmt::format("unsupported escape sequence: \\{}", *p));
+      } else {
+        add_char(*p);
+      }
+      break;
+
+    case '*': {
+      int nstar = 1;
+      while (*++p == '*') {
+        ++nstar;
+      }
+      switch (nstar) {
+      case 1:
+        if (after_slash and (*p == '/' or *p == '\0')) {
+          r += "[^/]+";
+          add(non_slash_chars());
+          add(non_slash_chars(), true);
+        } else {
+          r += "[^/]*";
+          add(non_slash_chars(), true);
+        }
+        break;
+      case 2:
+        r += ".*";
+        add(dot_chars(), true);
+        break;
+      default:
+        throw std::runtime_error("too many *s");
+      }
+    }
+      continue;
+
+    case '?':
+      r += "[^/]";
+      add(non_slash_chars());
+      break;
+
+    case '[': {
+      char_set cs;
+      auto end = parse_bracket(p + 1, cs);
+      r.append(p, end);
+      add(cs);
+      p = end;
+    }
+      continue;
+
+    case '.':
+    case '+':
+    case '^':
+    case '$':
+    case '(':
+    case ')':
+    case '{':
+    case '}':
+    case '|':
+      r += '\\';
+      r += *p;
+      add_char(*p);
+      break;
+
+    default:
+      r += *p;
+      add_char(*p);
+      break;
+    }
+
+    ++p;
+  }
+
+  return cr;
+}
+
+class filter_matcher_ final : public filter_matcher::impl {
+ public:
+  using cursor = filter_matcher::cursor;
+  using rule_type = filter_matcher::rule_type;
+
+  void add_rule(std::string const& rule) override {
+    auto cr = compile_rule(rule);
+    rule_base_.push_back(nfa_rule_.size());
+    nfa_rule_.insert(nfa_rule_.end(), cr.tokens.size() + 1, rules_.size());
+    rules_.push_back(std::move(cr));
+    reset(true);
+  }
+
+  size_t size() const override { return rules_.size(); }
+
+  rule_type type(size_t index) const override { return rules_[index].type; }
+
+  bool floating(size_t index) const override {
+    return rules_[index].floating;
+  }
+
+  std::string const& rule(size_t index) const override {
+    return rules_[index].rule;
+  }
+
+  std::string const& pattern(size_t index) const override {
+    return rules_[index].pattern;
+  }
+
+  cursor start(size_t anchor) override {
+    prepare();
+    if (start_generation_ != generation_) {
+      start_ = intern(std::vector<uint32_t>(start_nfa_));
+      start_generation_ = generation_;
+    }
+    return cursor{start_, generation_, 0, anchor};
+  }
+
+  cursor advance(cursor const& c, std::string_view s) override {
+    assert(valid(c));
+
+    auto st = c.state;
+    auto off = c.offset;
+
+    for (size_t i = 0; i < s.size(); ++i, ++off) {
+      if (off == c.anchor) {
+        st = inject(st);
+      } else if (off > c.anchor && states_[st].nfa.empty()) {
+        // nothing can match anymore, no matter what follows
+        off += s.size() - i;
+        break;
+      }
+      st = next(st, static_cast<uint8_t>(s[i]));
+    }
+
+    return cursor{st, generation_, off, c.anchor};
+  }
+
+  bool valid(cursor const& c) const override {
+    return prepared_ && c.generation == generation_ &&
+           c.state < states_.size();
+  }
+
+  std::optional<size_t> match(cursor const& c) override {
+    assert(valid(c));
+
+    auto st = c.offset == c.anchor ? inject(c.state) : c.state;
+
+    if (auto m = states_[st].match; m != kNoTransition) {
+      return m;
+    }
+
+    return std::nullopt;
+  }
+
+ private:
+  struct dfa_state {
+    std::vector<uint32_t> nfa;
+    uint32_t match{kNoTransition};
+    uint32_t inject{kNoTransition};
+  };
+
+  void reset(bool rules_changed) {
+    states_.clear();
+    next_.clear();
+    index_.clear();
+    ++generation_;
+    prepared_ = false;
+    if (rules_changed) {
+      classes_ready_ = false;
+    }
+  }
+
+  void prepare() {
+    if (prepared_) {
+      return;
+    }
+
+    if (!classes_ready_) {
+      compute_byte_classes();
+
+      start_nfa_.clear();
+      for (size_t r = 0; r < rules_.size(); ++r) {
+        if (rules_[r].floating) {
+          add_closure(start_nfa_, r, 0);
+        }
+      }
+    }
+
+    prepared_ = true;
+  }
+
+  // Partition all byte values into classes that cannot be distinguished
+  // by any of the rules. This keeps the transition table small.
+  void compute_byte_classes() {
+    byte_class_.fill(0);
+    num_classes_ = 1;
+
+    std::vector<uint32_t> remap;
+
+    for (auto const& cr : rules_) {
+      for (auto const& t : cr.tokens) {
+        remap.assign(2 * num_classes_, kNoTransition);
+        uint32_t n = 0;
+        for (size_t b = 0; b < 256; ++b) {
+          auto& slot = remap[2 * byte_class_[b] + (t.chars[b] ? 1 : 0)];
+          if (slot == kNoTransition) {
+            slot = n++;
+          }
+          byte_class_[b] = slot;
+        }
+        num_classes_ = n;
+      }
+    }
+
+    class_rep_.assign(num_classes_, 0);
+    for (size_t b = 256; b-- > 0;) {
+      class_rep_[byte_class_[b]] = b;
+    }
+
+    classes_ready_ = true;
+  }
+
+  void add_closure(std::vector<uint32_t>& set, size_t r, size_t pos) const {
+    auto const& tok = rules_[r].tokens;
+    set.push_back(rule_base_[r] + pos);
+    while (pos < tok.size() && tok[pos].repeat) {
+      set.push_back(rule_base_[r] + ++pos);
+    }
+  }
+
+  uint32_t intern(std::vector<uint32_t>&& set) {
+    std::sort(set.begin(), set.end());
+    set.erase(std::unique(set.begin(), set.end()), set.end());
+
+    if (auto it = index_.find(set); it != index_.end()) {
+      return it->second;
+    }
+
+    if (states_.size() >= kMaxDfaStates) {
+      reset(false);
+      prepared_ = true;
+    }
+
+    dfa_state ds;
+
+    for (auto id : set) {
+      auto r = nfa_rule_[id];
+      if (id - rule_base_[r] == rules_[r].tokens.size()) {
+        ds.match = r;
+        break;
+      }
+    }
+
+    ds.nfa = set;
+
+    uint32_t st = states_.size();
+    states_.push_back(std::move(ds));
+    next_.resize(next_.size() + num_classes_, kNoTransition);
+    index_.emplace(std::move(set), st);
+
+    return st;
+  }
+
+  uint32_t next(uint32_t st, uint8_t byte) {
+    auto cls = byte_class_[byte];
+
+    if (auto n = next_[st * num_classes_ + cls]; n != kNoTransition) {
+      return n;
+    }
+
+    auto const gen = generation_;
+    auto const rep = class_rep_[cls];
+    std::vector<uint32_t> set;
+
+    for (auto id : states_[st].nfa) {
+      auto r = nfa_rule_[id];
+      auto pos = id - rule_base_[r];
+      auto const& tok = rules_[r].tokens;
+      if (pos < tok.size() && tok[pos].chars[rep]) {
+        add_closure(set, r, tok[pos].repeat ? pos : pos + 1);
+      }
+    }
+
+    auto n = intern(std::move(set));
+
+    if (generation_ == gen) {
+      next_[st * num_classes_ + cls] = n;
+    }
+
+    return n;
+  }
+
+  // Start matching the anchored rules in addition to whatever is
+  // currently being matched.
+  uint32_t inject(uint32_t st) {
+    if (auto n = states_[st].inject; n != kNoTransition) {
+      return n;
+    }
+
+    auto const gen = generation_;
+    auto set = states_[st].nfa;
+
+    for (size_t r = 0; r < rules_.size(); ++r) {
+      if (!rules_[r].floating) {
+        add_closure(set, r, 0);
+      }
+    }
+
+    auto n = intern(std::move(set));
+
+    if (generation_ == gen) {
+      states_[st].inject = n;
+      states_[n].inject = n;
+    }
+
+    return n;
+  }
+
+  std::vector<compiled_rule> rules_;
+  std::vector<uint32_t> rule_base_;
+  std::vector<uint32_t> nfa_rule_;
+  std::array<uint32_t, 256> byte_class_{};
+  std::vector<uint8_t> class_rep_;
+  size_t num_classes_{1};
+  bool classes_ready_{false};
+  bool prepared_{false};
+  uint32_t generation_{0};
+  uint32_t start_{0};
+  uint32_t start_generation_{UINT32_MAX};
+  std::vector<uint32_t> start_nfa_;
+  std::vector<dfa_state> states_;
+  std::vector<uint32_t> next_;
+  std::map<std::vector<uint32_t>, uint32_t> index_;
+};
+
+} // namespace
+
+filter_matcher::filter_matcher()
+    : impl_{std::make_unique<filter_matcher_>()} {}
+
+filter_matcher::~filter_matcher() = default;
+
+} // namespace dwarfs
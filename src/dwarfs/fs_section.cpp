@@ -41,7 +41,7 @@ void read_section_header_common(T& header, size_t& start, mmif const& mm,
     DWARFS_THROW(runtime_error, "truncated section header");
   }
 
-  ::memcpy(&header, mm.as<void>(offset), sizeof(T));
+  ::memcpy(&header, mm.span(offset, sizeof(T)).data(), sizeof(T));
 
   offset += sizeof(T);
 
@@ -101,6 +101,7 @@ class fs_section_v1 final : public fs_section::impl {
 
   bool check_fast(mmif const&) const override { return true; }
   bool check(mmif const&) const override { return true; }
+  bool check(std::span<uint8_t const>) const override { return true; }
   bool verify(mmif const&) const override { return true; }
 
   std::span<uint8_t const> data(mmif const& mm) const override {
@@ -184,26 +185,44 @@ class fs_section_v2 final : public fs_section::impl {
     static auto constexpr kHdrCsLen =
         sizeof(section_header_v2) - offsetof(section_header_v2, number);
 
-    auto ok = checksum::verify(
-        checksum::algorithm::XXH3_64, mm.as<void>(start_ - kHdrCsLen),
-        hdr_.length + kHdrCsLen, &hdr_.xxh3_64, sizeof(hdr_.xxh3_64));
+    auto data = mm.span(start_ - kHdrCsLen, hdr_.length + kHdrCsLen);
 
-    auto state = check_state_.load();
+    return update_check_state(
+        checksum::verify(checksum::algorithm::XXH3_64, data.data(), data.size(),
+                         &hdr_.xxh3_64, sizeof(hdr_.xxh3_64)));
+  }
 
-    if (state != check_state::failed) {
-      auto desired = ok ? check_state::passed : check_state::failed;
-      check_state_.compare_exchange_strong(state, desired);
+  // Same as above, but for a copy of the section data that has been read
+  // into memory. The part of the header covered by the checksum is taken
+  // from the already parsed header.
+  bool check(std::span<uint8_t const> data) const override {
+    if (check_state_.load() == check_state::failed) {
+      return false;
     }
 
-    return ok;
+    static auto constexpr kHdrCsLen =
+        sizeof(section_header_v2) - offsetof(section_header_v2, number);
+
+    if (data.size() != hdr_.length) {
+      return false;
+    }
+
+    checksum cs(checksum::algorithm::XXH3_64);
+    cs.update(&hdr_.number, kHdrCsLen);
+    cs.update(data.data(), data.size());
+
+    uint64_t digest;
+
+    return update_check_state(cs.finalize(&digest) &&
+                              digest == hdr_.xxh3_64);
   }
 
   bool verify(mmif const& mm) const override {
     auto hdr_sha_len =
         sizeof(section_header_v2) - offsetof(section_header_v2, xxh3_64);
-    return checksum::verify(checksum::algorithm::SHA2_512_256,
-                            mm.as<void>(start_ - hdr_sha_len),
-                            hdr_.length + hdr_sha_len, &hdr_.sha2_512_256,
+    auto data = mm.span(start_ - hdr_sha_len, hdr_.length + hdr_sha_len);
+    return checksum::verify(checksum::algorithm::SHA2_512_256, data.data(),
+                            data.size(), &hdr_.sha2_512_256,
                             sizeof(hdr_.sha2_512_256));
   }
 
@@ -227,6 +246,17 @@ class fs_section_v2 final : public fs_section::impl {
  private:
   enum class check_state { unknown, passed, failed };
 
+  bool update_check_state(bool ok) const {
+    auto state = check_state_.load();
+
+    if (state != check_state::failed) {
+      auto desired = ok ? check_state::passed : check_state::failed;
+      check_state_.compare_exchange_strong(state, desired);
+    }
+
+    return ok;
+  }
+
   size_t start_;
   section_header_v2 hdr_;
   std::atomic<check_state> mutable check_state_{check_state::unknown};
@@ -264,6 +294,10 @@ class fs_section_v2_lazy final : public fs_section::impl {
 
   bool check(mmif const& mm) const override { return section().check(mm); }
 
+  bool check(std::span<uint8_t const> data) const override {
+    return section().check(data);
+  }
+
   bool verify(mmif const& mm) const override { return section().verify(mm); }
 
   std::span<uint8_t const> data(mmif const& mm) const override {
@@ -0,0 +1,670 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <curl/curl.h>
+
+#include <fmt/format.h>
+
+#include <folly/ExceptionString.h>
+
+#include "dwarfs/error.h"
+#include "dwarfs/http_mmif.h"
+#include "dwarfs/logger.h"
+
+namespace dwarfs {
+
+namespace {
+
+constexpr std::array<char, 8> const kCacheMagic{'D', 'W', 'H', 'T',
+                                                'T', 'P', 'C', '1'};
+
+// Runs of missing chunks are split into pieces of at most this size
+// when prefetching, so they can be fetched in parallel.
+constexpr size_t const kPrefetchPieceSize{size_t(4) << 20};
+
+struct cache_trailer {
+  std::array<char, 8> magic;
+  uint64_t image_size;
+  uint64_t chunk_size;
+  std::array<char, 232> validator;
+};
+
+static_assert(sizeof(cache_trailer) == 256);
+
+struct curl_handle_deleter {
+  void operator()(CURL* curl) const { ::curl_easy_cleanup(curl); }
+};
+
+using curl_handle = std::unique_ptr<CURL, curl_handle_deleter>;
+
+struct transfer {
+  uint8_t* dest{nullptr};
+  size_t length{0};
+  size_t received{0};
+  std::optional<uint64_t> range_start;
+  std::optional<uint64_t> total_size;
+  std::string etag;
+  std::string last_modified;
+
+  std::string validator() const {
+    return etag.empty() ? last_modified : etag;
+  }
+};
+
+std::string_view trim(std::string_view s) {
+  while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front()))) {
+    s.remove_prefix(1);
+  }
+  while (!s.empty() && std::isspace(static_cast<unsigned char>(s.back()))) {
+    s.remove_suffix(1);
+  }
+  return s;
+}
+
+std::optional<uint64_t> parse_uint(std::string_view s) {
+  uint64_t value;
+  auto [p, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+  if (ec != std::errc() || p != s.data() + s.size()) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+size_t write_callback(char* ptr, size_t size, size_t nmemb, void* userdata) {
+  auto& t = *static_cast<transfer*>(userdata);
+  auto n = size * nmemb;
+
+  if (t.received + n > t.length) {
+    // Either the server ignored our range or it sent more data than
+    // requested; in both cases, abort the transfer.
+    return 0;
+  }
+
+  if (t.dest) {
+    std::memcpy(t.dest + t.received, ptr, n);
+  }
+
+  t.received += n;
+
+  return n;
+}
+
+size_t header_callback(char* buffer, size_t size, size_t nitems,
+                       void* userdata) {
+  auto& t = *static_cast<transfer*>(userdata);
+  std::string_view line(buffer, size * nitems);
+
+  if (line.starts_with("HTTP/")) {
+    // start of a new response, e.g. after a redirect
+    t.range_start.reset();
+    t.total_size.reset();
+    t.etag.clear();
+    t.last_modified.clear();
+    return size * nitems;
+  }
+
+  auto colon = line.find(':');
+
+  if (colon == std::string_view::npos) {
+    return size * nitems;
+  }
+
+  auto name = trim(line.substr(0, colon));
+  auto value = trim(line.substr(colon + 1));
+
+  auto is = [&](std::string_view n) {
+    return name.size() == n.size() &&
+           std::equal(name.begin(), name.end(), n.begin(), [](char a, char b) {
+             return std::tolower(static_cast<unsigned char>(a)) == b;
+           });
+  };
+
+  if (is("content-range")) {
+    // bytes <start>-<end>/<total>
+    if (value.starts_with("bytes ")) {
+      value.remove_prefix(6);
+      auto dash = value.find('-');
+      auto slash = value.find('/');
+      if (dash != std::string_view::npos && slash != std::string_view::npos &&
+          dash < slash) {
+        t.range_start = parse_uint(value.substr(0, dash));
+        t.total_size = parse_uint(value.substr(slash + 1));
+      }
+    }
+  } else if (is("etag")) {
+    t.etag = value;
+  } else if (is("last-modified")) {
+    t.last_modified = value;
+  }
+
+  return size * nitems;
+}
+
+size_t align_up(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+template <typename LoggerPolicy>
+class http_mmif_ final : public http_mmif::impl {
+ public:
+  using file_range = mmif::file_range;
+
+  http_mmif_(logger& lgr, std::string const& url, http_mmif_options const& opts)
+      : LOG_PROXY_INIT(lgr)
+      , url_{url}
+      , path_{url}
+      , opts_{opts} {
+    static std::once_flag curl_init;
+    std::call_once(curl_init, [] { ::curl_global_init(CURL_GLOBAL_DEFAULT); });
+
+    if (opts_.chunk_size == 0) {
+      DWARFS_THROW(runtime_error, "chunk size must not be zero");
+    }
+
+    probe();
+
+    num_chunks_ = (size_ + opts_.chunk_size - 1) / opts_.chunk_size;
+    state_ = std::make_unique<std::atomic<uint8_t>[]>(num_chunks_);
+
+    open_cache();
+  }
+
+  ~http_mmif_() override {
+    if (map_) {
+      ::munmap(map_, map_size_);
+    }
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  void const* addr() const override { return data_; }
+
+  size_t size() const override { return size_; }
+
+  void const* range_addr(file_off_t offset, size_t length) override {
+    if (length > 0 && offset >= 0 && static_cast<size_t>(offset) < size_) {
+      ensure(offset, std::min(length, size_ - offset));
+    }
+    return data_ + offset;
+  }
+
+  std::error_code prefetch(std::span<file_range const> ranges) override;
+
+  std::filesystem::path const& path() const override { return path_; }
+
+  size_t bytes_fetched() const override { return bytes_fetched_.load(); }
+
+ private:
+  enum : uint8_t {
+    kMissing,
+    kFetching,
+    kPresent,
+  };
+
+  struct chunk_run {
+    size_t first;
+    size_t count;
+  };
+
+  void probe();
+  void open_cache();
+  void ensure(size_t offset, size_t length);
+  void claim(size_t first, size_t last, std::vector<chunk_run>& runs,
+             bool& pending);
+  void fetch_run(chunk_run const& run);
+  void fetch(uint64_t offset, size_t length, transfer& t);
+
+  bool all_present(size_t first, size_t last) const {
+    for (size_t c = first; c <= last; ++c) {
+      if (state_[c].load(std::memory_order_acquire) != kPresent) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  curl_handle get_handle() {
+    {
+      std::lock_guard lock(handles_mx_);
+      if (!handles_.empty()) {
+        auto h = std::move(handles_.back());
+        handles_.pop_back();
+        return h;
+      }
+    }
+
+    curl_handle h{::curl_easy_init()};
+
+    if (!h) {
+      DWARFS_THROW(runtime_error, "curl_easy_init() failed");
+    }
+
+    ::curl_easy_setopt(h.get(), CURLOPT_URL, url_.c_str());
+    ::curl_easy_setopt(h.get(), CURLOPT_FOLLOWLOCATION, 1L);
+    ::curl_easy_setopt(h.get(), CURLOPT_NOSIGNAL, 1L);
+    ::curl_easy_setopt(h.get(), CURLOPT_CONNECTTIMEOUT_MS,
+                       static_cast<long>(opts_.connect_timeout.count()));
+    ::curl_easy_setopt(h.get(), CURLOPT_WRITEFUNCTION, write_callback);
+    ::curl_easy_setopt(h.get(), CURLOPT_HEADERFUNCTION, header_callback);
+
+    return h;
+  }
+
+  void put_handle(curl_handle h) {
+    std::lock_guard lock(handles_mx_);
+    handles_.push_back(std::move(h));
+  }
+
+  LOG_PROXY_DECL(LoggerPolicy);
+  std::string const url_;
+  std::filesystem::path const path_;
+  http_mmif_options const opts_;
+  size_t size_{0};
+  size_t num_chunks_{0};
+  std::string validator_;
+  int fd_{-1};
+  void* map_{nullptr};
+  size_t map_size_{0};
+  uint8_t* data_{nullptr};
+  uint8_t* bitmap_{nullptr};
+  std::unique_ptr<std::atomic<uint8_t>[]> state_;
+  std::mutex mx_;
+  std::condition_variable cv_;
+  std::mutex handles_mx_;
+  std::vector<curl_handle> handles_;
+  std::atomic<size_t> bytes_fetched_{0};
+};
+
+template <typename LoggerPolicy>
+void http_mmif_<LoggerPolicy>::fetch(uint64_t offset, size_t length,
+                                     transfer& t) {
+  auto range = fmt::format("{}-{}", offset, offset + length - 1);
+  auto* dest = t.dest;
+
+  for (size_t attempt = 0;; ++attempt) {
+    t = transfer{};
+    t.dest = dest;
+    t.length = length;
+
+    auto h = get_handle();
+
+    ::curl_easy_setopt(h.get(), CURLOPT_RANGE, range.c_str());
+    ::curl_easy_setopt(h.get(), CURLOPT_WRITEDATA, &t);
+    ::curl_easy_setopt(h.get(), CURLOPT_HEADERDATA, &t);
+
+    auto rc = ::curl_easy_perform(h.get());
+
+    long status = 0;
+    ::curl_easy_getinfo(h.get(), CURLINFO_RESPONSE_CODE, &status);
+
+    put_handle(std::move(h));
+
+    std::string error;
+
+    if (status == 200) {
+      DWARFS_THROW(runtime_error,
+                   fmt::format("{} does not support range requests", url_));
+    }
+
+    if (rc != CURLE_OK) {
+      error = ::curl_easy_strerror(rc);
+    } else if (status != 206) {
+      error = fmt::format("unexpected HTTP status {}", status);
+    } else if (t.range_start != offset) {
+      error = "unexpected content range";
+    } else if (t.received != length) {
+      error = fmt::format("short read ({} of {} bytes)", t.received, length);
+    } else {
+      return;
+    }
+
+    if (attempt >= opts_.max_retries) {
+      DWARFS_THROW(runtime_error,
+                   fmt::format("failed to fetch bytes {} from {}: {}", range,
+                               url_, error));
+    }
+
+    LOG_WARN << "fetching bytes " << range << " from " << url_
+             << " failed (" << error << "), retrying";
+  }
+}
+
+template <typename LoggerPolicy>
+void http_mmif_<LoggerPolicy>::probe() {
+  transfer t;
+
+  fetch(0, 1, t);
+
+  if (!t.total_size) {
+    DWARFS_THROW(runtime_error,
+                 fmt::format("could not determine size of {}", url_));
+  }
+
+  size_ = *t.total_size;
+  validator_ = t.validator();
+
+  LOG_DEBUG << url_ << ": " << size_ << " bytes, validator: " << validator_;
+}
+
+template <typename LoggerPolicy>
+void http_mmif_<LoggerPolicy>::open_cache() {
+  auto data_size = align_up(size_, ::sysconf(_SC_PAGESIZE));
+
+  map_size_ = data_size + num_chunks_ + sizeof(cache_trailer);
+
+  cache_trailer trailer;
+  std::memset(&trailer, 0, sizeof(trailer));
+  trailer.magic = kCacheMagic;
+  trailer.image_size = size_;
+  trailer.chunk_size = opts_.chunk_size;
+  std::memcpy(trailer.validator.data(), validator_.data(),
+              std::min(validator_.size(), trailer.validator.size()));
+
+  if (opts_.cache_file.empty()) {
+    map_ = ::mmap(nullptr, map_size_, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (map_ == MAP_FAILED) {
+      map_ = nullptr;
+      DWARFS_THROW(system_error, "mmap()");
+    }
+  } else {
+    fd_ = ::open(opts_.cache_file.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+
+    if (fd_ < 0) {
+      DWARFS_THROW(system_error,
+                   fmt::format("open({})", opts_.cache_file.string()));
+    }
+
+    struct ::stat st;
+    bool reuse = false;
+
+    // Only reuse the cache if we can be sure the remote image is the same
+    if (::fstat(fd_, &st) == 0 &&
+        static_cast<size_t>(st.st_size) == map_size_ && !validator_.empty() &&
+        validator_.size() <= trailer.validator.size()) {
+      cache_trailer existing;
+      if (::pread(fd_, &existing, sizeof(existing),
+                  map_size_ - sizeof(existing)) == sizeof(existing)) {
+        reuse = std::memcmp(&existing, &trailer, sizeof(trailer)) == 0;
+      }
+    }
+
+    if (!reuse) {
+      if (::ftruncate(fd_, 0) != 0 || ::ftruncate(fd_, map_size_) != 0 ||
+          ::pwrite(fd_, &trailer, sizeof(trailer),
+                   map_size_ - sizeof(trailer)) != sizeof(trailer)) {
+        DWARFS_THROW(system_error, opts_.cache_file.string());
+      }
+    }
+
+    map_ = ::mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_,
+                  0);
+
+    if (map_ == MAP_FAILED) {
+      map_ = nullptr;
+      DWARFS_THROW(system_error, "mmap()");
+    }
+  }
+
+  data_ = static_cast<uint8_t*>(map_);
+  bitmap_ = data_ + data_size;
+
+  size_t present = 0;
+
+  for (size_t c = 0; c < num_chunks_; ++c) {
+    if (bitmap_[c]) {
+      state_[c].store(kPresent);
+      ++present;
+    } else {
+      state_[c].store(kMissing);
+    }
+  }
+
+  if (!opts_.cache_file.empty()) {
+    LOG_DEBUG << "using " << present << "/" << num_chunks_
+              << " cached chunks from " << opts_.cache_file;
+  }
+}
+
+// Claim all missing chunks in [first, last] for fetching by the current
+// thread. Returns runs of consecutive claimed chunks, and whether there
+// are chunks that are currently being fetched by other threads.
+template <typename LoggerPolicy>
+void http_mmif_<LoggerPolicy>::claim(size_t first, size_t last,
+                                     std::vector<chunk_run>& runs,
+                                     bool& pending) {
+  bool extend = false;
+
+  for (size_t c = first; c <= last; ++c) {
+    switch (state_[c].load()) {
+    case kMissing:
+      state_[c].store(kFetching);
+      if (extend) {
+        ++runs.back().count;
+      } else {
+        runs.push_back({c, 1});
+        extend = true;
+      }
+      break;
+
+    case kFetching:
+      pending = true;
+      extend = false;
+      break;
+
+    default:
+      extend = false;
+      break;
+    }
+  }
+}
+
+template <typename LoggerPolicy>
+void http_mmif_<LoggerPolicy>::fetch_run(chunk_run const& run) {
+  auto offset = run.first * opts_.chunk_size;
+  auto length = std::min(run.count * opts_.chunk_size, size_ - offset);
+
+  LOG_TRACE << "fetching " << length << " bytes at offset " << offset;
+
+  try {
+    transfer t;
+    t.dest = data_ + offset;
+    fetch(offset, length, t);
+
+    if (!validator_.empty() && !t.validator().empty() &&
+        t.validator() != validator_) {
+      DWARFS_THROW(runtime_error,
+                   fmt::format("{} has changed since it was opened", url_));
+    }
+  } catch (...) {
+    {
+      std::lock_guard lock(mx_);
+      for (size_t c = run.first; c < run.first + run.count; ++c) {
+        state_[c].store(kMissing);
+      }
+    }
+    cv_.notify_all();
+    throw;
+  }
+
+  bytes_fetched_ += length;
+
+  {
+    std::lock_guard lock(mx_);
+    for (size_t c = run.first; c < run.first + run.count; ++c) {
+      bitmap_[c] = 1;
+      state_[c].store(kPresent, std::memory_order_release);
+    }
+  }
+
+  cv_.notify_all();
+}
+
+template <typename LoggerPolicy>
+void http_mmif_<LoggerPolicy>::ensure(size_t offset, size_t length) {
+  auto first = offset / opts_.chunk_size;
+  auto last = (offset + length - 1) / opts_.chunk_size;
+
+  while (!all_present(first, last)) {
+    std::vector<chunk_run> runs;
+
+    {
+      std::unique_lock lock(mx_);
+
+      for (;;) {
+        bool pending = false;
+        claim(first, last, runs, pending);
+        if (!runs.empty() || !pending) {
+          break;
+        }
+        cv_.wait(lock);
+      }
+    }
+
+    for (size_t i = 0; i < runs.size(); ++i) {
+      try {
+        fetch_run(runs[i]);
+      } catch (...) {
+        std::lock_guard lock(mx_);
+        for (size_t j = i + 1; j < runs.size(); ++j) {
+          for (size_t c = runs[j].first; c < runs[j].first + runs[j].count;
+               ++c) {
+            state_[c].store(kMissing);
+          }
+        }
+        cv_.notify_all();
+        throw;
+      }
+    }
+  }
+}
+
+template <typename LoggerPolicy>
+std::error_code
+http_mmif_<LoggerPolicy>::prefetch(std::span<file_range const> ranges) {
+  auto const piece_chunks =
+      std::max<size_t>(1, kPrefetchPieceSize / opts_.chunk_size);
+  std::vector<chunk_run> runs;
+
+  {
+    std::lock_guard lock(mx_);
+
+    for (auto const& [offset, length] : ranges) {
+      if (length == 0 || offset < 0 || static_cast<size_t>(offset) >= size_) {
+        continue;
+      }
+
+      auto end = std::min<size_t>(offset + length, size_);
+      bool pending = false;
+      std::vector<chunk_run> tmp;
+
+      claim(offset / opts_.chunk_size, (end - 1) / opts_.chunk_size, tmp,
+            pending);
+
+      for (auto run : tmp) {
+        while (run.count > piece_chunks) {
+          runs.push_back({run.first, piece_chunks});
+          run.first += piece_chunks;
+          run.count -= piece_chunks;
+        }
+        runs.push_back(run);
+      }
+    }
+  }
+
+  if (runs.empty()) {
+    return {};
+  }
+
+  auto num_threads = std::min(runs.size(), opts_.max_parallel_requests);
+
+  LOG_DEBUG << "prefetching " << runs.size() << " chunk runs using "
+            << num_threads << " requests";
+
+  std::atomic<size_t> next{0};
+  std::atomic<bool> failed{false};
+
+  auto worker = [&] {
+    for (;;) {
+      auto i = next++;
+      if (i >= runs.size()) {
+        break;
+      }
+      try {
+        fetch_run(runs[i]);
+      } catch (...) {
+        LOG_WARN << "prefetch failed: "
+                 << folly::exceptionStr(std::current_exception());
+        failed = true;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+
+  for (size_t i = 1; i < num_threads; ++i) {
+    threads.emplace_back(worker);
+  }
+
+  worker();
+
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  return failed ? std::make_error_code(std::errc::io_error)
+                : std::error_code();
+}
+
+http_mmif::http_mmif(logger& lgr, std::string const& url,
+                     http_mmif_options const& opts)
+    : impl_(make_unique_logging_object<impl, http_mmif_, logger_policies>(
+          lgr, url, opts)) {}
+
+http_mmif::~http_mmif() = default;
+
+bool http_mmif::is_url(std::string_view path) {
+  return path.starts_with("http://") || path.starts_with("https://");
+}
+
+} // namespace dwarfs
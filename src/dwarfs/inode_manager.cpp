@@ -771,7 +771,7 @@ auto inode_manager_<LoggerPolicy>::ordered_span(
     LOG_VERBOSE << prefix << "ordering " << span.size()
                 << " inodes by path name...";
     auto tv = LOG_CPU_TIMED_VERBOSE;
-    order.by_path(span);
+    order.by_path(wg, span);
     tv << prefix << span.size() << " inodes ordered";
     break;
   }
@@ -780,7 +780,7 @@ auto inode_manager_<LoggerPolicy>::ordered_span(
     LOG_VERBOSE << prefix << "ordering " << span.size()
                 << " inodes by reverse path name...";
     auto tv = LOG_CPU_TIMED_VERBOSE;
-    order.by_reverse_path(span);
+    order.by_reverse_path(wg, span);
     tv << prefix << span.size() << " inodes ordered";
     break;
   }
@@ -789,7 +789,7 @@ auto inode_manager_<LoggerPolicy>::ordered_span(
     LOG_VERBOSE << prefix << "ordering " << span.size()
                 << " inodes by similarity...";
     auto tv = LOG_CPU_TIMED_VERBOSE;
-    order.by_similarity(span, cat);
+    order.by_similarity(wg, span, cat);
     tv << prefix << span.size() << " inodes ordered";
     break;
   }
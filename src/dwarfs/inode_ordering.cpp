@@ -20,14 +20,24 @@
  */
 
 #include <algorithm>
+#include <filesystem>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <folly/container/F14Map.h>
 
 #include "dwarfs/entry.h"
 #include "dwarfs/inode_element_view.h"
 #include "dwarfs/inode_ordering.h"
 #include "dwarfs/logger.h"
 #include "dwarfs/options.h"
+#include "dwarfs/parallel_sort.h"
 #include "dwarfs/promise_receiver.h"
 #include "dwarfs/similarity_ordering.h"
+#include "dwarfs/util.h"
 #include "dwarfs/worker_group.h"
 
 namespace dwarfs {
@@ -40,6 +50,76 @@ bool inode_less_by_size(inode const* a, inode const* b) {
   return sa > sb || (sa == sb && a->any()->less_revpath(*b->any()));
 }
 
+constexpr size_t const kMinParallelChunk{16384};
+
+/*
+ * Compact key that orders files exactly like `entry::less_revpath`:
+ * `name` is the rank of the file name among all file names, `parent`
+ * is the rank of the parent directory among all parent directories in
+ * reverse path order, offset by one so that files without a parent
+ * come first.
+ */
+struct revpath_key {
+  uint32_t name;
+  uint32_t parent;
+
+  bool operator<(revpath_key const& rhs) const {
+    return name < rhs.name || (name == rhs.name && parent < rhs.parent);
+  }
+};
+
+std::vector<revpath_key>
+make_revpath_keys(worker_group& wg,
+                  std::span<std::shared_ptr<inode> const> raw,
+                  std::vector<uint32_t> const& index) {
+  std::vector<std::string_view> names;
+  names.reserve(index.size());
+
+  folly::F14FastMap<entry const*, uint32_t> dir_rank;
+  std::vector<entry const*> dirs;
+  std::vector<entry const*> parents(index.size(), nullptr);
+
+  for (size_t k = 0; k < index.size(); ++k) {
+    auto f = raw[index[k]]->any();
+    names.push_back(f->name());
+    if (auto p = f->parent()) {
+      if (dir_rank.emplace(p.get(), 0).second) {
+        dirs.push_back(p.get());
+      }
+      parents[k] = p.get();
+    }
+  }
+
+  parallel_sort(wg, names.begin(), names.end(), std::less<>{},
+                kMinParallelChunk);
+  names.erase(std::unique(names.begin(), names.end()), names.end());
+
+  parallel_sort(
+      wg, dirs.begin(), dirs.end(),
+      [](entry const* a, entry const* b) { return a->less_revpath(*b); },
+      kMinParallelChunk);
+
+  for (size_t i = 0; i < dirs.size(); ++i) {
+    dir_rank[dirs[i]] = static_cast<uint32_t>(i + 1);
+  }
+
+  std::vector<revpath_key> keys(raw.size());
+
+  parallel_for_ranges(
+      wg, index.size(), kMinParallelChunk, [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+          auto& key = keys[index[k]];
+          auto const& name = raw[index[k]]->any()->name();
+          key.name = static_cast<uint32_t>(std::distance(
+              names.begin(),
+              std::lower_bound(names.begin(), names.end(), name)));
+          key.parent = parents[k] ? dir_rank.at(parents[k]) : 0;
+        }
+      });
+
+  return keys;
+}
+
 template <typename LoggerPolicy>
 class inode_ordering_ final : public inode_ordering::impl {
  public:
@@ -49,10 +129,11 @@ class inode_ordering_ final : public inode_ordering::impl {
       , opts_{opts} {}
 
   void by_inode_number(sortable_inode_span& sp) const override;
-  void by_path(sortable_inode_span& sp) const override;
-  void by_reverse_path(sortable_inode_span& sp) const override;
+  void by_path(worker_group& wg, sortable_inode_span& sp) const override;
   void
-  by_similarity(sortable_inode_span& sp, fragment_category cat) const override;
+  by_reverse_path(worker_group& wg, sortable_inode_span& sp) const override;
+  void by_similarity(worker_group& wg, sortable_inode_span& sp,
+                     fragment_category cat) const override;
   void
   by_nilsimsa(worker_group& wg, similarity_ordering_options const& opts,
               sortable_inode_span& sp, fragment_category cat) const override;
@@ -77,43 +158,85 @@ void inode_ordering_<LoggerPolicy>::by_inode_number(
 }
 
 template <typename LoggerPolicy>
-void inode_ordering_<LoggerPolicy>::by_path(sortable_inode_span& sp) const {
-  std::vector<std::string> paths;
-
+void inode_ordering_<LoggerPolicy>::by_path(worker_group& wg,
+                                            sortable_inode_span& sp) const {
   auto raw = sp.raw();
   auto& index = sp.index();
 
-  paths.resize(raw.size());
-
-  for (auto i : index) {
-    paths[i] = raw[i]->any()->path_as_string();
-  }
+  // The paths are stored back to back in a few large buffers rather than
+  // in one string per inode, and the path of each parent directory is
+  // only built once per range. The result is identical to that of
+  // entry::path_as_string().
+  std::vector<std::string_view> paths(raw.size());
+  std::vector<std::vector<char>> buffers;
+  std::mutex mx;
+
+  parallel_for_ranges(
+      wg, index.size(), kMinParallelChunk, [&](size_t begin, size_t end) {
+        folly::F14FastMap<entry const*, std::filesystem::path> dir_paths;
+        std::vector<std::pair<size_t, size_t>> ranges;
+        std::vector<char> buf;
+
+        ranges.reserve(end - begin);
+
+        for (size_t k = begin; k < end; ++k) {
+          auto f = raw[index[k]]->any();
+          std::string path;
+
+          if (auto p = f->parent()) {
+            auto it = dir_paths.find(p.get());
+            if (it == dir_paths.end()) {
+              it = dir_paths.emplace(p.get(), p->fs_path()).first;
+            }
+            path = u8string_to_string((it->second / f->u8name()).u8string());
+          } else {
+            path = f->path_as_string();
+          }
+
+          ranges.emplace_back(buf.size(), path.size());
+          buf.insert(buf.end(), path.begin(), path.end());
+        }
+
+        for (size_t k = begin; k < end; ++k) {
+          auto [offset, size] = ranges[k - begin];
+          paths[index[k]] = std::string_view(buf.data() + offset, size);
+        }
+
+        std::lock_guard lock(mx);
+        buffers.push_back(std::move(buf));
+      });
 
-  std::sort(index.begin(), index.end(),
-            [&](auto a, auto b) { return paths[a] < paths[b]; });
+  parallel_sort(
+      wg, index.begin(), index.end(),
+      [&](auto a, auto b) { return paths[a] < paths[b]; }, kMinParallelChunk);
 }
 
 template <typename LoggerPolicy>
 void inode_ordering_<LoggerPolicy>::by_reverse_path(
-    sortable_inode_span& sp) const {
+    worker_group& wg, sortable_inode_span& sp) const {
   auto raw = sp.raw();
   auto& index = sp.index();
 
-  std::sort(index.begin(), index.end(), [&](auto a, auto b) {
-    return raw[a]->any()->less_revpath(*raw[b]->any());
-  });
+  auto keys = make_revpath_keys(wg, raw, index);
+
+  parallel_sort(
+      wg, index.begin(), index.end(),
+      [&](auto a, auto b) { return keys[a] < keys[b]; }, kMinParallelChunk);
 }
 
 template <typename LoggerPolicy>
-void inode_ordering_<LoggerPolicy>::by_similarity(sortable_inode_span& sp,
+void inode_ordering_<LoggerPolicy>::by_similarity(worker_group& wg,
+                                                  sortable_inode_span& sp,
                                                   fragment_category cat) const {
   std::vector<std::optional<uint32_t>> hash_cache;
+  std::vector<size_t> size_cache;
 
   auto raw = sp.raw();
   auto& index = sp.index();
   bool any_missing = false;
 
   hash_cache.resize(raw.size());
+  size_cache.resize(raw.size());
 
   for (auto i : index) {
     auto& cache = hash_cache[i];
@@ -121,10 +244,16 @@ void inode_ordering_<LoggerPolicy>::by_similarity(sortable_inode_span& sp,
     if (!cache.has_value()) {
       any_missing = true;
     }
+    size_cache[i] = raw[i]->size();
   }
 
+  auto keys = make_revpath_keys(wg, raw, index);
+
+  // same order as inode_less_by_size()
   auto size_pred = [&](auto a, auto b) {
-    return inode_less_by_size(raw[a].get(), raw[b].get());
+    auto sa = size_cache[a];
+    auto sb = size_cache[b];
+    return sa > sb || (sa == sb && keys[a] < keys[b]);
   };
 
   auto start = index.begin();
@@ -134,26 +263,29 @@ void inode_ordering_<LoggerPolicy>::by_similarity(sortable_inode_span& sp,
       return !hash_cache[i].has_value();
     });
 
-    std::sort(index.begin(), start, size_pred);
+    parallel_sort(wg, index.begin(), start, size_pred, kMinParallelChunk);
   }
 
-  std::sort(start, index.end(), [&](auto a, auto b) {
-    assert(hash_cache[a].has_value());
-    assert(hash_cache[b].has_value());
+  parallel_sort(
+      wg, start, index.end(),
+      [&](auto a, auto b) {
+        assert(hash_cache[a].has_value());
+        assert(hash_cache[b].has_value());
 
-    auto const ca = *hash_cache[a];
-    auto const cb = *hash_cache[b];
+        auto const ca = *hash_cache[a];
+        auto const cb = *hash_cache[b];
 
-    if (ca < cb) {
-      return true;
-    }
+        if (ca < cb) {
+          return true;
+        }
 
-    if (ca > cb) {
-      return false;
-    }
+        if (ca > cb) {
+          return false;
+        }
 
-    return size_pred(a, b);
-  });
+        return size_pred(a, b);
+      },
+      kMinParallelChunk);
 }
 
 template <typename LoggerPolicy>
@@ -24,10 +24,13 @@
 #include <cstring>
 #include <future>
 #include <mutex>
+#include <optional>
 #include <ostream>
 #include <utility>
 #include <vector>
 
+#include <folly/CancellationToken.h>
+#include <folly/ScopeGuard.h>
 #include <folly/String.h>
 #include <folly/container/Enumerate.h>
 #include <folly/container/EvictingCacheMap.h>
@@ -88,6 +91,12 @@ constexpr size_t const offset_cache_updater_max_inline_offsets = 4;
 constexpr size_t const offset_cache_size = 64;
 constexpr size_t const readahead_cache_size = 64;
 
+struct range_request {
+  size_t block;
+  size_t offset;
+  size_t size;
+};
+
 template <typename LoggerPolicy>
 class inode_reader_ final : public inode_reader_v2::impl {
  public:
@@ -125,6 +134,9 @@ class inode_reader_ final : public inode_reader_v2::impl {
   folly::Expected<std::vector<std::future<block_range>>, int>
   readv(uint32_t inode, size_t size, file_off_t offset,
         chunk_range chunks) const override;
+  folly::Expected<size_t, int>
+  readv(uint32_t inode, size_t size, file_off_t offset, chunk_range chunks,
+        indexed_block_range_continuation cont) const override;
   void dump(std::ostream& os, const std::string& indent,
             chunk_range chunks) const override;
   void set_num_workers(size_t num) override { cache_.set_num_workers(num); }
@@ -132,6 +144,21 @@ class inode_reader_ final : public inode_reader_v2::impl {
     cache_.set_tidy_config(cfg);
   }
   size_t num_blocks() const override { return cache_.block_count(); }
+  void pin_blocks(std::vector<size_t> const& blocks) override {
+    cache_.pin(blocks);
+  }
+
+  void hold_blocks(std::span<size_t const> blocks) const override {
+    cache_.hold(blocks);
+  }
+
+  void unhold_blocks(std::span<size_t const> blocks) const override {
+    cache_.unhold(blocks);
+  }
+
+  void prefetch_blocks(std::span<size_t const> blocks) const override {
+    cache_.prefetch(blocks);
+  }
 
  private:
   using offset_cache_type =
@@ -141,9 +168,15 @@ class inode_reader_ final : public inode_reader_v2::impl {
 
   using readahead_cache_type = folly::EvictingCacheMap<uint32_t, file_off_t>;
 
+  template <typename RequestFunc>
+  folly::Expected<size_t, int>
+  request_ranges(uint32_t inode, size_t size, file_off_t offset,
+                 chunk_range chunks, RequestFunc const& request) const;
+
   folly::Expected<std::vector<std::future<block_range>>, int>
   read_internal(uint32_t inode, size_t size, file_off_t offset,
-                chunk_range chunks) const;
+                chunk_range chunks,
+                folly::CancellationToken const& cancel = {}) const;
 
   template <typename StoreFunc>
   ssize_t read_internal(uint32_t inode, size_t size, file_off_t read_offset,
@@ -209,7 +242,8 @@ void inode_reader_<LoggerPolicy>::do_readahead(uint32_t inode,
 
   while (it != end) {
     if (it_offset + it->size() >= readahead_pos) {
-      cache_.get(it->block(), it->offset(), it->size());
+      cache_.get(it->block(), it->offset(), it->size(),
+                 block_request_priority::READAHEAD);
     }
 
     it_offset += it->size();
@@ -222,22 +256,24 @@ void inode_reader_<LoggerPolicy>::do_readahead(uint32_t inode,
   }
 }
 
+// All ranges are determined before the first one is requested, so a read
+// that fails because of inconsistent metadata never leaves any requests in
+// flight.
 template <typename LoggerPolicy>
-folly::Expected<std::vector<std::future<block_range>>, int>
-inode_reader_<LoggerPolicy>::read_internal(uint32_t inode, size_t const size,
-                                           file_off_t const read_offset,
-                                           chunk_range chunks) const {
+template <typename RequestFunc>
+folly::Expected<size_t, int> inode_reader_<LoggerPolicy>::request_ranges(
+    uint32_t inode, size_t const size, file_off_t const read_offset,
+    chunk_range chunks, RequestFunc const& request) const {
   auto offset = read_offset;
 
   if (offset < 0) {
     return folly::makeUnexpected(-EINVAL);
   }
 
-  // request ranges from block cache
-  std::vector<std::future<block_range>> ranges;
+  std::vector<range_request> ranges;
 
   if (size == 0 || chunks.empty()) {
-    return ranges;
+    return 0;
   }
 
   auto it = chunks.begin();
@@ -249,11 +285,22 @@ inode_reader_<LoggerPolicy>::read_internal(uint32_t inode, size_t const size,
   offset_cache_type::value_type oc_ent;
   offset_cache_type::updater oc_upd;
 
-  // Check if we can find this inode in the offset cache
-  if (offset > 0 && chunks.size() >= offset_cache_type::chunk_index_interval) {
-    oc_ent = offset_cache_.find(inode, chunks.size());
+  if (offset > 0) {
+    // Check if we can find this inode in the offset cache
+    if (chunks.size() >= offset_cache_type::chunk_index_interval) {
+      oc_ent = offset_cache_.find(inode, chunks.size());
 
-    std::tie(it_index, it_offset) = oc_ent->find(offset, oc_upd);
+      std::tie(it_index, it_offset) = oc_ent->find(offset, oc_upd);
+    }
+
+    // The chunk offset index stored in the metadata, if any, works even
+    // if the inode hasn't been cached yet
+    if (auto [index, index_offset] = chunks.find_offset(offset);
+        index > it_index) {
+      it_index = index;
+      it_offset = index_offset;
+      oc_upd.disable();
+    }
 
     std::advance(it, it_index);
     offset -= it_offset;
@@ -276,10 +323,11 @@ inode_reader_<LoggerPolicy>::read_internal(uint32_t inode, size_t const size,
 
   if (it == end) {
     // offset beyond EOF; TODO: check if this should rather be -EINVAL
-    return ranges;
+    return 0;
   }
 
   size_t num_read = 0;
+  std::optional<std::pair<chunk_range::iterator, file_off_t>> readahead;
 
   while (it != end) {
     size_t const chunksize = it->size();
@@ -295,7 +343,7 @@ inode_reader_<LoggerPolicy>::read_internal(uint32_t inode, size_t const size,
       copysize = size - num_read;
     }
 
-    ranges.emplace_back(cache_.get(it->block(), copyoff, copysize));
+    ranges.push_back({it->block(), copyoff, copysize});
 
     num_read += copysize;
 
@@ -306,7 +354,7 @@ inode_reader_<LoggerPolicy>::read_internal(uint32_t inode, size_t const size,
       }
 
       if (opts_.readahead > 0) {
-        do_readahead(inode, it, end, read_offset, size, it_offset);
+        readahead.emplace(it, it_offset);
       }
 
       break;
@@ -319,6 +367,38 @@ inode_reader_<LoggerPolicy>::read_internal(uint32_t inode, size_t const size,
     oc_upd.add_offset(++it_index, it_offset);
   }
 
+  // request ranges from block cache
+  for (auto const& r : ranges) {
+    request(r);
+  }
+
+  if (readahead) {
+    do_readahead(inode, readahead->first, end, read_offset, size,
+                 readahead->second);
+  }
+
+  return ranges.size();
+}
+
+template <typename LoggerPolicy>
+folly::Expected<std::vector<std::future<block_range>>, int>
+inode_reader_<LoggerPolicy>::read_internal(uint32_t inode, size_t const size,
+                                           file_off_t const offset,
+                                           chunk_range chunks,
+                                           folly::CancellationToken const&
+                                               cancel) const {
+  std::vector<std::future<block_range>> ranges;
+
+  auto rv = request_ranges(
+      inode, size, offset, chunks, [&](range_request const& r) {
+        ranges.emplace_back(cache_.get(r.block, r.offset, r.size,
+                                       block_request_priority::DEMAND, cancel));
+      });
+
+  if (!rv) {
+    return folly::makeUnexpected(rv.error());
+  }
+
   return ranges;
 }
 
@@ -329,12 +409,17 @@ inode_reader_<LoggerPolicy>::read_internal(uint32_t inode, size_t size,
                                            file_off_t offset,
                                            chunk_range chunks,
                                            const StoreFunc& store) const {
-  auto ranges = read_internal(inode, size, offset, chunks);
+  folly::CancellationSource cancel;
+  auto ranges = read_internal(inode, size, offset, chunks, cancel.getToken());
 
   if (!ranges) {
     return ranges.error();
   }
 
+  // If we bail out early, don't make the cache decompress any data for
+  // the remaining ranges.
+  SCOPE_EXIT { cancel.requestCancellation(); };
+
   try {
     // now fill the buffer
     size_t num_read = 0;
@@ -362,6 +447,24 @@ inode_reader_<LoggerPolicy>::readv(uint32_t inode, size_t const size,
   return read_internal(inode, size, offset, chunks);
 }
 
+template <typename LoggerPolicy>
+folly::Expected<size_t, int> inode_reader_<LoggerPolicy>::readv(
+    uint32_t inode, size_t const size, file_off_t offset, chunk_range chunks,
+    indexed_block_range_continuation cont) const {
+  PERFMON_CLS_SCOPED_SECTION(readv_future)
+  PERFMON_SET_CONTEXT(static_cast<uint64_t>(offset), size);
+
+  size_t index = 0;
+
+  return request_ranges(
+      inode, size, offset, chunks, [&](range_request const& r) {
+        cache_.get(r.block, r.offset, r.size,
+                   [cont, i = index++](folly::Try<block_range>&& range) {
+                     cont(i, std::move(range));
+                   });
+      });
+}
+
 template <typename LoggerPolicy>
 ssize_t
 inode_reader_<LoggerPolicy>::read(char* buf, uint32_t inode, size_t size,
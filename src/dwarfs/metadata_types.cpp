@@ -38,29 +38,44 @@ namespace dwarfs {
 
 namespace {
 
-std::vector<thrift::metadata::directory>
-unpack_directories(logger& lgr, global_metadata::Meta const& meta) {
-  std::vector<thrift::metadata::directory> directories;
+constexpr auto first_entry_of = [](auto const& dir) -> uint32_t {
+  return dir.first_entry();
+};
+
+std::optional<delta_list_index>
+build_first_entry_index(global_metadata::Meta const& meta) {
+  std::optional<delta_list_index> index;
 
   if (auto opts = meta.options(); opts and opts->packed_directories()) {
+    index.emplace(meta.directories(), first_entry_of);
+  }
+
+  return index;
+}
+
+// Packed directories don't store parent entries, so we need to recover
+// them by traversing the tree. They're kept using only as many bits per
+// directory as needed to address all directory entries.
+packed_int_vector
+build_parent_entries(logger& lgr, global_metadata::Meta const& meta,
+                     std::optional<delta_list_index> const& first_entry) {
+  packed_int_vector parents;
+
+  if (first_entry) {
     LOG_PROXY(debug_logger_policy, lgr);
 
     auto ti = LOG_TIMED_DEBUG;
 
     auto dirent = *meta.dir_entries();
     auto metadir = meta.directories();
+    auto const num_dirs = metadir.size();
 
-    directories.resize(metadir.size());
+    parents = packed_int_vector(num_dirs, dirent.size());
 
-    // delta-decode first entries first
-    directories[0].first_entry() = metadir[0].first_entry();
+    auto first = [&](uint32_t ino) {
+      return first_entry->lookup(metadir, ino, first_entry_of);
+    };
 
-    for (size_t i = 1; i < directories.size(); ++i) {
-      directories[i].first_entry() =
-          directories[i - 1].first_entry().value() + metadir[i].first_entry();
-    }
-
-    // then traverse to recover parent entries
     std::queue<uint32_t> queue;
     queue.push(0);
 
@@ -70,22 +85,23 @@ unpack_directories(logger& lgr, global_metadata::Meta const& meta) {
 
       auto p_ino = dirent[parent].inode_num();
 
-      auto beg = directories[p_ino].first_entry().value();
-      auto end = directories[p_ino + 1].first_entry().value();
+      auto beg = first(p_ino);
+      auto end = first(p_ino + 1);
 
       for (auto e = beg; e < end; ++e) {
-        if (auto e_ino = dirent[e].inode_num();
-            e_ino < (directories.size() - 1)) {
-          directories[e_ino].parent_entry() = parent;
+        if (auto e_ino = dirent[e].inode_num(); e_ino < (num_dirs - 1)) {
+          parents.set(e_ino, parent);
           queue.push(e);
         }
       }
     }
 
-    ti << "unpacked directories table";
+    ti << "built directories index ("
+       << size_with_unit(first_entry->memory_usage() + parents.memory_usage())
+       << ")";
   }
 
-  return directories;
+  return parents;
 }
 
 // TODO: merge with inode_rank in metadata_v2
@@ -279,6 +295,29 @@ void check_packed_tables(global_metadata::Meta const& meta) {
   }
 }
 
+void check_chunk_offset_index(global_metadata::Meta const& meta) {
+  if (auto index = meta.chunk_offset_index()) {
+    auto chunk_begin = index->chunk_begin();
+    auto sample_begin = index->sample_begin();
+
+    if (index->interval() == 0) {
+      DWARFS_THROW(runtime_error, "invalid chunk offset index interval");
+    }
+
+    if (sample_begin.size() != chunk_begin.size() + 1 ||
+        sample_begin.back() != index->offsets().size() ||
+        !std::is_sorted(sample_begin.begin(), sample_begin.end())) {
+      DWARFS_THROW(runtime_error, "chunk offset index inconsistency");
+    }
+
+    if (!std::is_sorted(chunk_begin.begin(), chunk_begin.end()) ||
+        (!chunk_begin.empty() &&
+         chunk_begin.back() >= meta.chunks().size())) {
+      DWARFS_THROW(runtime_error, "chunk offset index out of range");
+    }
+  }
+}
+
 void check_compact_strings(
     ::apache::thrift::frozen::View<thrift::metadata::string_table> v,
     size_t expected_num, size_t max_item_len, std::string const& what) {
@@ -462,6 +501,7 @@ check_metadata(logger& lgr, global_metadata::Meta const& meta, bool check) {
     check_packed_tables(meta);
     check_string_tables(meta);
     check_chunks(meta);
+    check_chunk_offset_index(meta);
     auto offsets = check_partitioning(meta);
 
     auto num_dir = meta.directories().size() - 1;
@@ -525,9 +565,8 @@ check_metadata(logger& lgr, global_metadata::Meta const& meta, bool check) {
 
 global_metadata::global_metadata(logger& lgr, Meta const& meta)
     : meta_{meta}
-    , directories_storage_{unpack_directories(lgr, meta_)}
-    , directories_{directories_storage_.empty() ? nullptr
-                                                : directories_storage_.data()}
+    , first_entry_index_{build_first_entry_index(meta_)}
+    , parent_entries_{build_parent_entries(lgr, meta_, first_entry_index_)}
     , names_{meta_.compact_names()
                  ? string_table(lgr, "names", *meta_.compact_names())
                  : string_table(meta_.names())} {}
@@ -541,13 +580,40 @@ void global_metadata::check_consistency(logger& lgr) const {
 }
 
 uint32_t global_metadata::first_dir_entry(uint32_t ino) const {
-  return directories_ ? directories_[ino].first_entry().value()
-                      : meta_.directories()[ino].first_entry();
+  if (first_entry_index_) {
+    return first_entry_index_->lookup(meta_.directories(), ino,
+                                      first_entry_of);
+  }
+
+  return meta_.directories()[ino].first_entry();
 }
 
 uint32_t global_metadata::parent_dir_entry(uint32_t ino) const {
-  return directories_ ? directories_[ino].parent_entry().value()
-                      : meta_.directories()[ino].parent_entry();
+  if (first_entry_index_) {
+    return parent_entries_[ino];
+  }
+
+  return meta_.directories()[ino].parent_entry();
+}
+
+std::vector<thrift::metadata::directory>
+global_metadata::unpack_directories() const {
+  std::vector<thrift::metadata::directory> directories;
+
+  if (first_entry_index_) {
+    auto first =
+        first_entry_index_->unpack(meta_.directories(), first_entry_of);
+
+    directories.resize(first.size());
+
+    for (size_t i = 0; i < directories.size(); ++i) {
+      directories[i].first_entry() = first[i];
+      directories[i].parent_entry() =
+          i < parent_entries_.size() ? parent_entries_[i] : 0;
+    }
+  }
+
+  return directories;
 }
 
 auto inode_view::mode() const -> mode_type {
@@ -771,4 +837,66 @@ uint32_t directory_view::parent_inode() const {
   return ent;
 }
 
+std::pair<uint32_t, uint64_t> chunk_range::find_offset(uint64_t offset) const {
+  auto index = meta_->chunk_offset_index();
+
+  if (!index) {
+    return {0, 0};
+  }
+
+  auto chunk_begin = index->chunk_begin();
+  auto const begins = chunk_begin.size();
+
+  // Find this file in the index
+  size_t lo = 0;
+  size_t hi = begins;
+
+  while (lo < hi) {
+    auto mid = lo + (hi - lo) / 2;
+    if (chunk_begin[mid] < begin_) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  if (lo == begins || chunk_begin[lo] != begin_) {
+    return {0, 0};
+  }
+
+  auto sample_begin = index->sample_begin();
+  auto offsets = index->offsets();
+  size_t const first = sample_begin[lo];
+  size_t const last = sample_begin[lo + 1];
+
+  if (first > last || last > offsets.size()) {
+    return {0, 0};
+  }
+
+  // Find the last sample at or before `offset`
+  lo = first;
+  hi = last;
+
+  while (lo < hi) {
+    auto mid = lo + (hi - lo) / 2;
+    if (offsets[mid] <= offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  if (lo == first) {
+    return {0, 0};
+  }
+
+  auto const chunk = (lo - first) * index->interval();
+
+  if (chunk >= size()) {
+    return {0, 0};
+  }
+
+  return {static_cast<uint32_t>(chunk), offsets[lo - 1]};
+}
+
 } // namespace dwarfs
@@ -27,6 +27,7 @@
 #include <ctime>
 #include <filesystem>
 #include <numeric>
+#include <optional>
 #include <ostream>
 
 #include <boost/algorithm/string.hpp>
@@ -53,6 +54,7 @@
 #include "dwarfs/logger.h"
 #include "dwarfs/metadata_v2.h"
 #include "dwarfs/options.h"
+#include "dwarfs/packed_tables.h"
 #include "dwarfs/string_table.h"
 #include "dwarfs/util.h"
 #include "dwarfs/vfs_stat.h"
@@ -409,14 +411,13 @@ class metadata_ final : public metadata_v2::impl {
       , inode_count_(meta_.dir_entries() ? meta_.inodes().size()
                                          : meta_.entry_table_v2_2().size())
       , nlinks_(build_nlinks(options))
-      , chunk_table_(unpack_chunk_table())
-      , shared_files_(decompress_shared_files())
+      , chunk_table_index_(build_chunk_table_index())
+      , shared_files_index_(build_shared_files_index())
       , unique_files_(dev_inode_offset_ - file_inode_offset_ -
-                      (shared_files_.empty()
-                           ? meta_.shared_files_table()
-                                 ? meta_.shared_files_table()->size()
-                                 : 0
-                           : shared_files_.size()))
+                      (shared_files_index_ ? shared_files_index_->size()
+                       : meta_.shared_files_table()
+                           ? meta_.shared_files_table()->size()
+                           : 0))
       , options_(options)
       , symlinks_(meta_.compact_symlinks()
                       ? string_table(lgr, "symlinks", *meta_.compact_symlinks())
@@ -635,7 +636,9 @@ class metadata_ final : public metadata_v2::impl {
   find(directory_view dir, std::string_view name) const;
 
   uint32_t chunk_table_lookup(uint32_t ino) const {
-    return chunk_table_.empty() ? meta_.chunk_table()[ino] : chunk_table_[ino];
+    return chunk_table_index_
+               ? chunk_table_index_->lookup(meta_.chunk_table(), ino)
+               : meta_.chunk_table()[ino];
   }
 
   int file_inode_to_chunk_index(int inode) const {
@@ -644,9 +647,11 @@ class metadata_ final : public metadata_v2::impl {
     if (inode >= unique_files_) {
       inode -= unique_files_;
 
-      if (!shared_files_.empty()) {
-        if (inode < static_cast<int>(shared_files_.size())) {
-          inode = shared_files_[inode] + unique_files_;
+      if (shared_files_index_) {
+        if (inode < static_cast<int>(shared_files_index_->size())) {
+          inode = shared_files_index_->lookup(*meta_.shared_files_table(),
+                                              inode) +
+                  unique_files_;
         }
       } else if (auto sfp = meta_.shared_files_table()) {
         if (inode < static_cast<int>(sfp->size())) {
@@ -752,51 +757,39 @@ class metadata_ final : public metadata_v2::impl {
     return 0;
   }
 
-  std::vector<uint32_t> unpack_chunk_table() const {
-    std::vector<uint32_t> chunk_table;
+  // The packed tables are accessed in place. We only keep an index that
+  // allows for random access into the encoded tables.
+  std::optional<delta_list_index> build_chunk_table_index() const {
+    std::optional<delta_list_index> index;
 
     if (auto opts = meta_.options(); opts and opts->packed_chunk_table()) {
       auto ti = LOG_TIMED_DEBUG;
 
-      chunk_table.resize(meta_.chunk_table().size());
-      std::partial_sum(meta_.chunk_table().begin(), meta_.chunk_table().end(),
-                       chunk_table.begin());
+      index.emplace(meta_.chunk_table());
 
-      ti << "unpacked chunk table ("
-         << size_with_unit(sizeof(chunk_table.front()) * chunk_table.capacity())
-         << ")";
+      ti << "built chunk table index ("
+         << size_with_unit(index->memory_usage()) << ")";
     }
 
-    return chunk_table;
+    return index;
   }
 
-  std::vector<uint32_t> decompress_shared_files() const {
-    std::vector<uint32_t> decompressed;
+  std::optional<run_length_index> build_shared_files_index() const {
+    std::optional<run_length_index> index;
 
     if (auto opts = meta_.options();
         opts and opts->packed_shared_files_table()) {
       if (auto sfp = meta_.shared_files_table(); sfp and !sfp->empty()) {
         auto ti = LOG_TIMED_DEBUG;
 
-        auto size = std::accumulate(sfp->begin(), sfp->end(), 2 * sfp->size());
-        decompressed.reserve(size);
+        index.emplace(*sfp);
 
-        uint32_t index = 0;
-        for (auto c : *sfp) {
-          decompressed.insert(decompressed.end(), c + 2, index++);
-        }
-
-        DWARFS_CHECK(decompressed.size() == size,
-                     "unexpected decompressed shared files count");
-
-        ti << "decompressed shared files table ("
-           << size_with_unit(sizeof(decompressed.front()) *
-                             decompressed.capacity())
-           << ")";
+        ti << "built shared files table index ("
+           << size_with_unit(index->memory_usage()) << ")";
       }
     }
 
-    return decompressed;
+    return index;
   }
 
   std::vector<uint32_t> build_nlinks(metadata_options const& options) const {
@@ -841,8 +834,8 @@ class metadata_ final : public metadata_v2::impl {
   const int dev_inode_offset_;
   const int inode_count_;
   const std::vector<uint32_t> nlinks_;
-  const std::vector<uint32_t> chunk_table_;
-  const std::vector<uint32_t> shared_files_;
+  const std::optional<delta_list_index> chunk_table_index_;
+  const std::optional<run_length_index> shared_files_index_;
   const int unique_files_;
   const metadata_options options_;
   const string_table symlinks_;
@@ -1056,7 +1049,8 @@ metadata_<LoggerPolicy>::info_as_dynamic(int detail_level,
     if (auto sfp = meta_.shared_files_table()) {
       if (meta_.options()->packed_shared_files_table()) {
         meta["packed_shared_files_table"] = sfp->size();
-        meta["unpacked_shared_files_table"] = shared_files_.size();
+        meta["unpacked_shared_files_table"] =
+            shared_files_index_ ? shared_files_index_->size() : 0;
       } else {
         meta["shared_files_table"] = sfp->size();
       }
@@ -1205,7 +1199,8 @@ void metadata_<LoggerPolicy>::dump(
     if (auto sfp = meta_.shared_files_table()) {
       if (meta_.options()->packed_shared_files_table()) {
         os << "packed shared_files_table: " << sfp->size() << "\n";
-        os << "unpacked shared_files_table: " << shared_files_.size() << "\n";
+        os << "unpacked shared_files_table: "
+           << (shared_files_index_ ? shared_files_index_->size() : 0) << "\n";
       } else {
         os << "shared_files_table: " << sfp->size() << "\n";
       }
@@ -1313,14 +1308,17 @@ thrift::metadata::metadata metadata_<LoggerPolicy>::unpack_metadata() const {
   auto meta = meta_.thaw();
 
   if (auto opts = meta.options()) {
-    if (opts->packed_chunk_table().value()) {
-      meta.chunk_table() = chunk_table_;
+    if (chunk_table_index_) {
+      meta.chunk_table() = chunk_table_index_->unpack(meta_.chunk_table());
     }
-    if (opts->packed_directories().value()) {
-      meta.directories() = global_.directories();
+    if (global_.has_packed_directories()) {
+      meta.directories() = global_.unpack_directories();
     }
     if (opts->packed_shared_files_table().value()) {
-      meta.shared_files_table() = shared_files_;
+      meta.shared_files_table() =
+          shared_files_index_
+              ? shared_files_index_->unpack(*meta_.shared_files_table())
+              : std::vector<uint32_t>{};
     }
     if (auto const& names = global_.names(); names.is_packed()) {
       meta.names() = names.unpack();
@@ -1810,6 +1808,53 @@ metadata_v2::freeze(const thrift::metadata::metadata& data) {
   return freeze_to_buffer(data);
 }
 
+thrift::metadata::chunk_offset_index
+metadata_v2::build_chunk_offset_index(thrift::metadata::metadata const& mv2,
+                                      size_t min_chunks, size_t interval) {
+  thrift::metadata::chunk_offset_index index;
+  auto const& chunk_table = mv2.chunk_table().value();
+  auto const& chunks = mv2.chunks().value();
+
+  std::vector<std::pair<uint32_t, std::vector<uint64_t>>> files;
+
+  for (size_t i = 0; i + 1 < chunk_table.size(); ++i) {
+    auto const begin = chunk_table[i];
+    auto const end = chunk_table[i + 1];
+
+    if (end - begin < std::max(min_chunks, interval + 1)) {
+      continue;
+    }
+
+    std::vector<uint64_t> samples;
+    uint64_t offset = 0;
+
+    for (auto k = begin; k < end; ++k) {
+      if (k > begin && (k - begin) % interval == 0) {
+        samples.push_back(offset);
+      }
+      offset += chunks[k].size().value();
+    }
+
+    files.emplace_back(begin, std::move(samples));
+  }
+
+  std::sort(files.begin(), files.end(),
+            [](auto const& a, auto const& b) { return a.first < b.first; });
+
+  index.interval() = interval;
+
+  for (auto& [begin, samples] : files) {
+    index.chunk_begin()->push_back(begin);
+    index.sample_begin()->push_back(index.offsets()->size());
+    index.offsets()->insert(index.offsets()->end(), samples.begin(),
+                            samples.end());
+  }
+
+  index.sample_begin()->push_back(index.offsets()->size());
+
+  return index;
+}
+
 metadata_v2::metadata_v2(logger& lgr, std::span<uint8_t const> schema,
                          std::span<uint8_t const> data,
                          metadata_options const& options, int inode_offset,
@@ -25,10 +25,13 @@
 #ifdef _WIN32
 #include <folly/portability/Windows.h>
 #else
+#include <fcntl.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #endif
 
+#include <cstring>
+
 #include <boost/filesystem/path.hpp>
 
 #include "dwarfs/error.h"
@@ -48,6 +51,17 @@ uint64_t get_page_size() {
 #endif
 }
 
+// The mapping doesn't expose its file descriptor, so we have to open the
+// file a second time for explicit reads. If that fails, reads fall back
+// to copying from the mapping.
+int open_for_reading(std::filesystem::path const& path [[maybe_unused]]) {
+#ifdef _WIN32
+  return -1;
+#else
+  return ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+#endif
+}
+
 boost::filesystem::path boost_from_std_path(std::filesystem::path const& p) {
 #ifdef _WIN32
   return boost::filesystem::path(p.wstring());
@@ -58,6 +72,13 @@ boost::filesystem::path boost_from_std_path(std::filesystem::path const& p) {
 
 } // namespace
 
+// Most mappings are never read explicitly, so only open the descriptor
+// once it's actually needed rather than holding two per image.
+int mmap::read_fd() const {
+  std::call_once(fd_once_, [this] { fd_ = open_for_reading(path_); });
+  return fd_;
+}
+
 std::error_code
 mmap::lock(file_off_t offset [[maybe_unused]], size_t size [[maybe_unused]]) {
   std::error_code ec;
@@ -128,6 +149,73 @@ std::error_code mmap::release_until(file_off_t offset [[maybe_unused]]) {
   return ec;
 }
 
+std::error_code
+mmap::read(void* buf, file_off_t offset, size_t length) const {
+  std::error_code ec;
+
+  assert(offset + length <= size());
+
+#ifndef _WIN32
+  if (auto fd = read_fd(); fd >= 0) {
+    auto p = static_cast<char*>(buf);
+
+    while (length > 0) {
+      auto rv = ::pread(fd, p, length, offset);
+
+      if (rv < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        ec.assign(errno, std::generic_category());
+        break;
+      }
+
+      if (rv == 0) {
+        // file was truncated behind our back
+        ec = std::make_error_code(std::errc::io_error);
+        break;
+      }
+
+      p += rv;
+      offset += rv;
+      length -= rv;
+    }
+
+    return ec;
+  }
+#endif
+
+  std::memcpy(buf, mf_.const_data() + offset, length);
+
+  return ec;
+}
+
+std::error_code mmap::willneed(file_off_t offset [[maybe_unused]],
+                               size_t size [[maybe_unused]]) const {
+  std::error_code ec;
+
+#if defined(POSIX_FADV_WILLNEED)
+  if (auto fd = read_fd(); fd >= 0) {
+    if (auto err = ::posix_fadvise(fd, offset, size, POSIX_FADV_WILLNEED)) {
+      ec.assign(err, std::generic_category());
+    }
+    return ec;
+  }
+#endif
+
+#ifndef _WIN32
+  auto misalign = offset % page_size_;
+
+  auto data = const_cast<char*>(mf_.const_data() + offset - misalign);
+
+  if (::madvise(data, size + misalign, MADV_WILLNEED) != 0) {
+    ec.assign(errno, std::generic_category());
+  }
+#endif
+
+  return ec;
+}
+
 void const* mmap::addr() const { return mf_.const_data(); }
 
 size_t mmap::size() const { return mf_.size(); }
@@ -158,4 +246,12 @@ mmap::mmap(std::filesystem::path const& path, size_t size)
   assert(mf_.is_open());
 }
 
+mmap::~mmap() {
+#ifndef _WIN32
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+#endif
+}
+
 } // namespace dwarfs
@@ -59,9 +59,47 @@ std::ostream& operator<<(std::ostream& os, block_cache_options const& opts) {
       "init_workers={}, disable_block_integrity_check={}",
       opts.max_bytes, opts.num_workers, opts.decompress_ratio, opts.mm_release,
       opts.init_workers, opts.disable_block_integrity_check);
+  os << ", replacement_policy=" << opts.replacement_policy;
+  os << fmt::format(", range_cache_max_bytes={}, range_cache_max_extent={}",
+                    opts.range_cache_max_bytes, opts.range_cache_max_extent);
+  os << ", io_mode=" << opts.io_mode;
+  os << fmt::format(", io_max_request_size={}", opts.io_max_request_size);
   return os;
 }
 
+std::ostream& operator<<(std::ostream& os, cache_replacement_policy policy) {
+  std::string policystr{"unknown"};
+
+  switch (policy) {
+  case cache_replacement_policy::LRU:
+    policystr = "lru";
+    break;
+  case cache_replacement_policy::W_TINYLFU:
+    policystr = "tinylfu";
+    break;
+  case cache_replacement_policy::ARC:
+    policystr = "arc";
+    break;
+  }
+
+  return os << policystr;
+}
+
+std::ostream& operator<<(std::ostream& os, block_io_mode mode) {
+  std::string modestr{"unknown"};
+
+  switch (mode) {
+  case block_io_mode::MMAP:
+    modestr = "mmap";
+    break;
+  case block_io_mode::PREAD:
+    modestr = "pread";
+    break;
+  }
+
+  return os << modestr;
+}
+
 mlock_mode parse_mlock_mode(std::string_view mode) {
   if (mode == "none") {
     return mlock_mode::NONE;
@@ -75,4 +113,29 @@ mlock_mode parse_mlock_mode(std::string_view mode) {
   DWARFS_THROW(runtime_error, fmt::format("invalid lock mode: {}", mode));
 }
 
+cache_replacement_policy
+parse_cache_replacement_policy(std::string_view policy) {
+  if (policy == "lru") {
+    return cache_replacement_policy::LRU;
+  }
+  if (policy == "tinylfu") {
+    return cache_replacement_policy::W_TINYLFU;
+  }
+  if (policy == "arc") {
+    return cache_replacement_policy::ARC;
+  }
+  DWARFS_THROW(runtime_error,
+               fmt::format("invalid cache replacement policy: {}", policy));
+}
+
+block_io_mode parse_block_io_mode(std::string_view mode) {
+  if (mode == "mmap") {
+    return block_io_mode::MMAP;
+  }
+  if (mode == "pread") {
+    return block_io_mode::PREAD;
+  }
+  DWARFS_THROW(runtime_error, fmt::format("invalid block I/O mode: {}", mode));
+}
+
 } // namespace dwarfs
@@ -21,7 +21,9 @@
 
 #include <cerrno>
 #include <cstdlib>
+#include <fstream>
 
+#include <folly/Conv.h>
 #include <folly/portability/PThread.h>
 #include <folly/portability/Unistd.h>
 
@@ -32,6 +34,11 @@
 #include <mach/thread_info.h>
 #endif
 
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
 #include "dwarfs/mmap.h"
 #include "dwarfs/os_access_generic.h"
 #include "dwarfs/util.h"
@@ -223,4 +230,85 @@ os_access_generic::find_executable(std::filesystem::path const& name) const {
   return boost::process::search_path(name.wstring()).wstring();
 }
 
+std::vector<std::vector<int>> os_access_generic::numa_node_cpus() const {
+  std::vector<std::vector<int>> nodes;
+
+#ifdef __linux__
+  std::error_code ec;
+  fs::directory_iterator it("/sys/devices/system/node", ec);
+
+  for (; !ec && it != fs::directory_iterator(); it.increment(ec)) {
+    auto name = it->path().filename().string();
+
+    if (!name.starts_with("node")) {
+      continue;
+    }
+
+    auto node = folly::tryTo<size_t>(name.substr(4));
+
+    if (!node) {
+      continue;
+    }
+
+    std::ifstream ifs(it->path() / "cpulist");
+    std::string cpulist;
+
+    if (!std::getline(ifs, cpulist)) {
+      continue;
+    }
+
+    if (nodes.size() <= node.value()) {
+      nodes.resize(node.value() + 1);
+    }
+
+    try {
+      nodes[node.value()] = parse_cpu_list(cpulist);
+    } catch (...) {
+      return {};
+    }
+  }
+#endif
+
+  return nodes;
+}
+
+int os_access_generic::current_numa_node(std::error_code& ec) const {
+#ifdef __linux__
+  unsigned cpu{0};
+  unsigned node{0};
+
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 29)
+  // This is called for every block cache lookup; the glibc wrapper uses
+  // the vDSO and doesn't enter the kernel.
+  if (::getcpu(&cpu, &node) != 0) {
+    ec.assign(errno, std::generic_category());
+    return 0;
+  }
+#else
+  // Without a vDSO wrapper, only ask the kernel every so often. Threads
+  // rarely migrate across nodes, so a slightly stale node is fine.
+  static constexpr unsigned kRefreshInterval{64};
+  thread_local unsigned calls{0};
+  thread_local int cached_node{-1};
+
+  if (cached_node >= 0 && ++calls < kRefreshInterval) {
+    return cached_node;
+  }
+
+  if (::syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) {
+    ec.assign(errno, std::generic_category());
+    return 0;
+  }
+
+  calls = 0;
+  cached_node = static_cast<int>(node);
+#endif
+
+  return static_cast<int>(node);
+#else
+  ec = std::make_error_code(std::errc::not_supported);
+  return 0;
+#endif
+}
+
 } // namespace dwarfs
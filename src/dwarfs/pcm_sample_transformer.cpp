@@ -19,9 +19,13 @@
  * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cstring>
 #include <ostream>
 #include <type_traits>
+#include <vector>
 
 #include <fmt/format.h>
 
@@ -29,10 +33,318 @@
 
 #include "dwarfs/pcm_sample_transformer.h"
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define DWARFS_PCM_SIMD_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define DWARFS_PCM_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
 namespace dwarfs {
 
 namespace {
 
+std::vector<pcm_sample_cpu_variant> get_cpu_variants() {
+  std::vector<pcm_sample_cpu_variant> variants{
+      pcm_sample_cpu_variant::Fallback};
+
+#if defined(DWARFS_PCM_SIMD_X86) && defined(__has_builtin)
+#if __has_builtin(__builtin_cpu_supports)
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("sse4.1")) {
+    variants.push_back(pcm_sample_cpu_variant::Sse41);
+  }
+
+  if (__builtin_cpu_supports("avx2")) {
+    variants.push_back(pcm_sample_cpu_variant::Avx2);
+  }
+#endif
+#elif defined(DWARFS_PCM_SIMD_NEON)
+  variants.push_back(pcm_sample_cpu_variant::Neon);
+#endif
+
+  return variants;
+}
+
+std::vector<pcm_sample_cpu_variant> const& cpu_variants() {
+  static std::vector<pcm_sample_cpu_variant> const variants =
+      get_cpu_variants();
+  return variants;
+}
+
+/**
+ * Parameters shared by all vectorized kernels
+ *
+ * The kernels work on four samples per 128-bit register. When unpacking,
+ * the bytes of each sample are shuffled into the most significant bytes
+ * of a 32-bit lane, which is then shifted into place, sign-extended and
+ * unbiased. When packing, the inverse steps are performed and the low
+ * bytes of each lane are shuffled back into a contiguous byte stream.
+ * Both directions produce exactly the same results as the scalar code,
+ * including the treatment of any garbage in the padding bits.
+ */
+struct pcm_simd_params {
+  pcm_simd_params(pcm_sample_endianness end, pcm_sample_signedness sig,
+                  pcm_sample_padding pad, int bytes, int bits)
+      : bytes{bytes}
+      , unpack_shift{pad == pcm_sample_padding::Lsb ? 32 - bits
+                                                    : 32 - 8 * bytes}
+      , value_shift{32 - bits}
+      , pack_shift{pad == pcm_sample_padding::Lsb ? 8 * bytes - bits : 0}
+      , sign_fill{sig == pcm_sample_signedness::Signed && bits < 32
+                      ? ~UINT32_C(0) << bits
+                      : 0}
+      , bias{sig == pcm_sample_signedness::Unsigned ? UINT32_C(1) << (bits - 1)
+                                                   : 0} {
+    bool const big_endian = end == pcm_sample_endianness::Big;
+
+    unpack_shuffle.fill(0x80);
+    pack_shuffle.fill(0x80);
+
+    for (int lane = 0; lane < 4; ++lane) {
+      for (int i = 0; i < bytes; ++i) {
+        // i is the significance of the byte within the sample
+        int const pos = big_endian ? bytes - 1 - i : i;
+        unpack_shuffle[4 * lane + 4 - bytes + i] = bytes * lane + pos;
+        pack_shuffle[bytes * lane + pos] = 4 * lane + i;
+      }
+    }
+  }
+
+  alignas(16) std::array<uint8_t, 16> unpack_shuffle;
+  alignas(16) std::array<uint8_t, 16> pack_shuffle;
+  int bytes;
+  int unpack_shift;
+  int value_shift;
+  int pack_shift;
+  uint32_t sign_fill;
+  uint32_t bias;
+};
+
+#ifdef DWARFS_PCM_SIMD_X86
+
+__attribute__((target("sse4.1"))) inline __m128i
+pcm_unpack_lanes_sse41(__m128i v, __m128i unpack_shift, __m128i value_shift,
+                       __m128i sign_fill, __m128i bias) {
+  v = _mm_srl_epi32(v, unpack_shift);
+  auto const sign = _mm_srai_epi32(_mm_sll_epi32(v, value_shift), 31);
+  return _mm_sub_epi32(_mm_or_si128(v, _mm_and_si128(sign, sign_fill)), bias);
+}
+
+__attribute__((target("sse4.1"))) inline void
+pcm_store_bytes_sse41(uint8_t* dst, __m128i v, int size) {
+  switch (size) {
+  case 16:
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), v);
+    break;
+
+  case 12: {
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), v);
+    auto const tmp = _mm_extract_epi32(v, 2);
+    std::memcpy(dst + 8, &tmp, sizeof(tmp));
+  } break;
+
+  case 8:
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), v);
+    break;
+
+  default: {
+    auto const tmp = _mm_cvtsi128_si32(v);
+    std::memcpy(dst, &tmp, sizeof(tmp));
+  } break;
+  }
+}
+
+__attribute__((target("sse4.1"))) size_t
+pcm_unpack_sse41(int32_t* dst, uint8_t const* src, size_t count,
+                 pcm_simd_params const& p) {
+  auto const shuffle = _mm_load_si128(
+      reinterpret_cast<__m128i const*>(p.unpack_shuffle.data()));
+  auto const unpack_shift = _mm_cvtsi32_si128(p.unpack_shift);
+  auto const value_shift = _mm_cvtsi32_si128(p.value_shift);
+  auto const sign_fill = _mm_set1_epi32(p.sign_fill);
+  auto const bias = _mm_set1_epi32(p.bias);
+  size_t const bytes = p.bytes;
+  size_t i = 0;
+
+  // each load reads 16 bytes, but only consumes 4 * bytes of them
+  for (; (count - i) * bytes >= 16; i += 4) {
+    auto v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + bytes * i));
+    v = pcm_unpack_lanes_sse41(_mm_shuffle_epi8(v, shuffle), unpack_shift,
+                               value_shift, sign_fill, bias);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+  }
+
+  return i;
+}
+
+__attribute__((target("sse4.1"))) size_t
+pcm_pack_sse41(uint8_t* dst, int32_t const* src, size_t count,
+               pcm_simd_params const& p) {
+  auto const shuffle =
+      _mm_load_si128(reinterpret_cast<__m128i const*>(p.pack_shuffle.data()));
+  auto const pack_shift = _mm_cvtsi32_si128(p.pack_shift);
+  auto const bias = _mm_set1_epi32(p.bias);
+  size_t const bytes = p.bytes;
+  size_t i = 0;
+
+  for (; count - i >= 4; i += 4) {
+    auto v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i));
+    v = _mm_sll_epi32(_mm_add_epi32(v, bias), pack_shift);
+    pcm_store_bytes_sse41(dst + bytes * i, _mm_shuffle_epi8(v, shuffle),
+                          4 * bytes);
+  }
+
+  return i;
+}
+
+__attribute__((target("avx2"))) size_t
+pcm_unpack_avx2(int32_t* dst, uint8_t const* src, size_t count,
+                pcm_simd_params const& p) {
+  auto const shuffle = _mm256_broadcastsi128_si256(_mm_load_si128(
+      reinterpret_cast<__m128i const*>(p.unpack_shuffle.data())));
+  auto const unpack_shift = _mm_cvtsi32_si128(p.unpack_shift);
+  auto const value_shift = _mm_cvtsi32_si128(p.value_shift);
+  auto const sign_fill = _mm256_set1_epi32(p.sign_fill);
+  auto const bias = _mm256_set1_epi32(p.bias);
+  size_t const bytes = p.bytes;
+  size_t i = 0;
+
+  // the upper half is loaded from the fifth sample onwards
+  for (; count - i >= 4 && (count - i - 4) * bytes >= 16; i += 8) {
+    auto const lo =
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + bytes * i));
+    auto const hi = _mm_loadu_si128(
+        reinterpret_cast<__m128i const*>(src + bytes * (i + 4)));
+    auto v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    v = _mm256_srl_epi32(_mm256_shuffle_epi8(v, shuffle), unpack_shift);
+    auto const sign =
+        _mm256_srai_epi32(_mm256_sll_epi32(v, value_shift), 31);
+    v = _mm256_sub_epi32(
+        _mm256_or_si256(v, _mm256_and_si256(sign, sign_fill)), bias);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), v);
+  }
+
+  return i + pcm_unpack_sse41(dst + i, src + bytes * i, count - i, p);
+}
+
+__attribute__((target("avx2"))) size_t
+pcm_pack_avx2(uint8_t* dst, int32_t const* src, size_t count,
+              pcm_simd_params const& p) {
+  auto const shuffle = _mm256_broadcastsi128_si256(
+      _mm_load_si128(reinterpret_cast<__m128i const*>(p.pack_shuffle.data())));
+  auto const pack_shift = _mm_cvtsi32_si128(p.pack_shift);
+  auto const bias = _mm256_set1_epi32(p.bias);
+  size_t const bytes = p.bytes;
+  size_t i = 0;
+
+  for (; count - i >= 8; i += 8) {
+    auto v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src + i));
+    v = _mm256_sll_epi32(_mm256_add_epi32(v, bias), pack_shift);
+    v = _mm256_shuffle_epi8(v, shuffle);
+    pcm_store_bytes_sse41(dst + bytes * i, _mm256_castsi256_si128(v),
+                          4 * bytes);
+    pcm_store_bytes_sse41(dst + bytes * (i + 4),
+                          _mm256_extracti128_si256(v, 1), 4 * bytes);
+  }
+
+  return i + pcm_pack_sse41(dst + bytes * i, src + i, count - i, p);
+}
+
+#endif
+
+#ifdef DWARFS_PCM_SIMD_NEON
+
+size_t pcm_unpack_neon(int32_t* dst, uint8_t const* src, size_t count,
+                       pcm_simd_params const& p) {
+  auto const shuffle = vld1q_u8(p.unpack_shuffle.data());
+  auto const unpack_shift = vdupq_n_s32(-p.unpack_shift);
+  auto const value_shift = vdupq_n_s32(p.value_shift);
+  auto const sign_fill = vdupq_n_u32(p.sign_fill);
+  auto const bias = vdupq_n_u32(p.bias);
+  size_t const bytes = p.bytes;
+  size_t i = 0;
+
+  // each load reads 16 bytes, but only consumes 4 * bytes of them
+  for (; (count - i) * bytes >= 16; i += 4) {
+    auto const b = vqtbl1q_u8(vld1q_u8(src + bytes * i), shuffle);
+    auto const v = vshlq_u32(vreinterpretq_u32_u8(b), unpack_shift);
+    auto const sign = vreinterpretq_u32_s32(
+        vshrq_n_s32(vreinterpretq_s32_u32(vshlq_u32(v, value_shift)), 31));
+    auto const r = vsubq_u32(vorrq_u32(v, vandq_u32(sign, sign_fill)), bias);
+    vst1q_s32(dst + i, vreinterpretq_s32_u32(r));
+  }
+
+  return i;
+}
+
+size_t pcm_pack_neon(uint8_t* dst, int32_t const* src, size_t count,
+                     pcm_simd_params const& p) {
+  auto const shuffle = vld1q_u8(p.pack_shuffle.data());
+  auto const pack_shift = vdupq_n_s32(p.pack_shift);
+  auto const bias = vdupq_n_u32(p.bias);
+  size_t const bytes = p.bytes;
+  size_t i = 0;
+
+  for (; count - i >= 4; i += 4) {
+    auto v = vreinterpretq_u32_s32(vld1q_s32(src + i));
+    v = vshlq_u32(vaddq_u32(v, bias), pack_shift);
+    auto const b = vqtbl1q_u8(vreinterpretq_u8_u32(v), shuffle);
+    if (bytes == 4) {
+      vst1q_u8(dst + bytes * i, b);
+    } else {
+      std::array<uint8_t, 16> tmp;
+      vst1q_u8(tmp.data(), b);
+      std::memcpy(dst + bytes * i, tmp.data(), 4 * bytes);
+    }
+  }
+
+  return i;
+}
+
+#endif
+
+// Returns the number of samples processed; the caller handles the rest.
+size_t pcm_unpack_simd(pcm_sample_cpu_variant cpu, int32_t* dst,
+                       uint8_t const* src, size_t count,
+                       pcm_simd_params const& p) {
+  switch (cpu) {
+#ifdef DWARFS_PCM_SIMD_X86
+  case pcm_sample_cpu_variant::Sse41:
+    return pcm_unpack_sse41(dst, src, count, p);
+  case pcm_sample_cpu_variant::Avx2:
+    return pcm_unpack_avx2(dst, src, count, p);
+#endif
+#ifdef DWARFS_PCM_SIMD_NEON
+  case pcm_sample_cpu_variant::Neon:
+    return pcm_unpack_neon(dst, src, count, p);
+#endif
+  default:
+    return 0;
+  }
+}
+
+size_t pcm_pack_simd(pcm_sample_cpu_variant cpu, uint8_t* dst,
+                     int32_t const* src, size_t count,
+                     pcm_simd_params const& p) {
+  switch (cpu) {
+#ifdef DWARFS_PCM_SIMD_X86
+  case pcm_sample_cpu_variant::Sse41:
+    return pcm_pack_sse41(dst, src, count, p);
+  case pcm_sample_cpu_variant::Avx2:
+    return pcm_pack_avx2(dst, src, count, p);
+#endif
+#ifdef DWARFS_PCM_SIMD_NEON
+  case pcm_sample_cpu_variant::Neon:
+    return pcm_pack_neon(dst, src, count, p);
+#endif
+  default:
+    return 0;
+  }
+}
+
 template <typename UnpackedType>
 class basic_pcm_sample_transformer {
  public:
@@ -146,20 +458,22 @@ class basic_pcm_sample_transformer {
 
       return static_cast<UnpackedType>(src);
     } else {
-      return static_cast<UnpackedType>(src) - (1 << (bits - 1));
+      return static_cast<UnpackedType>(src - (uint_type(1) << (bits - 1)));
     }
   }
 
   template <pcm_sample_signedness Sig, pcm_sample_padding Pad, int Bytes>
   static constexpr uint_type pack_native(UnpackedType src, int bits) {
+    auto tmp = static_cast<uint_type>(src);
+
     if constexpr (Sig == pcm_sample_signedness::Unsigned) {
-      src += (1 << (bits - 1));
+      tmp += uint_type(1) << (bits - 1);
     }
 
     if constexpr (Pad == pcm_sample_padding::Lsb) {
-      return static_cast<uint_type>(src << (8 * Bytes - bits));
+      return tmp << (8 * Bytes - bits);
     } else {
-      return static_cast<uint_type>(src);
+      return tmp;
     }
   }
 };
@@ -223,12 +537,61 @@ class pcm_sample_transformer_generic final
   int bits_;
 };
 
+template <typename UnpackedType, pcm_sample_endianness End,
+          pcm_sample_signedness Sig, pcm_sample_padding Pad, int Bytes>
+class pcm_sample_transformer_simd final
+    : public pcm_sample_transformer<UnpackedType>::impl {
+ public:
+  static_assert(std::is_same_v<UnpackedType, int32_t>);
+
+  using basic_transformer = basic_pcm_sample_transformer<UnpackedType>;
+
+  pcm_sample_transformer_simd(pcm_sample_cpu_variant cpu, int bits)
+      : params_{End, Sig, Pad, Bytes, bits}
+      , cpu_{cpu}
+      , bits_{bits} {}
+
+  void unpack(std::span<UnpackedType> dst,
+              std::span<uint8_t const> src) const override {
+    assert(Bytes * dst.size() == src.size());
+    size_t i =
+        pcm_unpack_simd(cpu_, dst.data(), src.data(), dst.size(), params_);
+    for (; i < dst.size(); ++i) {
+      basic_transformer::template unpack<End, Sig, Pad, Bytes>(
+          &dst[i], &src[Bytes * i], bits_);
+    }
+  }
+
+  void pack(std::span<uint8_t> dst,
+            std::span<UnpackedType const> src) const override {
+    assert(dst.size() == Bytes * src.size());
+    size_t i = pcm_pack_simd(cpu_, dst.data(), src.data(), src.size(), params_);
+    for (; i < src.size(); ++i) {
+      basic_transformer::template pack<End, Sig, Pad, Bytes>(&dst[Bytes * i],
+                                                             &src[i], bits_);
+    }
+  }
+
+ private:
+  pcm_simd_params params_;
+  pcm_sample_cpu_variant cpu_;
+  int bits_;
+};
+
 template <typename UnpackedType, pcm_sample_endianness End,
           pcm_sample_signedness Sig, pcm_sample_padding Pad, int Bytes>
 std::unique_ptr<typename pcm_sample_transformer<UnpackedType>::impl>
-make_pcm_sample_transformer(int bits) {
+make_pcm_sample_transformer(int bits, pcm_sample_cpu_variant cpu) {
   static_assert(1 <= Bytes && Bytes <= 4);
 
+  if constexpr (std::is_same_v<UnpackedType, int32_t>) {
+    if (cpu != pcm_sample_cpu_variant::Fallback) {
+      return std::make_unique<
+          pcm_sample_transformer_simd<UnpackedType, End, Sig, Pad, Bytes>>(
+          cpu, bits);
+    }
+  }
+
   if constexpr (Bytes == 1) {
     if (bits == 8) {
       return std::make_unique<
@@ -288,16 +651,20 @@ make_pcm_sample_transformer(int bits) {
 template <typename UnpackedType, pcm_sample_endianness End,
           pcm_sample_signedness Sig, pcm_sample_padding Pad>
 std::unique_ptr<typename pcm_sample_transformer<UnpackedType>::impl>
-make_pcm_sample_transformer(int bytes, int bits) {
+make_pcm_sample_transformer(int bytes, int bits, pcm_sample_cpu_variant cpu) {
   switch (bytes) {
   case 1:
-    return make_pcm_sample_transformer<UnpackedType, End, Sig, Pad, 1>(bits);
+    return make_pcm_sample_transformer<UnpackedType, End, Sig, Pad, 1>(bits,
+                                                                       cpu);
   case 2:
-    return make_pcm_sample_transformer<UnpackedType, End, Sig, Pad, 2>(bits);
+    return make_pcm_sample_transformer<UnpackedType, End, Sig, Pad, 2>(bits,
+                                                                       cpu);
   case 3:
-    return make_pcm_sample_transformer<UnpackedType, End, Sig, Pad, 3>(bits);
+    return make_pcm_sample_transformer<UnpackedType, End, Sig, Pad, 3>(bits,
+                                                                       cpu);
   case 4:
-    return make_pcm_sample_transformer<UnpackedType, End, Sig, Pad, 4>(bits);
+    return make_pcm_sample_transformer<UnpackedType, End, Sig, Pad, 4>(bits,
+                                                                       cpu);
   default:
     throw std::runtime_error(
         fmt::format("unsupported number of bytes per sample: {}", bytes));
@@ -307,14 +674,17 @@ make_pcm_sample_transformer(int bytes, int bits) {
 template <typename UnpackedType, pcm_sample_endianness End,
           pcm_sample_signedness Sig>
 std::unique_ptr<typename pcm_sample_transformer<UnpackedType>::impl>
-make_pcm_sample_transformer(pcm_sample_padding pad, int bytes, int bits) {
+make_pcm_sample_transformer(pcm_sample_padding pad, int bytes, int bits,
+                            pcm_sample_cpu_variant cpu) {
   switch (pad) {
   case pcm_sample_padding::Lsb:
     return make_pcm_sample_transformer<UnpackedType, End, Sig,
-                                       pcm_sample_padding::Lsb>(bytes, bits);
+                                       pcm_sample_padding::Lsb>(bytes, bits,
+                                                                cpu);
   case pcm_sample_padding::Msb:
     return make_pcm_sample_transformer<UnpackedType, End, Sig,
-                                       pcm_sample_padding::Msb>(bytes, bits);
+                                       pcm_sample_padding::Msb>(bytes, bits,
+                                                                cpu);
   }
 
   folly::assume_unreachable();
@@ -323,16 +693,16 @@ make_pcm_sample_transformer(pcm_sample_padding pad, int bytes, int bits) {
 template <typename UnpackedType, pcm_sample_endianness End>
 std::unique_ptr<typename pcm_sample_transformer<UnpackedType>::impl>
 make_pcm_sample_transformer(pcm_sample_signedness sig, pcm_sample_padding pad,
-                            int bytes, int bits) {
+                            int bytes, int bits, pcm_sample_cpu_variant cpu) {
   switch (sig) {
   case pcm_sample_signedness::Signed:
     return make_pcm_sample_transformer<UnpackedType, End,
                                        pcm_sample_signedness::Signed>(
-        pad, bytes, bits);
+        pad, bytes, bits, cpu);
   case pcm_sample_signedness::Unsigned:
     return make_pcm_sample_transformer<UnpackedType, End,
                                        pcm_sample_signedness::Unsigned>(
-        pad, bytes, bits);
+        pad, bytes, bits, cpu);
   }
 
   folly::assume_unreachable();
@@ -342,18 +712,25 @@ template <typename UnpackedType>
 std::unique_ptr<typename pcm_sample_transformer<UnpackedType>::impl>
 make_pcm_sample_transformer(pcm_sample_endianness end,
                             pcm_sample_signedness sig, pcm_sample_padding pad,
-                            int bytes, int bits) {
+                            int bytes, int bits, pcm_sample_cpu_variant cpu) {
   assert(bits <= 8 * bytes);
 
+  auto const& variants = cpu_variants();
+
+  if (std::find(variants.begin(), variants.end(), cpu) == variants.end()) {
+    throw std::runtime_error(
+        fmt::format("unsupported CPU variant: {}", static_cast<int>(cpu)));
+  }
+
   switch (end) {
   case pcm_sample_endianness::Big:
     return make_pcm_sample_transformer<UnpackedType,
-                                       pcm_sample_endianness::Big>(sig, pad,
-                                                                   bytes, bits);
+                                       pcm_sample_endianness::Big>(
+        sig, pad, bytes, bits, cpu);
   case pcm_sample_endianness::Little:
     return make_pcm_sample_transformer<UnpackedType,
                                        pcm_sample_endianness::Little>(
-        sig, pad, bytes, bits);
+        sig, pad, bytes, bits, cpu);
   }
 
   folly::assume_unreachable();
@@ -365,11 +742,22 @@ template <typename UnpackedType>
 pcm_sample_transformer<UnpackedType>::pcm_sample_transformer(
     pcm_sample_endianness end, pcm_sample_signedness sig,
     pcm_sample_padding pad, int bytes, int bits)
+    : pcm_sample_transformer(end, sig, pad, bytes, bits,
+                             cpu_variants().back()) {}
+
+template <typename UnpackedType>
+pcm_sample_transformer<UnpackedType>::pcm_sample_transformer(
+    pcm_sample_endianness end, pcm_sample_signedness sig,
+    pcm_sample_padding pad, int bytes, int bits, pcm_sample_cpu_variant cpu)
     : impl_{make_pcm_sample_transformer<UnpackedType>(end, sig, pad, bytes,
-                                                      bits)} {}
+                                                      bits, cpu)} {}
 
 template class pcm_sample_transformer<int32_t>;
 
+std::span<pcm_sample_cpu_variant const> pcm_sample_cpu_variants() {
+  return cpu_variants();
+}
+
 std::ostream& operator<<(std::ostream& os, pcm_sample_endianness e) {
   os << (e == pcm_sample_endianness::Big ? "big-endian" : "little-endian");
   return os;
@@ -385,4 +773,22 @@ std::ostream& operator<<(std::ostream& os, pcm_sample_padding p) {
   return os;
 }
 
+std::ostream& operator<<(std::ostream& os, pcm_sample_cpu_variant v) {
+  switch (v) {
+  case pcm_sample_cpu_variant::Fallback:
+    os << "fallback";
+    break;
+  case pcm_sample_cpu_variant::Sse41:
+    os << "sse4.1";
+    break;
+  case pcm_sample_cpu_variant::Avx2:
+    os << "avx2";
+    break;
+  case pcm_sample_cpu_variant::Neon:
+    os << "neon";
+    break;
+  }
+  return os;
+}
+
 } // namespace dwarfs
@@ -96,6 +96,18 @@ void progress::set_status_function(status_function_type status_fun) {
   status_fun_ = std::make_shared<status_function_type>(std::move(status_fun));
 }
 
+void progress::set_stage_function(stage_function_type stage_fun) {
+  std::lock_guard lock(stage_mx_);
+  stage_fun_ = std::move(stage_fun);
+}
+
+void progress::stage(std::string_view name) {
+  std::lock_guard lock(stage_mx_);
+  if (stage_fun_) {
+    stage_fun_(name);
+  }
+}
+
 std::string progress::status(size_t max_len) {
   std::shared_ptr<status_function_type> fun;
   {
@@ -42,6 +42,7 @@
 #include "dwarfs/block_data.h"
 #include "dwarfs/block_manager.h"
 #include "dwarfs/categorizer.h"
+#include "dwarfs/checksum.h"
 #include "dwarfs/entry.h"
 #include "dwarfs/error.h"
 #include "dwarfs/features.h"
@@ -258,6 +259,29 @@ class save_shared_files_visitor : public visitor_base {
   std::vector<uint32_t> shared_files_;
 };
 
+// Assigns each non-directory entry to one of `count` partitions. This
+// must be stable across processes and machines, so we can't use
+// std::hash here. Hardlinks are kept together by using the inode number.
+size_t entry_partition(entry const& e, size_t count) {
+  std::string key;
+
+  if (e.type() == entry::E_FILE && e.num_hard_links() > 1) {
+    key = fmt::format("#{}", e.raw_inode_num());
+  } else {
+    key = e.name();
+    for (auto p = e.parent(); p && p->has_parent(); p = p->parent()) {
+      key = p->name() + '/' + key;
+    }
+  }
+
+  checksum cs(checksum::algorithm::XXH3_64);
+  cs.update(key.data(), key.size());
+  uint64_t hash;
+  cs.finalize(&hash);
+
+  return hash % count;
+}
+
 std::string status_string(progress const& p, size_t width) {
   auto cp = p.current.load();
   std::string label, path;
@@ -364,6 +388,14 @@ scanner_<LoggerPolicy>::add_entry(std::filesystem::path const& name,
       return nullptr;
     }
 
+    if (pe && pe->type() != entry::E_DIR && options_.partition_count > 1 &&
+        entry_partition(*pe, options_.partition_count) !=
+            options_.partition_index) {
+      // directories are part of all partitions, everything else
+      // belongs to exactly one
+      return nullptr;
+    }
+
     if (pe) {
       switch (pe->type()) {
       case entry::E_FILE:
@@ -607,6 +639,12 @@ void scanner_<LoggerPolicy>::scan(
     std::shared_ptr<file_access const> fa) {
   if (!options_.debug_filter_function) {
     LOG_INFO << "scanning " << path;
+    prog.stage("scan");
+
+    if (options_.partition_count > 1) {
+      LOG_INFO << "building partition " << options_.partition_index + 1
+               << " of " << options_.partition_count;
+    }
   }
 
   prog.set_status_function(status_string);
@@ -652,6 +690,7 @@ void scanner_<LoggerPolicy>::scan(
              [&fs](auto& os) { fs.dump(os); });
 
   LOG_INFO << "finalizing file inodes...";
+  prog.stage("finalize");
   uint32_t first_device_inode = first_file_inode;
   fs.finalize(first_device_inode);
 
@@ -699,6 +738,7 @@ void scanner_<LoggerPolicy>::scan(
   root->accept(pipsiv);
 
   LOG_INFO << "building metadata...";
+  prog.stage("names");
 
   wg_.add_job([&] {
     LOG_INFO << "saving names and symlinks...";
@@ -721,6 +761,7 @@ void scanner_<LoggerPolicy>::scan(
   dump_state(kEnvVarDumpInodes, "inodes", fa, [&im](auto& os) { im.dump(os); });
 
   LOG_INFO << "building blocks...";
+  prog.stage("order_segment");
 
   // TODO:
   // - get rid of multiple worker groups
@@ -844,6 +885,7 @@ void scanner_<LoggerPolicy>::scan(
   root->set_name(std::string());
 
   LOG_INFO << "saving chunks...";
+  prog.stage("metadata");
   mv2.chunk_table()->resize(im.count() + 1);
 
   // TODO: we should be able to start this once all blocks have been
@@ -869,6 +911,15 @@ void scanner_<LoggerPolicy>::scan(
   LOG_DEBUG << "total number of unique files: " << im.count();
   LOG_DEBUG << "total number of chunks: " << mv2.chunks()->size();
 
+  if (options_.chunk_index_min_chunks > 0) {
+    mv2.chunk_offset_index() = metadata_v2::build_chunk_offset_index(
+        mv2, options_.chunk_index_min_chunks, options_.chunk_index_interval);
+    LOG_DEBUG << "chunk offset index: "
+              << mv2.chunk_offset_index()->chunk_begin()->size()
+              << " files, " << mv2.chunk_offset_index()->offsets()->size()
+              << " samples";
+  }
+
   LOG_INFO << "saving directories...";
   mv2.dir_entries() = std::vector<thrift::metadata::dir_entry>();
   mv2.inodes()->resize(last_inode);
@@ -995,6 +1046,7 @@ void scanner_<LoggerPolicy>::scan(
   }
 
   LOG_INFO << "waiting for compression to finish...";
+  prog.stage("compress_write");
 
   fsw.flush();
 
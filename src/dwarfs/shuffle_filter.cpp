@@ -0,0 +1,893 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include <folly/lang/Bits.h>
+
+#include "dwarfs/compiler.h"
+#include "dwarfs/error.h"
+#include "dwarfs/shuffle_filter.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define DWARFS_SHUFFLE_SIMD_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define DWARFS_SHUFFLE_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace dwarfs {
+
+namespace {
+
+// Number of elements the vectorized bit shuffle kernels work on at once.
+// The byte lanes of each chunk are staged in a small buffer so that both
+// passes stay in the cache.
+constexpr size_t const kBitChunk{1024};
+
+// The scalar kernels start at element `i0` (or group `g0`), so they can
+// take care of whatever the vectorized kernels left over.
+
+void byte_shuffle_scalar(uint8_t const* src, uint8_t* dst, size_t count,
+                         size_t n, size_t i0) {
+  for (size_t j = 0; j < n; ++j) {
+    for (size_t i = i0; i < count; ++i) {
+      dst[j * count + i] = src[i * n + j];
+    }
+  }
+}
+
+void byte_unshuffle_scalar(uint8_t const* src, uint8_t* dst, size_t count,
+                           size_t n, size_t i0) {
+  for (size_t j = 0; j < n; ++j) {
+    for (size_t i = i0; i < count; ++i) {
+      dst[i * n + j] = src[j * count + i];
+    }
+  }
+}
+
+// Transpose an 8x8 bit matrix; this is its own inverse.
+DWARFS_FORCE_INLINE uint64_t transpose8x8(uint64_t x) {
+  uint64_t t;
+  t = (x ^ (x >> 7)) & UINT64_C(0x00AA00AA00AA00AA);
+  x = x ^ t ^ (t << 7);
+  t = (x ^ (x >> 14)) & UINT64_C(0x0000CCCC0000CCCC);
+  x = x ^ t ^ (t << 14);
+  t = (x ^ (x >> 28)) & UINT64_C(0x00000000F0F0F0F0);
+  x = x ^ t ^ (t << 28);
+  return x;
+}
+
+// Each byte lane of `count` bytes is split into 8 bit planes of
+// `count / 8` bytes each, followed by the `count % 8` remaining bytes.
+template <bool Shuffle>
+void bit_shuffle_scalar(uint8_t const* src, uint8_t* dst, size_t count,
+                        size_t n, size_t g0) {
+  size_t const groups = count / 8;
+
+  for (size_t j = 0; j < n; ++j) {
+    uint8_t* lane = Shuffle ? dst + j * count : nullptr;
+    uint8_t const* clane = Shuffle ? nullptr : src + j * count;
+
+    for (size_t g = g0; g < groups; ++g) {
+      uint64_t x = 0;
+
+      if constexpr (Shuffle) {
+        for (size_t k = 0; k < 8; ++k) {
+          x |= static_cast<uint64_t>(src[(g * 8 + k) * n + j]) << (8 * k);
+        }
+      } else {
+        for (size_t p = 0; p < 8; ++p) {
+          x |= static_cast<uint64_t>(clane[p * groups + g]) << (8 * p);
+        }
+      }
+
+      x = transpose8x8(x);
+
+      if constexpr (Shuffle) {
+        for (size_t p = 0; p < 8; ++p) {
+          lane[p * groups + g] = static_cast<uint8_t>(x >> (8 * p));
+        }
+      } else {
+        for (size_t k = 0; k < 8; ++k) {
+          dst[(g * 8 + k) * n + j] = static_cast<uint8_t>(x >> (8 * k));
+        }
+      }
+    }
+
+    for (size_t i = groups * 8; i < count; ++i) {
+      if constexpr (Shuffle) {
+        lane[i] = src[i * n + j];
+      } else {
+        dst[i * n + j] = clane[i];
+      }
+    }
+  }
+}
+
+/**
+ * Vectorized kernels
+ *
+ * The byte (un)shuffle kernels are built from a "riffle" step that
+ * interleaves the first half of a set of N registers with the second half
+ * byte by byte. Looking at the index of a byte within the N registers as a
+ * bit string, a riffle rotates that string left by one bit. For 16
+ * elements of N bytes, the index is `element:byte`; rotating it by four
+ * bits yields `byte:element`, i.e. one register per byte lane. Rotating by
+ * log2(N) bits reverts this. Only element sizes of 2, 4, 8 and 16 bytes
+ * are handled this way.
+ *
+ * The bit shuffle kernels first split a chunk of elements into byte lanes
+ * and then move the bits of each lane into bit planes, 8 bits at a time,
+ * using `movemask` (or an equivalent) on the most significant bits.
+ *
+ * The byte kernels return the number of elements processed and the bit
+ * kernels always process a full chunk; the caller takes care of the rest
+ * using the scalar code.
+ */
+struct shuffle_kernels {
+  size_t (*byte_shuffle)(uint8_t const* src, uint8_t* dst, size_t count,
+                         size_t n);
+  size_t (*byte_unshuffle)(uint8_t const* src, uint8_t* dst, size_t count,
+                           size_t n);
+  // Move the `kBitChunk` elements starting at `i0` from `n` consecutive
+  // byte lanes of `kBitChunk` bytes each into their bit planes in `dst`,
+  // and back.
+  void (*lanes_to_planes)(uint8_t const* lanes, uint8_t* dst, size_t count,
+                          size_t n, size_t i0);
+  void (*planes_to_lanes)(uint8_t const* src, uint8_t* lanes, size_t count,
+                          size_t n, size_t i0);
+};
+
+#ifdef DWARFS_SHUFFLE_SIMD_X86
+
+template <size_t N>
+DWARFS_FORCE_INLINE void riffle_sse2(__m128i* v) {
+  __m128i t[N];
+  for (size_t k = 0; k < N / 2; ++k) {
+    t[2 * k] = _mm_unpacklo_epi8(v[k], v[k + N / 2]);
+    t[2 * k + 1] = _mm_unpackhi_epi8(v[k], v[k + N / 2]);
+  }
+  std::copy(t, t + N, v);
+}
+
+// Collect the 16-bit masks of the 8 bits of all bytes, starting with the
+// most significant bit, into word 7 down to word 0.
+template <int I = 7>
+DWARFS_FORCE_INLINE __m128i
+movemask8_sse2(__m128i x, __m128i w = _mm_setzero_si128()) {
+  w = _mm_insert_epi16(w, _mm_movemask_epi8(x), I);
+  if constexpr (I > 0) {
+    return movemask8_sse2<I - 1>(_mm_add_epi8(x, x), w);
+  } else {
+    return w;
+  }
+}
+
+// Move the low bytes of all words to the front, followed by the high bytes.
+DWARFS_FORCE_INLINE __m128i deinterleave_sse2(__m128i w) {
+  return _mm_packus_epi16(_mm_and_si128(w, _mm_set1_epi16(0xff)),
+                          _mm_srli_epi16(w, 8));
+}
+
+template <size_t N>
+size_t byte_shuffle_sse2_n(uint8_t const* src, uint8_t* dst, size_t count) {
+  size_t i = 0;
+
+  for (; i + 16 <= count; i += 16) {
+    __m128i v[N];
+
+    for (size_t k = 0; k < N; ++k) {
+      v[k] = _mm_loadu_si128(
+          reinterpret_cast<__m128i const*>(src + i * N + 16 * k));
+    }
+
+    for (size_t r = 0; r < 4; ++r) {
+      riffle_sse2<N>(v);
+    }
+
+    for (size_t j = 0; j < N; ++j) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + j * count + i), v[j]);
+    }
+  }
+
+  return i;
+}
+
+template <size_t N>
+size_t byte_unshuffle_sse2_n(uint8_t const* src, uint8_t* dst, size_t count) {
+  size_t i = 0;
+
+  for (; i + 16 <= count; i += 16) {
+    __m128i v[N];
+
+    for (size_t j = 0; j < N; ++j) {
+      v[j] = _mm_loadu_si128(
+          reinterpret_cast<__m128i const*>(src + j * count + i));
+    }
+
+    for (size_t r = 1; r < N; r *= 2) {
+      riffle_sse2<N>(v);
+    }
+
+    for (size_t k = 0; k < N; ++k) {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * N + 16 * k),
+                       v[k]);
+    }
+  }
+
+  return i;
+}
+
+size_t
+byte_shuffle_sse2(uint8_t const* src, uint8_t* dst, size_t count, size_t n) {
+  switch (n) {
+  case 2:
+    return byte_shuffle_sse2_n<2>(src, dst, count);
+  case 4:
+    return byte_shuffle_sse2_n<4>(src, dst, count);
+  case 8:
+    return byte_shuffle_sse2_n<8>(src, dst, count);
+  case 16:
+    return byte_shuffle_sse2_n<16>(src, dst, count);
+  default:
+    return 0;
+  }
+}
+
+size_t
+byte_unshuffle_sse2(uint8_t const* src, uint8_t* dst, size_t count, size_t n) {
+  switch (n) {
+  case 2:
+    return byte_unshuffle_sse2_n<2>(src, dst, count);
+  case 4:
+    return byte_unshuffle_sse2_n<4>(src, dst, count);
+  case 8:
+    return byte_unshuffle_sse2_n<8>(src, dst, count);
+  case 16:
+    return byte_unshuffle_sse2_n<16>(src, dst, count);
+  default:
+    return 0;
+  }
+}
+
+void lanes_to_planes_sse2(uint8_t const* lanes, uint8_t* dst, size_t count,
+                          size_t n, size_t i0) {
+  size_t const groups = count / 8;
+
+  for (size_t j = 0; j < n; ++j) {
+    uint8_t const* lane = lanes + j * kBitChunk;
+    uint8_t* planes = dst + j * count + i0 / 8;
+
+    for (size_t i = 0; i < kBitChunk; i += 16) {
+      auto x = _mm_loadu_si128(reinterpret_cast<__m128i const*>(lane + i));
+
+      for (size_t p = 8; p-- > 0;) {
+        auto m = static_cast<uint16_t>(_mm_movemask_epi8(x));
+        std::memcpy(planes + p * groups + i / 8, &m, sizeof(m));
+        x = _mm_add_epi8(x, x);
+      }
+    }
+  }
+}
+
+void planes_to_lanes_sse2(uint8_t const* src, uint8_t* lanes, size_t count,
+                          size_t n, size_t i0) {
+  size_t const groups = count / 8;
+
+  for (size_t j = 0; j < n; ++j) {
+    uint8_t const* planes = src + j * count + i0 / 8;
+    uint8_t* lane = lanes + j * kBitChunk;
+
+    for (size_t g = 0; g < kBitChunk / 8; g += 16) {
+      __m128i v[8];
+
+      for (size_t p = 0; p < 8; ++p) {
+        v[p] = _mm_loadu_si128(
+            reinterpret_cast<__m128i const*>(planes + p * groups + g));
+      }
+
+      // v[k] now holds the 8 planes of groups g + 2k and g + 2k + 1
+      for (size_t r = 0; r < 3; ++r) {
+        riffle_sse2<8>(v);
+      }
+
+      for (size_t k = 0; k < 8; ++k) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lane + 8 * (g + 2 * k)),
+                         deinterleave_sse2(movemask8_sse2(v[k])));
+      }
+    }
+  }
+}
+
+// The AVX2 kernels process two blocks of the SSE2 kernels at once, one in
+// each 128-bit half, as the unpack instructions don't cross the halves.
+
+__attribute__((target("avx2"))) inline __m256i
+load2_avx2(uint8_t const* lo, uint8_t const* hi) {
+  return _mm256_inserti128_si256(
+      _mm256_castsi128_si256(
+          _mm_loadu_si128(reinterpret_cast<__m128i const*>(lo))),
+      _mm_loadu_si128(reinterpret_cast<__m128i const*>(hi)), 1);
+}
+
+__attribute__((target("avx2"))) inline void
+store2_avx2(uint8_t* lo, uint8_t* hi, __m256i v) {
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lo),
+                   _mm256_castsi256_si128(v));
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(hi),
+                   _mm256_extracti128_si256(v, 1));
+}
+
+template <size_t N>
+__attribute__((target("avx2"))) inline void riffle_avx2(__m256i* v) {
+  __m256i t[N];
+  for (size_t k = 0; k < N / 2; ++k) {
+    t[2 * k] = _mm256_unpacklo_epi8(v[k], v[k + N / 2]);
+    t[2 * k + 1] = _mm256_unpackhi_epi8(v[k], v[k + N / 2]);
+  }
+  std::copy(t, t + N, v);
+}
+
+// Like movemask8_sse2, but for both halves of the register at once.
+template <int I = 7>
+__attribute__((target("avx2"))) inline void
+movemask8_avx2(__m256i x, __m128i& lo, __m128i& hi) {
+  auto m = static_cast<uint32_t>(_mm256_movemask_epi8(x));
+  lo = _mm_insert_epi16(lo, static_cast<int>(m & 0xffff), I);
+  hi = _mm_insert_epi16(hi, static_cast<int>(m >> 16), I);
+  if constexpr (I > 0) {
+    movemask8_avx2<I - 1>(_mm256_add_epi8(x, x), lo, hi);
+  }
+}
+
+template <size_t N>
+__attribute__((target("avx2"))) size_t
+byte_shuffle_avx2_n(uint8_t const* src, uint8_t* dst, size_t count) {
+  size_t i = 0;
+
+  for (; i + 32 <= count; i += 32) {
+    __m256i v[N];
+
+    for (size_t k = 0; k < N; ++k) {
+      v[k] = load2_avx2(src + i * N + 16 * k, src + (i + 16) * N + 16 * k);
+    }
+
+    for (size_t r = 0; r < 4; ++r) {
+      riffle_avx2<N>(v);
+    }
+
+    for (size_t j = 0; j < N; ++j) {
+      store2_avx2(dst + j * count + i, dst + j * count + i + 16, v[j]);
+    }
+  }
+
+  return i;
+}
+
+template <size_t N>
+__attribute__((target("avx2"))) size_t
+byte_unshuffle_avx2_n(uint8_t const* src, uint8_t* dst, size_t count) {
+  size_t i = 0;
+
+  for (; i + 32 <= count; i += 32) {
+    __m256i v[N];
+
+    for (size_t j = 0; j < N; ++j) {
+      v[j] = load2_avx2(src + j * count + i, src + j * count + i + 16);
+    }
+
+    for (size_t r = 1; r < N; r *= 2) {
+      riffle_avx2<N>(v);
+    }
+
+    for (size_t k = 0; k < N; ++k) {
+      store2_avx2(dst + i * N + 16 * k, dst + (i + 16) * N + 16 * k, v[k]);
+    }
+  }
+
+  return i;
+}
+
+__attribute__((target("avx2"))) size_t
+byte_shuffle_avx2(uint8_t const* src, uint8_t* dst, size_t count, size_t n) {
+  switch (n) {
+  case 2:
+    return byte_shuffle_avx2_n<2>(src, dst, count);
+  case 4:
+    return byte_shuffle_avx2_n<4>(src, dst, count);
+  case 8:
+    return byte_shuffle_avx2_n<8>(src, dst, count);
+  case 16:
+    return byte_shuffle_avx2_n<16>(src, dst, count);
+  default:
+    return 0;
+  }
+}
+
+__attribute__((target("avx2"))) size_t
+byte_unshuffle_avx2(uint8_t const* src, uint8_t* dst, size_t count, size_t n) {
+  switch (n) {
+  case 2:
+    return byte_unshuffle_avx2_n<2>(src, dst, count);
+  case 4:
+    return byte_unshuffle_avx2_n<4>(src, dst, count);
+  case 8:
+    return byte_unshuffle_avx2_n<8>(src, dst, count);
+  case 16:
+    return byte_unshuffle_avx2_n<16>(src, dst, count);
+  default:
+    return 0;
+  }
+}
+
+__attribute__((target("avx2"))) void
+lanes_to_planes_avx2(uint8_t const* lanes, uint8_t* dst, size_t count,
+                     size_t n, size_t i0) {
+  size_t const groups = count / 8;
+
+  for (size_t j = 0; j < n; ++j) {
+    uint8_t const* lane = lanes + j * kBitChunk;
+    uint8_t* planes = dst + j * count + i0 / 8;
+
+    for (size_t i = 0; i < kBitChunk; i += 32) {
+      auto x = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(lane + i));
+
+      for (size_t p = 8; p-- > 0;) {
+        auto m = static_cast<uint32_t>(_mm256_movemask_epi8(x));
+        std::memcpy(planes + p * groups + i / 8, &m, sizeof(m));
+        x = _mm256_add_epi8(x, x);
+      }
+    }
+  }
+}
+
+__attribute__((target("avx2"))) void
+planes_to_lanes_avx2(uint8_t const* src, uint8_t* lanes, size_t count,
+                     size_t n, size_t i0) {
+  size_t const groups = count / 8;
+
+  for (size_t j = 0; j < n; ++j) {
+    uint8_t const* planes = src + j * count + i0 / 8;
+    uint8_t* lane = lanes + j * kBitChunk;
+
+    for (size_t g = 0; g < kBitChunk / 8; g += 32) {
+      __m256i v[8];
+
+      for (size_t p = 0; p < 8; ++p) {
+        v[p] = load2_avx2(planes + p * groups + g,
+                          planes + p * groups + g + 16);
+      }
+
+      for (size_t r = 0; r < 3; ++r) {
+        riffle_avx2<8>(v);
+      }
+
+      for (size_t k = 0; k < 8; ++k) {
+        auto lo = _mm_setzero_si128();
+        auto hi = _mm_setzero_si128();
+        movemask8_avx2(v[k], lo, hi);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lane + 8 * (g + 2 * k)),
+                         deinterleave_sse2(lo));
+        _mm_storeu_si128(
+            reinterpret_cast<__m128i*>(lane + 8 * (g + 16 + 2 * k)),
+            deinterleave_sse2(hi));
+      }
+    }
+  }
+}
+
+constexpr shuffle_kernels const kSse2Kernels{
+    byte_shuffle_sse2, byte_unshuffle_sse2, lanes_to_planes_sse2,
+    planes_to_lanes_sse2};
+
+constexpr shuffle_kernels const kAvx2Kernels{
+    byte_shuffle_avx2, byte_unshuffle_avx2, lanes_to_planes_avx2,
+    planes_to_lanes_avx2};
+
+#endif
+
+#ifdef DWARFS_SHUFFLE_SIMD_NEON
+
+template <size_t N>
+DWARFS_FORCE_INLINE void riffle_neon(uint8x16_t* v) {
+  uint8x16_t t[N];
+  for (size_t k = 0; k < N / 2; ++k) {
+    t[2 * k] = vzip1q_u8(v[k], v[k + N / 2]);
+    t[2 * k + 1] = vzip2q_u8(v[k], v[k + N / 2]);
+  }
+  std::copy(t, t + N, v);
+}
+
+// There's no movemask on NEON, so weigh the sign bits and add them up.
+DWARFS_FORCE_INLINE unsigned movemask_neon(uint8x16_t x) {
+  static constexpr uint8_t const kWeights[16] = {
+      1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+  auto sign = vreinterpretq_u8_s8(vshrq_n_s8(vreinterpretq_s8_u8(x), 7));
+  auto bits = vandq_u8(sign, vld1q_u8(kWeights));
+  return vaddv_u8(vget_low_u8(bits)) |
+         (static_cast<unsigned>(vaddv_u8(vget_high_u8(bits))) << 8);
+}
+
+template <size_t N>
+size_t byte_shuffle_neon_n(uint8_t const* src, uint8_t* dst, size_t count) {
+  size_t i = 0;
+
+  for (; i + 16 <= count; i += 16) {
+    uint8x16_t v[N];
+
+    for (size_t k = 0; k < N; ++k) {
+      v[k] = vld1q_u8(src + i * N + 16 * k);
+    }
+
+    for (size_t r = 0; r < 4; ++r) {
+      riffle_neon<N>(v);
+    }
+
+    for (size_t j = 0; j < N; ++j) {
+      vst1q_u8(dst + j * count + i, v[j]);
+    }
+  }
+
+  return i;
+}
+
+template <size_t N>
+size_t byte_unshuffle_neon_n(uint8_t const* src, uint8_t* dst, size_t count) {
+  size_t i = 0;
+
+  for (; i + 16 <= count; i += 16) {
+    uint8x16_t v[N];
+
+    for (size_t j = 0; j < N; ++j) {
+      v[j] = vld1q_u8(src + j * count + i);
+    }
+
+    for (size_t r = 1; r < N; r *= 2) {
+      riffle_neon<N>(v);
+    }
+
+    for (size_t k = 0; k < N; ++k) {
+      vst1q_u8(dst + i * N + 16 * k, v[k]);
+    }
+  }
+
+  return i;
+}
+
+size_t
+byte_shuffle_neon(uint8_t const* src, uint8_t* dst, size_t count, size_t n) {
+  switch (n) {
+  case 2:
+    return byte_shuffle_neon_n<2>(src, dst, count);
+  case 4:
+    return byte_shuffle_neon_n<4>(src, dst, count);
+  case 8:
+    return byte_shuffle_neon_n<8>(src, dst, count);
+  case 16:
+    return byte_shuffle_neon_n<16>(src, dst, count);
+  default:
+    return 0;
+  }
+}
+
+size_t
+byte_unshuffle_neon(uint8_t const* src, uint8_t* dst, size_t count, size_t n) {
+  switch (n) {
+  case 2:
+    return byte_unshuffle_neon_n<2>(src, dst, count);
+  case 4:
+    return byte_unshuffle_neon_n<4>(src, dst, count);
+  case 8:
+    return byte_unshuffle_neon_n<8>(src, dst, count);
+  case 16:
+    return byte_unshuffle_neon_n<16>(src, dst, count);
+  default:
+    return 0;
+  }
+}
+
+void lanes_to_planes_neon(uint8_t const* lanes, uint8_t* dst, size_t count,
+                          size_t n, size_t i0) {
+  size_t const groups = count / 8;
+
+  for (size_t j = 0; j < n; ++j) {
+    uint8_t const* lane = lanes + j * kBitChunk;
+    uint8_t* planes = dst + j * count + i0 / 8;
+
+    for (size_t i = 0; i < kBitChunk; i += 16) {
+      auto x = vld1q_u8(lane + i);
+
+      for (size_t p = 8; p-- > 0;) {
+        auto m = movemask_neon(x);
+        planes[p * groups + i / 8] = static_cast<uint8_t>(m);
+        planes[p * groups + i / 8 + 1] = static_cast<uint8_t>(m >> 8);
+        x = vaddq_u8(x, x);
+      }
+    }
+  }
+}
+
+void planes_to_lanes_neon(uint8_t const* src, uint8_t* lanes, size_t count,
+                          size_t n, size_t i0) {
+  size_t const groups = count / 8;
+
+  for (size_t j = 0; j < n; ++j) {
+    uint8_t const* planes = src + j * count + i0 / 8;
+    uint8_t* lane = lanes + j * kBitChunk;
+
+    for (size_t g = 0; g < kBitChunk / 8; g += 16) {
+      uint8x16_t v[8];
+
+      for (size_t p = 0; p < 8; ++p) {
+        v[p] = vld1q_u8(planes + p * groups + g);
+      }
+
+      for (size_t r = 0; r < 3; ++r) {
+        riffle_neon<8>(v);
+      }
+
+      for (size_t k = 0; k < 8; ++k) {
+        uint8_t* out = lane + 8 * (g + 2 * k);
+        auto x = v[k];
+
+        for (size_t b = 8; b-- > 0;) {
+          auto m = movemask_neon(x);
+          out[b] = static_cast<uint8_t>(m);
+          out[b + 8] = static_cast<uint8_t>(m >> 8);
+          x = vaddq_u8(x, x);
+        }
+      }
+    }
+  }
+}
+
+constexpr shuffle_kernels const kNeonKernels{
+    byte_shuffle_neon, byte_unshuffle_neon, lanes_to_planes_neon,
+    planes_to_lanes_neon};
+
+#endif
+
+shuffle_kernels const* get_simd_kernels() {
+#if defined(DWARFS_SHUFFLE_SIMD_X86)
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_cpu_supports)
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2")) {
+    return &kAvx2Kernels;
+  }
+#endif
+#endif
+  return &kSse2Kernels;
+#elif defined(DWARFS_SHUFFLE_SIMD_NEON)
+  return &kNeonKernels;
+#else
+  return nullptr;
+#endif
+}
+
+shuffle_kernels const* simd_kernels() {
+  static shuffle_kernels const* const kernels = get_simd_kernels();
+  return kernels;
+}
+
+void byte_shuffle_impl(uint8_t const* src, uint8_t* dst, size_t count,
+                       size_t n) {
+  size_t i = 0;
+  if (auto k = simd_kernels()) {
+    i = k->byte_shuffle(src, dst, count, n);
+  }
+  byte_shuffle_scalar(src, dst, count, n, i);
+}
+
+void byte_unshuffle_impl(uint8_t const* src, uint8_t* dst, size_t count,
+                         size_t n) {
+  size_t i = 0;
+  if (auto k = simd_kernels()) {
+    i = k->byte_unshuffle(src, dst, count, n);
+  }
+  byte_unshuffle_scalar(src, dst, count, n, i);
+}
+
+template <bool Shuffle>
+void bit_shuffle_impl(uint8_t const* src, uint8_t* dst, size_t count,
+                      size_t n) {
+  size_t i = 0;
+
+  if (auto k = simd_kernels(); k && count >= kBitChunk) {
+    std::vector<uint8_t> tmp(n > 1 ? n * kBitChunk : 0);
+
+    for (; i + kBitChunk <= count; i += kBitChunk) {
+      if constexpr (Shuffle) {
+        uint8_t const* lanes = src + i;
+        if (n > 1) {
+          byte_shuffle_impl(src + i * n, tmp.data(), kBitChunk, n);
+          lanes = tmp.data();
+        }
+        k->lanes_to_planes(lanes, dst, count, n, i);
+      } else {
+        uint8_t* lanes = n > 1 ? tmp.data() : dst + i;
+        k->planes_to_lanes(src, lanes, count, n, i);
+        if (n > 1) {
+          byte_unshuffle_impl(tmp.data(), dst + i * n, kBitChunk, n);
+        }
+      }
+    }
+  }
+
+  bit_shuffle_scalar<Shuffle>(src, dst, count, n, i / 8);
+}
+
+void check_args(std::span<uint8_t const> src, std::span<uint8_t> dst,
+                size_t element_size) {
+  if (element_size == 0) {
+    DWARFS_THROW(runtime_error, "element size must not be zero");
+  }
+  if (src.size() != dst.size()) {
+    DWARFS_THROW(runtime_error,
+                 fmt::format("shuffle size mismatch: {} != {}", src.size(),
+                             dst.size()));
+  }
+}
+
+void copy_tail(std::span<uint8_t const> src, std::span<uint8_t> dst,
+               size_t element_size) {
+  auto tail = src.size() % element_size;
+  if (tail > 0) {
+    std::memcpy(dst.data() + src.size() - tail, src.data() + src.size() - tail,
+                tail);
+  }
+}
+
+template <typename T>
+DWARFS_FORCE_INLINE T load(uint8_t const* p, bool swap) {
+  T v;
+  std::memcpy(&v, p, sizeof(T));
+  return swap ? folly::Endian::swap(v) : v;
+}
+
+template <typename T>
+DWARFS_FORCE_INLINE void store(uint8_t* p, T v, bool swap) {
+  if (swap) {
+    v = folly::Endian::swap(v);
+  }
+  std::memcpy(p, &v, sizeof(T));
+}
+
+template <typename T>
+void delta_encode_n(uint8_t* p, size_t count, bool swap) {
+  if (count < 2) {
+    return;
+  }
+  auto prev = load<T>(p + (count - 1) * sizeof(T), swap);
+  for (size_t i = count - 1; i > 0; --i) {
+    auto cur = prev;
+    prev = load<T>(p + (i - 1) * sizeof(T), swap);
+    store<T>(p + i * sizeof(T), static_cast<T>(cur - prev), swap);
+  }
+}
+
+template <typename T>
+void delta_decode_n(uint8_t* p, size_t count, bool swap) {
+  T acc = 0;
+  for (size_t i = 0; i < count; ++i) {
+    acc += load<T>(p + i * sizeof(T), swap);
+    store<T>(p + i * sizeof(T), acc, swap);
+  }
+}
+
+template <template <typename> class F>
+void delta_apply(std::span<uint8_t> data, size_t element_size,
+                 std::endian byteorder) {
+  auto count = data.size() / element_size;
+  bool const swap = byteorder != std::endian::native;
+
+  switch (element_size) {
+  case 1:
+    F<uint8_t>::apply(data.data(), count, false);
+    break;
+  case 2:
+    F<uint16_t>::apply(data.data(), count, swap);
+    break;
+  case 4:
+    F<uint32_t>::apply(data.data(), count, swap);
+    break;
+  case 8:
+    F<uint64_t>::apply(data.data(), count, swap);
+    break;
+  default:
+    DWARFS_THROW(runtime_error,
+                 fmt::format("unsupported element size for delta: {}",
+                             element_size));
+  }
+}
+
+template <typename T>
+struct delta_encoder {
+  static void apply(uint8_t* p, size_t count, bool swap) {
+    delta_encode_n<T>(p, count, swap);
+  }
+};
+
+template <typename T>
+struct delta_decoder {
+  static void apply(uint8_t* p, size_t count, bool swap) {
+    delta_decode_n<T>(p, count, swap);
+  }
+};
+
+} // namespace
+
+void byte_shuffle(std::span<uint8_t const> src, std::span<uint8_t> dst,
+                  size_t element_size) {
+  check_args(src, dst, element_size);
+  byte_shuffle_impl(src.data(), dst.data(), src.size() / element_size,
+                    element_size);
+  copy_tail(src, dst, element_size);
+}
+
+void byte_unshuffle(std::span<uint8_t const> src, std::span<uint8_t> dst,
+                    size_t element_size) {
+  check_args(src, dst, element_size);
+  byte_unshuffle_impl(src.data(), dst.data(), src.size() / element_size,
+                      element_size);
+  copy_tail(src, dst, element_size);
+}
+
+void bit_shuffle(std::span<uint8_t const> src, std::span<uint8_t> dst,
+                 size_t element_size) {
+  check_args(src, dst, element_size);
+  bit_shuffle_impl<true>(src.data(), dst.data(), src.size() / element_size,
+                         element_size);
+  copy_tail(src, dst, element_size);
+}
+
+void bit_unshuffle(std::span<uint8_t const> src, std::span<uint8_t> dst,
+                   size_t element_size) {
+  check_args(src, dst, element_size);
+  bit_shuffle_impl<false>(src.data(), dst.data(), src.size() / element_size,
+                          element_size);
+  copy_tail(src, dst, element_size);
+}
+
+bool delta_supported(size_t element_size) {
+  return element_size == 1 || element_size == 2 || element_size == 4 ||
+         element_size == 8;
+}
+
+void delta_encode(std::span<uint8_t> data, size_t element_size,
+                  std::endian byteorder) {
+  delta_apply<delta_encoder>(data, element_size, byteorder);
+}
+
+void delta_decode(std::span<uint8_t> data, size_t element_size,
+                  std::endian byteorder) {
+  delta_apply<delta_decoder>(data, element_size, byteorder);
+}
+
+} // namespace dwarfs
@@ -0,0 +1,383 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <folly/container/F14Map.h>
+#include <folly/system/ThreadName.h>
+
+#include "dwarfs/inode_reader_v2.h"
+#include "dwarfs/logger.h"
+#include "dwarfs/metadata_v2.h"
+#include "dwarfs/options.h"
+#include "dwarfs/tree_scan_tracker.h"
+
+namespace dwarfs {
+
+template <typename LoggerPolicy>
+class tree_scan_tracker_ final : public tree_scan_tracker::impl {
+ public:
+  using clock_type = std::chrono::steady_clock;
+
+  tree_scan_tracker_(logger& lgr, metadata_v2 const& meta,
+                     inode_reader_v2 const& ir, tree_scan_options const& opts)
+      : LOG_PROXY_INIT(lgr)
+      , meta_{meta}
+      , ir_{ir}
+      , opts_{opts}
+      , max_held_blocks_{std::max<size_t>(
+            opts.max_held_bytes / std::max<size_t>(meta.block_size(), 1),
+            1)}
+      , background_thread_{&tree_scan_tracker_::background_thread, this} {}
+
+  ~tree_scan_tracker_() override {
+    {
+      std::lock_guard lock(mx_);
+      running_ = false;
+    }
+    cond_.notify_all();
+    background_thread_.join();
+  }
+
+  void open(uint32_t inode) override {
+    auto const now = clock_type::now();
+    auto const file = file_of(inode);
+
+    std::lock_guard lock(mx_);
+
+    if (active_) {
+      touch(now);
+    } else {
+      detect(inode, now);
+    }
+
+    if (active_ && file && !done_[*file]) {
+      hold_and_prefetch(*file);
+    }
+  }
+
+  // Called for every read, so only take the lock once a file has been
+  // read to the end.
+  void read(uint32_t inode, file_off_t offset, size_t size) override {
+    if (!active_.load(std::memory_order_acquire)) {
+      return;
+    }
+
+    touch(clock_type::now());
+
+    auto const file = file_of(inode);
+
+    if (!file || offset + static_cast<file_off_t>(size) < file_size_[*file]) {
+      return;
+    }
+
+    std::lock_guard lock(mx_);
+
+    if (!active_ || done_[*file]) {
+      return;
+    }
+
+    done_[*file] = true;
+    release(*file);
+
+    if (--pending_ == 0) {
+      LOG_VERBOSE << "tree scan complete";
+      stop();
+    }
+  }
+
+  bool active() const override { return active_.load(); }
+
+ private:
+  void touch(clock_type::time_point now) {
+    last_activity_.store(now.time_since_epoch().count(),
+                         std::memory_order_relaxed);
+  }
+
+  clock_type::time_point last_activity() const {
+    return clock_type::time_point(
+        clock_type::duration(last_activity_.load(std::memory_order_relaxed)));
+  }
+
+  std::optional<size_t> file_of(uint32_t inode) const {
+    if (!indexed_.load(std::memory_order_acquire) ||
+        inode >= file_index_.size() || file_index_[inode] == 0) {
+      return std::nullopt;
+    }
+
+    return file_index_[inode] - 1;
+  }
+
+  std::span<size_t const> blocks_of(size_t file) const {
+    return std::span<size_t const>(file_blocks_)
+        .subspan(block_offsets_[file],
+                 block_offsets_[file + 1] - block_offsets_[file]);
+  }
+
+  // The static part of the scan state only depends on the metadata, so
+  // it's computed exactly once, off the request path.
+  void build_index() {
+    auto ti = LOG_TIMED_VERBOSE;
+
+    block_offsets_.push_back(0);
+
+    meta_.walk([&](dir_entry_view entry) {
+      auto iv = entry.inode();
+
+      if (!running_ || !iv.is_regular_file()) {
+        return;
+      }
+
+      auto inode = iv.inode_num();
+
+      if (inode >= file_index_.size()) {
+        file_index_.resize(inode + 1, 0);
+      }
+
+      // Hardlinks show up more than once, but are only read once
+      if (file_index_[inode] != 0) {
+        return;
+      }
+
+      auto chunks = meta_.get_chunks(inode);
+
+      if (!chunks || chunks->empty()) {
+        return;
+      }
+
+      file_off_t size{0};
+      auto const first = file_blocks_.size();
+
+      for (auto const& chunk : *chunks) {
+        size += chunk.size();
+        file_blocks_.push_back(chunk.block());
+      }
+
+      // Block numbers follow the order in which data is stored in the
+      // image
+      auto const begin = file_blocks_.begin() + first;
+      std::sort(begin, file_blocks_.end());
+      file_blocks_.erase(std::unique(begin, file_blocks_.end()),
+                         file_blocks_.end());
+
+      file_size_.push_back(size);
+      block_offsets_.push_back(file_blocks_.size());
+      file_index_[inode] = file_size_.size();
+    });
+
+    auto const num_blocks = ir_.num_blocks();
+
+    base_refs_.assign(num_blocks, 0);
+
+    for (auto block_no : file_blocks_) {
+      if (block_no < num_blocks) {
+        ++base_refs_[block_no];
+      }
+    }
+
+    indexed_.store(true, std::memory_order_release);
+
+    ti << "indexed " << file_size_.size() << " files for tree scan detection";
+  }
+
+  // Must be called with `mx_` held.
+  void detect(uint32_t inode, clock_type::time_point now) {
+    while (!recent_.empty() && now - recent_.front().first > opts_.window) {
+      recent_.pop_front();
+    }
+
+    if (std::none_of(recent_.begin(), recent_.end(),
+                     [inode](auto const& e) { return e.second == inode; })) {
+      recent_.emplace_back(now, inode);
+    }
+
+    // Until the index is ready, keep collecting opens; the next open
+    // after that will start the scan.
+    if (recent_.size() >= opts_.threshold && indexed_) {
+      recent_.clear();
+      start(now);
+    }
+  }
+
+  // Must be called with `mx_` held.
+  void start(clock_type::time_point now) {
+    refs_ = base_refs_;
+    held_.assign(base_refs_.size(), false);
+    done_.assign(file_size_.size(), false);
+    num_held_ = 0;
+    pending_ = file_size_.size();
+    touch(now);
+    active_.store(true, std::memory_order_release);
+
+    cond_.notify_all();
+
+    LOG_VERBOSE << "tree scan detected, tracking " << file_size_.size()
+                << " files, holding up to " << max_held_blocks_ << " blocks";
+  }
+
+  // Must be called with `mx_` held.
+  void stop() {
+    std::vector<size_t> blocks;
+
+    for (size_t block_no = 0; block_no < held_.size(); ++block_no) {
+      if (held_[block_no]) {
+        blocks.push_back(block_no);
+      }
+    }
+
+    ir_.unhold_blocks(blocks);
+    refs_.clear();
+    held_.clear();
+    done_.clear();
+    num_held_ = 0;
+    pending_ = 0;
+    recent_.clear();
+    active_ = false;
+  }
+
+  // Must be called with `mx_` held.
+  void release(size_t file) {
+    std::vector<size_t> done;
+
+    for (auto block_no : blocks_of(file)) {
+      if (block_no < refs_.size() && refs_[block_no] > 0 &&
+          --refs_[block_no] == 0 && held_[block_no]) {
+        held_[block_no] = false;
+        --num_held_;
+        done.push_back(block_no);
+      }
+    }
+
+    LOG_TRACE << "file " << file << " read completely, releasing "
+              << done.size() << " blocks";
+
+    ir_.unhold_blocks(done);
+  }
+
+  // Blocks are only held once a file referencing them is opened, and only
+  // as long as the budget allows; beyond that, they're just regularly
+  // cached. Prefetching continues past the end of the file, in the order
+  // in which the data is stored, with the blocks the scan still needs.
+  // Must be called with `mx_` held.
+  void hold_and_prefetch(size_t file) {
+    auto const blocks = blocks_of(file);
+
+    if (blocks.empty()) {
+      return;
+    }
+
+    std::vector<size_t> hold;
+    std::vector<size_t> prefetch;
+
+    for (auto block_no : blocks) {
+      if (block_no < refs_.size() && refs_[block_no] > 0 &&
+          !held_[block_no] && num_held_ < max_held_blocks_) {
+        held_[block_no] = true;
+        ++num_held_;
+        hold.push_back(block_no);
+      }
+    }
+
+    for (auto block_no = blocks.front();
+         block_no < refs_.size() &&
+         prefetch.size() < opts_.max_prefetch_blocks;
+         ++block_no) {
+      if (refs_[block_no] > 0) {
+        prefetch.push_back(block_no);
+      }
+    }
+
+    ir_.hold_blocks(hold);
+    ir_.prefetch_blocks(prefetch);
+  }
+
+  void background_thread() {
+    folly::setThreadName("tree-scan");
+
+    build_index();
+
+    std::unique_lock lock(mx_);
+
+    while (running_) {
+      if (!active_) {
+        cond_.wait(lock);
+        continue;
+      }
+
+      auto const deadline = last_activity() + opts_.idle_timeout;
+
+      if (clock_type::now() >= deadline) {
+        LOG_VERBOSE << "tree scan idle, releasing " << pending_
+                    << " unfinished files";
+        stop();
+      } else {
+        cond_.wait_until(lock, deadline);
+      }
+    }
+  }
+
+  LOG_PROXY_DECL(LoggerPolicy);
+  metadata_v2 const& meta_;
+  inode_reader_v2 const& ir_;
+  tree_scan_options const opts_;
+  size_t const max_held_blocks_;
+
+  // Built once by the background thread, read-only after `indexed_`
+  std::atomic<bool> indexed_{false};
+  std::vector<size_t> file_index_; // inode -> file + 1, 0 if not a file
+  std::vector<file_off_t> file_size_;
+  std::vector<size_t> block_offsets_;
+  std::vector<size_t> file_blocks_;
+  std::vector<uint32_t> base_refs_;
+
+  // State of the current scan, protected by `mx_` unless atomic
+  std::mutex mx_;
+  std::condition_variable cond_;
+  std::atomic<bool> running_{true};
+  std::atomic<bool> active_{false};
+  std::atomic<clock_type::rep> last_activity_{0};
+  std::deque<std::pair<clock_type::time_point, uint32_t>> recent_;
+  std::vector<uint32_t> refs_;
+  std::vector<bool> held_;
+  std::vector<bool> done_;
+  size_t num_held_{0};
+  size_t pending_{0};
+  std::thread background_thread_;
+};
+
+tree_scan_tracker::tree_scan_tracker(logger& lgr, metadata_v2 const& meta,
+                                     inode_reader_v2 const& ir,
+                                     tree_scan_options const& opts)
+    : impl_(make_unique_logging_object<impl, tree_scan_tracker_,
+                                       logger_policies>(lgr, meta, ir, opts)) {
+}
+
+} // namespace dwarfs
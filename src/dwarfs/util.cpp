@@ -67,6 +67,49 @@ int call_sys_main_iolayer_impl(std::span<T> args, iolayer const& iol,
   return main(argv_ptrs.size(), argv_ptrs.data(), iol);
 }
 
+// Match a single character against a `[...]` class starting at `p`.
+// Returns the position after the closing bracket, or `npos` if the
+// class isn't terminated, in which case `[` is taken literally.
+size_t match_char_class(std::string_view pattern, size_t p, char c,
+                        bool& matched) {
+  ++p;
+
+  bool negate = false;
+
+  if (p < pattern.size() && (pattern[p] == '!' || pattern[p] == '^')) {
+    negate = true;
+    ++p;
+  }
+
+  matched = false;
+  auto const first = p;
+
+  while (p < pattern.size() && (pattern[p] != ']' || p == first)) {
+    auto lo = pattern[p];
+    auto hi = lo;
+
+    if (p + 2 < pattern.size() && pattern[p + 1] == '-' &&
+        pattern[p + 2] != ']') {
+      hi = pattern[p + 2];
+      p += 2;
+    }
+
+    if (lo <= c && c <= hi) {
+      matched = true;
+    }
+
+    ++p;
+  }
+
+  if (p >= pattern.size()) {
+    return std::string_view::npos;
+  }
+
+  matched = matched != negate;
+
+  return p + 1;
+}
+
 } // namespace
 
 std::string size_with_unit(size_t size) {
@@ -198,6 +241,49 @@ file_off_t parse_image_offset(std::string const& str) {
   return off.value();
 }
 
+std::vector<int> parse_cpu_list(std::string_view str) {
+  std::vector<int> cpus;
+
+  auto parse_cpu = [&](std::string_view s) {
+    auto cpu = folly::tryTo<int>(folly::trimWhitespace(s));
+
+    if (!cpu || cpu.value() < 0) {
+      DWARFS_THROW(runtime_error, fmt::format("invalid cpu list: {}", str));
+    }
+
+    return cpu.value();
+  };
+
+  if (folly::trimWhitespace(str).empty()) {
+    return cpus;
+  }
+
+  std::vector<std::string_view> ranges;
+  folly::split(',', str, ranges);
+
+  for (auto const& range : ranges) {
+    std::vector<std::string_view> parts;
+    folly::split('-', range, parts);
+
+    if (parts.size() > 2) {
+      DWARFS_THROW(runtime_error, fmt::format("invalid cpu list: {}", str));
+    }
+
+    auto first = parse_cpu(parts.front());
+    auto last = parse_cpu(parts.back());
+
+    if (last < first) {
+      DWARFS_THROW(runtime_error, fmt::format("invalid cpu list: {}", str));
+    }
+
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+
+  return cpus;
+}
+
 std::string sys_string_to_string(sys_string const& in) {
 #ifdef _WIN32
   std::u16string tmp(in.size(), 0);
@@ -363,4 +449,75 @@ std::string_view basename(std::string_view path) {
   return path.substr(pos + 1);
 }
 
+bool glob_match(std::string_view pattern, std::string_view path) {
+  size_t p = 0;
+  size_t s = 0;
+
+  while (p < pattern.size()) {
+    auto c = pattern[p];
+
+    if (c == '*') {
+      bool const globstar = p + 1 < pattern.size() && pattern[p + 1] == '*';
+
+      p += globstar ? 2 : 1;
+
+      // `**/` also matches zero directories
+      if (globstar && p < pattern.size() && pattern[p] == '/' &&
+          glob_match(pattern.substr(p + 1), path.substr(s))) {
+        return true;
+      }
+
+      for (auto i = s;; ++i) {
+        if (glob_match(pattern.substr(p), path.substr(i))) {
+          return true;
+        }
+
+        if (i == path.size() || (!globstar && path[i] == '/')) {
+          return false;
+        }
+      }
+    }
+
+    if (s == path.size()) {
+      return false;
+    }
+
+    if (c == '?') {
+      if (path[s] == '/') {
+        return false;
+      }
+    } else if (c == '[') {
+      bool matched;
+      auto next = match_char_class(pattern, p, path[s], matched);
+
+      if (next != std::string_view::npos) {
+        if (!matched || path[s] == '/') {
+          return false;
+        }
+
+        p = next;
+        ++s;
+        continue;
+      }
+
+      if (path[s] != c) {
+        return false;
+      }
+    } else {
+      if (c == '\\' && p + 1 < pattern.size()) {
+        c = pattern[++p];
+      }
+
+      if (path[s] != c) {
+        return false;
+      }
+    }
+
+    ++p;
+    ++s;
+  }
+
+  return s == path.size();
+}
+
 } // namespace dwarfs
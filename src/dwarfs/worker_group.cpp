@@ -19,6 +19,7 @@
  * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <atomic>
 #include <condition_variable>
 #include <cstdint>
@@ -168,6 +169,50 @@ class basic_worker_group final : public worker_group::impl, private Policy {
     return jobs_.size();
   }
 
+  /**
+   * Return the number of workers that are neither busy nor about to
+   * pick up a queued job, and haven't been reserved
+   *
+   * \returns The number of idle workers.
+   */
+  size_t idle_workers() const override {
+    std::lock_guard lock(mx_);
+    return idle_workers_unlocked();
+  }
+
+  /**
+   * Reserve up to `max` idle workers
+   *
+   * Reserved workers are no longer reported as idle until they are
+   * released again, so concurrent callers never reserve the same
+   * workers. Also, no new jobs are started on their behalf, leaving
+   * their share of CPU time to the caller, e.g. for extra compression
+   * threads.
+   *
+   * \returns The number of workers actually reserved.
+   */
+  size_t reserve_idle_workers(size_t max) override {
+    std::lock_guard lock(mx_);
+    auto count = std::min(max, idle_workers_unlocked());
+    reserved_ += count;
+    return count;
+  }
+
+  /**
+   * Release workers previously reserved by `reserve_idle_workers()`
+   */
+  void release_idle_workers(size_t count) override {
+    {
+      std::lock_guard lock(mx_);
+      DWARFS_CHECK(count <= reserved_, "releasing more workers than reserved");
+      reserved_ -= count;
+    }
+
+    if (count > 0) {
+      cond_.notify_all();
+    }
+  }
+
   folly::Expected<std::chrono::nanoseconds, std::error_code>
   get_cpu_time() const override {
     std::lock_guard lock(mx_);
@@ -205,6 +250,11 @@ class basic_worker_group final : public worker_group::impl, private Policy {
  private:
   using jobs_t = std::queue<worker_group::job_t>;
 
+  size_t idle_workers_unlocked() const {
+    size_t const busy = pending_ + reserved_;
+    return busy < workers_.size() ? workers_.size() - busy : 0;
+  }
+
   void check_set_affinity_from_enviroment(const char* group_name) {
     if (auto var = os_.getenv("DWARFS_WORKER_GROUP_AFFINITY")) {
       std::vector<std::string_view> groups;
@@ -254,7 +304,9 @@ class basic_worker_group final : public worker_group::impl, private Policy {
       {
         std::unique_lock lock(mx_);
 
-        while (jobs_.empty() && running_) {
+        // Don't run more jobs than there are unreserved workers.
+        while ((jobs_.empty() || active_ + reserved_ >= workers_.size()) &&
+               running_) {
           cond_.wait(lock);
         }
 
@@ -269,6 +321,7 @@ class basic_worker_group final : public worker_group::impl, private Policy {
         job = std::move(jobs_.front());
 
         jobs_.pop();
+        ++active_;
       }
 
       {
@@ -294,8 +347,10 @@ class basic_worker_group final : public worker_group::impl, private Policy {
       {
         std::lock_guard lock(mx_);
         pending_--;
+        active_--;
       }
 
+      cond_.notify_one();
       wait_.notify_one();
       queue_.notify_one();
     }
@@ -311,6 +366,8 @@ class basic_worker_group final : public worker_group::impl, private Policy {
   mutable std::mutex mx_;
   std::atomic<bool> running_;
   std::atomic<size_t> pending_;
+  size_t active_{0};
+  size_t reserved_{0};
   const size_t max_queue_len_;
 };
 
@@ -20,11 +20,14 @@
  */
 
 #include <array>
+#include <atomic>
 #include <filesystem>
 #include <iostream>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <system_error>
+#include <thread>
 #include <type_traits>
 #include <unordered_map>
 #include <vector>
@@ -47,6 +50,7 @@
 
 #include <folly/Conv.h>
 #include <folly/String.h>
+#include <folly/system/ThreadName.h>
 #include <folly/experimental/symbolizer/SignalHandler.h>
 #include <folly/json.h>
 
@@ -71,6 +75,13 @@
 #endif
 #endif
 
+// FUSE over io_uring needs kernel support (6.14+) as well as libfuse 3.18+
+#if DWARFS_FUSE_LOWLEVEL && defined(FUSE_CAP_OVER_IO_URING)
+#define DWARFS_FUSE_IO_URING 1
+#else
+#define DWARFS_FUSE_IO_URING 0
+#endif
+
 #ifdef _WIN32
 #include <delayimp.h>
 #include <fuse3/winfsp_fuse.h>
@@ -81,9 +92,13 @@
 #endif
 
 #include "dwarfs/error.h"
+#include "dwarfs/file_access.h"
 #include "dwarfs/file_stat.h"
 #include "dwarfs/filesystem_v2.h"
 #include "dwarfs/fstypes.h"
+#ifdef DWARFS_HAVE_LIBCURL
+#include "dwarfs/http_mmif.h"
+#endif
 #include "dwarfs/iolayer.h"
 #include "dwarfs/iovec_read_buf.h"
 #include "dwarfs/library_dependencies.h"
@@ -149,6 +164,7 @@ struct options {
   std::shared_ptr<std::string> fsimage;
   int seen_mountpoint{0};
   char const* cachesize_str{nullptr};           // TODO: const?? -> use string?
+  char const* rangecache_str{nullptr};          // TODO: const?? -> use string?
   char const* blocksize_str{nullptr};           // TODO: const?? -> use string?
   char const* readahead_str{nullptr};           // TODO: const?? -> use string?
   char const* debuglevel_str{nullptr};          // TODO: const?? -> use string?
@@ -160,6 +176,15 @@ struct options {
   char const* cache_tidy_interval_str{nullptr}; // TODO: const?? -> use string?
   char const* cache_tidy_max_age_str{nullptr};  // TODO: const?? -> use string?
   char const* seq_detector_thresh_str{nullptr}; // TODO: const?? -> use string?
+  char const* tree_scan_thresh_str{nullptr};    // TODO: const?? -> use string?
+  char const* cache_policy_str{nullptr};        // TODO: const?? -> use string?
+  char const* block_io_str{nullptr};            // TODO: const?? -> use string?
+  char const* pin_str{nullptr};                 // TODO: const?? -> use string?
+  char const* pin_file_str{nullptr};            // TODO: const?? -> use string?
+#ifdef DWARFS_HAVE_LIBCURL
+  char const* http_cache_str{nullptr};          // TODO: const?? -> use string?
+  char const* http_chunk_str{nullptr};          // TODO: const?? -> use string?
+#endif
 #if DWARFS_PERFMON_ENABLED
   char const* perfmon_enabled_str{nullptr};    // TODO: const?? -> use string?
   char const* perfmon_trace_file_str{nullptr}; // TODO: const?? -> use string?
@@ -168,7 +193,10 @@ struct options {
   int readonly{0};
   int cache_image{0};
   int cache_files{0};
+  int numa{0};
+  int io_uring{0};
   size_t cachesize{0};
+  size_t rangecache{0};
   size_t blocksize{0};
   size_t readahead{0};
   size_t workers{0};
@@ -176,9 +204,12 @@ struct options {
   double decompress_ratio{0.0};
   logger_options logopts{};
   cache_tidy_strategy block_cache_tidy_strategy{cache_tidy_strategy::NONE};
+  cache_replacement_policy block_cache_policy{cache_replacement_policy::LRU};
+  block_io_mode block_io{block_io_mode::MMAP};
   std::chrono::milliseconds block_cache_tidy_interval{std::chrono::minutes(5)};
   std::chrono::milliseconds block_cache_tidy_max_age{std::chrono::minutes{10}};
   size_t seq_detector_threshold{kDefaultSeqDetectorThreshold};
+  size_t tree_scan_threshold{0};
   bool is_help{false};
 #ifdef DWARFS_BUILTIN_MANPAGE
   bool is_man{false};
@@ -192,6 +223,12 @@ struct dwarfs_userdata {
       : lgr{iol.term, iol.err}
       , iol{iol} {}
 
+  ~dwarfs_userdata() {
+    if (pin_thread.joinable()) {
+      pin_thread.join();
+    }
+  }
+
   dwarfs_userdata(dwarfs_userdata const&) = delete;
   dwarfs_userdata& operator=(dwarfs_userdata const&) = delete;
 
@@ -200,6 +237,11 @@ struct dwarfs_userdata {
   stream_logger lgr;
   filesystem_v2 fs;
   iolayer const& iol;
+  std::vector<std::vector<int>> numa_node_cpus;
+  std::atomic<size_t> numa_next_node{0};
+  std::atomic<bool> io_uring_active{false};
+  std::vector<std::string> pin_patterns;
+  std::thread pin_thread;
   std::shared_ptr<performance_monitor> perfmon;
   PERFMON_EXT_PROXY_DECL
   PERFMON_EXT_TIMER_DECL(op_init)
@@ -223,6 +265,7 @@ struct dwarfs_userdata {
 constexpr struct ::fuse_opt dwarfs_opts[] = {
     // TODO: user, group, atime, mtime, ctime for those fs who don't have it?
     DWARFS_OPT("cachesize=%s", cachesize_str, 0),
+    DWARFS_OPT("rangecache=%s", rangecache_str, 0),
     DWARFS_OPT("blocksize=%s", blocksize_str, 0),
     DWARFS_OPT("readahead=%s", readahead_str, 0),
     DWARFS_OPT("debuglevel=%s", debuglevel_str, 0),
@@ -231,15 +274,26 @@ constexpr struct ::fuse_opt dwarfs_opts[] = {
     DWARFS_OPT("decratio=%s", decompress_ratio_str, 0),
     DWARFS_OPT("offset=%s", image_offset_str, 0),
     DWARFS_OPT("tidy_strategy=%s", cache_tidy_strategy_str, 0),
+    DWARFS_OPT("cache_policy=%s", cache_policy_str, 0),
+    DWARFS_OPT("block_io=%s", block_io_str, 0),
+    DWARFS_OPT("pin=%s", pin_str, 0),
+    DWARFS_OPT("pin_file=%s", pin_file_str, 0),
+#ifdef DWARFS_HAVE_LIBCURL
+    DWARFS_OPT("httpcache=%s", http_cache_str, 0),
+    DWARFS_OPT("httpchunk=%s", http_chunk_str, 0),
+#endif
     DWARFS_OPT("tidy_interval=%s", cache_tidy_interval_str, 0),
     DWARFS_OPT("tidy_max_age=%s", cache_tidy_max_age_str, 0),
     DWARFS_OPT("seq_detector=%s", seq_detector_thresh_str, 0),
+    DWARFS_OPT("tree_scan=%s", tree_scan_thresh_str, 0),
     DWARFS_OPT("enable_nlink", enable_nlink, 1),
     DWARFS_OPT("readonly", readonly, 1),
     DWARFS_OPT("cache_image", cache_image, 1),
     DWARFS_OPT("no_cache_image", cache_image, 0),
     DWARFS_OPT("cache_files", cache_files, 1),
     DWARFS_OPT("no_cache_files", cache_files, 0),
+    DWARFS_OPT("numa", numa, 1),
+    DWARFS_OPT("io_uring", io_uring, 1),
 #if DWARFS_PERFMON_ENABLED
     DWARFS_OPT("perfmon=%s", perfmon_enabled_str, 0),
     DWARFS_OPT("perfmon_trace=%s", perfmon_trace_file_str, 0),
@@ -257,6 +311,7 @@ std::unordered_map<std::string_view, cache_tidy_strategy> const
 constexpr std::string_view pid_xattr{"user.dwarfs.driver.pid"};
 constexpr std::string_view perfmon_xattr{"user.dwarfs.driver.perfmon"};
 constexpr std::string_view inodeinfo_xattr{"user.dwarfs.inodeinfo"};
+constexpr std::string_view blockmap_xattr{"user.dwarfs.blockmap"};
 #endif
 
 template <typename LogProxy, typename T>
@@ -291,6 +346,37 @@ void checked_reply_err(LogProxy& log_, fuse_req_t req, T&& f) {
       *reinterpret_cast<dwarfs_userdata*>(fuse_get_context()->private_data)
 #endif
 
+// FUSE threads are created by libfuse, so they are pinned on the first
+// read they handle. Nodes are assigned round-robin, which spreads the
+// threads evenly and keeps each of them close to the block cache workers
+// and cached blocks of its node.
+//
+// With the io_uring transport, libfuse runs one queue thread per CPU that
+// is already bound to its core. These must not be moved; the block cache
+// picks the workers of the node they're running on anyway.
+void steer_numa_thread(dwarfs_userdata& userdata) {
+  thread_local bool steered{false};
+
+  if (steered || userdata.numa_node_cpus.empty() ||
+      userdata.io_uring_active.load()) {
+    return;
+  }
+
+  steered = true;
+
+  auto const& cpus =
+      userdata.numa_node_cpus[userdata.numa_next_node.fetch_add(1) %
+                              userdata.numa_node_cpus.size()];
+
+  std::error_code ec;
+  userdata.iol.os->thread_set_affinity(std::this_thread::get_id(), cpus, ec);
+
+  if (ec) {
+    LOG_PROXY(prod_logger_policy, userdata.lgr);
+    LOG_WARN << "failed to pin FUSE thread to NUMA node: " << ec.message();
+  }
+}
+
 void check_fusermount(dwarfs_userdata& userdata) {
 #ifndef WIN32
 
@@ -336,11 +422,45 @@ void op_init_common(void* data) {
 
   // we must do this *after* the fuse driver has forked into background
   userdata.fs.set_cache_tidy_config(tidy);
+
+  if (!userdata.pin_patterns.empty()) {
+    // Matching the patterns requires walking the whole file system, so
+    // don't hold up the mount. This needs the workers, so it must come
+    // *after* set_num_workers.
+    userdata.pin_thread = std::thread([&userdata] {
+      LOG_PROXY(LoggerPolicy, userdata.lgr);
+      folly::setThreadName("pin-paths");
+
+      try {
+        auto ti = LOG_TIMED_INFO;
+        auto blocks = userdata.fs.pin_paths(userdata.pin_patterns);
+        ti << "matched pin patterns, " << blocks << " blocks queued";
+      } catch (std::exception const& e) {
+        LOG_ERROR << "failed to pin files: " << folly::exceptionStr(e);
+      }
+    });
+  }
 }
 
 #if DWARFS_FUSE_LOWLEVEL
 template <typename LoggerPolicy>
-void op_init(void* data, struct fuse_conn_info* /*conn*/) {
+void op_init(void* data, [[maybe_unused]] struct fuse_conn_info* conn) {
+#if DWARFS_FUSE_IO_URING
+  auto& userdata = *reinterpret_cast<dwarfs_userdata*>(data);
+
+  if (userdata.opts.io_uring) {
+    LOG_PROXY(LoggerPolicy, userdata.lgr);
+
+    if (fuse_set_feature_flag(conn, FUSE_CAP_OVER_IO_URING)) {
+      userdata.io_uring_active = true;
+      LOG_INFO << "using FUSE over io_uring";
+    } else {
+      LOG_WARN << "kernel does not support FUSE over io_uring, "
+                  "falling back to /dev/fuse";
+    }
+  }
+#endif
+
   op_init_common<LoggerPolicy>(data);
 }
 #else
@@ -591,7 +711,15 @@ int op_open_common(LogProxy& log_, dwarfs_userdata& userdata,
       return EACCES;
     }
 
-    fi->fh = entry->inode_num();
+    // Go through the file system rather than using the inode number
+    // directly, so it gets to see the open (e.g. for tree scan detection)
+    auto inode = userdata.fs.open(*entry);
+
+    if (inode < 0) {
+      return EINVAL;
+    }
+
+    fi->fh = inode;
     fi->direct_io = !userdata.opts.cache_files;
     fi->keep_cache = userdata.opts.cache_files;
 
@@ -648,6 +776,8 @@ void op_read(fuse_req_t req, fuse_ino_t ino, size_t size, file_off_t off,
   LOG_DEBUG << __func__;
   PERFMON_SET_CONTEXT(ino, size)
 
+  steer_numa_thread(userdata);
+
   checked_reply_err(log_, req, [&]() -> ssize_t {
     if (FUSE_ROOT_ID + fi->fh != ino) {
       return EIO;
@@ -678,6 +808,8 @@ int op_read(char const* path, char* buf, size_t size, native_off_t off,
   LOG_DEBUG << __func__;
   PERFMON_SET_CONTEXT(fi->fh, size)
 
+  steer_numa_thread(userdata);
+
   return -checked_call(log_, [&] {
     auto rv = userdata.fs.read(fi->fh, buf, size, off);
 
@@ -937,6 +1069,17 @@ void op_getxattr(fuse_req_t req, fuse_ino_t ino, char const* name, size_t size
       } else {
         return ENOENT;
       }
+    } else if (name == blockmap_xattr) {
+      auto entry = userdata.fs.find(ino);
+
+      if (!entry) {
+        return ENOENT;
+      }
+
+      if (auto bm = userdata.fs.get_block_map(*entry)) {
+        auto data = bm->serialize();
+        oss.write(data.data(), data.size());
+      }
     }
 
 // TODO: figure out under which conditions we don't have ::view()
@@ -1005,6 +1148,11 @@ void op_listxattr(fuse_req_t req, fuse_ino_t ino, size_t size) {
 
     oss << inodeinfo_xattr << '\0';
 
+    if (auto entry = userdata.fs.find(ino);
+        entry && entry->is_regular_file()) {
+      oss << blockmap_xattr << '\0';
+    }
+
 // TODO: figure out under which conditions we don't have ::view()
 #ifdef __APPLE__
     auto xattrs = oss.str();
@@ -1064,6 +1212,7 @@ void usage(std::ostream& os, std::filesystem::path const& progname) {
      << " <image> <mountpoint> [options]\n\n"
      << "DWARFS options:\n"
      << "    -o cachesize=SIZE      set size of block cache (512M)\n"
+     << "    -o rangecache=SIZE     set size of range cache (0)\n"
      << "    -o blocksize=SIZE      set file I/O block size (512K)\n"
      << "    -o readahead=SIZE      set readahead size (0)\n"
      << "    -o workers=NUM         number of worker threads (2)\n"
@@ -1074,11 +1223,22 @@ void usage(std::ostream& os, std::filesystem::path const& progname) {
      << "    -o readonly            show read-only file system\n"
      << "    -o (no_)cache_image    (don't) keep image in kernel cache\n"
      << "    -o (no_)cache_files    (don't) keep files in kernel cache\n"
+     << "    -o numa                NUMA-aware block cache and threads\n"
+     << "    -o io_uring            use FUSE over io_uring if available\n"
      << "    -o debuglevel=NAME     " << logger::all_level_names() << "\n"
      << "    -o tidy_strategy=NAME  (none)|time|swap\n"
      << "    -o tidy_interval=TIME  interval for cache tidying (5m)\n"
      << "    -o tidy_max_age=TIME   tidy blocks after this time (10m)\n"
      << "    -o seq_detector=NUM    sequential access detector threshold (4)\n"
+     << "    -o tree_scan=NUM       tree scan detector threshold (0)\n"
+     << "    -o cache_policy=NAME   (lru)|tinylfu|arc\n"
+     << "    -o block_io=NAME       read compressed blocks via (mmap)|pread\n"
+     << "    -o pin=GLOB[:GLOB...]  keep blocks of matching files in memory\n"
+     << "    -o pin_file=FILE       read glob patterns to pin from file\n"
+#ifdef DWARFS_HAVE_LIBCURL
+     << "    -o httpcache=FILE      cache file for images loaded via HTTP\n"
+     << "    -o httpchunk=SIZE      HTTP range request granularity (1M)\n"
+#endif
 #if DWARFS_PERFMON_ENABLED
      << "    -o perfmon=name[+...]  enable performance monitor\n"
      << "    -o perfmon_trace=FILE  write performance monitor trace file\n"
@@ -1300,13 +1460,18 @@ void load_filesystem(dwarfs_userdata& userdata) {
   filesystem_options fsopts;
   fsopts.lock_mode = opts.lock_mode;
   fsopts.block_cache.max_bytes = opts.cachesize;
+  fsopts.block_cache.range_cache_max_bytes = opts.rangecache;
   fsopts.block_cache.num_workers = opts.workers;
   fsopts.block_cache.decompress_ratio = opts.decompress_ratio;
   fsopts.block_cache.mm_release = !opts.cache_image;
   fsopts.block_cache.init_workers = false;
   fsopts.block_cache.sequential_access_detector_threshold =
       opts.seq_detector_threshold;
+  fsopts.block_cache.numa_aware = bool(opts.numa);
+  fsopts.block_cache.replacement_policy = opts.block_cache_policy;
+  fsopts.block_cache.io_mode = opts.block_io;
   fsopts.inode_reader.readahead = opts.readahead;
+  fsopts.tree_scan.threshold = opts.tree_scan_threshold;
   fsopts.metadata.enable_nlink = bool(opts.enable_nlink);
   fsopts.metadata.readonly = bool(opts.readonly);
   fsopts.metadata.block_size = opts.blocksize;
@@ -1346,14 +1511,59 @@ void load_filesystem(dwarfs_userdata& userdata) {
   PERFMON_EXT_TIMER_SETUP(userdata, op_getxattr, "inode")
   PERFMON_EXT_TIMER_SETUP(userdata, op_listxattr, "inode")
 
-  auto fsimage = userdata.iol.os->canonical(std::filesystem::path(
-      reinterpret_cast<char8_t const*>(opts.fsimage->data())));
+  if (opts.numa) {
+    for (auto& cpus : userdata.iol.os->numa_node_cpus()) {
+      if (!cpus.empty()) {
+        userdata.numa_node_cpus.push_back(std::move(cpus));
+      }
+    }
+
+    if (userdata.numa_node_cpus.size() < 2) {
+      LOG_WARN << "no NUMA topology found, ignoring `numa` option";
+      userdata.numa_node_cpus.clear();
+    }
+  }
+
+#if !DWARFS_FUSE_IO_URING
+  if (opts.io_uring) {
+    LOG_WARN << "FUSE over io_uring not supported by this build, "
+                "ignoring `io_uring` option";
+  }
+#endif
+
+  std::shared_ptr<mmif> mm;
+
+#ifdef DWARFS_HAVE_LIBCURL
+  if (http_mmif::is_url(*opts.fsimage)) {
+    http_mmif_options httpopts;
+
+    if (opts.http_cache_str) {
+      // the cache file may not exist yet, so we can't canonicalize it
+      httpopts.cache_file = std::filesystem::absolute(std::filesystem::path(
+          reinterpret_cast<char8_t const*>(opts.http_cache_str)));
+    }
+
+    if (opts.http_chunk_str) {
+      httpopts.chunk_size = parse_size_with_unit(opts.http_chunk_str);
+    }
+
+    LOG_DEBUG << "attempting to load filesystem from " << *opts.fsimage;
+
+    mm = std::make_shared<http_mmif>(userdata.lgr, *opts.fsimage, httpopts);
+  }
+#endif
+
+  if (!mm) {
+    auto fsimage = userdata.iol.os->canonical(std::filesystem::path(
+        reinterpret_cast<char8_t const*>(opts.fsimage->data())));
 
-  LOG_DEBUG << "attempting to load filesystem from " << fsimage;
+    LOG_DEBUG << "attempting to load filesystem from " << fsimage;
 
-  userdata.fs =
-      filesystem_v2(userdata.lgr, *userdata.iol.os,
-                    std::make_shared<mmap>(fsimage), fsopts, userdata.perfmon);
+    mm = std::make_shared<mmap>(fsimage);
+  }
+
+  userdata.fs = filesystem_v2(userdata.lgr, *userdata.iol.os, std::move(mm),
+                              fsopts, userdata.perfmon);
 
   ti << "file system initialized";
 }
@@ -1448,6 +1658,8 @@ int dwarfs_main(int argc, sys_char** argv, iolayer const& iol) {
     opts.cachesize = opts.cachesize_str
                          ? parse_size_with_unit(opts.cachesize_str)
                          : (static_cast<size_t>(512) << 20);
+    opts.rangecache =
+        opts.rangecache_str ? parse_size_with_unit(opts.rangecache_str) : 0;
     opts.blocksize = opts.blocksize_str
                          ? parse_size_with_unit(opts.blocksize_str)
                          : kDefaultBlockSize;
@@ -1480,6 +1692,34 @@ int dwarfs_main(int argc, sys_char** argv, iolayer const& iol) {
             parse_time_with_unit(opts.cache_tidy_max_age_str);
       }
     }
+
+    if (opts.cache_policy_str) {
+      opts.block_cache_policy =
+          parse_cache_replacement_policy(opts.cache_policy_str);
+    }
+
+    if (opts.block_io_str) {
+      opts.block_io = parse_block_io_mode(opts.block_io_str);
+    }
+
+    if (opts.pin_str) {
+      folly::split(':', opts.pin_str, userdata.pin_patterns);
+    }
+
+    if (opts.pin_file_str) {
+      auto ifs = iol.file->open_input(opts.pin_file_str);
+      std::string line;
+
+      while (std::getline(ifs->is(), line)) {
+        auto glob = folly::trimWhitespace(line);
+        if (!glob.empty() && !glob.startsWith('#')) {
+          userdata.pin_patterns.push_back(glob.str());
+        }
+      }
+    }
+
+    std::erase_if(userdata.pin_patterns,
+                  [](auto const& glob) { return glob.empty(); });
   } catch (std::filesystem::filesystem_error const& e) {
     iol.err << folly::exceptionStr(e) << "\n";
     return 1;
@@ -1498,6 +1738,10 @@ int dwarfs_main(int argc, sys_char** argv, iolayer const& iol) {
           ? folly::to<size_t>(opts.seq_detector_thresh_str)
           : kDefaultSeqDetectorThreshold;
 
+  opts.tree_scan_threshold =
+      opts.tree_scan_thresh_str ? folly::to<size_t>(opts.tree_scan_thresh_str)
+                                : 0;
+
 #ifdef DWARFS_BUILTIN_MANPAGE
   if (userdata.opts.is_man) {
     show_manpage(manpage::get_dwarfs_manpage(), iol);
@@ -1532,6 +1776,14 @@ int dwarfs_main(int argc, sys_char** argv, iolayer const& iol) {
     }
   };
 
+#if DWARFS_FUSE_IO_URING
+  // We've consumed the `io_uring` option, but it's libfuse that sets up
+  // the io_uring transport when creating the session
+  if (opts.io_uring) {
+    fuse_opt_add_arg(&args, "-oio_uring");
+  }
+#endif
+
 #if FUSE_USE_VERSION >= 30
 #if DWARFS_FUSE_LOWLEVEL
   return run_fuse(args, fuse_opts, userdata);
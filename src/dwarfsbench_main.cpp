@@ -19,13 +19,23 @@
  * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <array>
 #include <exception>
+#include <iterator>
+#include <string_view>
+#include <vector>
 
 #include <boost/program_options.hpp>
 
+#include <fmt/format.h>
+
 #include <folly/Conv.h>
 #include <folly/String.h>
+#include <folly/json.h>
 
+#include "dwarfs/cache_policy.h"
+#include "dwarfs/file_access.h"
 #include "dwarfs/file_stat.h"
 #include "dwarfs/filesystem_v2.h"
 #include "dwarfs/fstypes.h"
@@ -43,8 +53,70 @@ namespace po = boost::program_options;
 
 namespace dwarfs {
 
+namespace {
+
+std::vector<size_t>
+load_block_cache_trace(iolayer const& iol, std::string const& path) {
+  auto ifs = iol.file->open_input(path);
+  std::string json(std::istreambuf_iterator<char>(ifs->is()), {});
+  std::vector<size_t> blocks;
+
+  for (auto const& ev : folly::parseJson(json)) {
+    if (ev.getDefault("cat", "").asString() == "block_cache" &&
+        ev.getDefault("ph", "").asString() == "B" &&
+        ev.getDefault("name", "").asString().starts_with("get(")) {
+      blocks.push_back(static_cast<size_t>(ev["args"]["block_no"].asInt()));
+    }
+  }
+
+  return blocks;
+}
+
+void replay_block_cache_trace(iolayer const& iol,
+                              std::vector<size_t> const& blocks,
+                              size_t cache_blocks) {
+  static constexpr std::array const policies{
+      cache_replacement_policy::LRU,
+      cache_replacement_policy::W_TINYLFU,
+      cache_replacement_policy::ARC,
+  };
+
+  auto const num_keys =
+      blocks.empty() ? 0 : *std::max_element(blocks.begin(), blocks.end()) + 1;
+
+  iol.out << fmt::format("replaying {} block accesses ({} distinct blocks) "
+                         "with a cache of {} blocks\n",
+                         blocks.size(), num_keys, cache_blocks);
+
+  for (auto policy : policies) {
+    cache_policy cache(policy, cache_blocks, num_keys);
+    std::vector<size_t> evicted;
+    size_t hits{0};
+
+    for (auto block_no : blocks) {
+      if (cache.access(block_no)) {
+        ++hits;
+      } else {
+        evicted.clear();
+        cache.insert(block_no, evicted);
+      }
+    }
+
+    auto const misses = blocks.size() - hits;
+    auto const hit_rate =
+        blocks.empty() ? 0.0 : 100.0 * hits / static_cast<double>(blocks.size());
+
+    iol.out << policy
+            << fmt::format(": {} hits, {} misses, {:.2f}% hit rate\n", hits,
+                           misses, hit_rate);
+  }
+}
+
+} // namespace
+
 int dwarfsbench_main(int argc, sys_char** argv, iolayer const& iol) {
-  std::string filesystem, cache_size_str, lock_mode_str, decompress_ratio_str;
+  std::string filesystem, cache_size_str, lock_mode_str, decompress_ratio_str,
+      cache_policy_str, cache_trace, block_size_str;
   logger_options logopts;
   size_t num_workers;
   size_t num_readers;
@@ -70,6 +142,15 @@ int dwarfsbench_main(int argc, sys_char** argv, iolayer const& iol) {
     ("decompress-ratio,r",
         po::value<std::string>(&decompress_ratio_str)->default_value("0.8"),
         "block cache size")
+    ("cache-policy,p",
+        po::value<std::string>(&cache_policy_str)->default_value("lru"),
+        "block cache replacement policy (lru, tinylfu, arc)")
+    ("cache-trace",
+        po::value<std::string>(&cache_trace),
+        "replay block cache perfmon trace with all replacement policies")
+    ("block-size",
+        po::value<std::string>(&block_size_str)->default_value("16m"),
+        "filesystem block size for trace replay")
     ;
   // clang-format on
 
@@ -85,7 +166,8 @@ int dwarfsbench_main(int argc, sys_char** argv, iolayer const& iol) {
     return 1;
   }
 
-  if (vm.count("help") or !vm.count("filesystem")) {
+  if (vm.count("help") or
+      (!vm.count("filesystem") and !vm.count("cache-trace"))) {
     iol.out << tool_header("dwarfsbench")
             << library_dependencies::common_as_string() << "\n\n"
             << opts << "\n";
@@ -93,6 +175,21 @@ int dwarfsbench_main(int argc, sys_char** argv, iolayer const& iol) {
   }
 
   try {
+    if (vm.count("cache-trace")) {
+      auto const block_size = parse_size_with_unit(block_size_str);
+      if (block_size == 0) {
+        iol.err << "error: block size must not be zero\n";
+        return 1;
+      }
+      auto const cache_blocks = std::max<size_t>(
+          1, parse_size_with_unit(cache_size_str) / block_size);
+      replay_block_cache_trace(iol, load_block_cache_trace(iol, cache_trace),
+                               cache_blocks);
+      if (!vm.count("filesystem")) {
+        return 0;
+      }
+    }
+
     stream_logger lgr(iol.term, iol.err, logopts);
     filesystem_options fsopts;
 
@@ -101,6 +198,8 @@ int dwarfsbench_main(int argc, sys_char** argv, iolayer const& iol) {
     fsopts.block_cache.num_workers = num_workers;
     fsopts.block_cache.decompress_ratio =
         folly::to<double>(decompress_ratio_str);
+    fsopts.block_cache.replacement_policy =
+        parse_cache_replacement_policy(cache_policy_str);
 
     dwarfs::filesystem_v2 fs(
         lgr, *iol.os, std::make_shared<dwarfs::mmap>(filesystem), fsopts);
@@ -28,6 +28,9 @@
 
 #include <archive.h>
 
+#include <fmt/format.h>
+
+#include <folly/Conv.h>
 #include <folly/String.h>
 
 #include "dwarfs/filesystem_extractor.h"
@@ -60,12 +63,12 @@ constexpr std::string_view kDash{"-"};
 
 int dwarfsextract_main(int argc, sys_char** argv, iolayer const& iol) {
   sys_string filesystem, output, trace_file;
-  std::string format, cache_size_str, image_offset;
+  std::string format, cache_size_str, image_offset, compression;
   logger_options logopts;
 #if DWARFS_PERFMON_ENABLED
   std::string perfmon_str;
 #endif
-  size_t num_workers;
+  size_t num_workers, compression_threads;
   bool continue_on_error{false}, disable_integrity_check{false},
       stdout_progress{false};
 
@@ -84,6 +87,12 @@ int dwarfsextract_main(int argc, sys_char** argv, iolayer const& iol) {
     ("format,f",
         po::value<std::string>(&format),
         "output format")
+    ("compression,z",
+        po::value<std::string>(&compression),
+        "output compression filter (FILTER[:LEVEL])")
+    ("compression-threads",
+        po::value<size_t>(&compression_threads)->default_value(0),
+        "number of compression threads (0 = one per CPU)")
     ("continue-on-error",
         po::value<bool>(&continue_on_error)->zero_tokens(),
         "continue if errors are encountered")
@@ -174,6 +183,33 @@ int dwarfsextract_main(int argc, sys_char** argv, iolayer const& iol) {
     filesystem_v2 fs(lgr, *iol.os, iol.os->map_file(fs_path), fsopts, perfmon);
     filesystem_extractor fsx(lgr, *iol.os);
 
+    filesystem_extractor_archive_options fsx_archive_opts;
+
+    if (!compression.empty()) {
+      if (format.empty()) {
+        DWARFS_THROW(runtime_error,
+                     "--compression can only be used with --format");
+      }
+
+      std::string_view filter{compression};
+
+      if (auto pos = filter.find(':'); pos != std::string_view::npos) {
+        auto level = folly::tryTo<int>(filter.substr(pos + 1));
+
+        if (!level) {
+          DWARFS_THROW(runtime_error,
+                       fmt::format("invalid compression level: {}",
+                                   filter.substr(pos + 1)));
+        }
+
+        fsx_archive_opts.compression_level = level.value();
+        filter = filter.substr(0, pos);
+      }
+
+      fsx_archive_opts.compression = filter;
+      fsx_archive_opts.compression_threads = compression_threads;
+    }
+
     if (format.empty()) {
       fsx.open_disk(iol.os->canonical(output));
     } else {
@@ -193,9 +229,9 @@ int dwarfsextract_main(int argc, sys_char** argv, iolayer const& iol) {
       }
 
       if (stream) {
-        fsx.open_stream(*stream, format);
+        fsx.open_stream(*stream, format, fsx_archive_opts);
       } else {
-        fsx.open_archive(iol.os->canonical(output), format);
+        fsx.open_archive(iol.os->canonical(output), format, fsx_archive_opts);
       }
     }
 
@@ -22,6 +22,7 @@
 #include <algorithm>
 #include <array>
 #include <cerrno>
+#include <chrono>
 #include <cstdio>
 #include <ctime>
 #include <filesystem>
@@ -62,11 +63,13 @@
 #include "dwarfs/categorizer.h"
 #include "dwarfs/category_parser.h"
 #include "dwarfs/chmod_entry_transformer.h"
+#include "dwarfs/compression_checkpoint.h"
 #include "dwarfs/console_writer.h"
 #include "dwarfs/entry.h"
 #include "dwarfs/error.h"
 #include "dwarfs/file_access.h"
 #include "dwarfs/filesystem_block_category_resolver.h"
+#include "dwarfs/filesystem_merger.h"
 #include "dwarfs/filesystem_v2.h"
 #include "dwarfs/filesystem_writer.h"
 #include "dwarfs/filter_debug.h"
@@ -375,19 +378,23 @@ int mkdwarfs_main(int argc, sys_char** argv, iolayer const& iol) {
   static constexpr size_t const kDefaultBloomFilterSize{4};
 
   segmenter_factory::config sf_config;
-  sys_string path_str, input_list_str, output_str, header_str;
+  sys_string path_str, input_list_str, output_str, header_str,
+      stage_events_str;
   std::string memory_limit, script_arg, schema_compression,
       metadata_compression, timestamp, time_resolution, progress_mode,
       recompress_opts, pack_metadata, file_hash_algo, debug_filter,
       max_similarity_size, chmod_str, history_compression,
-      recompress_categories;
+      recompress_categories, chunk_index, partition_str;
   std::vector<sys_string> filter;
+  std::vector<sys_string> merge_inputs;
   std::vector<std::string> order, max_lookback_blocks, window_size, window_step,
       bloom_filter_size, compression;
   size_t num_workers, num_scanner_workers, num_segmenter_workers;
   bool no_progress = false, remove_header = false, no_section_index = false,
        force_overwrite = false, no_history = false,
-       no_history_timestamps = false, no_history_command_line = false;
+       no_history_timestamps = false, no_history_command_line = false,
+       parallel_block_compression = false, use_checkpoint = false,
+       resume = false, merge_dedupe = false;
   unsigned level;
   int compress_niceness;
   uint16_t uid, gid;
@@ -457,6 +464,12 @@ int mkdwarfs_main(int argc, sys_char** argv, iolayer const& iol) {
     ("force,f",
         po::value<bool>(&force_overwrite)->zero_tokens(),
         "force overwrite of existing output image")
+    ("checkpoint",
+        po::value<bool>(&use_checkpoint)->zero_tokens(),
+        "keep a checkpoint index to allow resuming")
+    ("resume",
+        po::value<bool>(&resume)->zero_tokens(),
+        "resume an interrupted build from its checkpoint")
     ("compress-level,l",
         po::value<unsigned>(&level)->default_value(default_level),
         "compression level (0=fast, 9=best, please see man page for details)")
@@ -479,6 +492,9 @@ int mkdwarfs_main(int argc, sys_char** argv, iolayer const& iol) {
     ("compress-niceness",
         po::value<int>(&compress_niceness)->default_value(5),
         "compression worker threads niceness")
+    ("parallel-block-compression",
+        po::value<bool>(&parallel_block_compression)->zero_tokens(),
+        "use idle compression workers to compress individual blocks")
     ("num-scanner-workers",
         po::value<size_t>(&num_scanner_workers)
           ->value_name(dep_def_val("num-workers")),
@@ -496,6 +512,15 @@ int mkdwarfs_main(int argc, sys_char** argv, iolayer const& iol) {
     ("recompress-categories",
         po::value<std::string>(&recompress_categories),
         "only recompress blocks of these categories")
+    ("partition",
+        po::value<std::string>(&partition_str),
+        "only build partition K of N (K/N) for a distributed build")
+    ("merge",
+        po_sys_value<std::vector<sys_string>>(&merge_inputs)->multitoken(),
+        "merge filesystems into one without recompressing")
+    ("merge-dedupe",
+        po::value<bool>(&merge_dedupe)->zero_tokens(),
+        "deduplicate identical files when merging")
     ("categorize",
         po::value<categorize_optval>(&categorizer_list)
           ->implicit_value(categorize_optval("fits,pcmaudio,incompressible")),
@@ -517,6 +542,9 @@ int mkdwarfs_main(int argc, sys_char** argv, iolayer const& iol) {
     ("no-progress",
         po::value<bool>(&no_progress)->zero_tokens(),
         "don't show progress")
+    ("stage-events",
+        po_sys_value<sys_string>(&stage_events_str),
+        "write machine-readable pipeline stage events to this file")
     ;
 
   po::options_description filesystem_opts("File system options");
@@ -635,6 +663,10 @@ int mkdwarfs_main(int argc, sys_char** argv, iolayer const& iol) {
         "pack certain metadata elements (auto, all, none, chunk_table, "
         "directories, shared_files, names, names_index, symlinks, "
         "symlinks_index, force, plain)")
+    ("chunk-index",
+        po::value<std::string>(&chunk_index)->default_value("none"),
+        "index chunk offsets of files with at least this many chunks "
+        "(none, MINCHUNKS[:INTERVAL])")
     ;
   // clang-format on
 
@@ -752,7 +784,8 @@ int mkdwarfs_main(int argc, sys_char** argv, iolayer const& iol) {
     return 0;
   }
 
-  if (vm.count("help") or !(vm.count("input") or vm.count("input-list")) or
+  if (vm.count("help") or
+      !(vm.count("input") or vm.count("input-list") or vm.count("merge")) or
       (!vm.count("output") and !vm.count("debug-filter"))) {
     iol.out << tool_header("mkdwarfs")
             << library_dependencies::common_as_string() << "\n\n"
@@ -794,6 +827,13 @@ int mkdwarfs_main(int argc, sys_char** argv, iolayer const& iol) {
     return 1;
   }
 
+  bool const merge = vm.count("merge") > 0;
+
+  if (merge && (vm.count("input") || vm.count("input-list"))) {
+    iol.err << "error: cannot combine --merge with --input or --input-list\n";
+    return 1;
+  }
+
   std::filesystem::path path(path_str);
   std::optional<std::vector<std::filesystem::path>> input_list;
 
@@ -838,10 +878,65 @@ int mkdwarfs_main(int argc, sys_char** argv, iolayer const& iol) {
     }
   }
 
-  path = iol.os->canonical(path);
+  if (!merge) {
+    path = iol.os->canonical(path);
+  }
 
   bool recompress = vm.count("recompress");
   rewrite_options rw_opts;
+
+  if (merge && recompress) {
+    iol.err << "error: cannot combine --merge and --recompress\n";
+    return 1;
+  }
+
+  if (!partition_str.empty()) {
+    if (merge || recompress) {
+      iol.err << "error: --partition cannot be used with --merge or "
+                 "--recompress\n";
+      return 1;
+    }
+
+    std::string_view index_str, count_str;
+    std::optional<size_t> index, count;
+
+    if (folly::split('/', partition_str, index_str, count_str)) {
+      if (auto v = folly::tryTo<size_t>(index_str)) {
+        index = *v;
+      }
+      if (auto v = folly::tryTo<size_t>(count_str)) {
+        count = *v;
+      }
+    }
+
+    if (!index || !count || *index < 1 || *index > *count) {
+      iol.err << "error: invalid partition '" << partition_str
+              << "', expected K/N with 1 <= K <= N\n";
+      return 1;
+    }
+
+    options.partition_index = *index - 1;
+    options.partition_count = *count;
+  }
+
+  if (resume) {
+    use_checkpoint = true;
+  }
+
+  if (use_checkpoint) {
+    if (recompress) {
+      iol.err << "error: --checkpoint and --resume cannot be used with "
+                 "--recompress\n";
+      return 1;
+    }
+
+    if (std::filesystem::path(output_str) == "-") {
+      iol.err << "error: --checkpoint and --resume cannot be used when "
+                 "writing to stdout\n";
+      return 1;
+    }
+  }
+
   if (recompress) {
     std::unordered_map<std::string, unsigned> const modes{
         {"all", 3},
@@ -879,6 +974,22 @@ int mkdwarfs_main(int argc, sys_char** argv, iolayer const& iol) {
     return 1;
   }
 
+  merge_options merge_opts;
+
+  if (merge_dedupe) {
+    if (!merge) {
+      iol.err << "error: --merge-dedupe can only be used with --merge\n";
+      return 1;
+    }
+
+    if (!options.file_hash_algorithm) {
+      iol.err << "error: --merge-dedupe requires a file hash function\n";
+      return 1;
+    }
+
+    merge_opts.deduplicate = true;
+  }
+
   if (vm.count("max-similarity-size")) {
     auto size = parse_size_with_unit(max_similarity_size);
     if (size > 0) {
@@ -927,7 +1038,8 @@ int mkdwarfs_main(int argc, sys_char** argv, iolayer const& iol) {
 
   console_writer lgr(
       iol.term, iol.err, pg_mode,
-      recompress ? console_writer::REWRITE : console_writer::NORMAL, logopts);
+      recompress || merge ? console_writer::REWRITE : console_writer::NORMAL,
+      logopts);
 
   std::shared_ptr<script> script;
 
@@ -1062,6 +1174,24 @@ int mkdwarfs_main(int argc, sys_char** argv, iolayer const& iol) {
     }
   }
 
+  if (!chunk_index.empty() and chunk_index != "none") {
+    std::vector<std::string_view> parts;
+    folly::split(':', chunk_index, parts);
+
+    auto min_chunks = folly::tryTo<size_t>(parts[0]);
+    auto interval = parts.size() > 1 ? folly::tryTo<size_t>(parts[1])
+                                     : options.chunk_index_interval;
+
+    if (parts.size() > 2 || !min_chunks || !interval || *min_chunks == 0 ||
+        *interval == 0) {
+      iol.err << "error: invalid chunk index '" << chunk_index << "'\n";
+      return 1;
+    }
+
+    options.chunk_index_min_chunks = *min_chunks;
+    options.chunk_index_interval = *interval;
+  }
+
   unsigned interval_ms =
       pg_mode == console_writer::NONE || pg_mode == console_writer::SIMPLE
           ? 2000
@@ -1072,6 +1202,7 @@ int mkdwarfs_main(int argc, sys_char** argv, iolayer const& iol) {
   fswopts.worst_case_block_size = UINT64_C(1) << sf_config.block_size_bits;
   fswopts.remove_header = remove_header;
   fswopts.no_section_index = no_section_index;
+  fswopts.parallel_block_compression = parallel_block_compression;
 
   std::unique_ptr<input_stream> header_ifs;
 
@@ -1096,8 +1227,35 @@ int mkdwarfs_main(int argc, sys_char** argv, iolayer const& iol) {
     updater = [&](progress& p, bool last) { lgr.update(p, last); };
   }
 
+  std::unique_ptr<output_stream> stage_events;
+
+  if (!stage_events_str.empty()) {
+    std::filesystem::path stage_events_path(stage_events_str);
+    std::error_code ec;
+    stage_events = iol.file->open_output(stage_events_path, ec);
+    if (ec) {
+      LOG_ERROR << "cannot open stage events file '" << stage_events_path
+                << "': " << ec.message();
+      return 1;
+    }
+  }
+
   progress prog(std::move(updater), interval_ms);
 
+  if (stage_events) {
+    // One JSON object per line, flushed immediately so consumers can
+    // follow the stages as they happen
+    prog.set_stage_function([&os = stage_events->os(),
+                             start = std::chrono::steady_clock::now()](
+                                std::string_view name) {
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+      os << fmt::format("{{\"stage\":\"{}\",\"elapsed_s\":{}}}\n", name,
+                        elapsed.count())
+         << std::flush;
+    });
+  }
+
   // No more streaming to iol.err after this point as this would
   // cause a race with the progress thread.
 
@@ -1114,17 +1272,46 @@ int mkdwarfs_main(int argc, sys_char** argv, iolayer const& iol) {
 
   std::filesystem::path output(output_str);
 
+  std::shared_ptr<compression_checkpoint> checkpoint;
+
   std::variant<std::monostate, std::unique_ptr<output_stream>,
                std::ostringstream>
       os;
 
   if (!options.debug_filter_function) {
     if (output != "-") {
-      if (iol.file->exists(output) && !force_overwrite) {
+      if (iol.file->exists(output) && !force_overwrite && !resume) {
         LOG_ERROR << "output file already exists, use --force to overwrite";
         return 1;
       }
 
+      if (use_checkpoint) {
+        // This must happen before the output is opened, as resuming reads
+        // the blocks back from the partial image.
+        try {
+          // Only resume from a checkpoint that was created for the same
+          // input; the blocks themselves are identified by their contents.
+          auto const st = iol.os->symlink_info(path);
+          auto source = fmt::format("{}\n{}\n{}", path.string(), st.size,
+                                    st.mtime);
+
+          if (input_list) {
+            for (auto const& p : *input_list) {
+              source += '\n';
+              source += p.string();
+            }
+          }
+
+          checkpoint = std::make_shared<compression_checkpoint>(
+              lgr, *iol.file, output, source, resume);
+        } catch (std::exception const& e) {
+          LOG_ERROR << e.what();
+          return 1;
+        }
+
+        fswopts.checkpoint = checkpoint;
+      }
+
       std::error_code ec;
       auto stream = iol.file->open_output_binary(output, ec);
 
@@ -1208,6 +1395,58 @@ int mkdwarfs_main(int argc, sys_char** argv, iolayer const& iol) {
     cat_resolver = options.inode.categorizer_mgr;
   }
 
+  std::vector<std::unique_ptr<filesystem_v2>> merge_filesystems;
+  std::vector<std::string> merge_mount_points;
+
+  auto path_exists = [&iol](std::filesystem::path const& path) {
+    try {
+      iol.os->symlink_info(path);
+      return true;
+    } catch (std::exception const&) {
+      return false;
+    }
+  };
+
+  for (auto const& input : merge_inputs) {
+    // An input can be placed below a mount point using `image=path`. As
+    // image names can contain `=` as well, an input is only split if it
+    // doesn't name an existing file, but the part before the `=` does.
+    std::filesystem::path input_path(input);
+    std::string mount_point;
+
+    if (!path_exists(input_path)) {
+      for (auto pos = input.find('='); pos != sys_string::npos;
+           pos = input.find('=', pos + 1)) {
+        if (path_exists(input.substr(0, pos))) {
+          input_path = input.substr(0, pos);
+          mount_point = sys_string_to_string(input.substr(pos + 1));
+          break;
+        }
+      }
+    }
+
+    merge_mount_points.push_back(std::move(mount_point));
+
+    try {
+      filesystem_options fsopts;
+      fsopts.image_offset = filesystem_options::IMAGE_OFFSET_AUTO;
+      auto& fs = merge_filesystems.emplace_back(std::make_unique<filesystem_v2>(
+          lgr, *iol.os, iol.os->map_file(iol.os->canonical(input_path)),
+          fsopts));
+
+      if (auto num_errors = fs->check(filesystem_check_level::CHECKSUM);
+          num_errors != 0) {
+        LOG_ERROR << "input filesystem " << input_path
+                  << " is corrupt: detected " << num_errors << " error(s)";
+        return 1;
+      }
+    } catch (std::exception const& e) {
+      LOG_ERROR << "cannot open input filesystem " << input_path << ": "
+                << folly::exceptionStr(e);
+      return 1;
+    }
+  }
+
   category_parser cp(cat_resolver);
 
   try {
@@ -1340,6 +1579,14 @@ int mkdwarfs_main(int argc, sys_char** argv, iolayer const& iol) {
     if (recompress) {
       input_filesystem->rewrite(prog, *fsw, *cat_resolver, rw_opts);
       wg_compress.wait();
+    } else if (merge) {
+      filesystem_merger merger(lgr, options, merge_opts);
+
+      for (size_t i = 0; i < merge_filesystems.size(); ++i) {
+        merger.add_input(*merge_filesystems[i], merge_mount_points[i]);
+      }
+
+      merger.merge(*fsw, prog);
     } else {
       auto sf = std::make_shared<segmenter_factory>(
           lgr, prog, options.inode.categorizer_mgr, sf_config);
@@ -1387,6 +1634,19 @@ int mkdwarfs_main(int argc, sys_char** argv, iolayer const& iol) {
     }
   }
 
+  if (stage_events) {
+    std::error_code ec;
+    stage_events->close(ec);
+    if (ec) {
+      LOG_WARN << "failed to close stage events file: " << ec.message();
+    }
+  }
+
+  if (checkpoint) {
+    // the image is complete, so the checkpoint is no longer needed
+    checkpoint->remove();
+  }
+
   if (!options.debug_filter_function) {
     std::ostringstream err;
 
@@ -1399,7 +1659,8 @@ int mkdwarfs_main(int argc, sys_char** argv, iolayer const& iol) {
       err << "without errors";
     }
 
-    ti << "filesystem " << (recompress ? "rewritten " : "created ")
+    ti << "filesystem "
+       << (recompress ? "rewritten " : merge ? "merged " : "created ")
        << err.str();
   }
 
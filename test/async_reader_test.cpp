@@ -0,0 +1,327 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <fmt/format.h>
+
+#include "dwarfs/async_reader.h"
+#include "dwarfs/c_api.h"
+#include "dwarfs/filesystem_v2.h"
+#include "dwarfs_tool_main.h"
+
+#include "mmap_mock.h"
+#include "test_helpers.h"
+#include "test_logger.h"
+
+using namespace dwarfs;
+
+namespace {
+
+class async_reader_test : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    os = std::make_shared<test::os_access_mock>();
+    os->add("", {1, 040755, 1, 0, 0, 10, 42, 0, 0, 0});
+
+    std::mt19937_64 rng{42};
+
+    for (size_t i = 0; i < 64; ++i) {
+      auto name = fmt::format("file{}", i);
+      auto data =
+          test::create_random_string(1000 + rng() % 100000, 32, 127, rng);
+      os->add_file(name, data);
+      files[name] = std::move(data);
+    }
+
+    auto fa = std::make_shared<test::test_file_access>();
+    test::test_iolayer iol{os, fa};
+
+    std::vector<std::string> args{"mkdwarfs", "-i", "/", "-o", "-", "-l3",
+                                  "-S16"};
+    ASSERT_EQ(0, mkdwarfs_main(args, iol.get()));
+
+    image = iol.out();
+    fs = filesystem_v2(lgr, *os, std::make_shared<test::mmap_mock>(image));
+  }
+
+  uint32_t open(std::string const& name) {
+    auto iv = fs.find(("/" + name).c_str());
+    EXPECT_TRUE(iv);
+    return fs.open(*iv);
+  }
+
+  test::test_logger lgr;
+  std::shared_ptr<test::os_access_mock> os;
+  std::map<std::string, std::string> files;
+  std::string image;
+  filesystem_v2 fs;
+};
+
+std::string to_string(std::vector<block_range> const& ranges) {
+  std::string rv;
+  for (auto const& r : ranges) {
+    rv.append(reinterpret_cast<char const*>(r.data()), r.size());
+  }
+  return rv;
+}
+
+} // namespace
+
+TEST_F(async_reader_test, queue) {
+  std::atomic<size_t> notified{0};
+  async_reader reader(lgr, *os, fs, {.notify = [&] { ++notified; }});
+
+  std::vector<std::string> names;
+  std::vector<std::string> buffers;
+
+  for (auto const& [name, data] : files) {
+    auto ino = open(name);
+    names.push_back(name);
+    buffers.emplace_back(data.size() / 2, '\0');
+
+    // one request copying the first half, one zero-copy for the rest
+    reader.submit({.inode = ino,
+                   .offset = 0,
+                   .size = buffers.back().size(),
+                   .buffer = buffers.back().data(),
+                   .user_data = 2 * (names.size() - 1)});
+    reader.submit({.inode = ino,
+                   .offset = static_cast<file_off_t>(buffers.back().size()),
+                   .size = data.size(),
+                   .user_data = 2 * (names.size() - 1) + 1});
+  }
+
+  std::vector<async_read_completion> comps;
+
+  while (comps.size() < 2 * files.size()) {
+    reader.wait(comps);
+  }
+
+  EXPECT_EQ(0, reader.in_flight());
+  EXPECT_EQ(0, reader.poll(comps));
+  EXPECT_GT(notified.load(), 0);
+
+  for (auto const& c : comps) {
+    auto const& name = names[c.user_data / 2];
+    auto const& data = files[name];
+    auto half = data.size() / 2;
+
+    if (c.user_data % 2 == 0) {
+      EXPECT_EQ(half, c.result) << name;
+      EXPECT_TRUE(c.ranges.empty()) << name;
+      EXPECT_EQ(data.substr(0, half), buffers[c.user_data / 2]) << name;
+    } else {
+      EXPECT_EQ(data.size() - half, c.result) << name;
+      EXPECT_EQ(data.substr(half), to_string(c.ranges)) << name;
+    }
+  }
+}
+
+TEST_F(async_reader_test, callback_and_errors) {
+  std::mutex mx;
+  std::condition_variable cv;
+  std::vector<async_read_completion> comps;
+
+  {
+    async_reader reader(lgr, *os, fs, {.num_threads = 4});
+
+    auto cb = [&](async_read_completion&& c) {
+      std::lock_guard lock(mx);
+      comps.push_back(std::move(c));
+      cv.notify_all();
+    };
+
+    auto ino = open("file7");
+
+    reader.submit({.inode = ino, .offset = 100, .size = 1000, .user_data = 1},
+                  cb);
+    reader.submit({.inode = ino, .offset = -1, .size = 10, .user_data = 2}, cb);
+    reader.submit({.inode = 1000000, .size = 10, .user_data = 3}, cb);
+
+    std::unique_lock lock(mx);
+    cv.wait(lock, [&] { return comps.size() == 3; });
+  }
+
+  std::sort(comps.begin(), comps.end(),
+            [](auto const& a, auto const& b) {
+              return a.user_data < b.user_data;
+            });
+
+  EXPECT_EQ(files["file7"].substr(100, 1000), to_string(comps[0].ranges));
+  EXPECT_EQ(-EINVAL, comps[1].result);
+  EXPECT_EQ(-EBADF, comps[2].result);
+}
+
+TEST_F(async_reader_test, completes_out_of_order) {
+  // With a single thread, a request whose blocks are all cached must not
+  // get stuck behind earlier requests that are still waiting for blocks
+  async_reader reader(lgr, *os, fs, {.num_threads = 1});
+
+  auto const& cached = files["file0"];
+  std::string buf(cached.size(), '\0');
+  ASSERT_EQ(cached.size(),
+            fs.read(open("file0"), buf.data(), buf.size(), file_off_t{0}));
+
+  uint64_t id = 0;
+
+  for (auto const& [name, data] : files) {
+    if (name != "file0") {
+      reader.submit(
+          {.inode = open(name), .size = data.size(), .user_data = ++id});
+    }
+  }
+
+  reader.submit({.inode = open("file0"), .size = cached.size()});
+
+  std::vector<async_read_completion> comps;
+
+  while (comps.size() < files.size()) {
+    reader.wait(comps);
+  }
+
+  auto it = std::find_if(comps.begin(), comps.end(),
+                         [](auto const& c) { return c.user_data == 0; });
+
+  ASSERT_NE(comps.end(), it);
+  EXPECT_NE(comps.size() - 1, std::distance(comps.begin(), it));
+  EXPECT_EQ(cached, to_string(it->ranges));
+}
+
+TEST_F(async_reader_test, wait_timeout) {
+  async_reader reader(lgr, *os, fs);
+  std::vector<async_read_completion> comps;
+
+  // nothing in flight, so this must not block
+  EXPECT_EQ(0, reader.wait(comps, 10));
+  EXPECT_EQ(0, reader.wait(comps, 1, 1, std::chrono::milliseconds(1)));
+}
+
+TEST_F(async_reader_test, c_api) {
+  auto path = std::filesystem::temp_directory_path() /
+              fmt::format("dwarfs_async_reader_test_{}.dwarfs",
+                          std::random_device{}());
+
+  {
+    std::ofstream ofs(path, std::ios::binary);
+    ofs.write(image.data(), image.size());
+  }
+
+  dwarfs_fs* cfs = nullptr;
+  ASSERT_EQ(0, dwarfs_fs_open(path.string().c_str(), nullptr, &cfs))
+      << dwarfs_last_error();
+
+  uint32_t ino;
+  uint64_t size;
+
+  EXPECT_EQ(-ENOENT, dwarfs_fs_open_file(cfs, "/nope", &ino, &size));
+  EXPECT_STRNE("", dwarfs_last_error());
+
+  ASSERT_EQ(0, dwarfs_fs_open_file(cfs, "/file3", &ino, &size));
+  auto const& data = files["file3"];
+  ASSERT_EQ(data.size(), size);
+
+  std::string buf(size, '\0');
+  EXPECT_EQ(size, dwarfs_fs_read(cfs, ino, buf.data(), size, 0));
+  EXPECT_EQ(data, buf);
+
+  dwarfs_reader* reader = nullptr;
+  ASSERT_EQ(0, dwarfs_reader_create(cfs, 0, nullptr, nullptr, &reader));
+
+  std::string half(size / 2, '\0');
+  dwarfs_read_request reqs[2] = {
+      {ino, 0, half.size(), half.data(), 1},
+      {ino, static_cast<int64_t>(half.size()), size, nullptr, 2},
+  };
+
+  ASSERT_EQ(0, dwarfs_reader_submit(reader, reqs, 2));
+
+  std::vector<dwarfs_read_completion> comps(2);
+  size_t count = 0;
+
+  while (count < 2) {
+    count += dwarfs_reader_wait(reader, comps.data() + count, 1, 2 - count, -1);
+  }
+
+  EXPECT_EQ(0, dwarfs_reader_in_flight(reader));
+
+  std::sort(comps.begin(), comps.end(),
+            [](auto const& a, auto const& b) {
+              return a.user_data < b.user_data;
+            });
+
+  EXPECT_EQ(half.size(), comps[0].result);
+  EXPECT_EQ(nullptr, comps[0].buffer);
+  EXPECT_EQ(data.substr(0, half.size()), half);
+
+  std::string rest;
+  for (size_t i = 0; i < comps[1].num_ranges; ++i) {
+    rest.append(static_cast<char const*>(comps[1].ranges[i].data),
+                comps[1].ranges[i].size);
+  }
+  EXPECT_EQ(data.substr(half.size()), rest);
+  dwarfs_buffer_release(comps[1].buffer);
+
+  dwarfs_reader_destroy(reader);
+  dwarfs_fs_close(cfs);
+
+  std::vector<std::pair<dwarfs_log_level, std::string>> messages;
+
+  ASSERT_EQ(0, dwarfs_fs_open_with_log(
+                   path.string().c_str(), nullptr, DWARFS_LOG_DEBUG,
+                   [](dwarfs_log_level level, char const* msg, void* arg) {
+                     static_cast<decltype(messages)*>(arg)->emplace_back(
+                         level, msg);
+                   },
+                   &messages, &cfs))
+      << dwarfs_last_error();
+  dwarfs_fs_close(cfs);
+
+  EXPECT_FALSE(messages.empty());
+  EXPECT_TRUE(std::all_of(messages.begin(), messages.end(), [](auto const& m) {
+    return m.first <= DWARFS_LOG_DEBUG;
+  }));
+
+  ASSERT_EQ(0, dwarfs_fs_open_with_log(path.string().c_str(), nullptr,
+                                       DWARFS_LOG_TRACE, nullptr, nullptr,
+                                       &cfs));
+  dwarfs_fs_close(cfs);
+
+  EXPECT_EQ(-EINVAL, dwarfs_fs_open_with_log(
+                         path.string().c_str(), nullptr,
+                         static_cast<dwarfs_log_level>(42), nullptr, nullptr,
+                         &cfs));
+
+  std::filesystem::remove(path);
+}
@@ -0,0 +1,215 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <fmt/format.h>
+
+#include <folly/String.h>
+#include <folly/json.h>
+
+#include "dwarfs/bcj_filter.h"
+#include "dwarfs/block_compressor.h"
+
+using namespace dwarfs;
+
+namespace {
+
+struct known_value {
+  bcj_architecture arch;
+  std::string_view input;
+  std::string_view encoded;
+};
+
+// generated using the liblzma simple filters
+constexpr known_value const known_values[] = {
+    {bcj_architecture::X86, "90e800000000909090e8f0ffffff9090",
+     "90e806000000909090e8feffffff9090"},
+    {bcj_architecture::ARM, "00000000010000eb00000000fcffffeb",
+     "00000000040000eb00000000010000eb"},
+    {bcj_architecture::ARMTHUMB, "0000000000f000f800000000fff7fef7",
+     "0000000000f004f800000000fff7fef7"},
+    {bcj_architecture::POWERPC, "60000000480000014800fff160000000",
+     "60000000480000054800fff960000000"},
+    {bcj_architecture::SPARC, "01000000400000017fffffff01000000",
+     "01000000400000024000000101000000"},
+};
+
+std::vector<uint8_t> unhex(std::string_view hex) {
+  std::string bin;
+  folly::unhexlify(hex, bin);
+  return {bin.begin(), bin.end()};
+}
+
+std::vector<uint8_t> random_code(size_t size, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<int> byte(0, 255);
+  std::vector<uint8_t> data(size);
+  for (auto& b : data) {
+    b = byte(rng);
+  }
+  return data;
+}
+
+} // namespace
+
+TEST(bcj_filter, architecture_names) {
+  for (auto arch : bcj_architectures()) {
+    auto name = bcj_architecture_name(arch);
+    auto parsed = parse_bcj_architecture(name);
+    ASSERT_TRUE(parsed) << name;
+    EXPECT_EQ(arch, *parsed);
+  }
+
+  EXPECT_FALSE(parse_bcj_architecture("riscv"));
+  EXPECT_FALSE(parse_bcj_architecture(""));
+}
+
+TEST(bcj_filter, known_values) {
+  for (auto const& kv : known_values) {
+    auto data = unhex(kv.input);
+    auto expected = unhex(kv.encoded);
+
+    bcj_encode(kv.arch, data);
+    EXPECT_EQ(expected, data) << kv.arch;
+
+    bcj_decode(kv.arch, data);
+    EXPECT_EQ(unhex(kv.input), data) << kv.arch;
+  }
+}
+
+class bcj_filter_test : public testing::TestWithParam<bcj_architecture> {};
+
+TEST_P(bcj_filter_test, roundtrip) {
+  auto arch = GetParam();
+
+  for (size_t size : {0, 1, 3, 4, 5, 15, 16, 17, 1000, 65537}) {
+    auto const orig = random_code(size, size);
+    auto data = orig;
+
+    bcj_encode(arch, data);
+
+    if (size > 65536) {
+      EXPECT_NE(orig, data) << arch << ", " << size;
+    }
+
+    bcj_decode(arch, data);
+
+    EXPECT_EQ(orig, data) << arch << ", " << size;
+  }
+}
+
+TEST_P(bcj_filter_test, compressor_roundtrip) {
+  auto arch = GetParam();
+  auto name = std::string(bcj_architecture_name(arch));
+
+  // repetitive code with calls, so the data compresses well
+  auto const chunk = random_code(256, 42);
+  std::vector<uint8_t> data;
+  for (int i = 0; i < 64; ++i) {
+    data.insert(data.end(), chunk.begin(), chunk.end());
+  }
+
+  for (auto const& spec :
+       {fmt::format("bcj:arch={}", name), std::string("bcj:arch=auto")}) {
+    block_compressor bc(spec);
+    std::string metadata =
+        folly::toJson(folly::dynamic::object("architecture", name));
+
+    EXPECT_EQ(compression_type::BCJ, bc.type());
+
+    auto compressed = bc.compress(data, metadata);
+
+    EXPECT_LT(compressed.size(), data.size());
+
+    std::vector<uint8_t> decompressed;
+    block_decompressor bd(compression_type::BCJ, compressed.data(),
+                          compressed.size(), decompressed);
+
+    EXPECT_EQ(data.size(), bd.uncompressed_size());
+
+    auto meta = bd.metadata();
+    ASSERT_TRUE(meta);
+    EXPECT_EQ(name, folly::parseJson(*meta)["architecture"].asString());
+
+    bd.decompress_frame(bd.uncompressed_size());
+
+    EXPECT_EQ(data, decompressed) << spec;
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(dwarfs, bcj_filter_test,
+                         testing::ValuesIn(bcj_architectures()));
+
+TEST(bcj_compressor, compress_append) {
+  auto const chunk = random_code(256, 42);
+  std::vector<uint8_t> data;
+  for (int i = 0; i < 64; ++i) {
+    data.insert(data.end(), chunk.begin(), chunk.end());
+  }
+
+  block_compressor bc("bcj:arch=x86");
+  std::string metadata =
+      folly::toJson(folly::dynamic::object("architecture", "x86"));
+  auto const expected = bc.compress(data, metadata);
+
+  std::vector<uint8_t> target{1, 2, 3};
+  bc.compress_append(data, target, &metadata, 1);
+
+  ASSERT_EQ(expected.size() + 3, target.size());
+  EXPECT_EQ(1, target[0]);
+  EXPECT_EQ(2, target[1]);
+  EXPECT_EQ(3, target[2]);
+  EXPECT_TRUE(std::equal(expected.begin(), expected.end(), target.begin() + 3));
+
+  // compress() replaces the previous contents
+  bc.compress(data, target, &metadata);
+  EXPECT_EQ(expected, target);
+}
+
+TEST(bcj_compressor, requirements) {
+  {
+    block_compressor bc("bcj");
+    auto req = folly::parseJson(bc.metadata_requirements());
+    ASSERT_TRUE(req.count("architecture"));
+    EXPECT_EQ("set", req["architecture"][0].asString());
+    EXPECT_EQ(bcj_architectures().size(), req["architecture"][1].size());
+  }
+
+  {
+    block_compressor bc("bcj:arch=arm64");
+    EXPECT_TRUE(bc.metadata_requirements().empty());
+  }
+
+  EXPECT_THROW(block_compressor("bcj:arch=riscv"), std::exception);
+  EXPECT_THROW(block_compressor("bcj:compression=bcj"), std::exception);
+
+  {
+    block_compressor bc("bcj");
+    std::vector<uint8_t> data(1024, 0);
+    EXPECT_THROW(bc.compress(data), std::exception);
+  }
+}
@@ -0,0 +1,221 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <boost/program_options.hpp>
+
+#include <folly/json.h>
+
+#include "dwarfs/categorizer.h"
+
+#include "test_logger.h"
+
+using namespace dwarfs;
+
+namespace fs = std::filesystem;
+namespace po = boost::program_options;
+
+namespace {
+
+template <typename T>
+void put(std::vector<uint8_t>& data, size_t offset, T value) {
+  std::memcpy(data.data() + offset, &value, sizeof(value));
+}
+
+// A minimal little-endian ELF64 file with a single code section
+std::vector<uint8_t>
+make_elf64(uint16_t machine, size_t text_offset, size_t text_size) {
+  size_t const shoff = text_offset + text_size + 1000;
+  std::vector<uint8_t> data(shoff + 2 * 64, 0x55);
+
+  std::memset(data.data(), 0, 64);
+  std::memcpy(data.data(), "\177ELF", 4);
+  data[4] = 2; // ELFCLASS64
+  data[5] = 1; // ELFDATA2LSB
+  data[6] = 1; // EV_CURRENT
+  put<uint16_t>(data, 16, 2);     // ET_EXEC
+  put<uint16_t>(data, 18, machine);
+  put<uint64_t>(data, 40, shoff);
+  put<uint16_t>(data, 58, 64); // e_shentsize
+  put<uint16_t>(data, 60, 2);  // e_shnum
+
+  auto sh = shoff;
+  std::memset(data.data() + sh, 0, 2 * 64);
+  sh += 64;
+  put<uint32_t>(data, sh + 4, 1);   // SHT_PROGBITS
+  put<uint64_t>(data, sh + 8, 0x6); // SHF_ALLOC | SHF_EXECINSTR
+  put<uint64_t>(data, sh + 24, text_offset);
+  put<uint64_t>(data, sh + 32, text_size);
+
+  return data;
+}
+
+// A minimal PE file with a single code section
+std::vector<uint8_t>
+make_pe(uint16_t machine, size_t text_offset, size_t text_size) {
+  std::vector<uint8_t> data(text_offset + text_size + 512, 0x55);
+  size_t const pe = 0x80;
+
+  std::memset(data.data(), 0, text_offset);
+  data[0] = 'M';
+  data[1] = 'Z';
+  put<uint32_t>(data, 0x3c, pe);
+  std::memcpy(data.data() + pe, "PE\0\0", 4);
+  put<uint16_t>(data, pe + 4, machine);
+  put<uint16_t>(data, pe + 6, 1);  // NumberOfSections
+  put<uint16_t>(data, pe + 20, 0); // SizeOfOptionalHeader
+
+  auto sh = pe + 24;
+  std::memcpy(data.data() + sh, ".text\0\0\0", 8);
+  put<uint32_t>(data, sh + 16, text_size);
+  put<uint32_t>(data, sh + 20, text_offset);
+  put<uint32_t>(data, sh + 36, 0x60000020);
+
+  return data;
+}
+
+} // namespace
+
+class binary_categorizer : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    lgr.clear();
+
+    auto& catreg = categorizer_registry::instance();
+
+    po::options_description opts;
+    catreg.add_options(opts);
+
+    po::variables_map vm;
+    catmgr = std::make_shared<categorizer_manager>(lgr);
+    catmgr->add(catreg.create(lgr, "binary", vm));
+
+    code_category = catmgr->category_value("binary/code").value();
+    data_category = catmgr->category_value("binary/data").value();
+  }
+
+  auto categorize(fs::path const& path, std::span<uint8_t const> data) {
+    auto job = catmgr->job(path);
+    job.set_total_size(data.size());
+    job.categorize_random_access(data);
+    return job.result();
+  }
+
+  std::string architecture(fragment_category cat) const {
+    auto meta = folly::parseJson(catmgr->category_metadata(cat));
+    return meta["architecture"].asString();
+  }
+
+  std::shared_ptr<categorizer_manager> catmgr;
+  test::test_logger lgr{logger::INFO};
+  fragment_category::value_type code_category;
+  fragment_category::value_type data_category;
+};
+
+TEST_F(binary_categorizer, elf) {
+  auto data = make_elf64(62, 4096, 8192);
+  auto frag = categorize("elf", data);
+  auto fs = frag.span();
+
+  ASSERT_EQ(3, fs.size());
+  EXPECT_EQ(data_category, fs[0].category().value());
+  EXPECT_EQ(4096, fs[0].size());
+  EXPECT_EQ(code_category, fs[1].category().value());
+  EXPECT_EQ(8192, fs[1].size());
+  EXPECT_EQ(data_category, fs[2].category().value());
+  EXPECT_EQ(data.size() - 4096 - 8192, fs[2].size());
+  EXPECT_EQ("x86", architecture(fs[1].category()));
+}
+
+TEST_F(binary_categorizer, pe) {
+  auto data = make_pe(0xaa64, 1024, 6144);
+  auto frag = categorize("pe.exe", data);
+  auto fs = frag.span();
+
+  ASSERT_EQ(3, fs.size());
+  EXPECT_EQ(data_category, fs[0].category().value());
+  EXPECT_EQ(1024, fs[0].size());
+  EXPECT_EQ(code_category, fs[1].category().value());
+  EXPECT_EQ(6144, fs[1].size());
+  EXPECT_EQ(data_category, fs[2].category().value());
+  EXPECT_EQ(512, fs[2].size());
+  EXPECT_EQ("arm64", architecture(fs[1].category()));
+}
+
+TEST_F(binary_categorizer, distinct_architectures) {
+  auto x86 = make_elf64(62, 4096, 8192);
+  auto arm64 = make_elf64(183, 4096, 8192);
+
+  auto f1 = categorize("x86", x86);
+  auto f2 = categorize("arm64", arm64);
+
+  ASSERT_EQ(3, f1.span().size());
+  ASSERT_EQ(3, f2.span().size());
+
+  EXPECT_NE(f1.span()[1].category(), f2.span()[1].category());
+  EXPECT_EQ("arm64", architecture(f2.span()[1].category()));
+}
+
+TEST_F(binary_categorizer, not_categorized) {
+  // not an executable
+  {
+    std::vector<uint8_t> data(16384, 0x7f);
+    EXPECT_TRUE(categorize("data", data).empty());
+  }
+
+  // code section too small
+  {
+    auto data = make_elf64(62, 4096, 100);
+    EXPECT_TRUE(categorize("tiny", data).empty());
+  }
+
+  // truncated section headers
+  {
+    auto data = make_elf64(62, 4096, 8192);
+    data.resize(data.size() - 32);
+    EXPECT_TRUE(categorize("truncated", data).empty());
+  }
+}
+
+TEST_F(binary_categorizer, requirements) {
+  catmgr->set_metadata_requirements(
+      code_category, R"({"architecture": ["set", ["arm64"]]})");
+
+  auto x86 = make_elf64(62, 4096, 8192);
+  auto arm64 = make_elf64(183, 4096, 8192);
+
+  EXPECT_TRUE(categorize("x86", x86).empty());
+  EXPECT_EQ(3, categorize("arm64", arm64).span().size());
+
+  EXPECT_THAT(
+      [&] {
+        catmgr->set_metadata_requirements(code_category,
+                                          R"({"foo": ["set", ["bar"]]})");
+      },
+      ::testing::ThrowsMessage<std::runtime_error>(
+          "unsupported metadata requirements: foo"));
+}
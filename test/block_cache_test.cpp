@@ -21,21 +21,37 @@
 
 #include <algorithm>
 #include <array>
+#include <chrono>
+#include <cstring>
+#include <map>
 #include <numeric>
 #include <optional>
 #include <random>
 #include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
 #include <vector>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <fmt/format.h>
+
+#include <folly/CancellationToken.h>
 #include <folly/container/Enumerate.h>
 
+#include "dwarfs/block_cache.h"
 #include "dwarfs/block_range.h"
+#include "dwarfs/block_reader.h"
 #include "dwarfs/cached_block.h"
 #include "dwarfs/error.h"
+#include "dwarfs/file_stat.h"
 #include "dwarfs/filesystem_v2.h"
+#include "dwarfs/fs_section.h"
+#include "dwarfs/fstypes.h"
+#include "dwarfs/options.h"
 #include "dwarfs_tool_main.h"
 
 #include "mmap_mock.h"
@@ -70,6 +86,15 @@ class mock_cached_block : public cached_block {
   std::optional<std::span<uint8_t const>> span_;
 };
 
+size_t get_log_counter(test::test_logger const& lgr, std::string_view prefix) {
+  for (auto const& e : lgr.get_log()) {
+    if (e.output.starts_with(prefix)) {
+      return std::stoul(e.output.substr(prefix.size()));
+    }
+  }
+  return 0;
+}
+
 } // namespace
 
 TEST(block_range, uncompressed) {
@@ -140,6 +165,10 @@ TEST_P(options_test, cache_stress) {
 
   auto os = std::make_shared<test::os_access_mock>();
 
+  if (cache_opts.numa_aware) {
+    os->set_numa_node_cpus({{0, 1}, {}, {2, 3}});
+  }
+
   {
     static constexpr size_t const num_files{256};
     static constexpr size_t const avg_size{5000};
@@ -180,6 +209,7 @@ TEST_P(options_test, cache_stress) {
   test::test_logger lgr(logger::TRACE);
   filesystem_options opts{
       .block_cache = cache_opts,
+      .inode_reader = {.readahead = 16 * 1024},
   };
   filesystem_v2 fs(lgr, *os, mm, opts);
 
@@ -249,7 +279,13 @@ TEST_P(options_test, cache_stress) {
   for (auto const& [i, reqs] : folly::enumerate(data)) {
     auto& succ = success[i];
     // TODO: preqs is a workaround for older Clang versions
-    threads.emplace_back([&, preqs = &reqs] {
+    threads.emplace_back([&, i, preqs = &reqs] {
+      if (cache_opts.numa_aware) {
+        std::vector<int> cpus{i % 2 == 0 ? 0 : 2};
+        std::error_code ec;
+        os->thread_set_affinity(std::this_thread::get_id(), cpus, ec);
+      }
+
       for (auto const& req : *preqs) {
         auto fh = fs.open(req.inode);
         auto range = fs.readv(fh, req.size, req.offset);
@@ -298,9 +334,506 @@ constexpr std::array const cache_options{
                         .num_workers = 4,
                         .mm_release = false,
                         .disable_block_integrity_check = true},
+    block_cache_options{.max_bytes = 256 * 1024,
+                        .num_workers = 2,
+                        .sequential_access_detector_threshold = 2},
+    block_cache_options{.max_bytes = 256 * 1024,
+                        .num_workers = 1,
+                        .sequential_access_detector_threshold = 2,
+                        .max_queued_speculative_requests = 1},
+    block_cache_options{.max_bytes = 256 * 1024,
+                        .num_workers = 3,
+                        .max_queued_speculative_requests = 0},
+    block_cache_options{
+        .max_bytes = 256 * 1024, .num_workers = 4, .numa_aware = true},
+    block_cache_options{.max_bytes = 256 * 1024,
+                        .num_workers = 0,
+                        .sequential_access_detector_threshold = 2,
+                        .numa_aware = true},
+    block_cache_options{
+        .max_bytes = 256 * 1024,
+        .num_workers = 3,
+        .replacement_policy = cache_replacement_policy::W_TINYLFU},
+    block_cache_options{.max_bytes = 256 * 1024,
+                        .num_workers = 3,
+                        .replacement_policy = cache_replacement_policy::ARC},
+    block_cache_options{
+        .max_bytes = 1024 * 1024,
+        .num_workers = 4,
+        .numa_aware = true,
+        .replacement_policy = cache_replacement_policy::W_TINYLFU},
+    block_cache_options{.max_bytes = 256 * 1024,
+                        .num_workers = 3,
+                        .range_cache_max_bytes = 64 * 1024},
+    block_cache_options{.max_bytes = 256 * 1024,
+                        .num_workers = 0,
+                        .decompress_ratio = 0.5,
+                        .range_cache_max_bytes = 16 * 1024,
+                        .range_cache_max_extent = 1024},
+    block_cache_options{.max_bytes = 256 * 1024,
+                        .num_workers = 3,
+                        .io_mode = block_io_mode::PREAD},
+    block_cache_options{.max_bytes = 256 * 1024,
+                        .num_workers = 4,
+                        .sequential_access_detector_threshold = 2,
+                        .io_mode = block_io_mode::PREAD,
+                        .io_max_request_size = 100 * 1024},
 };
 
 }
 
 INSTANTIATE_TEST_SUITE_P(block_cache, options_test,
                          ::testing::ValuesIn(cache_options));
+
+TEST(block_cache, numa_workers) {
+  auto os = std::make_shared<test::os_access_mock>();
+  os->set_numa_node_cpus({{0, 1}, {}, {2, 3, 4}});
+
+  std::shared_ptr<mmif> mm;
+
+  {
+    auto fa = std::make_shared<test::test_file_access>();
+    test::test_iolayer iol{os, fa};
+    os->add("", {1, 040755, 1, 0, 0, 10, 42, 0, 0, 0});
+    os->add_file("foo", 10000, true);
+    std::vector<std::string> args{"mkdwarfs", "-i", "/", "-o", "-"};
+    EXPECT_EQ(0, mkdwarfs_main(args, iol.get()));
+    mm = std::make_shared<test::mmap_mock>(iol.out());
+  }
+
+  test::test_logger lgr;
+
+  auto count_pinned = [&](std::vector<int> const& cpus) {
+    return std::count_if(
+        os->set_affinity_calls.begin(), os->set_affinity_calls.end(),
+        [&](auto const& call) { return std::get<1>(call) == cpus; });
+  };
+
+  {
+    os->set_affinity_calls.clear();
+    filesystem_v2 fs(lgr, *os, mm,
+                     {.block_cache = {.num_workers = 4, .numa_aware = true}});
+    EXPECT_EQ(2, count_pinned({0, 1}));
+    EXPECT_EQ(2, count_pinned({2, 3, 4}));
+
+    // one worker per CPU if no number of workers is given
+    os->set_affinity_calls.clear();
+    fs.set_num_workers(0);
+    EXPECT_EQ(2, count_pinned({0, 1}));
+    EXPECT_EQ(3, count_pinned({2, 3, 4}));
+
+    auto iv = fs.find("/foo");
+    ASSERT_TRUE(iv);
+    auto fh = fs.open(*iv);
+    std::vector<char> buf(10000);
+    EXPECT_EQ(10000, fs.read(fh, buf.data(), buf.size(), 0));
+  }
+
+  {
+    os->set_affinity_calls.clear();
+    filesystem_v2 fs(lgr, *os, mm, {.block_cache = {.num_workers = 4}});
+    EXPECT_EQ(0, os->set_affinity_calls.size());
+  }
+
+  {
+    os->set_numa_node_cpus({{0, 1, 2, 3}});
+    os->set_affinity_calls.clear();
+    filesystem_v2 fs(lgr, *os, mm,
+                     {.block_cache = {.num_workers = 4, .numa_aware = true}});
+    EXPECT_EQ(0, os->set_affinity_calls.size());
+  }
+}
+
+TEST(block_cache, pin_paths) {
+  auto os = std::make_shared<test::os_access_mock>();
+
+  std::shared_ptr<mmif> mm;
+
+  {
+    auto fa = std::make_shared<test::test_file_access>();
+    test::test_iolayer iol{os, fa};
+    os->add("", {1, 040755, 1, 0, 0, 10, 42, 0, 0, 0});
+    os->add("lib", {2, 040755, 1, 0, 0, 10, 42, 0, 0, 0});
+    os->add_file("lib/libfoo.so.1", 100000, true);
+    os->add_file("lib/libbar.so.2", 100000, true);
+    os->add_file("data", 200000, true);
+    std::vector<std::string> args{"mkdwarfs", "-i", "/",  "-o",
+                                  "-",        "-S", "14"};
+    EXPECT_EQ(0, mkdwarfs_main(args, iol.get()));
+    mm = std::make_shared<test::mmap_mock>(iol.out());
+  }
+
+  test::test_logger lgr;
+
+  auto read_all = [](filesystem_v2& fs, char const* path) {
+    auto iv = fs.find(path);
+    EXPECT_TRUE(iv);
+    file_stat st;
+    EXPECT_EQ(0, fs.getattr(*iv, &st));
+    std::string buf(st.size, '\0');
+    auto fh = fs.open(*iv);
+    EXPECT_EQ(static_cast<ssize_t>(buf.size()),
+              fs.read(fh, buf.data(), buf.size(), 0));
+    return buf;
+  };
+
+  std::string lib, data;
+
+  {
+    filesystem_v2 fs(lgr, *os, mm, {.block_cache = {.num_workers = 2}});
+    lib = read_all(fs, "/lib/libfoo.so.1");
+    data = read_all(fs, "/data");
+  }
+
+  {
+    filesystem_v2 fs(lgr, *os, mm,
+                     {.block_cache = {.max_bytes = 1 << 14, .num_workers = 2}});
+
+    EXPECT_EQ(0, fs.pin_paths({"nomatch/**"}));
+
+    auto pinned = fs.pin_paths({"/lib/*.so*"});
+    EXPECT_GE(pinned, 12);
+    EXPECT_LT(pinned, fs.num_blocks());
+
+    // pinning blocks that are already pinned is harmless
+    EXPECT_EQ(pinned, fs.pin_paths({"lib/libfoo.so.1", "lib/libbar.so.2"}));
+
+    for (int i = 0; i < 3; ++i) {
+      EXPECT_EQ(lib, read_all(fs, "/lib/libfoo.so.1"));
+      EXPECT_EQ(data, read_all(fs, "/data"));
+    }
+  }
+}
+
+TEST(block_cache, tree_scan) {
+  auto os = std::make_shared<test::os_access_mock>();
+
+  std::shared_ptr<mmif> mm;
+  std::map<std::string, std::string> files;
+
+  {
+    auto fa = std::make_shared<test::test_file_access>();
+    test::test_iolayer iol{os, fa};
+    std::mt19937_64 rng{42};
+
+    os->add("", {1, 040755, 1, 0, 0, 10, 42, 0, 0, 0});
+
+    for (int d = 0; d < 8; ++d) {
+      auto dir = fmt::format("dir{}", d);
+      os->add_dir(dir);
+      for (int f = 0; f < 16; ++f) {
+        auto path = fmt::format("{}/file{}", dir, f);
+        auto data =
+            test::create_random_string(1000 + rng() % 20000, 32, 127, rng);
+        os->add_file(path, data);
+        files[path] = std::move(data);
+      }
+    }
+
+    std::vector<std::string> args{"mkdwarfs", "-i", "/", "-o", "-", "-S", "14"};
+    EXPECT_EQ(0, mkdwarfs_main(args, iol.get()));
+    mm = std::make_shared<test::mmap_mock>(iol.out());
+  }
+
+  for (size_t threshold : {0, 1}) {
+    test::test_logger lgr(logger::VERBOSE);
+    size_t num_blocks;
+
+    {
+      filesystem_v2 fs(lgr, *os, mm,
+                       {.block_cache = {.max_bytes = 1 << 14,
+                                        .num_workers = 2},
+                        .tree_scan = {.threshold = threshold,
+                                      .max_held_bytes = 1 << 24}});
+
+      num_blocks = fs.num_blocks();
+
+      if (threshold > 0) {
+        // The tracker builds its index in the background
+        ASSERT_TRUE(lgr.wait_for("indexed ", std::chrono::seconds(10)));
+      }
+
+      // read everything in directory order, in small pieces
+      fs.walk([&](auto e) {
+        auto iv = e.inode();
+        if (!iv.is_regular_file()) {
+          return;
+        }
+        auto const& expected = files.at(e.unix_path());
+        std::string buf(expected.size(), '\0');
+        auto fh = fs.open(iv);
+        for (size_t off = 0; off < buf.size(); off += 4096) {
+          auto size = std::min<size_t>(4096, buf.size() - off);
+          EXPECT_EQ(static_cast<ssize_t>(size),
+                    fs.read(fh, buf.data() + off, size, off));
+        }
+        EXPECT_EQ(expected, buf) << e.unix_path();
+      });
+    }
+
+    auto created = get_log_counter(lgr, "blocks created: ");
+
+    if (threshold > 0) {
+      // each block must have been decompressed exactly once
+      EXPECT_LE(created, num_blocks);
+    }
+
+    EXPECT_GT(created, 0);
+  }
+}
+
+TEST(block_cache, tree_scan_idle) {
+  auto os = std::make_shared<test::os_access_mock>();
+
+  std::shared_ptr<mmif> mm;
+
+  {
+    auto fa = std::make_shared<test::test_file_access>();
+    test::test_iolayer iol{os, fa};
+    std::mt19937_64 rng{42};
+
+    os->add("", {1, 040755, 1, 0, 0, 10, 42, 0, 0, 0});
+
+    for (int f = 0; f < 16; ++f) {
+      os->add_file(fmt::format("file{}", f),
+                   test::create_random_string(20000, 32, 127, rng));
+    }
+
+    std::vector<std::string> args{"mkdwarfs", "-i", "/", "-o", "-", "-S", "14"};
+    EXPECT_EQ(0, mkdwarfs_main(args, iol.get()));
+    mm = std::make_shared<test::mmap_mock>(iol.out());
+  }
+
+  test::test_logger lgr(logger::VERBOSE);
+
+  filesystem_v2 fs(lgr, *os, mm,
+                   {.block_cache = {.max_bytes = 1 << 14, .num_workers = 1},
+                    .tree_scan = {.threshold = 4,
+                                  .idle_timeout = std::chrono::milliseconds(50),
+                                  .max_held_bytes = 2 << 14}});
+
+  ASSERT_TRUE(lgr.wait_for("indexed 16 files", std::chrono::seconds(10)));
+
+  // Open a few files, but only read their first bytes and then go away
+  for (int f = 0; f < 4; ++f) {
+    auto iv = fs.find(fmt::format("/file{}", f).c_str());
+    ASSERT_TRUE(iv);
+    auto fh = fs.open(*iv);
+    std::array<char, 16> buf;
+    EXPECT_EQ(static_cast<ssize_t>(buf.size()),
+              fs.read(fh, buf.data(), buf.size(), 0));
+  }
+
+  EXPECT_TRUE(lgr.wait_for("tree scan detected, tracking 16 files, holding "
+                           "up to 2 blocks",
+                           std::chrono::seconds(10)));
+
+  // Without any further accesses, the scan must expire on its own
+  EXPECT_TRUE(lgr.wait_for("tree scan idle, releasing 16 unfinished files",
+                           std::chrono::seconds(10)));
+}
+
+TEST(block_cache, no_prefetch_of_cached_blocks) {
+  auto os = std::make_shared<test::os_access_mock>();
+
+  std::shared_ptr<mmif> mm;
+  std::string data;
+
+  {
+    auto fa = std::make_shared<test::test_file_access>();
+    test::test_iolayer iol{os, fa};
+    std::mt19937_64 rng{42};
+    data = test::create_random_string(200000, 32, 127, rng);
+    os->add("", {1, 040755, 1, 0, 0, 10, 42, 0, 0, 0});
+    os->add_file("data", data);
+    std::vector<std::string> args{"mkdwarfs", "-i", "/", "-o", "-", "-S", "14"};
+    EXPECT_EQ(0, mkdwarfs_main(args, iol.get()));
+    mm = std::make_shared<test::mmap_mock>(iol.out());
+  }
+
+  test::test_logger lgr(logger::VERBOSE);
+  size_t num_blocks;
+
+  {
+    filesystem_v2 fs(lgr, *os, mm,
+                     {.block_cache = {.max_bytes = 1 << 24,
+                                      .num_workers = 2,
+                                      .sequential_access_detector_threshold =
+                                          2}});
+
+    num_blocks = fs.num_blocks();
+    ASSERT_GT(num_blocks, 4);
+
+    auto iv = fs.find("/data");
+    ASSERT_TRUE(iv);
+
+    // The second pass is served from the cache, so the sequential
+    // access detector must not trigger any further decompression.
+    for (int pass = 0; pass < 2; ++pass) {
+      std::string buf(data.size(), '\0');
+      auto fh = fs.open(*iv);
+      for (size_t off = 0; off < buf.size(); off += 4096) {
+        auto size = std::min<size_t>(4096, buf.size() - off);
+        EXPECT_EQ(static_cast<ssize_t>(size),
+                  fs.read(fh, buf.data() + off, size, off));
+      }
+      EXPECT_EQ(data, buf);
+    }
+  }
+
+  EXPECT_GT(get_log_counter(lgr, "sequential prefetches: "), 0);
+  EXPECT_LE(get_log_counter(lgr, "blocks created: "), num_blocks);
+}
+
+TEST(block_cache, range_cache_hits) {
+  auto os = std::make_shared<test::os_access_mock>();
+
+  std::shared_ptr<mmif> mm;
+  std::string small;
+  std::string large;
+
+  {
+    auto fa = std::make_shared<test::test_file_access>();
+    test::test_iolayer iol{os, fa};
+    std::mt19937_64 rng{42};
+    small = test::create_random_string(500, 32, 127, rng);
+    large = test::create_random_string(100000, 32, 127, rng);
+    os->add("", {1, 040755, 1, 0, 0, 10, 42, 0, 0, 0});
+    os->add_file("a", small);
+    os->add_file("b", large);
+    std::vector<std::string> args{"mkdwarfs", "-i", "/",  "-o",
+                                  "-",        "-S", "14", "--order=path"};
+    EXPECT_EQ(0, mkdwarfs_main(args, iol.get()));
+    mm = std::make_shared<test::mmap_mock>(iol.out());
+  }
+
+  auto read_file = [](filesystem_v2& fs, std::string const& path,
+                      std::string const& expected) {
+    auto iv = fs.find(path.c_str());
+    ASSERT_TRUE(iv);
+    std::string buf(expected.size(), '\0');
+    auto fh = fs.open(*iv);
+    for (size_t off = 0; off < buf.size(); off += 4096) {
+      auto size = std::min<size_t>(4096, buf.size() - off);
+      EXPECT_EQ(static_cast<ssize_t>(size),
+                fs.read(fh, buf.data() + off, size, off));
+    }
+    EXPECT_EQ(expected, buf) << path;
+  };
+
+  for (bool tidy : {false, true}) {
+    test::test_logger lgr(logger::VERBOSE);
+    size_t num_blocks;
+
+    {
+      filesystem_v2 fs(lgr, *os, mm,
+                       {.block_cache = {.max_bytes = 1 << 14,
+                                        .num_workers = 2,
+                                        .range_cache_max_bytes = 4096}});
+
+      num_blocks = fs.num_blocks();
+      ASSERT_GT(num_blocks, 2);
+
+      read_file(fs, "/a", small);
+
+      if (tidy) {
+        // The tidy thread drops the only cached block
+        fs.set_cache_tidy_config({
+            .strategy = cache_tidy_strategy::EXPIRY_TIME,
+            .interval = std::chrono::milliseconds(1),
+            .expiry_time = std::chrono::milliseconds(1),
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      } else {
+        // Reading the large file evicts the block containing the small one
+        read_file(fs, "/b", large);
+      }
+
+      read_file(fs, "/a", small);
+    }
+
+    EXPECT_GT(get_log_counter(lgr, "range cache hits: "), 0) << tidy;
+
+    // The small file must not have been decompressed a second time
+    EXPECT_EQ(get_log_counter(lgr, "blocks created: "), tidy ? 1 : num_blocks)
+        << tidy;
+  }
+}
+
+TEST(block_reader, coalesced_sections_are_not_shared) {
+  static constexpr size_t kSectionSize{4096};
+  std::mt19937_64 rng{42};
+  auto data = test::create_random_string(4 * kSectionSize, rng);
+  auto mm = std::make_shared<test::mmap_mock>(data);
+  test::test_logger lgr(logger::VERBOSE);
+
+  std::vector<fs_section> sections;
+  for (size_t i = 0; i < 4; ++i) {
+    sections.emplace_back(mm, section_type::BLOCK, i * kSectionSize,
+                          kSectionSize, 2);
+  }
+
+  {
+    block_reader reader(lgr, mm, 1 << 20);
+
+    for (auto const& s : sections) {
+      reader.announce(s);
+    }
+
+    for (auto const& s : sections) {
+      auto buf = reader.read(s);
+      ASSERT_TRUE(buf);
+      EXPECT_EQ(0, std::memcmp(buf.get(), data.data() + s.start(), s.length()));
+      // A partially decompressed block may hold on to its data for a long
+      // time, so it must not keep the buffer of the whole run alive
+      EXPECT_EQ(1, buf.use_count());
+    }
+  }
+
+  EXPECT_EQ(1, get_log_counter(lgr, "block reads: "));
+}
+
+TEST(block_cache, canceled_demand_request) {
+  auto os = std::make_shared<test::os_access_mock>();
+
+  std::shared_ptr<mmif> mm;
+  std::string data;
+
+  {
+    auto fa = std::make_shared<test::test_file_access>();
+    test::test_iolayer iol{os, fa};
+    std::mt19937_64 rng{42};
+    data = test::create_random_string(10000, 32, 127, rng);
+    os->add("", {1, 040755, 1, 0, 0, 10, 42, 0, 0, 0});
+    os->add_file("data", data);
+    std::vector<std::string> args{"mkdwarfs", "-i", "/", "-o", "-"};
+    EXPECT_EQ(0, mkdwarfs_main(args, iol.get()));
+    mm = std::make_shared<test::mmap_mock>(iol.out());
+  }
+
+  test::test_logger lgr(logger::VERBOSE);
+
+  {
+    block_cache cache(lgr, *os, mm,
+                      {.max_bytes = 1 << 20, .num_workers = 1}, nullptr);
+
+    // The first section of the image is the only block
+    fs_section section(*mm, 0, 2);
+    ASSERT_EQ(section_type::BLOCK, section.type());
+    cache.insert(section);
+
+    folly::CancellationSource source;
+    source.requestCancellation();
+
+    auto canceled = cache.get(0, 0, data.size(),
+                              block_request_priority::DEMAND,
+                              source.getToken());
+    EXPECT_THROW(canceled.get(), runtime_error);
+
+    auto range = cache.get(0, 0, data.size()).get();
+    EXPECT_EQ(data, std::string(reinterpret_cast<char const*>(range.data()),
+                                range.size()));
+  }
+
+  EXPECT_EQ(1, get_log_counter(lgr, "canceled demand requests: "));
+}
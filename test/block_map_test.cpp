@@ -0,0 +1,147 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <fmt/format.h>
+
+#include "dwarfs/block_map.h"
+#include "dwarfs/error.h"
+#include "dwarfs/filesystem_v2.h"
+#include "dwarfs_tool_main.h"
+
+#include "mmap_mock.h"
+#include "test_helpers.h"
+#include "test_logger.h"
+
+using namespace dwarfs;
+
+namespace {
+
+std::span<uint8_t const> as_span(std::string const& s) {
+  return {reinterpret_cast<uint8_t const*>(s.data()), s.size()};
+}
+
+} // namespace
+
+TEST(block_map, serialize_roundtrip) {
+  file_block_map bm;
+  bm.blocks = {{3, compression_type::ZSTD, 1234, 1 << 20},
+               {7, compression_type::NONE, 4096, 4096}};
+  bm.extents = {{0, 1000, 7, 17}, {1000, (1ULL << 33), 3, 123456}};
+
+  auto data = bm.serialize();
+
+  EXPECT_EQ(size_t{16 + 2 * 24 + 2 * 24}, data.size());
+  EXPECT_EQ("DWBM", data.substr(0, 4));
+  EXPECT_EQ(bm, file_block_map::deserialize(as_span(data)));
+
+  EXPECT_EQ(file_block_map{},
+            file_block_map::deserialize(as_span(file_block_map{}.serialize())));
+
+  EXPECT_THROW(file_block_map::deserialize(as_span(data.substr(0, 40))),
+               runtime_error);
+
+  auto bad = data;
+  bad[0] = 'X';
+  EXPECT_THROW(file_block_map::deserialize(as_span(bad)), runtime_error);
+
+  bad = data;
+  bad[4] = 2;
+  EXPECT_THROW(file_block_map::deserialize(as_span(bad)), runtime_error);
+}
+
+TEST(block_map, filesystem) {
+  auto os = std::make_shared<test::os_access_mock>();
+  auto fa = std::make_shared<test::test_file_access>();
+  test::test_iolayer iol{os, fa};
+  std::mt19937_64 rng{42};
+  std::map<std::string, std::string> files;
+
+  os->add("", {1, 040755, 1, 0, 0, 10, 42, 0, 0, 0});
+  os->add_dir("dir");
+
+  for (int f = 0; f < 8; ++f) {
+    auto path = fmt::format("dir/file{}", f);
+    auto data = test::create_random_string(f * 7000, 32, 127, rng);
+    os->add_file(path, data);
+    files[path] = std::move(data);
+  }
+
+  std::vector<std::string> args{"mkdwarfs", "-i", "/", "-o", "-", "-S", "14"};
+  ASSERT_EQ(0, mkdwarfs_main(args, iol.get()));
+
+  test::test_logger lgr;
+  auto mm = std::make_shared<test::mmap_mock>(iol.out());
+  filesystem_v2 fs(lgr, *os, mm);
+
+  auto dir = fs.find("/dir");
+  ASSERT_TRUE(dir);
+  EXPECT_FALSE(fs.get_block_map(*dir));
+
+  for (auto const& [path, data] : files) {
+    auto iv = fs.find(("/" + path).c_str());
+    ASSERT_TRUE(iv) << path;
+
+    auto bm = fs.get_block_map(*iv);
+    ASSERT_TRUE(bm) << path;
+
+    file_off_t offset = 0;
+    std::string content;
+
+    for (auto const& e : bm->extents) {
+      EXPECT_EQ(offset, e.offset) << path;
+      offset += e.size;
+
+      auto it = std::find_if(bm->blocks.begin(), bm->blocks.end(),
+                             [&](auto const& b) { return b.block == e.block; });
+      ASSERT_NE(bm->blocks.end(), it) << path;
+      EXPECT_LE(e.block_offset + e.size, it->uncompressed_size) << path;
+
+      std::string buf(e.size, '\0');
+      EXPECT_EQ(static_cast<ssize_t>(e.size),
+                fs.read(iv->inode_num(), buf.data(), e.size, e.offset));
+      content += buf;
+    }
+
+    EXPECT_EQ(data.size(), offset) << path;
+    EXPECT_EQ(data, content) << path;
+
+    for (size_t i = 1; i < bm->blocks.size(); ++i) {
+      EXPECT_LT(bm->blocks[i - 1].block, bm->blocks[i].block) << path;
+    }
+
+    for (auto const& b : bm->blocks) {
+      EXPECT_GT(b.compressed_size, 0) << path;
+      EXPECT_GT(b.uncompressed_size, 0) << path;
+    }
+
+    auto ser = bm->serialize();
+    EXPECT_EQ(*bm, file_block_map::deserialize(as_span(ser))) << path;
+  }
+}
@@ -0,0 +1,205 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <array>
+#include <numeric>
+#include <random>
+#include <set>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "dwarfs/cache_policy.h"
+#include "dwarfs/error.h"
+#include "dwarfs/options.h"
+
+using namespace dwarfs;
+
+namespace {
+
+constexpr std::array const all_policies{
+    cache_replacement_policy::LRU,
+    cache_replacement_policy::W_TINYLFU,
+    cache_replacement_policy::ARC,
+};
+
+size_t replay(cache_policy& cache, std::vector<size_t> const& trace,
+              std::set<size_t>* cached = nullptr) {
+  size_t hits = 0;
+  std::vector<size_t> evicted;
+
+  for (auto key : trace) {
+    if (cache.access(key)) {
+      ++hits;
+    } else {
+      evicted.clear();
+      cache.insert(key, evicted);
+
+      if (cached) {
+        cached->insert(key);
+        for (auto k : evicted) {
+          EXPECT_EQ(1, cached->erase(k)) << k;
+        }
+      }
+    }
+  }
+
+  return hits;
+}
+
+} // namespace
+
+class cache_policy_test
+    : public ::testing::TestWithParam<cache_replacement_policy> {};
+
+TEST_P(cache_policy_test, capacity) {
+  static constexpr size_t kCapacity{50};
+  static constexpr size_t kNumKeys{500};
+
+  cache_policy cache(GetParam(), kCapacity, kNumKeys);
+  std::mt19937_64 rng{42};
+  std::geometric_distribution<size_t> dist{0.02};
+  std::vector<size_t> trace;
+
+  for (size_t i = 0; i < 20000; ++i) {
+    trace.push_back(std::min(dist(rng), kNumKeys - 1));
+  }
+
+  std::set<size_t> cached;
+  auto hits = replay(cache, trace, &cached);
+
+  EXPECT_GT(hits, 0);
+  EXPECT_EQ(kCapacity, cache.size());
+  EXPECT_EQ(cached.size(), cache.size());
+
+  for (size_t key = 0; key < kNumKeys; ++key) {
+    EXPECT_EQ(cached.contains(key), cache.contains(key)) << key;
+  }
+
+  for (auto key : cached) {
+    cache.erase(key);
+    EXPECT_FALSE(cache.contains(key));
+  }
+
+  EXPECT_EQ(0, cache.size());
+}
+
+TEST_P(cache_policy_test, unbounded) {
+  cache_policy cache(GetParam(), 0, 100);
+  std::vector<size_t> trace(1000);
+  std::iota(trace.begin(), trace.end(), 0);
+
+  EXPECT_EQ(0, replay(cache, trace));
+  EXPECT_EQ(1000, cache.size());
+  EXPECT_EQ(1000, replay(cache, trace));
+}
+
+TEST_P(cache_policy_test, hot_set) {
+  cache_policy cache(GetParam(), 10, 100);
+  std::vector<size_t> trace;
+
+  for (size_t i = 0; i < 10; ++i) {
+    for (size_t key = 0; key < 5; ++key) {
+      trace.push_back(key);
+    }
+  }
+
+  EXPECT_EQ(45, replay(cache, trace));
+}
+
+TEST_P(cache_policy_test, touch) {
+  static constexpr size_t kCapacity{100};
+
+  cache_policy cache(GetParam(), kCapacity, 1000);
+  std::vector<size_t> evicted;
+
+  for (size_t key = 0; key < kCapacity; ++key) {
+    cache.insert(key, evicted);
+  }
+
+  ASSERT_TRUE(evicted.empty());
+
+  // Key 0 is the least recently used key, touching it must protect it
+  // from being evicted next, just like for a re-inserted block.
+  cache.touch(0);
+
+  // touching keys that aren't cached is a no-op
+  cache.touch(kCapacity + 1);
+  EXPECT_FALSE(cache.contains(kCapacity + 1));
+
+  for (size_t key = kCapacity; key < kCapacity + 10; ++key) {
+    cache.insert(key, evicted);
+  }
+
+  EXPECT_TRUE(cache.contains(0));
+  EXPECT_EQ(kCapacity, cache.size());
+}
+
+INSTANTIATE_TEST_SUITE_P(dwarfs, cache_policy_test,
+                         ::testing::ValuesIn(all_policies));
+
+TEST(cache_policy, scan_resistance) {
+  static constexpr size_t kCapacity{100};
+  static constexpr size_t kHotKeys{50};
+  static constexpr size_t kScanKeys{1000};
+
+  std::vector<size_t> warmup;
+  std::vector<size_t> scan;
+  std::vector<size_t> hot;
+
+  for (size_t i = 0; i < 10; ++i) {
+    for (size_t key = 0; key < kHotKeys; ++key) {
+      warmup.push_back(key);
+    }
+  }
+
+  for (size_t key = kHotKeys; key < kHotKeys + kScanKeys; ++key) {
+    scan.push_back(key);
+  }
+
+  for (size_t key = 0; key < kHotKeys; ++key) {
+    hot.push_back(key);
+  }
+
+  auto hot_hits_after_scan = [&](cache_replacement_policy policy) {
+    cache_policy cache(policy, kCapacity, kHotKeys + kScanKeys);
+    replay(cache, warmup);
+    replay(cache, scan);
+    return replay(cache, hot);
+  };
+
+  EXPECT_EQ(0, hot_hits_after_scan(cache_replacement_policy::LRU));
+  EXPECT_EQ(kHotKeys, hot_hits_after_scan(cache_replacement_policy::W_TINYLFU));
+  EXPECT_EQ(kHotKeys, hot_hits_after_scan(cache_replacement_policy::ARC));
+}
+
+TEST(cache_policy, parse) {
+  EXPECT_EQ(cache_replacement_policy::LRU,
+            parse_cache_replacement_policy("lru"));
+  EXPECT_EQ(cache_replacement_policy::W_TINYLFU,
+            parse_cache_replacement_policy("tinylfu"));
+  EXPECT_EQ(cache_replacement_policy::ARC,
+            parse_cache_replacement_policy("arc"));
+  EXPECT_THAT([] { parse_cache_replacement_policy("fifo"); },
+              ::testing::ThrowsMessage<dwarfs::runtime_error>(::testing::HasSubstr(
+                  "invalid cache replacement policy: fifo")));
+}
@@ -0,0 +1,297 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <span>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "dwarfs/checksum.h"
+#include "dwarfs/compression_checkpoint.h"
+#include "dwarfs/error.h"
+#include "dwarfs/fstypes.h"
+
+#include "test_helpers.h"
+#include "test_logger.h"
+
+using namespace dwarfs;
+
+namespace {
+
+std::span<uint8_t const> as_span(std::string const& s) {
+  return {reinterpret_cast<uint8_t const*>(s.data()), s.size()};
+}
+
+std::string as_string(std::vector<uint8_t> const& v) {
+  return {reinterpret_cast<char const*>(v.data()), v.size()};
+}
+
+std::string make_section(section_type type, compression_type compression,
+                         std::string const& data) {
+  section_header_v2 sh{};
+  std::memcpy(sh.magic, "DWARFS", 6);
+  sh.major = MAJOR_VERSION;
+  sh.minor = MINOR_VERSION;
+  sh.type = static_cast<uint16_t>(type);
+  sh.compression = static_cast<uint16_t>(compression);
+  sh.length = data.size();
+
+  checksum xxh(checksum::algorithm::XXH3_64);
+  xxh.update(&sh.number,
+             sizeof(section_header_v2) - offsetof(section_header_v2, number));
+  xxh.update(data.data(), data.size());
+  xxh.finalize(&sh.xxh3_64);
+
+  return std::string(reinterpret_cast<char const*>(&sh), sizeof(sh)) + data;
+}
+
+class compression_checkpoint_test : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    k1 = compression_checkpoint::make_key("cfg", as_span("block1"));
+    k2 = compression_checkpoint::make_key("cfg", as_span("block2"));
+    k3 = compression_checkpoint::make_key("cfg", as_span("block3"));
+    s1 = make_section(section_type::BLOCK, compression_type::ZSTD,
+                      "compressed1");
+    s2 = make_section(section_type::BLOCK, compression_type::NONE, "block2");
+    s3 = make_section(section_type::BLOCK, compression_type::LZMA,
+                      "compressed3");
+  }
+
+  // Write an index for a partial image consisting of a header and the
+  // three sections above.
+  void write_checkpoint() {
+    compression_checkpoint cp(lgr, fa, image, source, false);
+    cp.add(k1, header.size());
+    cp.add(k2, header.size() + s1.size());
+    cp.add(k3, header.size() + s1.size() + s2.size());
+    fa.set_file(image, header + s1 + s2 + s3);
+  }
+
+  test::test_logger lgr;
+  test::test_file_access fa;
+  std::filesystem::path image{"image.dwarfs"};
+  std::filesystem::path index{"image.dwarfs.checkpoint"};
+  std::filesystem::path partial{"image.dwarfs.partial"};
+  std::filesystem::path partial_index{"image.dwarfs.partial.checkpoint"};
+  std::string source{"/input\n1234\n5678"};
+  std::string header{"#!/bin/sh\n"};
+  compression_checkpoint::key_type k1, k2, k3;
+  std::string s1, s2, s3;
+};
+
+} // namespace
+
+TEST(compression_checkpoint, make_key) {
+  auto k1 = compression_checkpoint::make_key("zstd [level=19]", as_span("a"));
+  auto k2 = compression_checkpoint::make_key("zstd [level=19]", as_span("b"));
+  auto k3 = compression_checkpoint::make_key("zstd [level=18]", as_span("a"));
+
+  EXPECT_EQ(k1, compression_checkpoint::make_key("zstd [level=19]",
+                                                 as_span("a")));
+  EXPECT_NE(k1, k2);
+  EXPECT_NE(k1, k3);
+}
+
+TEST_F(compression_checkpoint_test, resume) {
+  write_checkpoint();
+
+  {
+    compression_checkpoint cp(lgr, fa, image, source, true);
+    EXPECT_EQ(size_t{3}, cp.num_blocks());
+
+    // the partial image has been moved aside
+    EXPECT_FALSE(fa.exists(image));
+    EXPECT_TRUE(fa.exists(partial));
+    EXPECT_TRUE(fa.exists(partial_index));
+
+    auto b1 = cp.take(k1);
+    ASSERT_TRUE(b1);
+    EXPECT_EQ(compression_type::ZSTD, b1->compression);
+    EXPECT_EQ("compressed1", as_string(b1->data));
+    EXPECT_FALSE(cp.take(k1));
+
+    auto b2 = cp.take(k2);
+    ASSERT_TRUE(b2);
+    EXPECT_EQ(compression_type::NONE, b2->compression);
+    EXPECT_TRUE(b2->data.empty());
+
+    EXPECT_EQ(size_t{1}, cp.num_blocks());
+  }
+
+  // the index is re-created when resuming
+  EXPECT_EQ(size_t{32}, fa.get_file(index).value().size());
+
+  // The resumed build didn't finish, so the partial image must still be
+  // usable for the next attempt
+  {
+    compression_checkpoint cp(lgr, fa, image, source, true);
+    EXPECT_EQ(size_t{3}, cp.num_blocks());
+    EXPECT_TRUE(cp.take(k3));
+  }
+}
+
+TEST_F(compression_checkpoint_test, resume_interrupted_resume) {
+  write_checkpoint();
+
+  {
+    compression_checkpoint cp(lgr, fa, image, source, true);
+    EXPECT_EQ(size_t{3}, cp.num_blocks());
+  }
+
+  // A resumed build that got further than the original one
+  {
+    compression_checkpoint cp(lgr, fa, image, source, false);
+    cp.add(k1, header.size());
+    cp.add(k2, header.size() + s1.size());
+    cp.add(k3, header.size() + s1.size() + s2.size());
+    fa.set_file(image, header + s1 + s2 + s3);
+  }
+
+  fa.set_file(partial, header + s1);
+
+  compression_checkpoint cp(lgr, fa, image, source, true);
+  EXPECT_EQ(size_t{3}, cp.num_blocks());
+  EXPECT_EQ(header + s1 + s2 + s3, fa.get_file(partial).value());
+  EXPECT_TRUE(cp.take(k3));
+}
+
+TEST_F(compression_checkpoint_test, no_resume) {
+  write_checkpoint();
+
+  compression_checkpoint cp(lgr, fa, image, source, false);
+  EXPECT_EQ(size_t{0}, cp.num_blocks());
+  EXPECT_FALSE(cp.take(k1));
+  EXPECT_TRUE(fa.exists(image));
+}
+
+TEST_F(compression_checkpoint_test, different_source) {
+  write_checkpoint();
+
+  compression_checkpoint cp(lgr, fa, image, "/input\n1234\n5679", true);
+  EXPECT_EQ(size_t{0}, cp.num_blocks());
+  EXPECT_FALSE(cp.take(k1));
+}
+
+TEST_F(compression_checkpoint_test, partial_image) {
+  write_checkpoint();
+
+  auto img = fa.get_file(image).value();
+  fa.set_file(image, img.substr(0, img.size() - 1));
+
+  compression_checkpoint cp(lgr, fa, image, source, true);
+  EXPECT_EQ(size_t{2}, cp.num_blocks());
+  EXPECT_TRUE(cp.take(k1));
+  EXPECT_TRUE(cp.take(k2));
+  EXPECT_FALSE(cp.take(k3));
+}
+
+TEST_F(compression_checkpoint_test, torn_index) {
+  write_checkpoint();
+
+  auto idx = fa.get_file(index).value();
+  fa.set_file(index, idx.substr(0, idx.size() - 3));
+
+  compression_checkpoint cp(lgr, fa, image, source, true);
+  EXPECT_EQ(size_t{2}, cp.num_blocks());
+  EXPECT_FALSE(cp.take(k3));
+}
+
+TEST_F(compression_checkpoint_test, corrupt_index) {
+  write_checkpoint();
+
+  auto idx = fa.get_file(index).value();
+  idx[idx.size() - 20] ^= 1;
+  fa.set_file(index, idx);
+
+  compression_checkpoint cp(lgr, fa, image, source, true);
+  EXPECT_EQ(size_t{2}, cp.num_blocks());
+  EXPECT_FALSE(cp.take(k3));
+}
+
+TEST_F(compression_checkpoint_test, corrupt_image) {
+  write_checkpoint();
+
+  auto img = fa.get_file(image).value();
+  img[header.size() + s1.size() - 1] ^= 1;
+  fa.set_file(image, img);
+
+  // the data is only verified once it's taken
+  compression_checkpoint cp(lgr, fa, image, source, true);
+  EXPECT_EQ(size_t{3}, cp.num_blocks());
+  EXPECT_FALSE(cp.take(k1));
+  EXPECT_TRUE(cp.take(k2));
+  EXPECT_TRUE(cp.take(k3));
+}
+
+TEST_F(compression_checkpoint_test, wrong_section_type) {
+  fa.set_file(image, make_section(section_type::METADATA_V2,
+                                  compression_type::ZSTD, "compressed1"));
+
+  {
+    compression_checkpoint cp(lgr, fa, image, source, false);
+    cp.add(k1, 0);
+  }
+
+  compression_checkpoint cp(lgr, fa, image, source, true);
+  EXPECT_EQ(size_t{0}, cp.num_blocks());
+}
+
+TEST_F(compression_checkpoint_test, missing_files) {
+  {
+    compression_checkpoint cp(lgr, fa, image, source, true);
+    EXPECT_EQ(size_t{0}, cp.num_blocks());
+  }
+
+  write_checkpoint();
+  fa.remove(image);
+
+  compression_checkpoint cp(lgr, fa, image, source, true);
+  EXPECT_EQ(size_t{0}, cp.num_blocks());
+}
+
+TEST_F(compression_checkpoint_test, invalid_index) {
+  write_checkpoint();
+  fa.set_file(index, "this is not a checkpoint");
+
+  compression_checkpoint cp(lgr, fa, image, source, true);
+  EXPECT_EQ(size_t{0}, cp.num_blocks());
+}
+
+TEST_F(compression_checkpoint_test, open_error) {
+  fa.set_open_error(index, std::make_error_code(std::errc::permission_denied));
+  EXPECT_THROW(compression_checkpoint(lgr, fa, image, source, false),
+               runtime_error);
+}
+
+TEST_F(compression_checkpoint_test, remove) {
+  write_checkpoint();
+  EXPECT_TRUE(fa.exists(index));
+
+  compression_checkpoint cp(lgr, fa, image, source, true);
+  fa.set_file(image, "new image");
+  cp.remove();
+  EXPECT_FALSE(fa.exists(index));
+  EXPECT_FALSE(fa.exists(partial));
+  EXPECT_FALSE(fa.exists(partial_index));
+  EXPECT_TRUE(fa.exists(image));
+}
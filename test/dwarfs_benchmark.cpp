@@ -19,6 +19,9 @@
  * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <numeric>
+#include <random>
 #include <sstream>
 
 #include <benchmark/benchmark.h>
@@ -33,6 +36,7 @@
 #include "dwarfs/iovec_read_buf.h"
 #include "dwarfs/logger.h"
 #include "dwarfs/options.h"
+#include "dwarfs/packed_tables.h"
 #include "dwarfs/progress.h"
 #include "dwarfs/scanner.h"
 #include "dwarfs/segmenter_factory.h"
@@ -179,6 +183,56 @@ void frozen_string_table_lookup(::benchmark::State& state) {
   }
 }
 
+auto make_frozen_delta_list(size_t size) {
+  using namespace apache::thrift::frozen;
+  std::mt19937_64 rng{42};
+  std::uniform_int_distribution<uint32_t> dist{0, 100};
+  std::vector<uint32_t> deltas(size);
+  std::generate(deltas.begin(), deltas.end(), [&] { return dist(rng); });
+  std::string tmp;
+  freezeToString(deltas, tmp);
+  return mapFrozen<std::vector<uint32_t>>(std::move(tmp));
+}
+
+void frozen_list_lookup(::benchmark::State& state) {
+  auto data = make_frozen_delta_list(state.range(0));
+  size_t i = 0;
+
+  for (auto _ : state) {
+    ::benchmark::DoNotOptimize(data[i++ % data.size()]);
+  }
+}
+
+void unpacked_delta_list_lookup(::benchmark::State& state) {
+  auto data = make_frozen_delta_list(state.range(0));
+  std::vector<uint32_t> unpacked(data.size());
+  std::partial_sum(data.begin(), data.end(), unpacked.begin());
+  size_t i = 0;
+
+  for (auto _ : state) {
+    ::benchmark::DoNotOptimize(unpacked[i++ % unpacked.size()]);
+  }
+}
+
+void packed_delta_list_lookup(::benchmark::State& state) {
+  auto data = make_frozen_delta_list(state.range(0));
+  delta_list_index index(data);
+  size_t i = 0;
+
+  for (auto _ : state) {
+    ::benchmark::DoNotOptimize(index.lookup(data, i++ % index.size()));
+  }
+}
+
+void packed_delta_list_index(::benchmark::State& state) {
+  auto data = make_frozen_delta_list(state.range(0));
+
+  for (auto _ : state) {
+    delta_list_index index(data);
+    ::benchmark::DoNotOptimize(index);
+  }
+}
+
 void dwarfs_initialize(::benchmark::State& state) {
   auto image = make_filesystem(state);
   test::test_logger lgr;
@@ -468,6 +522,11 @@ BENCHMARK(frozen_string_table_lookup)
     ->Args({true, false})
     ->Args({true, true});
 
+BENCHMARK(frozen_list_lookup)->Arg(1 << 20);
+BENCHMARK(unpacked_delta_list_lookup)->Arg(1 << 20);
+BENCHMARK(packed_delta_list_lookup)->Arg(1 << 20);
+BENCHMARK(packed_delta_list_index)->Arg(1 << 20);
+
 BENCHMARK(dwarfs_initialize)->Apply(PackParams);
 
 BENCHMARK_REGISTER_F(filesystem, find_inode)->Apply(PackParams);
@@ -515,6 +515,8 @@ std::vector<std::string> const compressions{
 #endif
 #ifdef DWARFS_HAVE_LIBZSTD
     "zstd:level=1",
+    "bcj:arch=x86:compression=zstd,level=1",
+    "shuffle:element_size=4:compression=zstd,level=1",
 #endif
 #ifdef DWARFS_HAVE_LIBLZMA
     "lzma:level=1",
@@ -813,6 +815,90 @@ TEST_P(compression_regression, github45) {
 INSTANTIATE_TEST_SUITE_P(dwarfs, compression_regression,
                          ::testing::ValuesIn(compressions));
 
+class compressor_buffer_reuse : public testing::TestWithParam<std::string> {};
+
+TEST_P(compressor_buffer_reuse, roundtrip) {
+  block_compressor bc(GetParam());
+  std::vector<uint8_t> target;
+
+  for (size_t size : {1u << 20, 1u << 16, 1u << 18}) {
+    auto text = test::loremipsum(size);
+    std::vector<uint8_t> input(text.begin(), text.end());
+
+    auto capacity = target.capacity();
+
+    bc.compress(input, target);
+
+    EXPECT_GE(target.capacity(), capacity);
+    EXPECT_EQ(target, bc.compress(input));
+
+    auto output = block_decompressor::decompress(bc.type(), target.data(),
+                                                 target.size());
+
+    EXPECT_EQ(input, output);
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(dwarfs, compressor_buffer_reuse,
+                         ::testing::ValuesIn(compressions));
+
+class compressor_parallel : public testing::TestWithParam<std::string> {};
+
+TEST_P(compressor_parallel, roundtrip) {
+  block_compressor bc(GetParam());
+  auto text = test::loremipsum(8 << 20);
+  std::vector<uint8_t> input(text.begin(), text.end());
+
+  for (size_t num_threads : {1, 2, 5}) {
+    std::vector<uint8_t> target;
+
+    bc.compress(input, target, nullptr, num_threads);
+
+    if (bc.type() != compression_type::NONE) {
+      EXPECT_LT(target.size(), input.size()) << num_threads;
+    }
+
+    auto output = block_decompressor::decompress(bc.type(), target.data(),
+                                                 target.size());
+
+    EXPECT_EQ(input, output) << num_threads;
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(dwarfs, compressor_parallel,
+                         ::testing::ValuesIn(compressions));
+
+#ifdef DWARFS_HAVE_LIBLZMA
+TEST(compressor_parallel, lzma_uses_multiple_threads) {
+  block_compressor bc("lzma:level=1");
+  auto text = test::loremipsum(8 << 20);
+  std::vector<uint8_t> input(text.begin(), text.end());
+  std::vector<uint8_t> target;
+
+  bc.compress(input, target, nullptr, 4);
+
+  // The multi-threaded encoder compresses each thread's share of the
+  // input into a separate block of the xz stream. The number of blocks
+  // is stored at the start of the index, which precedes the 12-byte
+  // stream footer.
+  ASSERT_GT(target.size(), 24);
+  auto const* footer = target.data() + target.size() - 12;
+  size_t backward_size = 0;
+  for (size_t i = 0; i < 4; ++i) {
+    backward_size |= static_cast<size_t>(footer[4 + i]) << (8 * i);
+  }
+  auto const* index = footer - 4 * (backward_size + 1);
+  ASSERT_GE(index, target.data());
+  EXPECT_EQ(0, index[0]);
+  EXPECT_EQ(4, index[1]);
+
+  auto output =
+      block_decompressor::decompress(bc.type(), target.data(), target.size());
+
+  EXPECT_EQ(input, output);
+}
+#endif
+
 class file_scanner
     : public testing::TestWithParam<
           std::tuple<file_order_mode, std::optional<std::string>>> {};
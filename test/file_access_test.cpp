@@ -85,6 +85,11 @@ TEST(file_access_generic_test, basic) {
     EXPECT_EQ(data, binary_data);
     binary_is->close();
   }
+
+  fa->remove(binary_file);
+
+  EXPECT_FALSE(fa->exists(binary_file));
+  EXPECT_TRUE(fa->exists(text_file));
 }
 
 TEST(file_access_generic_test, error_handling) {
@@ -107,6 +112,7 @@ TEST(file_access_generic_test, error_handling) {
     EXPECT_THAT([&] { fa->open_input_binary(nonexistent_file); }, matcher);
     EXPECT_THAT([&] { fa->open_output(file_in_subdir); }, matcher);
     EXPECT_THAT([&] { fa->open_output_binary(file_in_subdir); }, matcher);
+    EXPECT_THAT([&] { fa->remove(nonexistent_file); }, matcher);
   }
 
   {
@@ -136,5 +142,10 @@ TEST(file_access_generic_test, error_handling) {
       auto x [[maybe_unused]] = fa->open_output_binary(file_in_subdir, ec);
       EXPECT_THAT(ec, matcher);
     }
+    {
+      std::error_code ec;
+      fa->remove(nonexistent_file, ec);
+      EXPECT_THAT(ec, matcher);
+    }
   }
 }
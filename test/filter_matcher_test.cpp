@@ -0,0 +1,120 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <gtest/gtest.h>
+
+#include "dwarfs/filter_matcher.h"
+
+using namespace dwarfs;
+
+namespace {
+
+std::optional<size_t> match(filter_matcher& fm, std::string_view path) {
+  return fm.match(path, 0);
+}
+
+} // namespace
+
+TEST(filter_matcher, first_matching_rule) {
+  filter_matcher fm;
+  fm.add_rule("- gcc/**.o");
+  fm.add_rule("+ *.o");
+  fm.add_rule("- *");
+
+  EXPECT_EQ(3, fm.size());
+  EXPECT_EQ(filter_matcher::rule_type::exclude, fm.type(0));
+  EXPECT_EQ(filter_matcher::rule_type::include, fm.type(1));
+  EXPECT_EQ(".*/gcc/.*\\.o", fm.pattern(0));
+
+  EXPECT_EQ(0, match(fm, "/usr/lib/gcc/x86_64/crt1.o"));
+  EXPECT_EQ(1, match(fm, "/usr/lib/crt1.o"));
+  EXPECT_EQ(2, match(fm, "/usr/lib/crt1.so"));
+  EXPECT_EQ(std::nullopt, match(fm, "/usr/lib/"));
+  EXPECT_EQ(std::nullopt, match(fm, "/"));
+}
+
+TEST(filter_matcher, anchored_rules) {
+  filter_matcher fm;
+  fm.add_rule("- /usr/lib/");
+  fm.add_rule("+ /usr/**");
+  fm.add_rule("- lib/");
+
+  EXPECT_FALSE(fm.floating(0));
+  EXPECT_TRUE(fm.floating(2));
+
+  EXPECT_EQ(0, fm.match("/src/usr/lib/", 4));
+  EXPECT_EQ(1, fm.match("/src/usr/lib/x", 4));
+  EXPECT_EQ(2, fm.match("/src/lib/", 4));
+  EXPECT_EQ(2, fm.match("/src/usr/lib/", 0));
+  EXPECT_EQ(std::nullopt, fm.match("/usr/bin", 4));
+}
+
+TEST(filter_matcher, wildcards) {
+  filter_matcher fm;
+  fm.add_rule("+ lib/*/");
+  fm.add_rule("+ ?.[ch]");
+  fm.add_rule("- \\[x]*");
+  fm.add_rule("- [[:digit:]]z");
+
+  EXPECT_EQ(0, match(fm, "/lib/x/"));
+  EXPECT_EQ(std::nullopt, match(fm, "/lib//"));
+  EXPECT_EQ(std::nullopt, match(fm, "/lib/x/y/"));
+  EXPECT_EQ(1, match(fm, "/a/b.c"));
+  EXPECT_EQ(1, match(fm, "/b.h"));
+  EXPECT_EQ(std::nullopt, match(fm, "/bb.c"));
+  EXPECT_EQ(2, match(fm, "/[x]yz"));
+  EXPECT_EQ(3, match(fm, "/a/7z"));
+  EXPECT_EQ(std::nullopt, match(fm, "/a/xz"));
+}
+
+TEST(filter_matcher, incremental) {
+  filter_matcher fm;
+  fm.add_rule("- /a/b/c*");
+  fm.add_rule("+ b/**");
+
+  auto c = fm.advance(fm.start(0), "/a/");
+  auto d = fm.advance(c, "b/");
+
+  EXPECT_EQ(0, fm.match(fm.advance(d, "cde")));
+  EXPECT_EQ(1, fm.match(fm.advance(d, "xyz")));
+  EXPECT_EQ(std::nullopt, fm.match(fm.advance(c, "xyz")));
+  EXPECT_EQ(1, fm.match(fm.advance(fm.advance(c, "x/b/"), "c")));
+
+  EXPECT_TRUE(fm.valid(d));
+  fm.add_rule("- *");
+  EXPECT_FALSE(fm.valid(d));
+}
+
+TEST(filter_matcher, invalid_rules) {
+  filter_matcher fm;
+  EXPECT_THROW(fm.add_rule("grmpf"), std::runtime_error);
+  EXPECT_THROW(fm.add_rule("- ***"), std::runtime_error);
+  EXPECT_THROW(fm.add_rule("- [abc"), std::runtime_error);
+  EXPECT_THROW(fm.add_rule("- [z-a]"), std::runtime_error);
+  EXPECT_THROW(fm.add_rule("- [[:foo:]]"), std::runtime_error);
+  EXPECT_THROW(fm.add_rule("- foo\\"), std::runtime_error);
+  EXPECT_TRUE(fm.empty());
+}
@@ -0,0 +1,416 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <fmt/format.h>
+
+#include "dwarfs/file_stat.h"
+#include "dwarfs/filesystem_v2.h"
+#include "dwarfs/http_mmif.h"
+#include "dwarfs_tool_main.h"
+
+#include "test_helpers.h"
+#include "test_logger.h"
+
+using namespace dwarfs;
+
+namespace {
+
+// Minimal HTTP/1.1 server that serves a single resource and supports
+// single range requests. Good enough to stand in for an object store.
+class http_test_server {
+ public:
+  explicit http_test_server(std::string data, std::string etag = "\"v1\"")
+      : data_{std::move(data)}
+      , etag_{std::move(etag)} {
+    listen_fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+
+    if (::bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) !=
+            0 ||
+        ::listen(listen_fd_, 16) != 0) {
+      throw std::runtime_error("cannot start test server");
+    }
+
+    socklen_t len = sizeof(addr);
+    ::getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&addr), &len);
+    port_ = ntohs(addr.sin_port);
+
+    thread_ = std::thread([this] { run(); });
+  }
+
+  ~http_test_server() {
+    ::shutdown(listen_fd_, SHUT_RDWR);
+    ::close(listen_fd_);
+    thread_.join();
+
+    {
+      std::lock_guard lock(mx_);
+      for (auto fd : conn_fds_) {
+        ::shutdown(fd, SHUT_RDWR);
+      }
+    }
+
+    for (auto& t : conn_threads_) {
+      t.join();
+    }
+  }
+
+  std::string url() const {
+    return fmt::format("http://127.0.0.1:{}/image.dwarfs", port_);
+  }
+
+  void set_etag(std::string etag) {
+    std::lock_guard lock(mx_);
+    etag_ = std::move(etag);
+  }
+
+  void set_range_support(bool enabled) { range_support_ = enabled; }
+
+  size_t requests() const { return requests_; }
+
+ private:
+  void run() {
+    for (;;) {
+      int fd = ::accept(listen_fd_, nullptr, nullptr);
+      if (fd < 0) {
+        break;
+      }
+      std::lock_guard lock(mx_);
+      conn_fds_.push_back(fd);
+      conn_threads_.emplace_back([this, fd] { serve(fd); });
+    }
+  }
+
+  void serve(int fd) {
+    std::string buffer;
+    std::array<char, 4096> tmp;
+
+    for (;;) {
+      auto end = buffer.find("\r\n\r\n");
+
+      if (end == std::string::npos) {
+        auto rv = ::recv(fd, tmp.data(), tmp.size(), 0);
+        if (rv <= 0) {
+          break;
+        }
+        buffer.append(tmp.data(), rv);
+        continue;
+      }
+
+      auto request = buffer.substr(0, end);
+      buffer.erase(0, end + 4);
+
+      ++requests_;
+
+      if (!respond(fd, request)) {
+        break;
+      }
+    }
+
+    ::close(fd);
+  }
+
+  bool respond(int fd, std::string const& request) {
+    std::string etag;
+
+    {
+      std::lock_guard lock(mx_);
+      etag = etag_;
+    }
+
+    std::string header;
+    std::string_view body{data_};
+
+    auto pos = request.find("Range: bytes=");
+
+    if (range_support_ && pos != std::string::npos) {
+      size_t first, last;
+      if (std::sscanf(request.c_str() + pos, "Range: bytes=%zu-%zu", &first,
+                      &last) != 2 ||
+          first > last || last >= data_.size()) {
+        header = "HTTP/1.1 416 Range Not Satisfiable\r\n"
+                 "Content-Length: 0\r\n\r\n";
+        body = {};
+      } else {
+        body = body.substr(first, last - first + 1);
+        header = fmt::format("HTTP/1.1 206 Partial Content\r\n"
+                             "Content-Range: bytes {}-{}/{}\r\n",
+                             first, last, data_.size());
+      }
+    } else {
+      header = "HTTP/1.1 200 OK\r\n";
+    }
+
+    if (!body.empty() || header.find(" 416 ") == std::string::npos) {
+      header += fmt::format("ETag: {}\r\nContent-Length: {}\r\n\r\n", etag,
+                            body.size());
+    }
+
+    return send_all(fd, header) && send_all(fd, body);
+  }
+
+  static bool send_all(int fd, std::string_view data) {
+    while (!data.empty()) {
+      auto rv = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+      if (rv <= 0) {
+        return false;
+      }
+      data.remove_prefix(rv);
+    }
+    return true;
+  }
+
+  std::string const data_;
+  std::string etag_;
+  int listen_fd_{-1};
+  uint16_t port_{0};
+  std::atomic<bool> range_support_{true};
+  std::atomic<size_t> requests_{0};
+  std::mutex mx_;
+  std::vector<int> conn_fds_;
+  std::vector<std::thread> conn_threads_;
+  std::thread thread_;
+};
+
+std::string_view as_string_view(std::span<uint8_t const> s) {
+  return {reinterpret_cast<char const*>(s.data()), s.size()};
+}
+
+} // namespace
+
+TEST(http_mmif, fetch_ranges_on_demand) {
+  auto data = test::create_random_string(3 * 1024 * 1024 + 123);
+  http_test_server server(data);
+  test::test_logger lgr;
+
+  http_mmif_options opts;
+  opts.chunk_size = 64 * 1024;
+
+  http_mmif mm(lgr, server.url(), opts);
+
+  EXPECT_EQ(data.size(), mm.size());
+  EXPECT_EQ(0, mm.bytes_fetched());
+
+  std::mt19937_64 rng{42};
+
+  for (int i = 0; i < 50; ++i) {
+    auto offset = rng() % data.size();
+    auto length = std::min<size_t>(rng() % 20000 + 1, data.size() - offset);
+    EXPECT_EQ(data.substr(offset, length),
+              as_string_view(mm.span(offset, length)))
+        << offset << ", " << length;
+  }
+
+  EXPECT_GT(mm.bytes_fetched(), 0);
+  EXPECT_LT(mm.bytes_fetched(), data.size());
+
+  auto fetched = mm.bytes_fetched();
+  auto requests = server.requests();
+
+  // the last chunk is shorter than the others
+  EXPECT_EQ(data.substr(data.size() - 100),
+            as_string_view(mm.span(data.size() - 100, 100)));
+  EXPECT_EQ(data.substr(data.size() - 100),
+            as_string_view(mm.span(data.size() - 100, 100)));
+
+  EXPECT_LE(mm.bytes_fetched(), fetched + opts.chunk_size);
+  EXPECT_LE(server.requests(), requests + 1);
+}
+
+TEST(http_mmif, concurrent_access) {
+  auto data = test::create_random_string(1024 * 1024);
+  http_test_server server(data);
+  test::test_logger lgr;
+
+  http_mmif_options opts;
+  opts.chunk_size = 16 * 1024;
+
+  http_mmif mm(lgr, server.url(), opts);
+
+  std::vector<std::thread> threads;
+  std::atomic<size_t> mismatches{0};
+
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&, t] {
+      std::mt19937_64 rng(t);
+      for (int i = 0; i < 100; ++i) {
+        auto offset = rng() % (data.size() - 50000);
+        if (data.substr(offset, 50000) !=
+            as_string_view(mm.span(offset, 50000))) {
+          ++mismatches;
+        }
+      }
+    });
+  }
+
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  EXPECT_EQ(0, mismatches);
+  EXPECT_LE(mm.bytes_fetched(), data.size());
+}
+
+TEST(http_mmif, prefetch) {
+  auto data = test::create_random_string(2 * 1024 * 1024);
+  http_test_server server(data);
+  test::test_logger lgr;
+
+  http_mmif_options opts;
+  opts.chunk_size = 32 * 1024;
+  opts.max_parallel_requests = 4;
+
+  http_mmif mm(lgr, server.url(), opts);
+
+  std::vector<mmif::file_range> ranges{
+      {0, 100000}, {500000, 1000000}, {data.size() - 10, 10}};
+
+  EXPECT_FALSE(mm.prefetch(ranges));
+
+  auto fetched = mm.bytes_fetched();
+  auto requests = server.requests();
+
+  for (auto const& [offset, length] : ranges) {
+    EXPECT_EQ(data.substr(offset, length),
+              as_string_view(mm.span(offset, length)));
+  }
+
+  EXPECT_EQ(fetched, mm.bytes_fetched());
+  EXPECT_EQ(requests, server.requests());
+}
+
+TEST(http_mmif, cache_file) {
+  auto data = test::create_random_string(512 * 1024);
+  http_test_server server(data);
+  test::test_logger lgr;
+
+  http_mmif_options opts;
+  opts.chunk_size = 16 * 1024;
+  opts.cache_file = std::filesystem::temp_directory_path() /
+                    fmt::format("dwarfs_http_mmif_test_{}.cache", ::getpid());
+
+  std::filesystem::remove(opts.cache_file);
+
+  {
+    http_mmif mm(lgr, server.url(), opts);
+    EXPECT_EQ(data.substr(1000, 100000),
+              as_string_view(mm.span(1000, 100000)));
+    EXPECT_GT(mm.bytes_fetched(), 0);
+  }
+
+  {
+    http_mmif mm(lgr, server.url(), opts);
+    EXPECT_EQ(data.substr(1000, 100000),
+              as_string_view(mm.span(1000, 100000)));
+    EXPECT_EQ(0, mm.bytes_fetched());
+  }
+
+  server.set_etag("\"v2\"");
+
+  {
+    http_mmif mm(lgr, server.url(), opts);
+    EXPECT_EQ(data.substr(1000, 100000),
+              as_string_view(mm.span(1000, 100000)));
+    EXPECT_GT(mm.bytes_fetched(), 0);
+  }
+
+  std::filesystem::remove(opts.cache_file);
+}
+
+TEST(http_mmif, range_requests_not_supported) {
+  http_test_server server(test::create_random_string(1000));
+  test::test_logger lgr;
+
+  server.set_range_support(false);
+
+  EXPECT_THAT([&] { http_mmif(lgr, server.url()); },
+              ::testing::ThrowsMessage<dwarfs::runtime_error>(
+                  ::testing::HasSubstr("does not support range requests")));
+}
+
+TEST(http_mmif, filesystem) {
+  auto os = std::make_shared<test::os_access_mock>();
+  std::mt19937_64 rng{42};
+  std::vector<std::string> contents;
+
+  os->add("", {1, 040755, 1, 0, 0, 10, 42, 0, 0, 0});
+
+  for (size_t i = 0; i < 64; ++i) {
+    contents.push_back(
+        test::create_random_string(rng() % 50000, 32, 127, rng));
+    os->add_file(std::to_string(i), contents.back());
+  }
+
+  std::string image;
+
+  {
+    auto fa = std::make_shared<test::test_file_access>();
+    test::test_iolayer iol{os, fa};
+    std::vector<std::string> args{"mkdwarfs", "-i", "/",     "-o",
+                                  "-",        "-l3", "-S16"};
+    ASSERT_EQ(0, mkdwarfs_main(args, iol.get()));
+    image = iol.out();
+  }
+
+  http_test_server server(image);
+  test::test_logger lgr;
+
+  http_mmif_options mmopts;
+  mmopts.chunk_size = 4096;
+
+  auto mm = std::make_shared<http_mmif>(lgr, server.url(), mmopts);
+  filesystem_v2 fs(lgr, *os, mm);
+
+  // only metadata should have been fetched so far
+  EXPECT_LT(mm->bytes_fetched(), image.size());
+
+  for (size_t i = 0; i < contents.size(); ++i) {
+    auto iv = fs.find(fmt::format("/{}", i).c_str());
+    ASSERT_TRUE(iv) << i;
+    std::string buf(contents[i].size(), '\0');
+    EXPECT_EQ(buf.size(), fs.read(fs.open(*iv), buf.data(), buf.size()));
+    EXPECT_EQ(contents[i], buf) << i;
+  }
+}
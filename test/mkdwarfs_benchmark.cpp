@@ -0,0 +1,790 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * End-to-end benchmark for the complete mkdwarfs pipeline
+ *
+ * Each corpus is generated deterministically into an in-memory
+ * `os_access_mock` and fed through `mkdwarfs_main`. All file contents
+ * are generated up front, so generating them isn't part of any stage.
+ * The image is only counted, never stored. Stage boundaries are taken
+ * from the events mkdwarfs writes with `--stage-events`, so stages that
+ * overlap in practice (e.g. block compression running alongside
+ * segmenting) are attributed to the stage during which the main thread
+ * is waiting for them.
+ *
+ * Results are written to stdout as JSON.
+ *
+ * Usage: mkdwarfs_benchmark [--corpus NAME]... [--scale N] [--repeat N]
+ *                           [-- mkdwarfs-options...]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <numbers>
+#include <optional>
+#include <random>
+#include <span>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include <fmt/format.h>
+
+#include <folly/json.h>
+
+#include "dwarfs/file_access.h"
+#include "dwarfs/iolayer.h"
+#include "dwarfs/version.h"
+#include "dwarfs_tool_main.h"
+
+#include "loremipsum.h"
+#include "test_helpers.h"
+
+using namespace dwarfs;
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+/*
+ * Process resource usage
+ */
+
+double cpu_seconds() {
+#ifdef _WIN32
+  FILETIME creation, exited, kernel, user;
+  if (!::GetProcessTimes(::GetCurrentProcess(), &creation, &exited, &kernel,
+                         &user)) {
+    return 0.0;
+  }
+  auto to_100ns = [](FILETIME const& ft) {
+    return (static_cast<uint64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+  };
+  return (to_100ns(kernel) + to_100ns(user)) * 1e-7;
+#else
+  struct rusage ru;
+  ::getrusage(RUSAGE_SELF, &ru);
+  auto tv = [](struct timeval const& t) { return t.tv_sec + t.tv_usec * 1e-6; };
+  return tv(ru.ru_utime) + tv(ru.ru_stime);
+#endif
+}
+
+// Reset the peak RSS high water mark where the OS supports it (Linux).
+// Elsewhere, peaks are process-wide maxima up to that point.
+void reset_peak_rss() {
+#ifdef __linux__
+  std::ofstream ofs("/proc/self/clear_refs");
+  ofs << "5";
+#endif
+}
+
+uint64_t peak_rss_bytes() {
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS pmc;
+  if (::GetProcessMemoryInfo(::GetCurrentProcess(), &pmc, sizeof(pmc))) {
+    return pmc.PeakWorkingSetSize;
+  }
+  return 0;
+#elif defined(__linux__)
+  std::ifstream ifs("/proc/self/status");
+  std::string line;
+  while (std::getline(ifs, line)) {
+    if (line.starts_with("VmHWM:")) {
+      return std::stoull(line.substr(6)) * 1024;
+    }
+  }
+  return 0;
+#else
+  struct rusage ru;
+  ::getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+  return ru.ru_maxrss;
+#else
+  return static_cast<uint64_t>(ru.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+/*
+ * Stage tracking based on the stage events written by mkdwarfs
+ */
+
+constexpr std::string_view const kStageEventsPath{"/stage-events.jsonl"};
+
+class stage_recorder : public std::streambuf {
+ public:
+  struct stage {
+    std::string name;
+    double wall_s{0.0};
+    double cpu_s{0.0};
+    uint64_t peak_rss{0};
+  };
+
+  stage_recorder() { begin("setup"); }
+
+  std::vector<stage> finish() {
+    std::lock_guard lock(mx_);
+    end();
+    return std::move(stages_);
+  }
+
+ protected:
+  int_type overflow(int_type ch) override {
+    if (ch != traits_type::eof()) {
+      char c = traits_type::to_char_type(ch);
+      xsputn(&c, 1);
+    }
+    return ch;
+  }
+
+  std::streamsize xsputn(char const* s, std::streamsize n) override {
+    std::lock_guard lock(mx_);
+    for (std::streamsize i = 0; i < n; ++i) {
+      if (s[i] == '\n') {
+        on_event(line_);
+        line_.clear();
+      } else {
+        line_.push_back(s[i]);
+      }
+    }
+    return n;
+  }
+
+ private:
+  void on_event(std::string const& line) {
+    auto event = folly::parseJson(line);
+    end();
+    begin(event["stage"].asString());
+  }
+
+  void begin(std::string name) {
+    current_ = std::move(name);
+    reset_peak_rss();
+    start_wall_ = clock_type::now();
+    start_cpu_ = cpu_seconds();
+  }
+
+  void end() {
+    auto& s = stages_.emplace_back();
+    s.name = current_;
+    s.wall_s = std::chrono::duration<double>(clock_type::now() - start_wall_)
+                   .count();
+    s.cpu_s = cpu_seconds() - start_cpu_;
+    s.peak_rss = peak_rss_bytes();
+  }
+
+  std::mutex mx_;
+  std::string line_;
+  std::vector<stage> stages_;
+  std::string current_;
+  clock_type::time_point start_wall_;
+  double start_cpu_{0.0};
+};
+
+// Hands the stage events file to a `stage_recorder` as it is written
+class stage_event_file_access : public test::test_file_access {
+ public:
+  explicit stage_event_file_access(stage_recorder& recorder)
+      : recorder_{recorder} {}
+
+  using test::test_file_access::open_output;
+
+  std::unique_ptr<output_stream>
+  open_output(std::filesystem::path const& path,
+              std::error_code& ec) const override {
+    if (path == kStageEventsPath) {
+      return std::make_unique<event_stream>(recorder_);
+    }
+    return test::test_file_access::open_output(path, ec);
+  }
+
+ private:
+  class event_stream : public output_stream {
+   public:
+    explicit event_stream(stage_recorder& recorder)
+        : os_{&recorder} {}
+
+    std::ostream& os() override { return os_; }
+    void close() override { os_.flush(); }
+    void close(std::error_code&) override { os_.flush(); }
+
+   private:
+    std::ostream os_;
+  };
+
+  stage_recorder& recorder_;
+};
+
+class counting_streambuf : public std::streambuf {
+ public:
+  uint64_t count() const { return count_; }
+
+ protected:
+  int_type overflow(int_type ch) override {
+    if (ch != traits_type::eof()) {
+      ++count_;
+    }
+    return ch;
+  }
+
+  std::streamsize xsputn(char const*, std::streamsize n) override {
+    count_ += n;
+    return n;
+  }
+
+ private:
+  uint64_t count_{0};
+};
+
+/*
+ * Synthetic corpora
+ */
+
+class corpus_builder {
+ public:
+  explicit corpus_builder(uint64_t seed)
+      : os_{std::make_shared<test::os_access_mock>()}
+      , rng_{seed} {
+    os_->add("", {1, 040755, 1, 0, 0, 10, 42, 0, 0, 0});
+  }
+
+  std::mt19937_64& rng() { return rng_; }
+
+  void add_dir(std::string const& path) {
+    test::simplestat st;
+    st.ino = next_ino_++;
+    st.mode = posix_file_type::directory | 0755;
+    os_->add(path, st);
+  }
+
+  void add_file(std::string const& path, std::string const& data) {
+    test::simplestat st;
+    st.ino = next_ino_++;
+    st.mode = posix_file_type::regular | 0644;
+    st.uid = 1000;
+    st.gid = 100;
+    st.size = data.size();
+    add_entry(path, st, data);
+  }
+
+  void add_entry(std::string const& path, test::simplestat const& st) {
+    os_->add(path, st);
+  }
+
+  void add_entry(std::string const& path, test::simplestat const& st,
+                 std::string const& data) {
+    os_->add(path, st, data);
+    ++files_;
+    bytes_ += st.size;
+  }
+
+  std::shared_ptr<test::os_access_mock> os() const { return os_; }
+  size_t files() const { return files_; }
+  uint64_t bytes() const { return bytes_; }
+
+ private:
+  std::shared_ptr<test::os_access_mock> os_;
+  std::mt19937_64 rng_;
+  file_stat::ino_type next_ino_{1000};
+  size_t files_{0};
+  uint64_t bytes_{0};
+};
+
+void put_le(std::string& s, size_t offset, uint64_t value, size_t bytes) {
+  for (size_t i = 0; i < bytes; ++i) {
+    s[offset + i] = static_cast<char>((value >> (8 * i)) & 0xff);
+  }
+}
+
+void put_be(std::string& s, size_t offset, uint64_t value, size_t bytes) {
+  for (size_t i = 0; i < bytes; ++i) {
+    s[offset + bytes - 1 - i] = static_cast<char>((value >> (8 * i)) & 0xff);
+  }
+}
+
+// Text made of random slices of lorem ipsum interspersed with identifiers
+std::string make_text(size_t size, std::mt19937_64& rng) {
+  auto const& li = test::loremipsum();
+  std::uniform_int_distribution<size_t> len_dist(16, 256);
+  std::string rv;
+  rv.reserve(size + 300);
+
+  while (rv.size() < size) {
+    auto len = len_dist(rng);
+    auto pos = rng() % (li.size() - len);
+    rv.append(li, pos, len);
+    rv += fmt::format("\n  id_{:x}({});\n", rng() % 4096, rng() % 100);
+  }
+
+  rv.resize(size);
+  return rv;
+}
+
+void make_sourcetree(corpus_builder& cb, size_t /*scale*/) {
+  for (auto const& [stat, name] : test::test_dirtree()) {
+    auto path = std::string(name.substr(name.size() == 5 ? 5 : 6));
+
+    switch (stat.type()) {
+    case posix_file_type::regular:
+      cb.add_entry(path, stat, test::loremipsum(stat.size));
+      break;
+    case posix_file_type::symlink:
+      cb.os()->add(path, stat, test::loremipsum(stat.size));
+      break;
+    default:
+      cb.add_entry(path, stat);
+      break;
+    }
+  }
+}
+
+// Many small files in a deep tree, mainly for the file ordering stage;
+// names share prefixes and contain characters sorting before '/'.
+void make_deeptree(corpus_builder& cb, size_t scale) {
+  auto& rng = cb.rng();
+  size_t const num_files = 100000 * scale;
+  std::vector<std::string> dirs{""};
+
+  while (dirs.size() < num_files / 50) {
+    auto parent = dirs[rng() % dirs.size()];
+    auto dir = fmt::format("{}{}d{}{}", parent, parent.empty() ? "" : "/",
+                           rng() % 3 == 0 ? "." : "-", dirs.size());
+    cb.add_dir(dir);
+    dirs.push_back(std::move(dir));
+  }
+
+  for (size_t i = 0; i < num_files; ++i) {
+    auto const& dir = dirs[rng() % dirs.size()];
+    auto size = 64 + rng() % 448;
+    cb.add_file(fmt::format("{}{}f{}.{}", dir, dir.empty() ? "" : "/",
+                            rng() % 1000, i),
+                test::loremipsum(size));
+  }
+}
+
+void make_releases(corpus_builder& cb, size_t scale) {
+  auto& rng = cb.rng();
+  size_t const num_files = 200 * scale;
+  size_t const num_releases = 12;
+  std::uniform_int_distribution<size_t> size_dist(1024, 64 * 1024);
+
+  std::vector<std::string> files;
+  files.reserve(num_files);
+  for (size_t i = 0; i < num_files; ++i) {
+    files.push_back(make_text(size_dist(rng), rng));
+  }
+
+  for (size_t r = 0; r < num_releases; ++r) {
+    auto dir = fmt::format("project-1.{}", r);
+    cb.add_dir(dir);
+    cb.add_dir(dir + "/src");
+
+    for (size_t i = 0; i < files.size(); ++i) {
+      cb.add_file(fmt::format("{}/src/file{:04}.c", dir, i), files[i]);
+    }
+
+    // mutate roughly 10% of the files for the next release
+    for (auto& f : files) {
+      if (rng() % 10 == 0) {
+        auto len = std::min<size_t>(f.size() / 4, 512 + rng() % 4096);
+        auto pos = rng() % (f.size() - len);
+        f.replace(pos, len, make_text(len + rng() % 256, rng));
+      }
+    }
+  }
+}
+
+std::string make_elf(std::vector<std::string> const& functions,
+                     std::mt19937_64& rng) {
+  size_t const num_funcs = 32 + rng() % 96;
+  std::string code;
+  std::vector<size_t> starts;
+
+  for (size_t i = 0; i < num_funcs; ++i) {
+    starts.push_back(code.size());
+    code += functions[rng() % functions.size()];
+  }
+
+  // patch in relative calls between functions, like real executables
+  for (size_t i = 0; i + 5 < code.size(); i += 16 + rng() % 48) {
+    code[i] = static_cast<char>(0xe8);
+    auto target = starts[rng() % starts.size()];
+    put_le(code, i + 1, static_cast<uint32_t>(target - (i + 5)), 4);
+  }
+
+  auto data = make_text(code.size() / 2, rng);
+
+  size_t const ehdr = 64;
+  size_t const shentsize = 64;
+  size_t const text_off = ehdr;
+  size_t const data_off = text_off + code.size();
+  size_t const shoff = data_off + data.size();
+
+  std::string elf(shoff + 3 * shentsize, '\0');
+  std::memcpy(elf.data(), "\177ELF\2\1\1", 7);
+  put_le(elf, 16, 2, 2);        // e_type = ET_EXEC
+  put_le(elf, 18, 62, 2);       // e_machine = EM_X86_64
+  put_le(elf, 20, 1, 4);        // e_version
+  put_le(elf, 24, 0x401000, 8); // e_entry
+  put_le(elf, 40, shoff, 8);
+  put_le(elf, 52, ehdr, 2);
+  put_le(elf, 58, shentsize, 2);
+  put_le(elf, 60, 3, 2);
+
+  std::memcpy(elf.data() + text_off, code.data(), code.size());
+  std::memcpy(elf.data() + data_off, data.data(), data.size());
+
+  auto section = [&](size_t index, uint64_t flags, size_t offset,
+                     size_t size) {
+    auto sh = shoff + index * shentsize;
+    put_le(elf, sh + 4, 1, 4); // SHT_PROGBITS
+    put_le(elf, sh + 8, flags, 8);
+    put_le(elf, sh + 24, offset, 8);
+    put_le(elf, sh + 32, size, 8);
+  };
+
+  section(1, 0x6, text_off, code.size()); // SHF_ALLOC | SHF_EXECINSTR
+  section(2, 0x3, data_off, data.size()); // SHF_ALLOC | SHF_WRITE
+
+  return elf;
+}
+
+void make_elf_binaries(corpus_builder& cb, size_t scale) {
+  auto& rng = cb.rng();
+
+  // a pool of "library functions" shared between executables
+  static constexpr uint8_t const opcodes[] = {
+      0x48, 0x89, 0x8b, 0x83, 0x85, 0xc3, 0x0f, 0x1f, 0x44, 0x00,
+      0x55, 0x5d, 0x41, 0x57, 0x56, 0x53, 0xe9, 0x74, 0x75, 0xff};
+  std::vector<std::string> functions(512);
+  for (auto& f : functions) {
+    f.resize(64 + rng() % 1024);
+    for (auto& c : f) {
+      c = rng() % 4 == 0 ? static_cast<char>(rng())
+                         : static_cast<char>(opcodes[rng() % sizeof(opcodes)]);
+    }
+  }
+
+  cb.add_dir("bin");
+  cb.add_dir("lib");
+
+  for (size_t i = 0; i < 64 * scale; ++i) {
+    cb.add_file(fmt::format("{}/prog{:04}", i % 4 == 0 ? "lib" : "bin", i),
+                make_elf(functions, rng));
+  }
+}
+
+std::string make_wav(size_t frames, std::mt19937_64& rng) {
+  size_t const channels = 2;
+  size_t const data_size = frames * channels * sizeof(int16_t);
+  std::string wav(44 + data_size, '\0');
+
+  std::memcpy(wav.data(), "RIFF", 4);
+  put_le(wav, 4, wav.size() - 8, 4);
+  std::memcpy(wav.data() + 8, "WAVEfmt ", 8);
+  put_le(wav, 16, 16, 4);
+  put_le(wav, 20, 1, 2); // PCM
+  put_le(wav, 22, channels, 2);
+  put_le(wav, 24, 44100, 4);
+  put_le(wav, 28, 44100 * channels * 2, 4);
+  put_le(wav, 32, channels * 2, 2);
+  put_le(wav, 34, 16, 2);
+  std::memcpy(wav.data() + 36, "data", 4);
+  put_le(wav, 40, data_size, 4);
+
+  std::normal_distribution<double> noise(0.0, 200.0);
+  double const f1 = 110.0 + rng() % 880;
+  double const f2 = f1 * 1.5;
+  double const k = 2.0 * std::numbers::pi / 44100.0;
+
+  for (size_t i = 0; i < frames; ++i) {
+    for (size_t c = 0; c < channels; ++c) {
+      auto v = 8000.0 * std::sin(k * f1 * i + c) +
+               4000.0 * std::sin(k * f2 * i) + noise(rng);
+      put_le(wav, 44 + (i * channels + c) * 2,
+             static_cast<uint16_t>(static_cast<int16_t>(v)), 2);
+    }
+  }
+
+  return wav;
+}
+
+void make_pcmaudio(corpus_builder& cb, size_t scale) {
+  auto& rng = cb.rng();
+  cb.add_dir("audio");
+  for (size_t i = 0; i < 16 * scale; ++i) {
+    cb.add_file(fmt::format("audio/track{:02}.wav", i),
+                make_wav(44100 * (5 + rng() % 20), rng));
+  }
+}
+
+std::string make_fits(size_t width, size_t height, std::mt19937_64& rng) {
+  constexpr size_t const granularity = 2880;
+  std::string header;
+
+  auto card = [&header](std::string_view keyword, std::string_view value) {
+    auto c = fmt::format("{:<8}= {:>20}", keyword, value);
+    c.resize(80, ' ');
+    header += c;
+  };
+
+  card("SIMPLE", "T");
+  card("BITPIX", "16");
+  card("NAXIS", "2");
+  card("NAXIS1", std::to_string(width));
+  card("NAXIS2", std::to_string(height));
+  header += fmt::format("{:<80}", "END");
+  header.resize((header.size() + granularity - 1) / granularity * granularity,
+                ' ');
+
+  auto const data_size = width * height * sizeof(uint16_t);
+  std::string fits(header);
+  fits.resize(header.size() +
+              (data_size + granularity - 1) / granularity * granularity);
+
+  std::normal_distribution<double> noise(0.0, 40.0);
+  double const cx = rng() % width;
+  double const cy = rng() % height;
+
+  for (size_t y = 0; y < height; ++y) {
+    for (size_t x = 0; x < width; ++x) {
+      auto d = std::hypot(x - cx, y - cy);
+      auto v = 1000.0 + 12000.0 / (1.0 + d / 50.0) + noise(rng);
+      // 14-bit sensor data, stored in the upper bits
+      auto pixel = static_cast<uint16_t>(std::clamp(v, 0.0, 16383.0)) << 2;
+      put_be(fits, header.size() + (y * width + x) * 2, pixel, 2);
+    }
+  }
+
+  return fits;
+}
+
+void make_fits_images(corpus_builder& cb, size_t scale) {
+  auto& rng = cb.rng();
+  cb.add_dir("fits");
+  for (size_t i = 0; i < 16 * scale; ++i) {
+    cb.add_file(fmt::format("fits/frame{:03}.fit", i),
+                make_fits(1024, 768, rng));
+  }
+}
+
+void make_random(corpus_builder& cb, size_t scale) {
+  auto& rng = cb.rng();
+  cb.add_dir("random");
+  for (size_t i = 0; i < 32 * scale; ++i) {
+    size_t const size = (1 << 20) + rng() % (1 << 20);
+    auto const seed = rng();
+    cb.add_file(fmt::format("random/blob{:03}.bin", i),
+                test::create_random_string(size, seed));
+  }
+}
+
+struct corpus {
+  std::string_view name;
+  void (*build)(corpus_builder&, size_t);
+};
+
+constexpr corpus const corpora[] = {
+    {"sourcetree", &make_sourcetree},
+    {"deeptree", &make_deeptree},
+    {"releases", &make_releases},
+    {"elf", &make_elf_binaries},
+    {"pcmaudio", &make_pcmaudio},
+    {"fits", &make_fits_images},
+    {"random", &make_random},
+};
+
+folly::dynamic run_once(corpus_builder const& cb,
+                        std::vector<std::string> args) {
+  stage_recorder recorder;
+  auto fa = std::make_shared<stage_event_file_access>(recorder);
+  test::test_iolayer tiol{cb.os(), fa};
+  auto const& base = tiol.get();
+
+  std::istringstream in;
+  counting_streambuf out_buf;
+  std::ostream out(&out_buf);
+  std::ostringstream err;
+
+  args.push_back(fmt::format("--stage-events={}", kStageEventsPath));
+
+  iolayer iol{base.os, base.term, base.file, in, out, err};
+
+  auto start_wall = clock_type::now();
+  auto start_cpu = cpu_seconds();
+
+  auto exit_code = mkdwarfs_main(args, iol);
+
+  auto wall = std::chrono::duration<double>(clock_type::now() - start_wall);
+  auto cpu = cpu_seconds() - start_cpu;
+  auto stages = recorder.finish();
+
+  folly::dynamic run = folly::dynamic::object;
+  folly::dynamic st = folly::dynamic::array;
+  uint64_t peak_rss{0};
+
+  for (auto const& s : stages) {
+    st.push_back(folly::dynamic::object("name", s.name)(
+        "wall_s", s.wall_s)("cpu_s", s.cpu_s)(
+        "peak_rss_bytes", static_cast<int64_t>(s.peak_rss)));
+    peak_rss = std::max(peak_rss, s.peak_rss);
+  }
+
+  run["exit_code"] = exit_code;
+  run["wall_s"] = wall.count();
+  run["cpu_s"] = cpu;
+  run["peak_rss_bytes"] = static_cast<int64_t>(peak_rss);
+  run["output_bytes"] = static_cast<int64_t>(out_buf.count());
+  run["stages"] = std::move(st);
+
+  if (exit_code != 0) {
+    run["log"] = err.str();
+  }
+
+  return run;
+}
+
+int usage(std::ostream& os) {
+  os << "usage: mkdwarfs_benchmark [--corpus NAME]... [--scale N] "
+        "[--repeat N] [-- mkdwarfs-options...]\n\ncorpora:";
+  for (auto const& c : corpora) {
+    os << " " << c.name;
+  }
+  os << "\n";
+  return 1;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  std::vector<std::string_view> selected;
+  std::vector<std::string> extra_args;
+  size_t scale = 1;
+  size_t repeat = 1;
+
+  try {
+    for (int i = 1; i < argc; ++i) {
+      std::string_view arg{argv[i]};
+      if (arg == "--") {
+        extra_args.assign(argv + i + 1, argv + argc);
+        break;
+      }
+      if (i + 1 >= argc) {
+        return usage(std::cerr);
+      }
+      if (arg == "--corpus") {
+        selected.emplace_back(argv[++i]);
+      } else if (arg == "--scale") {
+        scale = std::stoul(argv[++i]);
+      } else if (arg == "--repeat") {
+        repeat = std::stoul(argv[++i]);
+      } else {
+        return usage(std::cerr);
+      }
+    }
+  } catch (std::exception const&) {
+    return usage(std::cerr);
+  }
+
+  for (auto name : selected) {
+    if (std::none_of(std::begin(corpora), std::end(corpora),
+                     [name](auto const& c) { return c.name == name; })) {
+      std::cerr << "unknown corpus: " << name << "\n";
+      return usage(std::cerr);
+    }
+  }
+
+  std::vector<std::string> args{"mkdwarfs",
+                                "-i",
+                                "/",
+                                "-o",
+                                "-",
+                                "--no-progress",
+                                "--log-level=info",
+                                "--categorize=binary,fits,pcmaudio,"
+                                "incompressible"};
+  args.insert(args.end(), extra_args.begin(), extra_args.end());
+
+  folly::dynamic result = folly::dynamic::object;
+  result["version"] = PRJ_GIT_ID;
+  result["scale"] = static_cast<int64_t>(scale);
+  result["mkdwarfs_args"] = folly::dynamic::array;
+  for (auto const& a : args) {
+    result["mkdwarfs_args"].push_back(a);
+  }
+
+  folly::dynamic results = folly::dynamic::array;
+
+  for (size_t ci = 0; ci < std::size(corpora); ++ci) {
+    auto const& c = corpora[ci];
+
+    if (!selected.empty() &&
+        std::find(selected.begin(), selected.end(), c.name) ==
+            selected.end()) {
+      continue;
+    }
+
+    corpus_builder cb(42 + ci);
+    c.build(cb, scale);
+
+    folly::dynamic runs = folly::dynamic::array;
+    for (size_t r = 0; r < repeat; ++r) {
+      runs.push_back(run_once(cb, args));
+    }
+
+    auto output_bytes = runs[0]["output_bytes"].asInt();
+
+    auto input_bytes = static_cast<int64_t>(cb.bytes());
+
+    results.push_back(folly::dynamic::object("name", std::string(c.name))(
+        "files", static_cast<int64_t>(cb.files()))("input_bytes", input_bytes)(
+        "output_bytes", output_bytes)(
+        "ratio", input_bytes > 0
+                     ? static_cast<double>(output_bytes) / input_bytes
+                     : 0.0)("runs", std::move(runs)));
+  }
+
+  result["corpora"] = std::move(results);
+
+  std::cout << folly::toPrettyJson(result) << "\n";
+
+  return 0;
+}
@@ -0,0 +1,232 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <boost/program_options.hpp>
+
+#include <fmt/format.h>
+
+#include <folly/json.h>
+#include <folly/lang/Bits.h>
+
+#include "dwarfs/categorizer.h"
+
+#include "loremipsum.h"
+#include "test_logger.h"
+
+using namespace dwarfs;
+
+namespace fs = std::filesystem;
+namespace po = boost::program_options;
+
+namespace {
+
+template <typename T>
+std::vector<uint8_t> make_array(size_t count, bool big_endian) {
+  std::vector<uint8_t> data(count * sizeof(T));
+  for (size_t i = 0; i < count; ++i) {
+    auto v = static_cast<T>(1000.0 * std::sin(0.001 * i));
+    if constexpr (sizeof(T) == 8) {
+      uint64_t u;
+      std::memcpy(&u, &v, sizeof(u));
+      u = big_endian ? folly::Endian::big(u) : folly::Endian::little(u);
+      std::memcpy(data.data() + i * sizeof(T), &u, sizeof(u));
+    } else {
+      uint32_t u;
+      std::memcpy(&u, &v, sizeof(u));
+      u = big_endian ? folly::Endian::big(u) : folly::Endian::little(u);
+      std::memcpy(data.data() + i * sizeof(T), &u, sizeof(u));
+    }
+  }
+  return data;
+}
+
+std::vector<uint8_t> make_npy(std::string_view descr, size_t count,
+                              std::vector<uint8_t> const& payload) {
+  auto dict = fmt::format("{{'descr': '{}', 'fortran_order': False, "
+                          "'shape': ({},), }}",
+                          descr, count);
+  dict.resize(117, ' ');
+  dict.push_back('\n');
+  std::vector<uint8_t> data{0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0};
+  data.push_back(dict.size() & 0xff);
+  data.push_back(dict.size() >> 8);
+  data.insert(data.end(), dict.begin(), dict.end());
+  data.insert(data.end(), payload.begin(), payload.end());
+  return data;
+}
+
+} // namespace
+
+class numeric_categorizer : public ::testing::Test {
+ protected:
+  void SetUp() override { lgr.clear(); }
+
+  void create_catmgr(std::vector<char const*> args = {}) {
+    auto& catreg = categorizer_registry::instance();
+
+    po::options_description opts;
+    catreg.add_options(opts);
+
+    args.insert(args.begin(), "program");
+
+    po::variables_map vm;
+    auto parsed = po::parse_command_line(args.size(), args.data(), opts);
+
+    po::store(parsed, vm);
+    po::notify(vm);
+
+    catmgr = std::make_shared<categorizer_manager>(lgr);
+    catmgr->add(catreg.create(lgr, "numeric", vm));
+
+    array_category = catmgr->category_value("numeric/array").value();
+    metadata_category = catmgr->category_value("numeric/metadata").value();
+  }
+
+  auto categorize(fs::path const& path, std::span<uint8_t const> data) {
+    auto job = catmgr->job(path);
+    job.set_total_size(data.size());
+    job.categorize_random_access(data);
+    return job.result();
+  }
+
+  folly::dynamic metadata(fragment_category cat) const {
+    return folly::parseJson(catmgr->category_metadata(cat));
+  }
+
+  std::shared_ptr<categorizer_manager> catmgr;
+  test::test_logger lgr{logger::INFO};
+  fragment_category::value_type array_category;
+  fragment_category::value_type metadata_category;
+};
+
+TEST_F(numeric_categorizer, npy) {
+  create_catmgr();
+
+  auto payload = make_array<float>(1000, true);
+  auto data = make_npy(">f4", 1000, payload);
+  auto frag = categorize("test.npy", data);
+  auto fs = frag.span();
+
+  ASSERT_EQ(2, fs.size());
+  EXPECT_EQ(metadata_category, fs[0].category().value());
+  EXPECT_EQ(128, fs[0].size());
+  EXPECT_EQ(array_category, fs[1].category().value());
+  EXPECT_EQ(4000, fs[1].size());
+
+  auto meta = metadata(fs[1].category());
+  EXPECT_EQ(4, meta["element_size"].asInt());
+  EXPECT_EQ("big", meta["endianness"].asString());
+}
+
+TEST_F(numeric_categorizer, npy_complex_with_trailer) {
+  create_catmgr();
+
+  std::vector<uint8_t> payload(10 * 16 + 7, 0);
+  auto data = make_npy("<c16", 10, payload);
+  auto frag = categorize("complex.npy", data);
+  auto fs = frag.span();
+
+  ASSERT_EQ(3, fs.size());
+  EXPECT_EQ(metadata_category, fs[0].category().value());
+  EXPECT_EQ(array_category, fs[1].category().value());
+  EXPECT_EQ(160, fs[1].size());
+  EXPECT_EQ(metadata_category, fs[2].category().value());
+  EXPECT_EQ(7, fs[2].size());
+
+  auto meta = metadata(fs[1].category());
+  EXPECT_EQ(8, meta["element_size"].asInt());
+  EXPECT_EQ("little", meta["endianness"].asString());
+}
+
+TEST_F(numeric_categorizer, npy_unsupported) {
+  create_catmgr();
+
+  std::vector<uint8_t> payload(100, 0);
+
+  EXPECT_TRUE(categorize("u1.npy", make_npy("|u1", 100, payload)).empty());
+  EXPECT_TRUE(categorize("str.npy", make_npy("<U5", 5, payload)).empty());
+}
+
+TEST_F(numeric_categorizer, raw_arrays) {
+  create_catmgr();
+
+  {
+    auto data = make_array<float>(100000, false);
+    auto frag = categorize("f32le", data);
+    ASSERT_EQ(1, frag.span().size());
+    auto meta = metadata(frag.span()[0].category());
+    EXPECT_EQ(4, meta["element_size"].asInt());
+    EXPECT_EQ("little", meta["endianness"].asString());
+  }
+
+  {
+    auto data = make_array<double>(100000, true);
+    auto frag = categorize("f64be", data);
+    ASSERT_EQ(1, frag.span().size());
+    auto meta = metadata(frag.span()[0].category());
+    EXPECT_EQ(8, meta["element_size"].asInt());
+    EXPECT_EQ("big", meta["endianness"].asString());
+  }
+
+  {
+    auto text = test::loremipsum(200000);
+    std::span<uint8_t const> data(
+        reinterpret_cast<uint8_t const*>(text.data()), text.size());
+    EXPECT_TRUE(categorize("text", data).empty());
+  }
+}
+
+TEST_F(numeric_categorizer, raw_min_size) {
+  create_catmgr({"--numeric-raw-min-size=1M"});
+
+  auto data = make_array<float>(100000, false);
+  EXPECT_TRUE(categorize("f32le", data).empty());
+}
+
+TEST_F(numeric_categorizer, requirements) {
+  create_catmgr();
+
+  catmgr->set_metadata_requirements(array_category,
+                                    R"({"element_size": ["set", [8]]})");
+
+  auto data = make_npy("<f4", 1000, make_array<float>(1000, false));
+  EXPECT_TRUE(categorize("f32.npy", data).empty());
+
+  data = make_npy("<f8", 1000, make_array<double>(1000, false));
+  EXPECT_EQ(2, categorize("f64.npy", data).span().size());
+
+  EXPECT_THAT(
+      [&] {
+        catmgr->set_metadata_requirements(array_category,
+                                          R"({"foo": ["set", ["bar"]]})");
+      },
+      ::testing::ThrowsMessage<std::runtime_error>(
+          "unsupported metadata requirements: foo"));
+}
@@ -0,0 +1,151 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "dwarfs/packed_tables.h"
+
+using namespace dwarfs;
+
+namespace {
+
+struct wrapped {
+  uint32_t value;
+  uint32_t get() const { return value; }
+};
+
+} // namespace
+
+TEST(delta_list_index, lookup) {
+  std::mt19937_64 rng{42};
+  std::uniform_int_distribution<uint32_t> dist{0, 1000};
+
+  for (size_t size : {1, 2, 15, 16, 17, 31, 32, 33, 1000}) {
+    std::vector<uint32_t> deltas(size);
+    std::generate(deltas.begin(), deltas.end(), [&] { return dist(rng); });
+
+    std::vector<uint32_t> expected(size);
+    std::partial_sum(deltas.begin(), deltas.end(), expected.begin());
+
+    delta_list_index index(deltas);
+
+    ASSERT_EQ(size, index.size());
+
+    for (size_t i = 0; i < size; ++i) {
+      EXPECT_EQ(expected[i], index.lookup(deltas, i)) << size << ", " << i;
+    }
+
+    EXPECT_EQ(expected, index.unpack(deltas));
+    EXPECT_LE(index.memory_usage(),
+              sizeof(uint32_t) *
+                  (size / delta_list_index::kSampleInterval + 1));
+  }
+}
+
+TEST(delta_list_index, projection) {
+  std::vector<wrapped> deltas{{3}, {0}, {5}, {1}, {0}, {7}};
+  auto proj = [](wrapped const& w) { return w.get(); };
+
+  delta_list_index index(deltas, proj);
+
+  EXPECT_EQ(3, index.lookup(deltas, 0, proj));
+  EXPECT_EQ(3, index.lookup(deltas, 1, proj));
+  EXPECT_EQ(9, index.lookup(deltas, 3, proj));
+  EXPECT_EQ(16, index.lookup(deltas, 5, proj));
+  EXPECT_THAT(index.unpack(deltas, proj),
+              ::testing::ElementsAre(3, 3, 8, 9, 9, 16));
+}
+
+TEST(run_length_index, lookup) {
+  std::mt19937_64 rng{42};
+
+  for (auto max_run : {0, 1, 3, 40}) {
+    std::uniform_int_distribution<uint32_t> dist(0, max_run);
+
+    for (size_t runs : {1, 2, 7, 100}) {
+      std::vector<uint32_t> encoded(runs);
+      std::generate(encoded.begin(), encoded.end(), [&] { return dist(rng); });
+
+      std::vector<uint32_t> expected;
+      for (uint32_t r = 0; r < runs; ++r) {
+        expected.insert(expected.end(),
+                        encoded[r] + run_length_index::kMinRunLength, r);
+      }
+
+      run_length_index index(encoded);
+
+      ASSERT_EQ(expected.size(), index.size());
+
+      for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(expected[i], index.lookup(encoded, i))
+            << max_run << ", " << runs << ", " << i;
+      }
+
+      EXPECT_EQ(expected, index.unpack(encoded));
+    }
+  }
+}
+
+TEST(packed_int_vector, roundtrip) {
+  std::mt19937_64 rng{42};
+
+  for (uint64_t max_value :
+       {uint64_t(0), uint64_t(1), uint64_t(5), uint64_t(1000),
+        uint64_t(123456789), ~uint64_t(0)}) {
+    std::uniform_int_distribution<uint64_t> dist(0, max_value);
+    std::vector<uint64_t> values(777);
+    std::generate(values.begin(), values.end(), [&] { return dist(rng); });
+
+    packed_int_vector vec(values.size(), max_value);
+
+    ASSERT_EQ(values.size(), vec.size());
+    EXPECT_EQ(std::bit_width(max_value), vec.bits());
+
+    // write in random order to make sure neighbours aren't clobbered
+    std::vector<size_t> order(values.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), rng);
+
+    for (auto i : order) {
+      vec.set(i, values[i]);
+    }
+
+    for (size_t i = 0; i < values.size(); ++i) {
+      EXPECT_EQ(values[i], vec[i]) << max_value << ", " << i;
+    }
+
+    for (size_t i = 0; i < values.size(); i += 3) {
+      vec.set(i, 0);
+    }
+
+    for (size_t i = 0; i < values.size(); ++i) {
+      EXPECT_EQ(i % 3 == 0 ? 0 : values[i], vec[i]) << max_value << ", " << i;
+    }
+  }
+}
@@ -0,0 +1,260 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <fmt/format.h>
+
+#include "dwarfs/categorizer.h"
+#include "dwarfs/entry.h"
+#include "dwarfs/inode.h"
+#include "dwarfs/inode_manager.h"
+#include "dwarfs/inode_ordering.h"
+#include "dwarfs/mmif.h"
+#include "dwarfs/options.h"
+#include "dwarfs/parallel_sort.h"
+#include "dwarfs/progress.h"
+#include "dwarfs/worker_group.h"
+
+#include "test_helpers.h"
+#include "test_logger.h"
+
+using namespace dwarfs;
+
+TEST(parallel_sort, matches_std_sort) {
+  test::test_logger lgr;
+  test::os_access_mock os;
+  std::mt19937_64 rng{42};
+
+  for (size_t workers : {1, 2, 3, 7}) {
+    worker_group wg(lgr, os, "sort", workers);
+
+    for (size_t size : {0, 1, 100, 1000, 12345, 100000}) {
+      std::vector<std::string> data(size);
+      for (auto& s : data) {
+        s = test::create_random_string(1 + rng() % 16, 'a', 'f', rng);
+        s += std::to_string(rng());
+      }
+
+      auto expected = data;
+      std::sort(expected.begin(), expected.end());
+
+      parallel_sort(wg, data.begin(), data.end(), std::less<>{}, 100);
+
+      EXPECT_EQ(expected, data) << workers << "/" << size;
+    }
+  }
+}
+
+TEST(parallel_sort, for_ranges) {
+  test::test_logger lgr;
+  test::os_access_mock os;
+  worker_group wg(lgr, os, "ranges", 4);
+
+  std::vector<std::atomic<int>> seen(10000);
+
+  parallel_for_ranges(wg, seen.size(), 100, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      ++seen[i];
+    }
+  });
+
+  EXPECT_TRUE(std::all_of(seen.begin(), seen.end(),
+                          [](auto const& v) { return v.load() == 1; }));
+
+  EXPECT_THROW(parallel_for_ranges(wg, seen.size(), 100,
+                                   [](size_t begin, size_t) {
+                                     if (begin > 0) {
+                                       throw std::runtime_error("error");
+                                     }
+                                   }),
+               std::runtime_error);
+}
+
+TEST(parallel_sort, inode_orderings_match_comparators) {
+  namespace fs = std::filesystem;
+
+  test::test_logger lgr;
+  auto os = std::make_shared<test::os_access_mock>();
+  std::mt19937_64 rng{42};
+
+  os->add("", {1, 040755, 1, 0, 0, 10, 42, 0, 0, 0});
+
+  // Directory and file names are shared across directories and include
+  // characters that sort before the path separator, which is where path
+  // order and per-component order differ. With three levels, there are
+  // well over `kMinParallelChunk` files, so all sorts run in parallel.
+  std::vector<std::string> const dir_names{"a", "a-b", "a.b", "ab", "b"};
+  std::vector<fs::path> dirs{""};
+  std::vector<fs::path> files;
+
+  for (size_t level = 0, begin = 0; level < 3; ++level) {
+    auto const end = dirs.size();
+    for (size_t d = begin; d < end; ++d) {
+      for (auto const& name : dir_names) {
+        auto path = dirs[d] / name;
+        os->add_dir(path);
+        dirs.push_back(path);
+      }
+    }
+    begin = end;
+  }
+
+  for (auto const& dir : dirs) {
+    std::vector<std::string> names;
+    for (size_t i = 0; i < 128; ++i) {
+      names.push_back(fmt::format("f{}", i));
+    }
+    if (std::distance(dir.begin(), dir.end()) == 3) {
+      // Leaf directories can have files named like directories elsewhere
+      names.insert(names.end(), dir_names.begin(), dir_names.end());
+      names.push_back("a-");
+      names.push_back("a.");
+    }
+    for (auto const& name : names) {
+      auto path = dir / name;
+      // few distinct sizes, so that there are many ties
+      os->add_file(path, test::create_random_string(64 * (1 + rng() % 8),
+                                                    'a', 'z', rng));
+      files.push_back(path);
+    }
+  }
+
+  auto ef = entry_factory::create();
+  progress prog([](progress const&, bool) {}, 1000);
+
+  inode_options iopts;
+  iopts.fragment_order.set_default({.mode = file_order_mode::SIMILARITY});
+  // larger files won't have a similarity hash
+  iopts.max_similarity_scan_size = 256;
+
+  inode_manager im(lgr, prog, iopts);
+
+  std::vector<std::shared_ptr<entry>> entries;
+  std::map<fs::path, std::shared_ptr<entry>> dir_entries;
+  std::vector<std::shared_ptr<inode>> inodes;
+
+  dir_entries[""] = ef->create(*os, "/");
+
+  for (size_t d = 1; d < dirs.size(); ++d) {
+    dir_entries[dirs[d]] =
+        ef->create(*os, dirs[d], dir_entries.at(dirs[d].parent_path()));
+  }
+
+  for (auto const& path : files) {
+    auto e = ef->create(*os, path, dir_entries.at(path.parent_path()));
+    auto f = dynamic_cast<file*>(e.get());
+    ASSERT_TRUE(f) << path;
+    auto ino = im.create_inode();
+    ino->set_files({f});
+    auto mm = os->map_file(path);
+    ino->scan(mm.get(), iopts, prog);
+    entries.push_back(std::move(e));
+    inodes.push_back(std::move(ino));
+  }
+
+  auto const cat = categorizer_manager::default_category();
+  inode_ordering order(lgr, prog, iopts);
+  worker_group wg(lgr, *os, "order", 4);
+
+  // The comparators used before the orderings were parallelized
+  auto less_revpath = [&](uint32_t a, uint32_t b) {
+    return inodes[a]->any()->less_revpath(*inodes[b]->any());
+  };
+
+  auto less_by_size = [&](uint32_t a, uint32_t b) {
+    auto sa = inodes[a]->size();
+    auto sb = inodes[b]->size();
+    return sa > sb || (sa == sb && less_revpath(a, b));
+  };
+
+  std::vector<uint32_t> all(inodes.size());
+  std::iota(all.begin(), all.end(), 0);
+
+  {
+    std::vector<std::string> paths;
+    for (auto const& i : inodes) {
+      paths.push_back(i->any()->path_as_string());
+    }
+
+    auto expected = all;
+    std::sort(expected.begin(), expected.end(),
+              [&](auto a, auto b) { return paths[a] < paths[b]; });
+
+    sortable_inode_span sp(inodes);
+    sp.all();
+    order.by_path(wg, sp);
+
+    EXPECT_EQ(expected, sp.index());
+  }
+
+  {
+    auto expected = all;
+    std::sort(expected.begin(), expected.end(), less_revpath);
+
+    sortable_inode_span sp(inodes);
+    sp.all();
+    order.by_reverse_path(wg, sp);
+
+    EXPECT_EQ(expected, sp.index());
+  }
+
+  {
+    std::vector<std::optional<uint32_t>> hashes;
+    for (auto const& i : inodes) {
+      hashes.push_back(i->similarity_hash(cat));
+    }
+
+    auto expected = all;
+    auto start = std::stable_partition(
+        expected.begin(), expected.end(),
+        [&](auto i) { return !hashes[i].has_value(); });
+
+    ASSERT_NE(expected.begin(), start);
+    ASSERT_NE(expected.end(), start);
+
+    std::sort(expected.begin(), start, less_by_size);
+    std::sort(start, expected.end(), [&](auto a, auto b) {
+      if (*hashes[a] != *hashes[b]) {
+        return *hashes[a] < *hashes[b];
+      }
+      return less_by_size(a, b);
+    });
+
+    sortable_inode_span sp(inodes);
+    sp.all();
+    order.by_similarity(wg, sp, cat);
+
+    EXPECT_EQ(expected, sp.index());
+  }
+}
@@ -0,0 +1,113 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "dwarfs/pcm_sample_transformer.h"
+
+namespace {
+
+using namespace dwarfs;
+
+constexpr size_t const kNumSamples{1 << 20};
+
+// state.range(0): index into pcm_sample_cpu_variants()
+// state.range(1): bytes per sample
+// state.range(2): bits per sample
+// state.range(3): 0 for little endian, 1 for big endian
+pcm_sample_transformer<int32_t> make_transformer(::benchmark::State& state) {
+  return {state.range(3) ? pcm_sample_endianness::Big
+                         : pcm_sample_endianness::Little,
+          pcm_sample_signedness::Signed, pcm_sample_padding::Lsb,
+          static_cast<int>(state.range(1)), static_cast<int>(state.range(2)),
+          pcm_sample_cpu_variants()[state.range(0)]};
+}
+
+std::vector<uint8_t> make_packed(size_t bytes) {
+  std::independent_bits_engine<std::mt19937_64,
+                               std::numeric_limits<uint8_t>::digits, uint16_t>
+      rng;
+  std::vector<uint8_t> packed(bytes * kNumSamples);
+  std::generate(begin(packed), end(packed), std::ref(rng));
+  return packed;
+}
+
+void set_label(::benchmark::State& state) {
+  std::ostringstream oss;
+  oss << pcm_sample_cpu_variants()[state.range(0)];
+  state.SetLabel(oss.str());
+  state.SetItemsProcessed(state.iterations() * kNumSamples);
+  state.SetBytesProcessed(state.iterations() * kNumSamples * state.range(1));
+}
+
+void pcm_unpack(::benchmark::State& state) {
+  auto xfm = make_transformer(state);
+  auto packed = make_packed(state.range(1));
+  std::vector<int32_t> unpacked(kNumSamples);
+
+  for (auto _ : state) {
+    xfm.unpack(unpacked, packed);
+    ::benchmark::DoNotOptimize(unpacked.data());
+  }
+
+  set_label(state);
+}
+
+void pcm_pack(::benchmark::State& state) {
+  auto xfm = make_transformer(state);
+  auto packed = make_packed(state.range(1));
+  std::vector<int32_t> unpacked(kNumSamples);
+  xfm.unpack(unpacked, packed);
+
+  for (auto _ : state) {
+    xfm.pack(packed, unpacked);
+    ::benchmark::DoNotOptimize(packed.data());
+  }
+
+  set_label(state);
+}
+
+void pcm_args(::benchmark::internal::Benchmark* b) {
+  for (size_t cpu = 0; cpu < pcm_sample_cpu_variants().size(); ++cpu) {
+    for (auto [bytes, bits] : {std::pair{2, 16}, {3, 24}, {3, 20}, {4, 24}}) {
+      for (int big_endian : {0, 1}) {
+        b->Args({static_cast<int64_t>(cpu), bytes, bits, big_endian});
+      }
+    }
+  }
+  b->ArgNames({"cpu", "bytes", "bits", "be"});
+}
+
+} // namespace
+
+BENCHMARK(pcm_unpack)->Apply(pcm_args);
+BENCHMARK(pcm_pack)->Apply(pcm_args);
+
+BENCHMARK_MAIN();
@@ -21,6 +21,8 @@
 
 #include <gtest/gtest.h>
 
+#include <random>
+#include <tuple>
 #include <vector>
 
 #include <folly/lang/Bits.h>
@@ -284,3 +286,63 @@ TEST(pcm_sample_transformer, int24_20bit_be_lsb) {
   EXPECT_EQ(ref, unpacked);
   EXPECT_EQ(packed, repacked);
 }
+
+class pcm_sample_transformer_variants
+    : public testing::TestWithParam<
+          std::tuple<pcm_sample_endianness, pcm_sample_signedness,
+                     pcm_sample_padding, int>> {};
+
+TEST_P(pcm_sample_transformer_variants, match_fallback) {
+  auto [end, sig, pad, bytes] = GetParam();
+  std::mt19937_64 rng(42);
+  std::uniform_int_distribution<int> byte_dist(0, 255);
+
+  for (auto cpu : pcm_sample_cpu_variants()) {
+    for (int bits = 1; bits <= 8 * bytes; ++bits) {
+      pcm_sample_transformer<int32_t> ref(end, sig, pad, bytes, bits,
+                                          pcm_sample_cpu_variant::Fallback);
+      pcm_sample_transformer<int32_t> xfm(end, sig, pad, bytes, bits, cpu);
+
+      for (size_t samples : {0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 33, 1001}) {
+        std::vector<uint8_t> packed(bytes * samples);
+        std::vector<int32_t> ref_unpacked(samples);
+        std::vector<int32_t> unpacked(samples);
+        std::vector<uint8_t> ref_repacked(packed.size());
+        std::vector<uint8_t> repacked(packed.size());
+
+        // random bytes, including garbage in the padding bits
+        for (auto& b : packed) {
+          b = byte_dist(rng);
+        }
+
+        ref.unpack(ref_unpacked, packed);
+        xfm.unpack(unpacked, packed);
+
+        EXPECT_EQ(ref_unpacked, unpacked)
+            << cpu << ", " << bits << " bits, " << samples << " samples";
+
+        ref.pack(ref_repacked, ref_unpacked);
+        xfm.pack(repacked, ref_unpacked);
+
+        EXPECT_EQ(ref_repacked, repacked)
+            << cpu << ", " << bits << " bits, " << samples << " samples";
+      }
+    }
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    dwarfs, pcm_sample_transformer_variants,
+    ::testing::Combine(::testing::Values(pcm_sample_endianness::Big,
+                                         pcm_sample_endianness::Little),
+                       ::testing::Values(pcm_sample_signedness::Signed,
+                                         pcm_sample_signedness::Unsigned),
+                       ::testing::Values(pcm_sample_padding::Lsb,
+                                         pcm_sample_padding::Msb),
+                       ::testing::Values(1, 2, 3, 4)));
+
+TEST(pcm_sample_transformer, cpu_variants) {
+  auto variants = pcm_sample_cpu_variants();
+  ASSERT_FALSE(variants.empty());
+  EXPECT_EQ(pcm_sample_cpu_variant::Fallback, variants.front());
+}
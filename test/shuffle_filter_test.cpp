@@ -0,0 +1,269 @@
+/* vim:set ts=2 sw=2 sts=2 et: */
+/**
+ * \author     Marcus Holland-Moritz (github@mhxnet.de)
+ * \copyright  Copyright (c) Marcus Holland-Moritz
+ *
+ * This file is part of dwarfs.
+ *
+ * dwarfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * dwarfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <fmt/format.h>
+
+#include <folly/json.h>
+
+#include "dwarfs/block_compressor.h"
+#include "dwarfs/shuffle_filter.h"
+
+using namespace dwarfs;
+
+namespace {
+
+std::vector<uint8_t> random_bytes(size_t size, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<int> byte(0, 255);
+  std::vector<uint8_t> data(size);
+  for (auto& b : data) {
+    b = byte(rng);
+  }
+  return data;
+}
+
+std::vector<uint8_t> float_data(size_t count) {
+  std::vector<float> values(count);
+  for (size_t i = 0; i < count; ++i) {
+    values[i] = 1000.0f * std::sin(0.001f * i);
+  }
+  std::vector<uint8_t> data(count * sizeof(float));
+  std::memcpy(data.data(), values.data(), data.size());
+  return data;
+}
+
+// Straightforward implementations of the on-disk layout to check the
+// vectorized kernels against
+std::vector<uint8_t>
+reference_byte_shuffle(std::vector<uint8_t> const& in, size_t n) {
+  auto out = in;
+  auto const count = in.size() / n;
+  for (size_t i = 0; i < count; ++i) {
+    for (size_t j = 0; j < n; ++j) {
+      out[j * count + i] = in[i * n + j];
+    }
+  }
+  return out;
+}
+
+std::vector<uint8_t>
+reference_bit_shuffle(std::vector<uint8_t> const& in, size_t n) {
+  auto out = reference_byte_shuffle(in, n);
+  auto const count = in.size() / n;
+  auto const groups = count / 8;
+  for (size_t j = 0; j < n; ++j) {
+    auto* planes = &out[j * count];
+    std::fill(planes, planes + 8 * groups, 0);
+    for (size_t i = 0; i < 8 * groups; ++i) {
+      auto const byte = in[i * n + j];
+      for (size_t p = 0; p < 8; ++p) {
+        if (byte & (1 << p)) {
+          planes[p * groups + i / 8] |= 1 << (i % 8);
+        }
+      }
+    }
+  }
+  return out;
+}
+
+} // namespace
+
+TEST(shuffle_filter, byte_shuffle) {
+  std::vector<uint8_t> const in{1, 2, 3, 4, 5, 6, 7, 8, 9};
+  std::vector<uint8_t> out(in.size());
+
+  byte_shuffle(in, out, 4);
+  EXPECT_EQ((std::vector<uint8_t>{1, 5, 2, 6, 3, 7, 4, 8, 9}), out);
+
+  byte_shuffle(in, out, 2);
+  EXPECT_EQ((std::vector<uint8_t>{1, 3, 5, 7, 2, 4, 6, 8, 9}), out);
+
+  std::vector<uint8_t> back(in.size());
+  byte_unshuffle(out, back, 2);
+  EXPECT_EQ(in, back);
+}
+
+TEST(shuffle_filter, bit_shuffle) {
+  // eight single-byte elements with only the lowest bit set
+  std::vector<uint8_t> const in(8, 1);
+  std::vector<uint8_t> out(in.size());
+
+  bit_shuffle(in, out, 1);
+  EXPECT_EQ((std::vector<uint8_t>{0xff, 0, 0, 0, 0, 0, 0, 0}), out);
+}
+
+TEST(shuffle_filter, delta) {
+  std::vector<uint8_t> data{1, 0, 3, 0, 6, 0, 10, 0};
+
+  delta_encode(data, 2, std::endian::little);
+  EXPECT_EQ((std::vector<uint8_t>{1, 0, 2, 0, 3, 0, 4, 0}), data);
+
+  delta_decode(data, 2, std::endian::little);
+  EXPECT_EQ((std::vector<uint8_t>{1, 0, 3, 0, 6, 0, 10, 0}), data);
+
+  std::vector<uint8_t> be{0, 1, 0, 3, 0, 6, 0, 10};
+
+  delta_encode(be, 2, std::endian::big);
+  EXPECT_EQ((std::vector<uint8_t>{0, 1, 0, 2, 0, 3, 0, 4}), be);
+
+  EXPECT_FALSE(delta_supported(3));
+  EXPECT_THROW(delta_encode(data, 3, std::endian::little), std::exception);
+}
+
+class shuffle_filter_test : public testing::TestWithParam<size_t> {};
+
+TEST_P(shuffle_filter_test, roundtrip) {
+  auto element_size = GetParam();
+
+  for (size_t size : {0, 1, 7, 8, 63, 64, 65, 1000, 4099, 65536}) {
+    auto const orig = random_bytes(size, size);
+    std::vector<uint8_t> tmp(size);
+    std::vector<uint8_t> back(size);
+
+    byte_shuffle(orig, tmp, element_size);
+    byte_unshuffle(tmp, back, element_size);
+    EXPECT_EQ(orig, back) << element_size << ", " << size;
+
+    bit_shuffle(orig, tmp, element_size);
+    bit_unshuffle(tmp, back, element_size);
+    EXPECT_EQ(orig, back) << element_size << ", " << size;
+
+    if (delta_supported(element_size)) {
+      for (auto e : {std::endian::little, std::endian::big}) {
+        back = orig;
+        delta_encode(back, element_size, e);
+        delta_decode(back, element_size, e);
+        EXPECT_EQ(orig, back) << element_size << ", " << size;
+      }
+    }
+  }
+}
+
+TEST_P(shuffle_filter_test, reference) {
+  auto element_size = GetParam();
+
+  for (size_t size : {15, 16, 100, 512, 1023, 1024, 1025, 20000, 100003}) {
+    auto const orig = random_bytes(size * element_size + 5, size);
+    std::vector<uint8_t> out(orig.size());
+
+    byte_shuffle(orig, out, element_size);
+    EXPECT_EQ(reference_byte_shuffle(orig, element_size), out)
+        << element_size << ", " << size;
+
+    bit_shuffle(orig, out, element_size);
+    EXPECT_EQ(reference_bit_shuffle(orig, element_size), out)
+        << element_size << ", " << size;
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(dwarfs, shuffle_filter_test,
+                         testing::Values(1, 2, 3, 4, 8, 12, 16));
+
+TEST(shuffle_compressor, roundtrip) {
+  auto const data = float_data(16384);
+  std::string const metadata = R"({"element_size": 4, "endianness": "little"})";
+
+  block_compressor plain("zstd:level=3");
+  auto const plain_size = plain.compress(data).size();
+
+  for (auto const& spec :
+       {"shuffle:compression=zstd,level=3", "shuffle:mode=bit",
+        "shuffle:delta:compression=zstd,level=3", "shuffle:mode=none:delta",
+        "shuffle:element_size=4:endianness=little:delta"}) {
+    block_compressor bc(spec);
+
+    EXPECT_EQ(compression_type::SHUFFLE, bc.type());
+
+    auto compressed = bc.compress(data, metadata);
+
+    std::vector<uint8_t> decompressed;
+    block_decompressor bd(compression_type::SHUFFLE, compressed.data(),
+                          compressed.size(), decompressed);
+
+    EXPECT_EQ(data.size(), bd.uncompressed_size());
+
+    auto meta = bd.metadata();
+    ASSERT_TRUE(meta);
+    EXPECT_EQ(4, folly::parseJson(*meta)["element_size"].asInt());
+
+    bd.decompress_frame(bd.uncompressed_size());
+
+    EXPECT_EQ(data, decompressed) << spec;
+
+    if (std::string_view(spec).starts_with("shuffle:compression")) {
+      EXPECT_LT(compressed.size(), plain_size) << spec;
+    }
+  }
+}
+
+TEST(shuffle_compressor, requirements) {
+  {
+    block_compressor bc("shuffle");
+    auto req = folly::parseJson(bc.metadata_requirements());
+    EXPECT_TRUE(req.count("element_size"));
+    EXPECT_FALSE(req.count("endianness"));
+  }
+
+  {
+    block_compressor bc("shuffle:delta");
+    auto req = folly::parseJson(bc.metadata_requirements());
+    EXPECT_TRUE(req.count("element_size"));
+    EXPECT_TRUE(req.count("endianness"));
+  }
+
+  {
+    block_compressor bc("shuffle:element_size=8");
+    EXPECT_TRUE(bc.metadata_requirements().empty());
+
+    auto cc = bc.get_compression_constraints(std::string());
+    ASSERT_TRUE(cc.granularity);
+    EXPECT_EQ(8, cc.granularity.value());
+  }
+
+  {
+    block_compressor bc("shuffle");
+    auto cc = bc.get_compression_constraints(R"({"element_size": 2})");
+    ASSERT_TRUE(cc.granularity);
+    EXPECT_EQ(2, cc.granularity.value());
+  }
+
+  EXPECT_THROW(block_compressor("shuffle:mode=foo"), std::exception);
+  EXPECT_THROW(block_compressor("shuffle:delta:element_size=3"),
+               std::exception);
+  EXPECT_THROW(block_compressor("shuffle:compression=shuffle"),
+               std::exception);
+
+  {
+    block_compressor bc("shuffle");
+    std::vector<uint8_t> data(1024, 0);
+    EXPECT_THROW(bc.compress(data), std::exception);
+  }
+}
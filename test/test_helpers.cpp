@@ -19,6 +19,7 @@
  * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
@@ -548,6 +549,41 @@ void os_access_mock::set_executable_resolver(
   executable_resolver_ = std::move(resolver);
 }
 
+std::vector<std::vector<int>> os_access_mock::numa_node_cpus() const {
+  std::lock_guard<std::mutex> lock{mx_};
+  return numa_node_cpus_;
+}
+
+int os_access_mock::current_numa_node(std::error_code& /*ec*/) const {
+  std::lock_guard<std::mutex> lock{mx_};
+
+  // Threads are considered to run on the node of the first CPU they
+  // were most recently pinned to, or on node 0 if they were never pinned.
+  auto tid = std::this_thread::get_id();
+
+  for (auto it = set_affinity_calls.rbegin(); it != set_affinity_calls.rend();
+       ++it) {
+    auto const& [id, cpus] = *it;
+
+    if (id == tid && !cpus.empty()) {
+      for (size_t node = 0; node < numa_node_cpus_.size(); ++node) {
+        if (std::ranges::find(numa_node_cpus_[node], cpus.front()) !=
+            numa_node_cpus_[node].end()) {
+          return static_cast<int>(node);
+        }
+      }
+      break;
+    }
+  }
+
+  return 0;
+}
+
+void os_access_mock::set_numa_node_cpus(std::vector<std::vector<int>> nodes) {
+  std::lock_guard<std::mutex> lock{mx_};
+  numa_node_cpus_ = std::move(nodes);
+}
+
 std::optional<fs::path> find_binary(std::string_view name) {
   os_access_generic os;
 
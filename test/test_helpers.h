@@ -149,8 +149,14 @@ class os_access_mock : public os_access {
   std::filesystem::path
   find_executable(std::filesystem::path const& name) const override;
 
+  std::vector<std::vector<int>> numa_node_cpus() const override;
+
+  int current_numa_node(std::error_code& ec) const override;
+
   void set_executable_resolver(executable_resolver_type resolver);
 
+  void set_numa_node_cpus(std::vector<std::vector<int>> nodes);
+
   std::set<std::filesystem::path> get_failed_paths() const;
 
   void set_dir_reader_delay(std::chrono::nanoseconds delay) {
@@ -183,6 +189,7 @@ class os_access_mock : public os_access {
   std::chrono::nanoseconds dir_reader_delay_{0};
   std::map<std::filesystem::path, std::chrono::nanoseconds> map_file_delays_;
   size_t map_file_delay_min_size_{0};
+  std::vector<std::vector<int>> numa_node_cpus_;
 };
 
 class script_mock : public script {
@@ -283,6 +290,16 @@ class test_file_access : public file_access {
   std::unique_ptr<output_stream>
   open_output_binary(std::filesystem::path const& path) const override;
 
+  void remove(std::filesystem::path const& path,
+              std::error_code& ec) const override;
+  void remove(std::filesystem::path const& path) const override;
+
+  void rename(std::filesystem::path const& from,
+              std::filesystem::path const& to,
+              std::error_code& ec) const override;
+  void rename(std::filesystem::path const& from,
+              std::filesystem::path const& to) const override;
+
   void set_file(std::filesystem::path const& path, std::string contents) const;
   std::optional<std::string> get_file(std::filesystem::path const& path) const;
 
@@ -170,6 +170,44 @@ test_file_access::open_output_binary(std::filesystem::path const& path) const {
   return rv;
 }
 
+void test_file_access::remove(std::filesystem::path const& path,
+                              std::error_code& ec) const {
+  if (files_.erase(path) == 0) {
+    ec = std::make_error_code(std::errc::no_such_file_or_directory);
+  }
+}
+
+void test_file_access::remove(std::filesystem::path const& path) const {
+  std::error_code ec;
+  remove(path, ec);
+  if (ec) {
+    throw std::system_error(ec, fmt::format("remove('{}')", path.string()));
+  }
+}
+
+void test_file_access::rename(std::filesystem::path const& from,
+                              std::filesystem::path const& to,
+                              std::error_code& ec) const {
+  auto it = files_.find(from);
+  if (it == files_.end()) {
+    ec = std::make_error_code(std::errc::no_such_file_or_directory);
+    return;
+  }
+  auto content = std::move(it->second);
+  files_.erase(it);
+  files_[to] = std::move(content);
+}
+
+void test_file_access::rename(std::filesystem::path const& from,
+                              std::filesystem::path const& to) const {
+  std::error_code ec;
+  rename(from, to, ec);
+  if (ec) {
+    throw std::system_error(ec, fmt::format("rename('{}', '{}')",
+                                            from.string(), to.string()));
+  }
+}
+
 void test_file_access::set_file(std::filesystem::path const& path,
                                 std::string content) const {
   files_[path] = std::move(content);
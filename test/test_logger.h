@@ -21,10 +21,14 @@
 
 #pragma once
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <cstdlib>
 #include <mutex>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include <folly/Conv.h>
@@ -71,11 +75,25 @@ class test_logger : public ::dwarfs::logger {
     }
 
     if (level <= threshold_) {
-      std::lock_guard lock(mx_);
-      log_.emplace_back(level, output, file, line);
+      {
+        std::lock_guard lock(mx_);
+        log_.emplace_back(level, output, file, line);
+      }
+      cond_.notify_all();
     }
   }
 
+  // Wait until a message starting with `prefix` has been logged, e.g. by
+  // a background thread. Returns false on timeout.
+  bool wait_for(std::string_view prefix, std::chrono::milliseconds timeout) {
+    std::unique_lock lock(mx_);
+    return cond_.wait_for(lock, timeout, [&] {
+      return std::any_of(log_.begin(), log_.end(), [&](auto const& e) {
+        return e.output.starts_with(prefix);
+      });
+    });
+  }
+
   std::vector<log_entry> const& get_log() const { return log_; }
 
   bool empty() const { return log_.empty(); }
@@ -93,6 +111,7 @@ class test_logger : public ::dwarfs::logger {
   }
 
   std::mutex mx_;
+  std::condition_variable cond_;
   std::vector<log_entry> log_;
   level_type const threshold_;
   level_type const output_threshold_;
@@ -23,9 +23,12 @@
 #include <array>
 #include <filesystem>
 #include <iostream>
+#include <map>
 #include <random>
 #include <regex>
 #include <set>
+#include <sstream>
+#include <string>
 #include <vector>
 
 #include <gmock/gmock.h>
@@ -1684,6 +1687,69 @@ TEST(mkdwarfs_test, pack_mode_invalid) {
   EXPECT_THAT(t.err(), ::testing::HasSubstr("'--pack-metadata' is invalid"));
 }
 
+TEST(mkdwarfs_test, chunk_index) {
+  std::mt19937_64 rng{42};
+  std::map<std::string, std::string> files{
+      {"/large1", test::create_random_string(200000, rng)},
+      {"/large2", test::create_random_string(150000, rng)},
+      {"/small", test::create_random_string(5000, rng)},
+  };
+
+  for (std::string pack_mode : {"none", "chunk_table"}) {
+    auto t = mkdwarfs_tester::create_empty();
+    t.add_root_dir();
+    for (auto const& [path, data] : files) {
+      t.os->add_file(path.substr(1), data);
+    }
+
+    // With 1 KiB blocks, each large file consists of well over 64 chunks
+    ASSERT_EQ(0, t.run({"-i", "/", "-o", "-", "-l1", "-S", "10",
+                        "--chunk-index=64:16", "--pack-metadata=" + pack_mode,
+                        "--log-level=debug"}))
+        << t.err();
+    EXPECT_THAT(t.err(), ::testing::HasSubstr("chunk offset index: 2 files"));
+
+    auto opts = default_fs_opts;
+    opts.metadata.check_consistency = true;
+    auto fs = t.fs_from_stdout(opts);
+
+    for (auto const& [path, data] : files) {
+      auto iv = fs.find(path.c_str());
+      ASSERT_TRUE(iv) << path;
+      auto fh = fs.open(*iv);
+
+      std::vector<size_t> offsets;
+      for (size_t off = 1024; off < data.size(); off += 1024) {
+        offsets.push_back(off - 1);
+        offsets.push_back(off);
+        offsets.push_back(off + 1);
+      }
+      offsets.push_back(data.size() - 1);
+
+      // Walk backwards first so the offset cache doesn't help
+      for (auto it = offsets.rbegin(); it != offsets.rend(); ++it) {
+        auto size = std::min<size_t>(100, data.size() - *it);
+        std::string buf(size, '\0');
+        ASSERT_EQ(static_cast<ssize_t>(size),
+                  fs.read(fh, buf.data(), size, *it))
+            << path << ":" << *it;
+        EXPECT_EQ(data.substr(*it, size), buf)
+            << pack_mode << ":" << path << ":" << *it;
+      }
+    }
+  }
+}
+
+TEST(mkdwarfs_test, chunk_index_invalid) {
+  for (std::string arg : {"0", "foo", "64:0", "64:16:1", "64:"}) {
+    auto t = mkdwarfs_tester::create_empty();
+    t.add_root_dir();
+    EXPECT_NE(0, t.run({"-i", "/", "-o", "-", "--chunk-index=" + arg}))
+        << arg;
+    EXPECT_THAT(t.err(), ::testing::HasSubstr("invalid chunk index")) << arg;
+  }
+}
+
 TEST(mkdwarfs_test, filesystem_header) {
   auto const header = test::loremipsum(333);
 
@@ -1761,6 +1827,266 @@ TEST(mkdwarfs_test, output_file_fail_close) {
   EXPECT_THAT(t.err(), ::testing::HasSubstr("failed to close output file"));
 }
 
+TEST(mkdwarfs_test, checkpoint_resume) {
+  std::filesystem::path const output{"test.dwarfs"};
+  std::filesystem::path const index{"test.dwarfs.checkpoint"};
+  std::filesystem::path const partial{"test.dwarfs.partial"};
+  std::vector<std::string> args{"-i", "/", "-o", output.string(), "-l3",
+                                "-S16", "--no-history"};
+
+  std::string reference;
+
+  {
+    mkdwarfs_tester t;
+    ASSERT_EQ(0, t.run(args)) << t.err();
+    reference = t.fa->get_file(output).value();
+    EXPECT_FALSE(t.fa->exists(index));
+  }
+
+  {
+    // simulate an interrupted build by failing at the very end
+    mkdwarfs_tester t;
+    t.fa->set_close_error(output,
+                          std::make_error_code(std::errc::no_space_on_device));
+    auto cp_args = args;
+    cp_args.push_back("--checkpoint");
+    EXPECT_NE(0, t.run(cp_args)) << t.err();
+    EXPECT_TRUE(t.fa->exists(index));
+
+    // the output never made it to disk, so use a truncated reference
+    mkdwarfs_tester t2;
+    t2.fa->set_file(index, t.fa->get_file(index).value());
+    t2.fa->set_file(output, reference.substr(0, reference.size() / 2));
+    auto resume_args = args;
+    resume_args.push_back("--resume");
+    resume_args.push_back("--log-level=info");
+    ASSERT_EQ(0, t2.run(resume_args)) << t2.err();
+    EXPECT_THAT(t2.err(), ::testing::HasSubstr("resuming with"));
+    EXPECT_THAT(t2.err(), ::testing::Not(::testing::HasSubstr(
+                              "reused 0 compressed blocks")));
+    EXPECT_EQ(reference, t2.fa->get_file(output).value());
+    EXPECT_FALSE(t2.fa->exists(index));
+    EXPECT_FALSE(t2.fa->exists(partial));
+  }
+}
+
+TEST(mkdwarfs_test, checkpoint_invalid_usage) {
+  {
+    mkdwarfs_tester t;
+    EXPECT_NE(0, t.run({"-i", "/", "-o", "-", "--checkpoint"})) << t.err();
+    EXPECT_THAT(t.err(), ::testing::HasSubstr("writing to stdout"));
+  }
+
+  {
+    mkdwarfs_tester t;
+    t.fa->set_file("input.dwarfs", "bla");
+    EXPECT_NE(0, t.run({"-i", "input.dwarfs", "-o", "output.dwarfs",
+                        "--recompress", "--resume"}))
+        << t.err();
+    EXPECT_THAT(t.err(), ::testing::HasSubstr("--recompress"));
+  }
+}
+
+namespace {
+
+std::map<std::string, std::string> get_fs_contents(filesystem_v2 const& fs) {
+  std::map<std::string, std::string> rv;
+
+  fs.walk([&](auto const& e) {
+    auto iv = e.inode();
+    file_stat st;
+    if (fs.getattr(iv, &st) != 0) {
+      throw std::runtime_error(
+          fmt::format("getattr() failed for {}", e.path()));
+    }
+
+    std::string data;
+
+    if (st.is_regular_file()) {
+      data.resize(st.size);
+      fs.read(iv.inode_num(), data.data(), data.size());
+    } else if (st.is_symlink()) {
+      data = fs.readlink(iv).value();
+    }
+
+    rv.emplace(e.unix_path(),
+               fmt::format("{:o} {} {} {} {} {} {}", st.mode, st.uid, st.gid,
+                           st.mtime, st.nlink, st.rdev, data));
+  });
+
+  return rv;
+}
+
+} // namespace
+
+TEST(mkdwarfs_test, partitioned_build) {
+  static constexpr size_t const num_partitions{3};
+
+  auto make_tester = [] {
+    mkdwarfs_tester t;
+    t.add_random_file_tree({.avg_size = 1024.0, .dimension = 6});
+    return t;
+  };
+
+  std::vector<std::string> const args{"-i", "/", "-o", "image.dwarfs",
+                                      "--with-devices", "--with-specials"};
+  std::map<std::string, std::string> reference;
+
+  {
+    auto t = make_tester();
+    ASSERT_EQ(0, t.run(args)) << t.err();
+    reference = get_fs_contents(t.fs_from_file("image.dwarfs"));
+  }
+
+  auto merge_tester = mkdwarfs_tester::create_empty();
+  merge_tester.add_root_dir();
+  std::vector<std::string> merge_args{"-o", "-", "--merge"};
+  std::ptrdiff_t total_files{0};
+
+  for (size_t i = 1; i <= num_partitions; ++i) {
+    auto t = make_tester();
+    auto part_args = args;
+    part_args.push_back(fmt::format("--partition={}/{}", i, num_partitions));
+    ASSERT_EQ(0, t.run(part_args)) << t.err();
+
+    auto contents = get_fs_contents(t.fs_from_file("image.dwarfs"));
+    total_files += std::count_if(contents.begin(), contents.end(),
+                                 [](auto const& kv) {
+                                   return kv.second.front() != '4'; // dirs
+                                 });
+    EXPECT_LT(contents.size(), reference.size());
+
+    auto name = fmt::format("part{}.dwarfs", i);
+    merge_tester.os->add_file(name, t.fa->get_file("image.dwarfs").value());
+    merge_args.push_back(name);
+  }
+
+  EXPECT_EQ(std::count_if(reference.begin(), reference.end(),
+                          [](auto const& kv) {
+                            return kv.second.front() != '4';
+                          }),
+            total_files);
+
+  ASSERT_EQ(0, merge_tester.run(merge_args)) << merge_tester.err();
+
+  auto fs = merge_tester.fs_from_stdout();
+  EXPECT_EQ(0, fs.check(filesystem_check_level::FULL));
+  EXPECT_EQ(reference, get_fs_contents(fs));
+}
+
+TEST(mkdwarfs_test, merge_conflict) {
+  std::string image;
+
+  {
+    mkdwarfs_tester t;
+    ASSERT_EQ(0, t.run({"-i", "/", "-o", "-"})) << t.err();
+    image = t.out();
+  }
+
+  auto t = mkdwarfs_tester::create_empty();
+  t.add_root_dir();
+  t.os->add_file("a.dwarfs", image);
+  t.os->add_file("b.dwarfs", image);
+  EXPECT_NE(0, t.run({"-o", "-", "--merge", "a.dwarfs", "b.dwarfs"}));
+  EXPECT_THAT(t.err(), ::testing::HasSubstr("exists in both input 1"));
+}
+
+TEST(mkdwarfs_test, merge_with_mount_points) {
+  std::string image;
+  std::map<std::string, std::string> reference;
+  size_t reference_blocks{0};
+
+  {
+    mkdwarfs_tester t;
+    t.add_random_file_tree({.avg_size = 1024.0, .dimension = 5});
+    ASSERT_EQ(0, t.run({"-i", "/", "-o", "-"})) << t.err();
+    image = t.out();
+    auto fs = t.fs_from_stdout();
+    reference = get_fs_contents(fs);
+    reference_blocks = fs.num_blocks();
+  }
+
+  for (bool dedupe : {false, true}) {
+    auto t = mkdwarfs_tester::create_empty();
+    t.add_root_dir();
+    t.os->add_file("a.dwarfs", image);
+    t.os->add_file("b.dwarfs", image);
+
+    std::vector<std::string> args{"-o", "-", "--merge", "a.dwarfs=one",
+                                  "b.dwarfs=/two/three"};
+    if (dedupe) {
+      args.push_back("--merge-dedupe");
+    }
+
+    ASSERT_EQ(0, t.run(args)) << t.err();
+
+    auto fs = t.fs_from_stdout();
+    EXPECT_EQ(0, fs.check(filesystem_check_level::FULL));
+    EXPECT_EQ(dedupe ? reference_blocks : 2 * reference_blocks,
+              fs.num_blocks());
+
+    std::map<std::string, std::string> one, two;
+
+    for (auto const& [path, value] : get_fs_contents(fs)) {
+      if (path.starts_with("/one")) {
+        one.emplace(path.substr(4).empty() ? "/" : path.substr(4), value);
+      } else if (path.starts_with("/two/three")) {
+        two.emplace(path.substr(10).empty() ? "/" : path.substr(10), value);
+      } else {
+        EXPECT_TRUE(path == "/" || path == "/two") << path;
+      }
+    }
+
+    EXPECT_EQ(reference, one);
+    EXPECT_EQ(reference, two);
+  }
+}
+
+TEST(mkdwarfs_test, merge_image_name_with_equals_sign) {
+  std::string image;
+
+  {
+    mkdwarfs_tester t;
+    ASSERT_EQ(0, t.run({"-i", "/", "-o", "-"})) << t.err();
+    image = t.out();
+  }
+
+  auto t = mkdwarfs_tester::create_empty();
+  t.add_root_dir();
+  t.os->add_file("build=1.dwarfs", image);
+
+  ASSERT_EQ(0, t.run({"-o", "-", "--merge", "build=1.dwarfs",
+                      "build=1.dwarfs=/a=b"}))
+      << t.err();
+
+  auto fs = t.fs_from_stdout();
+  EXPECT_TRUE(fs.find("/a=b/foo.pl"));
+  EXPECT_TRUE(fs.find("/foo.pl"));
+  EXPECT_FALSE(fs.find("/1.dwarfs"));
+
+  auto t2 = mkdwarfs_tester::create_empty();
+  t2.add_root_dir();
+  t2.os->add_file("x=y", image);
+  EXPECT_NE(0, t2.run({"-o", "-", "--merge", "x=z"}));
+  EXPECT_THAT(t2.err(), ::testing::HasSubstr("cannot open input filesystem"));
+}
+
+TEST(mkdwarfs_test, merge_dedupe_without_merge) {
+  mkdwarfs_tester t;
+  EXPECT_NE(0, t.run({"-i", "/", "-o", "-", "--merge-dedupe"}));
+  EXPECT_THAT(t.err(),
+              ::testing::HasSubstr("can only be used with --merge"));
+}
+
+TEST(mkdwarfs_test, invalid_partition) {
+  for (auto const& arg : {"--partition=0/3", "--partition=4/3",
+                          "--partition=3", "--partition=a/b"}) {
+    mkdwarfs_tester t;
+    EXPECT_NE(0, t.run({"-i", "/", "-o", "-", arg})) << arg;
+    EXPECT_THAT(t.err(), ::testing::HasSubstr("invalid partition")) << arg;
+  }
+}
+
 TEST(mkdwarfs_test, compression_cannot_be_used_without_category) {
   mkdwarfs_tester t;
   EXPECT_NE(0, t.run({"-i", "/", "-o", "-", "-C", "flac"}));
@@ -1839,6 +2165,60 @@ TEST(dwarfsextract_test, stdout_progress_error) {
                            "cannot use --stdout-progress with --output=-"));
 }
 
+TEST(dwarfsextract_test, compression) {
+  auto t = dwarfsextract_tester::create_with_image();
+  ASSERT_EQ(0, t.run({"-i", "image.dwarfs", "-f", "ustar", "-z", "gzip:9"}))
+      << t.err();
+  auto out = t.out();
+  EXPECT_TRUE(out.starts_with("\x1f\x8b"))
+      << folly::hexlify(out.substr(0, 16));
+}
+
+TEST(dwarfsextract_test, compression_threads) {
+  std::vector<std::pair<std::string, std::string_view>> const filters{
+      {"zstd", "\x28\xb5\x2f\xfd"},
+      {"xz", "\xfd""7zXZ"},
+  };
+
+  for (auto const& [filter, magic] : filters) {
+    auto t = dwarfsextract_tester::create_with_image();
+    ASSERT_EQ(0, t.run({"-i", "image.dwarfs", "-f", "ustar", "-z", filter,
+                        "--compression-threads", "4", "--log-level=debug"}))
+        << filter << ": " << t.err();
+    auto out = t.out();
+    EXPECT_TRUE(out.starts_with(magic))
+        << filter << ": " << folly::hexlify(out.substr(0, 16));
+    EXPECT_THAT(t.err(), ::testing::HasSubstr(
+                             fmt::format("using 4 {} compression threads",
+                                         filter)));
+  }
+}
+
+TEST(dwarfsextract_test, compression_threads_unsupported) {
+  auto t = dwarfsextract_tester::create_with_image();
+  ASSERT_EQ(0, t.run({"-i", "image.dwarfs", "-f", "ustar", "-z", "gzip",
+                      "--compression-threads", "4"}))
+      << t.err();
+  EXPECT_TRUE(t.out().starts_with("\x1f\x8b"));
+  EXPECT_THAT(t.err(),
+              ::testing::HasSubstr(
+                  "'gzip' compression does not support multiple threads"));
+}
+
+TEST(dwarfsextract_test, compression_without_format) {
+  auto t = dwarfsextract_tester::create_with_image();
+  EXPECT_NE(0, t.run({"-i", "image.dwarfs", "-z", "zstd"})) << t.err();
+  EXPECT_THAT(t.err(), ::testing::HasSubstr(
+                           "--compression can only be used with --format"));
+}
+
+TEST(dwarfsextract_test, compression_invalid_level) {
+  auto t = dwarfsextract_tester::create_with_image();
+  EXPECT_NE(0, t.run({"-i", "image.dwarfs", "-f", "ustar", "-z", "zstd:x"}))
+      << t.err();
+  EXPECT_THAT(t.err(), ::testing::HasSubstr("invalid compression level: x"));
+}
+
 TEST(dwarfsck_test, check_exclusive) {
   auto t = dwarfsck_tester::create_with_image();
   EXPECT_NE(0, t.run({"image.dwarfs", "--no-check", "--check-integrity"}))
@@ -2812,3 +3192,30 @@ TEST(mkdwarfs_test, file_scanner_dump) {
 
   EXPECT_NE(*raw, *finalized);
 }
+
+TEST(mkdwarfs_test, stage_events) {
+  auto t = mkdwarfs_tester::create_empty();
+  t.add_root_dir();
+  t.add_random_file_tree({.avg_size = 1024.0, .dimension = 5});
+
+  ASSERT_EQ(0, t.run("-l1 -i / -o - --stage-events=stages.jsonl")) << t.err();
+
+  auto events = t.fa->get_file("stages.jsonl");
+  ASSERT_TRUE(events);
+
+  std::vector<std::string> stages;
+  double last_elapsed{0.0};
+  std::istringstream iss(events.value());
+  std::string line;
+
+  while (std::getline(iss, line)) {
+    auto ev = folly::parseJson(line);
+    stages.push_back(ev["stage"].asString());
+    EXPECT_GE(ev["elapsed_s"].asDouble(), last_elapsed) << line;
+    last_elapsed = ev["elapsed_s"].asDouble();
+  }
+
+  EXPECT_THAT(stages, ::testing::ElementsAre("scan", "finalize", "names",
+                                             "order_segment", "metadata",
+                                             "compress_write"));
+}
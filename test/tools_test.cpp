@@ -629,6 +629,7 @@ class driver_runner {
                     << process_->err() << "exit code: " << ec << "\n";
           rv = false;
         }
+        err_ = process_->err();
       }
       process_.reset();
       mountpoint_.clear();
@@ -646,6 +647,7 @@ class driver_runner {
                     << process_->out() << "err:\n"
                     << process_->err() << "exit code: " << ec << "\n";
         }
+        err_ = process_->err();
         process_.reset();
         mountpoint_.clear();
         return is_expected_exit_code;
@@ -676,6 +678,9 @@ class driver_runner {
     return rv;
   }
 
+  // Output of a driver running in the foreground, once it's unmounted
+  std::string const& err() const { return err_; }
+
   ~driver_runner() {
     if (!mountpoint_.empty()) {
       if (!unmount()) {
@@ -717,6 +722,7 @@ class driver_runner {
 
   fs::path mountpoint_;
   std::unique_ptr<subprocess> process_;
+  std::string err_;
 #if !(defined(_WIN32) || defined(__APPLE__))
   process_guard dwarfs_guard_;
 #endif
@@ -1031,6 +1037,47 @@ TEST_P(tools_test, end_to_end) {
       EXPECT_TRUE(runner.unmount()) << runner.cmdline();
     }
 
+    {
+      // The option must reach libfuse; without kernel or libfuse support,
+      // the driver falls back to the classic transport
+      scoped_no_leak_check no_leak_check;
+      std::vector<std::string> args{"-oio_uring"};
+
+      driver_runner runner(driver_runner::foreground, driver,
+                           mode == binary_mode::universal_tool, image,
+                           mountpoint, args);
+
+      ASSERT_TRUE(wait_until_file_ready(mountpoint / "format.sh", timeout))
+          << runner.cmdline();
+      compare_directories_result cdr;
+      ASSERT_TRUE(compare_directories(fsdata_dir, mountpoint, &cdr))
+          << runner.cmdline() << ": " << cdr;
+      EXPECT_EQ(cdr.regular_files.size(), 26)
+          << runner.cmdline() << ": " << cdr;
+
+      EXPECT_TRUE(runner.unmount()) << runner.cmdline();
+    }
+
+    {
+      // Opening files through FUSE must feed the tree scan detector
+      scoped_no_leak_check no_leak_check;
+      std::vector<std::string> args{"-otree_scan=4", "-odebuglevel=verbose"};
+
+      driver_runner runner(driver_runner::foreground, driver,
+                           mode == binary_mode::universal_tool, image,
+                           mountpoint, args);
+
+      ASSERT_TRUE(wait_until_file_ready(mountpoint / "format.sh", timeout))
+          << runner.cmdline();
+      compare_directories_result cdr;
+      ASSERT_TRUE(compare_directories(fsdata_dir, mountpoint, &cdr))
+          << runner.cmdline() << ": " << cdr;
+
+      EXPECT_TRUE(runner.unmount()) << runner.cmdline();
+      EXPECT_THAT(runner.err(), ::testing::HasSubstr("tree scan detected"))
+          << runner.cmdline();
+    }
+
     {
       auto const [out, err, ec] = subprocess::run(
           driver,
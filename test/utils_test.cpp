@@ -318,6 +318,46 @@ TEST(utils, offset_cache_prefill) {
   EXPECT_EQ(test_chunks.back() - 1, prefill_off);
 }
 
+TEST(utils, offset_cache_disabled_updater) {
+  cache_type cache(4);
+
+  // Start a chunk walk in the middle of the file, as if the position
+  // was found in the metadata's chunk offset index
+  auto ent = cache.find(test_inode, test_chunks.size());
+  auto upd = cache_type::updater();
+  ent->find(total_size - 1, upd);
+  upd.disable();
+
+  cache_type::chunk_index_type chunk_index = 16;
+  cache_type::file_offset_type chunk_offset = std::accumulate(
+      test_chunks.begin(), test_chunks.begin() + chunk_index, 0);
+
+  while (chunk_index + 1 < test_chunks.size()) {
+    chunk_offset += test_chunks[chunk_index];
+    upd.add_offset(++chunk_index, chunk_offset);
+  }
+
+  EXPECT_TRUE(upd.offsets().empty());
+
+  ent->update(upd, chunk_index, chunk_offset, test_chunks.back());
+  cache.set(test_inode, ent);
+
+  // No offsets have been recorded, but the last chunk is known
+  auto [test_ix, test_off, test_lookups] =
+      find_file_position(test_inode, test_chunks, total_size - 1, &cache);
+
+  EXPECT_EQ(test_chunks.size() - 1, test_ix);
+  EXPECT_EQ(test_chunks.back() - 1, test_off);
+  EXPECT_EQ(1, test_lookups);
+
+  auto [mid_ix, mid_off, mid_lookups] =
+      find_file_position(test_inode, test_chunks, 20, &cache);
+
+  EXPECT_EQ(2, mid_ix);
+  EXPECT_EQ(2, mid_off);
+  EXPECT_EQ(3, mid_lookups);
+}
+
 TEST(utils, parse_time_with_unit) {
   using namespace std::chrono_literals;
   EXPECT_EQ(3ms, parse_time_with_unit("3ms"));
@@ -393,3 +433,46 @@ TEST(utils, parse_image_offset) {
               ::testing::ThrowsMessage<dwarfs::runtime_error>(
                   ::testing::HasSubstr("failed to parse image offset")));
 }
+
+TEST(utils, parse_cpu_list) {
+  EXPECT_EQ(std::vector<int>{}, parse_cpu_list(""));
+  EXPECT_EQ(std::vector<int>{}, parse_cpu_list("\n"));
+  EXPECT_EQ(std::vector<int>{0}, parse_cpu_list("0"));
+  EXPECT_EQ((std::vector<int>{0, 1, 2, 3}), parse_cpu_list("0-3\n"));
+  EXPECT_EQ((std::vector<int>{0, 1, 8, 9, 10, 12}),
+            parse_cpu_list("0-1,8-10,12"));
+  EXPECT_THAT([] { parse_cpu_list("3-1"); },
+              ::testing::ThrowsMessage<dwarfs::runtime_error>(
+                  ::testing::HasSubstr("invalid cpu list")));
+  EXPECT_THAT([] { parse_cpu_list("0-1-2"); },
+              ::testing::ThrowsMessage<dwarfs::runtime_error>(
+                  ::testing::HasSubstr("invalid cpu list")));
+  EXPECT_THAT([] { parse_cpu_list("0,x"); },
+              ::testing::ThrowsMessage<dwarfs::runtime_error>(
+                  ::testing::HasSubstr("invalid cpu list")));
+}
+
+TEST(utils, glob_match) {
+  EXPECT_TRUE(glob_match("usr/bin/python3", "usr/bin/python3"));
+  EXPECT_FALSE(glob_match("usr/bin/python3", "usr/bin/python"));
+  EXPECT_TRUE(glob_match("usr/bin/*", "usr/bin/python3"));
+  EXPECT_FALSE(glob_match("usr/bin/*", "usr/bin/x/python3"));
+  EXPECT_TRUE(glob_match("usr/lib/*.so*", "usr/lib/libc.so.6"));
+  EXPECT_FALSE(glob_match("usr/lib/*.so", "usr/lib/libc.so.6"));
+  EXPECT_TRUE(glob_match("etc/**", "etc/ssl/certs/ca.pem"));
+  EXPECT_TRUE(glob_match("**/*.conf", "etc/nginx/nginx.conf"));
+  EXPECT_TRUE(glob_match("**/*.conf", "top.conf"));
+  EXPECT_TRUE(glob_match("etc/**/x", "etc/x"));
+  EXPECT_TRUE(glob_match("etc/**/x", "etc/a/b/x"));
+  EXPECT_FALSE(glob_match("etc/**/x", "etc/a/b/y"));
+  EXPECT_TRUE(glob_match("lib?", "lib6"));
+  EXPECT_FALSE(glob_match("lib?", "lib/"));
+  EXPECT_TRUE(glob_match("file[0-9]", "file7"));
+  EXPECT_FALSE(glob_match("file[!0-9]", "file7"));
+  EXPECT_TRUE(glob_match("file[!0-9]", "filex"));
+  EXPECT_TRUE(glob_match("file[", "file["));
+  EXPECT_TRUE(glob_match("a\\*b", "a*b"));
+  EXPECT_FALSE(glob_match("a\\*b", "axb"));
+  EXPECT_TRUE(glob_match("*", ""));
+  EXPECT_FALSE(glob_match("?", ""));
+}
@@ -19,6 +19,9 @@
  * along with dwarfs.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <chrono>
+#include <future>
+
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
@@ -49,3 +52,90 @@ TEST(worker_group_test, set_thread_affinity_env) {
   worker_group wg_apple(lgr, os, "apple", 1);
   EXPECT_EQ(0, os.set_affinity_calls.size());
 }
+
+TEST(worker_group_test, idle_workers) {
+  test::test_logger lgr;
+  test::os_access_mock os;
+
+  worker_group wg(lgr, os, "idle", 3);
+  EXPECT_EQ(3, wg.idle_workers());
+
+  std::promise<void> release;
+  auto released = release.get_future().share();
+
+  for (int i = 0; i < 2; ++i) {
+    wg.add_job([released] { released.wait(); });
+  }
+
+  EXPECT_EQ(1, wg.idle_workers());
+
+  for (int i = 0; i < 2; ++i) {
+    wg.add_job([released] { released.wait(); });
+  }
+
+  EXPECT_EQ(0, wg.idle_workers());
+
+  release.set_value();
+  wg.wait();
+
+  EXPECT_EQ(3, wg.idle_workers());
+}
+
+TEST(worker_group_test, reserve_idle_workers) {
+  test::test_logger lgr;
+  test::os_access_mock os;
+
+  worker_group wg(lgr, os, "reserve", 4);
+
+  std::promise<void> release;
+  auto released = release.get_future().share();
+
+  wg.add_job([released] { released.wait(); });
+
+  EXPECT_EQ(3, wg.idle_workers());
+  EXPECT_EQ(2, wg.reserve_idle_workers(2));
+  EXPECT_EQ(1, wg.idle_workers());
+
+  // concurrent callers must not get the same workers
+  EXPECT_EQ(1, wg.reserve_idle_workers(4));
+  EXPECT_EQ(0, wg.reserve_idle_workers(4));
+  EXPECT_EQ(0, wg.idle_workers());
+
+  wg.release_idle_workers(2);
+  EXPECT_EQ(2, wg.idle_workers());
+  wg.release_idle_workers(1);
+
+  release.set_value();
+  wg.wait();
+
+  EXPECT_EQ(4, wg.idle_workers());
+}
+
+TEST(worker_group_test, reserved_workers_start_no_jobs) {
+  test::test_logger lgr;
+  test::os_access_mock os;
+
+  worker_group wg(lgr, os, "held", 2);
+
+  EXPECT_EQ(1, wg.reserve_idle_workers(1));
+
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  std::promise<void> started;
+  auto second = started.get_future();
+
+  wg.add_job([released] { released.wait(); });
+  wg.add_job([&started] { started.set_value(); });
+
+  // the only unreserved worker is busy with the first job
+  EXPECT_EQ(std::future_status::timeout,
+            second.wait_for(std::chrono::milliseconds(50)));
+
+  wg.release_idle_workers(1);
+
+  // now the second job runs while the first is still blocked
+  second.wait();
+
+  release.set_value();
+  wg.wait();
+}
@@ -46,3 +46,16 @@ struct ricepp_block_header {
    5: bool big_endian
    6: UInt16 ricepp_version
 }
+
+struct bcj_block_header {
+   1: UInt8 architecture
+   2: UInt16 compression
+}
+
+struct shuffle_block_header {
+   1: UInt8 element_size
+   2: UInt8 shuffle
+   3: bool delta
+   4: bool big_endian
+   5: UInt16 compression
+}
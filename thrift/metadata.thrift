@@ -149,6 +149,38 @@ struct fs_options {
    5: bool   packed_shared_files_table
 }
 
+/**
+ * Sampled chunk offsets for files with many chunks
+ *
+ * Finding the chunk that contains a given file offset otherwise
+ * requires summing up the sizes of all preceding chunks. For each
+ * indexed file, this stores the file offset of every `interval`-th
+ * chunk, so the chunk can be located by binary search.
+ *
+ * The samples of the file whose first chunk is `chunk_begin[i]` are
+ *
+ *    offsets[sample_begin[i]]
+ *    ..
+ *    offsets[sample_begin[i + 1] - 1]
+ *
+ * where `offsets[sample_begin[i] + k]` is the file offset of the
+ * chunk with index `(k + 1) * interval` relative to `chunk_begin[i]`.
+ */
+struct chunk_offset_index {
+   // distance between sampled chunks
+   1: UInt32              interval
+
+   // index of the first chunk of each indexed file, sorted
+   2: list<UInt32>        chunk_begin
+
+   // index of the first sample of each indexed file, plus a
+   // final entry with the total number of samples
+   3: list<UInt32>        sample_begin
+
+   // file offsets of the sampled chunks
+   4: list<UInt64>        offsets
+}
+
 /**
  * An (optionally packed) string table
  */
@@ -388,4 +420,12 @@ struct metadata {
   // index into this vector is the block number and the value
   // is an index into `category_names`.
   29: optional list<UInt32>     block_categories
+
+  //==========================================================//
+  // fields added with dwarfs-0.10.0, file system version 2.5 //
+  //==========================================================//
+
+  // Sampled chunk offsets of files with many chunks, for fast
+  // random access into large, fragmented files.
+  30: optional chunk_offset_index chunk_offset_index
 }